@@ -448,6 +448,8 @@ void blk_cleanup_queue(struct request_queue *q)
 	 */
 	if (q->elevator)
 		blk_drain_queue(q, true);
+	if (q->mq_ops)
+		blk_mq_drain_queue(q);
 
 	/* @q won't process any more request, flush async actions */
 	del_timer_sync(&q->backing_dev_info.laptop_mode_wb_timer);
@@ -611,6 +613,9 @@ blk_init_allocated_queue(struct request_queue *q, request_fn_proc *rfn,
 	if (blk_init_free_list(q))
 		return NULL;
 
+	if (blk_wbt_init(q))
+		return NULL;
+
 	q->request_fn		= rfn;
 	q->prep_rq_fn		= NULL;
 	q->unprep_rq_fn		= NULL;
@@ -1184,6 +1189,7 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 	if (unlikely(--req->ref_count))
 		return;
 
+	blk_wbt_done(q, req);
 	elv_completed_request(q, req);
 
 	/* this is a bio leak */
@@ -1375,6 +1381,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
 	unsigned int request_count = 0;
+	bool wb_acct;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1425,12 +1432,23 @@ get_rq:
 	if (sync)
 		rw_flags |= REQ_SYNC;
 
+	/*
+	 * Buffered writes may have to wait for writeback throttling before
+	 * they get a request. This might drop the queue lock and sleep.
+	 */
+	wb_acct = blk_wbt_wait(q, bio);
+
 	/*
 	 * Grab a free request. This is might sleep but can not fail.
 	 * Returns with the queue unlocked.
 	 */
 	req = get_request_wait(q, rw_flags, bio);
 	if (unlikely(!req)) {
+		if (wb_acct) {
+			spin_lock_irq(q->queue_lock);
+			blk_wbt_abort(q);
+			spin_unlock_irq(q->queue_lock);
+		}
 		bio_endio(bio, -ENODEV);	/* @q is dead */
 		goto out_unlock;
 	}
@@ -1442,6 +1460,8 @@ get_rq:
 	 * often, and the elevators are able to handle it.
 	 */
 	init_request_from_bio(req, bio);
+	if (wb_acct)
+		req->cmd_flags |= REQ_WBT;
 
 	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags))
 		req->cpu = raw_smp_processor_id();
@@ -2078,6 +2098,8 @@ void blk_dequeue_request(struct request *rq)
 		q->in_flight[rq_is_sync(rq)]++;
 		set_io_start_time_ns(rq);
 	}
+
+	blk_wbt_issue(q, rq);
 }
 
 /**
@@ -2803,6 +2825,8 @@ void blk_start_plug(struct blk_plug *plug)
 	plug->magic = PLUG_MAGIC;
 	INIT_LIST_HEAD(&plug->list);
 	INIT_LIST_HEAD(&plug->cb_list);
+	bio_list_init(&plug->mq_list);
+	plug->mq_count = 0;
 	plug->should_sort = 0;
 
 	/*
@@ -2891,6 +2915,7 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	BUG_ON(plug->magic != PLUG_MAGIC);
 
 	flush_plug_callbacks(plug);
+	blk_mq_flush_plug_list(plug, from_schedule);
 	if (list_empty(&plug->list))
 		return;
 
@@ -0,0 +1,215 @@
+/*
+ * Block device IOPS benchmark
+ *
+ * Runs 1..N submitter threads, each bound to its own cpu, issuing small
+ * random reads and writes to a block device and reports the IOPS reached
+ * at each thread count. Used to check that multi-queue devices such as
+ * brd and zram scale with the number of submitting cpus.
+ *
+ *   modprobe blk-mq-bench dev=/dev/ram0 run_time=5 rw_mix=70
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/fs.h>
+#include <linux/random.h>
+#include <linux/completion.h>
+#include <linux/jiffies.h>
+#include <linux/slab.h>
+#include <linux/gfp.h>
+
+static char *dev = "/dev/ram0";
+module_param(dev, charp, 0444);
+MODULE_PARM_DESC(dev, "block device to benchmark");
+
+static unsigned int run_time = 5;
+module_param(run_time, uint, 0444);
+MODULE_PARM_DESC(run_time, "seconds per thread count");
+
+static unsigned int depth = 16;
+module_param(depth, uint, 0444);
+MODULE_PARM_DESC(depth, "bios in flight per thread, submitted under one plug");
+
+static unsigned int rw_mix = 100;
+module_param(rw_mix, uint, 0444);
+MODULE_PARM_DESC(rw_mix, "percentage of reads");
+
+static unsigned int max_threads;
+module_param(max_threads, uint, 0444);
+MODULE_PARM_DESC(max_threads, "highest thread count (default online cpus)");
+
+struct bench_thread {
+	struct block_device	*bdev;
+	u32			nr_blocks;	/* clamped, for a 32-bit modulo */
+	struct page		**pages;
+	atomic_t		inflight;
+	struct completion	done;
+	unsigned long		ios;
+	atomic_t		errors;
+	struct completion	exited;
+};
+
+static void bench_end_io(struct bio *bio, int err)
+{
+	struct bench_thread *bt = bio->bi_private;
+
+	if (err)
+		atomic_inc(&bt->errors);
+	bio_put(bio);
+	if (atomic_dec_and_test(&bt->inflight))
+		complete(&bt->done);
+}
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	unsigned long end = jiffies + run_time * HZ;
+	struct blk_plug plug;
+	unsigned int i;
+
+	while (time_before(jiffies, end)) {
+		INIT_COMPLETION(bt->done);
+		atomic_set(&bt->inflight, 1);
+
+		blk_start_plug(&plug);
+		for (i = 0; i < depth; i++) {
+			struct bio *bio = bio_alloc(GFP_KERNEL, 1);
+			int rw = (random32() % 100) < rw_mix ? READ : WRITE;
+
+			bio->bi_bdev = bt->bdev;
+			bio->bi_sector = (sector_t)(random32() % bt->nr_blocks)
+					 << (PAGE_SHIFT - 9);
+			bio->bi_end_io = bench_end_io;
+			bio->bi_private = bt;
+			bio_add_page(bio, bt->pages[i], PAGE_SIZE, 0);
+
+			atomic_inc(&bt->inflight);
+			submit_bio(rw, bio);
+		}
+		blk_finish_plug(&plug);
+
+		if (!atomic_dec_and_test(&bt->inflight))
+			wait_for_completion(&bt->done);
+		bt->ios += depth;
+		cond_resched();
+	}
+
+	complete(&bt->exited);
+	return 0;
+}
+
+static unsigned long bench_run(struct block_device *bdev,
+			       struct bench_thread *threads, unsigned int nr)
+{
+	struct task_struct *tsk;
+	unsigned long ios = 0, errors = 0;
+	unsigned int i, cpu = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct bench_thread *bt = &threads[i];
+
+		bt->ios = 0;
+		atomic_set(&bt->errors, 0);
+		init_completion(&bt->done);
+		init_completion(&bt->exited);
+
+		cpu = i ? cpumask_next(cpu, cpu_online_mask) :
+			  cpumask_first(cpu_online_mask);
+		tsk = kthread_create(bench_thread_fn, bt, "blk-mq-bench/%u",
+				     cpu);
+		if (IS_ERR(tsk)) {
+			complete(&bt->exited);
+			continue;
+		}
+		kthread_bind(tsk, cpu);
+		wake_up_process(tsk);
+	}
+
+	for (i = 0; i < nr; i++) {
+		wait_for_completion(&threads[i].exited);
+		ios += threads[i].ios;
+		errors += atomic_read(&threads[i].errors);
+	}
+
+	if (errors)
+		pr_warn("blk-mq-bench: %lu I/O errors\n", errors);
+
+	return ios / run_time;
+}
+
+static int __init blk_mq_bench_init(void)
+{
+	struct bench_thread *threads;
+	struct block_device *bdev;
+	sector_t nr_blocks;
+	unsigned int nr, i, j;
+	int ret = -ENOMEM;
+
+	if (!run_time || !depth || rw_mix > 100)
+		return -EINVAL;
+
+	bdev = blkdev_get_by_path(dev, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				  blk_mq_bench_init);
+	if (IS_ERR(bdev))
+		return PTR_ERR(bdev);
+
+	nr_blocks = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (!nr_blocks) {
+		ret = -ENOSPC;
+		goto out_put;
+	}
+
+	if (!max_threads || max_threads > num_online_cpus())
+		max_threads = num_online_cpus();
+
+	threads = kcalloc(max_threads, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		goto out_put;
+
+	for (i = 0; i < max_threads; i++) {
+		threads[i].bdev = bdev;
+		threads[i].nr_blocks = min_t(sector_t, nr_blocks, UINT_MAX);
+		threads[i].pages = kcalloc(depth, sizeof(struct page *),
+					   GFP_KERNEL);
+		if (!threads[i].pages)
+			goto out_free;
+		for (j = 0; j < depth; j++) {
+			threads[i].pages[j] = alloc_page(GFP_KERNEL);
+			if (!threads[i].pages[j])
+				goto out_free;
+		}
+	}
+
+	pr_info("blk-mq-bench: %s, %u%% reads, depth %u, %us per run\n",
+		dev, rw_mix, depth, run_time);
+	for (nr = 1; nr <= max_threads; nr++)
+		pr_info("blk-mq-bench: %2u threads: %8lu IOPS\n", nr,
+			bench_run(bdev, threads, nr));
+	ret = 0;
+
+out_free:
+	for (i = 0; i < max_threads; i++) {
+		if (!threads[i].pages)
+			continue;
+		for (j = 0; j < depth; j++)
+			if (threads[i].pages[j])
+				__free_page(threads[i].pages[j]);
+		kfree(threads[i].pages);
+	}
+	kfree(threads);
+out_put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	return ret;
+}
+
+static void __exit blk_mq_bench_exit(void)
+{
+}
+
+module_init(blk_mq_bench_init);
+module_exit(blk_mq_bench_exit);
+
+MODULE_DESCRIPTION("Block device IOPS benchmark");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,346 @@
+/*
+ * Multi-queue submission for bio based drivers.
+ *
+ * Drivers that opt in with blk_mq_init_queue() never see q->queue_lock on
+ * the submission path. Bios are staged in the submitting task's plug, then
+ * pushed to a per-cpu software queue and dispatched in batches to the
+ * hardware context that cpu maps to. Each hardware context is run by at
+ * most one cpu at a time, so the driver sees serialized batches per
+ * context and may keep per-context state (e.g. scratch buffers) without
+ * further locking.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+#include <linux/hardirq.h>
+
+#include "blk.h"
+
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return find_first_bit(hctx->ctx_map, hctx->nr_ctx) < hctx->nr_ctx;
+}
+
+/*
+ * Pull everything staged on the software queues of @hctx into @list.
+ */
+static void blk_mq_flush_busy_ctxs(struct blk_mq_hw_ctx *hctx,
+				   struct bio_list *list)
+{
+	struct blk_mq_ctx *ctx;
+	unsigned long flags;
+	unsigned int i;
+
+	for_each_set_bit(i, hctx->ctx_map, hctx->nr_ctx) {
+		if (!test_and_clear_bit(i, hctx->ctx_map))
+			continue;
+
+		ctx = hctx->ctxs[i];
+		spin_lock_irqsave(&ctx->lock, flags);
+		ctx->dispatched += bio_list_size(&ctx->list);
+		bio_list_merge(list, &ctx->list);
+		bio_list_init(&ctx->list);
+		spin_unlock_irqrestore(&ctx->lock, flags);
+	}
+}
+
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct bio_list list;
+	unsigned int batch;
+
+	/*
+	 * If someone else is running this context, they will recheck the
+	 * software queues after dropping BLK_MQ_S_RUNNING and pick up
+	 * whatever we staged.
+	 */
+	while (!test_and_set_bit_lock(BLK_MQ_S_RUNNING, &hctx->state)) {
+		for (;;) {
+			bio_list_init(&list);
+			blk_mq_flush_busy_ctxs(hctx, &list);
+			if (bio_list_empty(&list))
+				break;
+
+			batch = bio_list_size(&list);
+			hctx->runs++;
+			hctx->dispatched += batch;
+			if (batch > hctx->max_batch)
+				hctx->max_batch = batch;
+
+			q->mq_ops->queue_bios(hctx, &list);
+		}
+
+		clear_bit_unlock(BLK_MQ_S_RUNNING, &hctx->state);
+		smp_mb__after_clear_bit();
+
+		if (!blk_mq_hctx_has_pending(hctx))
+			break;
+	}
+}
+
+static void blk_mq_run_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (async || in_interrupt() || irqs_disabled())
+		kblockd_schedule_work(hctx->queue, &hctx->run_work);
+	else
+		__blk_mq_run_hw_queue(hctx);
+}
+
+/**
+ * blk_mq_run_queues - dispatch everything staged on a multi-queue device
+ * @q:		the request queue
+ * @async:	punt the dispatch to kblockd
+ */
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (blk_mq_hctx_has_pending(hctx))
+			blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/*
+ * Stage @list on the software queue of the local cpu and kick the
+ * hardware context it maps to.
+ */
+static void blk_mq_insert_bios(struct request_queue *q, struct bio_list *list,
+			       unsigned int nr, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned long flags;
+
+	ctx = per_cpu_ptr(q->queue_ctx, get_cpu());
+	hctx = ctx->hctx;
+
+	spin_lock_irqsave(&ctx->lock, flags);
+	bio_list_merge(&ctx->list, list);
+	ctx->queued += nr;
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
+	set_bit(ctx->index_hw, hctx->ctx_map);
+	put_cpu();
+
+	blk_mq_run_hw_queue(hctx, async);
+}
+
+/*
+ * Push the bios staged in @plug. Consecutive bios for the same queue are
+ * inserted in one go.
+ */
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+{
+	struct request_queue *q, *this_q = NULL;
+	struct bio_list list, batch;
+	unsigned int depth = 0;
+	struct bio *bio;
+
+	if (bio_list_empty(&plug->mq_list))
+		return;
+
+	list = plug->mq_list;
+	bio_list_init(&plug->mq_list);
+	plug->mq_count = 0;
+
+	bio_list_init(&batch);
+	while ((bio = bio_list_pop(&list))) {
+		q = bdev_get_queue(bio->bi_bdev);
+		if (q != this_q) {
+			if (this_q)
+				blk_mq_insert_bios(this_q, &batch, depth,
+						   from_schedule);
+			bio_list_init(&batch);
+			this_q = q;
+			depth = 0;
+		}
+		bio_list_add(&batch, bio);
+		depth++;
+	}
+
+	if (this_q)
+		blk_mq_insert_bios(this_q, &batch, depth, from_schedule);
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct blk_plug *plug = current->plug;
+	struct bio_list list;
+
+	/*
+	 * Flushes and FUA writes have ordering requirements against what
+	 * is already staged, so push everything out with them.
+	 */
+	if (bio->bi_rw & (REQ_FLUSH | REQ_FUA)) {
+		if (plug)
+			blk_mq_flush_plug_list(plug, false);
+		plug = NULL;
+	}
+
+	if (plug) {
+		bio_list_add(&plug->mq_list, bio);
+		if (++plug->mq_count >= BLK_MQ_MAX_PLUGGED)
+			blk_mq_flush_plug_list(plug, false);
+		return;
+	}
+
+	bio_list_init(&list);
+	bio_list_add(&list, bio);
+	blk_mq_insert_bios(q, &list, 1, false);
+}
+
+/**
+ * blk_mq_init_queue - switch a bio based queue to multi-queue submission
+ * @q:			queue set up with blk_alloc_queue()
+ * @ops:		dispatch operations of the driver
+ * @nr_hw_queues:	number of hardware contexts, 0 for one per cpu
+ *
+ * Description:
+ *    Called in place of blk_queue_make_request(), so before any queue
+ *    limits are set up. Bios submitted to @q are handed
+ *    to @ops->queue_bios in batches, from the submitting task or from
+ *    kblockd. Software queues are mapped to hardware contexts round robin
+ *    by cpu number.
+ */
+int blk_mq_init_queue(struct request_queue *q, struct blk_mq_ops *ops,
+		      unsigned int nr_hw_queues)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int i, cpu;
+
+	if (!nr_hw_queues || nr_hw_queues > nr_cpu_ids)
+		nr_hw_queues = nr_cpu_ids;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!q->queue_ctx)
+		return -ENOMEM;
+
+	q->queue_hw_ctx = kcalloc(nr_hw_queues, sizeof(*q->queue_hw_ctx),
+				  GFP_KERNEL);
+	if (!q->queue_hw_ctx)
+		goto err;
+
+	q->nr_hw_queues = nr_hw_queues;
+	for (i = 0; i < nr_hw_queues; i++) {
+		unsigned int nr_ctx = DIV_ROUND_UP(nr_cpu_ids - i,
+						   nr_hw_queues);
+
+		hctx = kmalloc_node(sizeof(*hctx), GFP_KERNEL | __GFP_ZERO,
+				    q->node);
+		if (!hctx)
+			goto err;
+		q->queue_hw_ctx[i] = hctx;
+
+		hctx->ctxs = kcalloc(nr_ctx, sizeof(*hctx->ctxs), GFP_KERNEL);
+		hctx->ctx_map = kcalloc(BITS_TO_LONGS(nr_ctx),
+					sizeof(unsigned long), GFP_KERNEL);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			goto err;
+
+		hctx->queue = q;
+		hctx->queue_num = i;
+		INIT_WORK(&hctx->run_work, blk_mq_run_work_fn);
+	}
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(q->queue_ctx, cpu);
+		spin_lock_init(&ctx->lock);
+		bio_list_init(&ctx->list);
+		ctx->cpu = cpu;
+
+		hctx = q->queue_hw_ctx[cpu % nr_hw_queues];
+		ctx->hctx = hctx;
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+
+	q->mq_ops = ops;
+	blk_queue_make_request(q, blk_mq_make_request);
+	return 0;
+
+err:
+	blk_mq_free_queue(q);
+	return -ENOMEM;
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called from blk_cleanup_queue(), once no new bios can arrive.
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cancel_work_sync(&hctx->run_work);
+		__blk_mq_run_hw_queue(hctx);
+	}
+}
+
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	if (q->queue_hw_ctx) {
+		for (i = 0; i < q->nr_hw_queues; i++) {
+			hctx = q->queue_hw_ctx[i];
+			if (!hctx)
+				continue;
+			kfree(hctx->ctx_map);
+			kfree(hctx->ctxs);
+			kfree(hctx);
+		}
+		kfree(q->queue_hw_ctx);
+	}
+
+	free_percpu(q->queue_ctx);
+	q->queue_hw_ctx = NULL;
+	q->queue_ctx = NULL;
+	q->nr_hw_queues = 0;
+	q->mq_ops = NULL;
+}
+
+ssize_t blk_mq_stats_show(struct request_queue *q, char *page)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int i, j;
+	ssize_t ret = 0;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		ret += scnprintf(page + ret, PAGE_SIZE - ret,
+				"hctx%u: runs %lu dispatched %lu max_batch %lu\n",
+				i, hctx->runs, hctx->dispatched,
+				hctx->max_batch);
+
+		for (j = 0; j < hctx->nr_ctx; j++) {
+			ctx = hctx->ctxs[j];
+			ret += scnprintf(page + ret, PAGE_SIZE - ret,
+					"  cpu%u: queued %lu dispatched %lu\n",
+					ctx->cpu, ctx->queued,
+					ctx->dispatched);
+		}
+	}
+
+	return ret;
+}
@@ -161,6 +161,13 @@ static ssize_t queue_discard_zeroes_data_show(struct request_queue *q, char *pag
 	return queue_var_show(queue_discard_zeroes_data(q), page);
 }
 
+static ssize_t queue_mq_stats_show(struct request_queue *q, char *page)
+{
+	if (!q->mq_ops)
+		return sprintf(page, "none\n");
+	return blk_mq_stats_show(q, page);
+}
+
 static ssize_t
 queue_max_sectors_store(struct request_queue *q, const char *page, size_t count)
 {
@@ -387,6 +394,24 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_mq_stats_entry = {
+	.attr = {.name = "mq_stats", .mode = S_IRUGO },
+	.show = queue_mq_stats_show,
+};
+
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wbt_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_wbt_lat_show,
+	.store = blk_wbt_lat_store,
+};
+
+static struct queue_sysfs_entry queue_wbt_state_entry = {
+	.attr = {.name = "wbt_state", .mode = S_IRUGO },
+	.show = blk_wbt_state_show,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -409,6 +434,11 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_mq_stats_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wbt_lat_entry.attr,
+	&queue_wbt_state_entry.attr,
+#endif
 	NULL,
 };
 
@@ -495,8 +525,12 @@ static void blk_release_queue(struct kobject *kobj)
 		__blk_queue_free_tags(q);
 
 	blk_throtl_release(q);
+	blk_wbt_exit(q);
 	blk_trace_shutdown(q);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	bdi_destroy(&q->backing_dev_info);
 
 	ida_simple_remove(&blk_queue_ida, q->id);
@@ -547,6 +581,8 @@ int blk_register_queue(struct gendisk *disk)
 		return ret;
 	}
 
+	blk_wbt_enable_default(q);
+
 	return 0;
 }
 
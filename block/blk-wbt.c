@@ -0,0 +1,373 @@
+/*
+ * Writeback throttling
+ *
+ * Buffered writeback submits large writes as fast as the queue accepts
+ * them, and reads issued by interactive tasks then wait behind a full
+ * device queue. Limit the number of buffered write requests a queue has
+ * in flight, and scale that limit down while reads completing in a
+ * monitoring window take longer than a latency target. When reads meet
+ * the target again, or stop, the limit is scaled back up.
+ *
+ * Periodic and background writeback get a quarter of the current depth,
+ * other buffered writes half of it, and kswapd or writers that are stuck
+ * in balance_dirty_pages() all of it. Sync writes are never throttled.
+ *
+ * All state is protected by the queue lock.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/backing-dev.h>
+#include <linux/swap.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+
+#include "blk.h"
+
+/* Write requests in flight at scale step 0 */
+#define RWB_DEF_DEPTH		16
+
+/* Monitoring window */
+#define RWB_WINDOW_MSECS	100
+
+/* Default read latency targets */
+#define RWB_NONROT_LAT_USEC	2000
+#define RWB_ROT_LAT_USEC	75000
+
+struct rq_wb {
+	struct request_queue	*queue;
+
+	u64			min_lat_nsec;	/* read latency target, 0 = off */
+	unsigned int		max_depth;
+	int			scale_step;
+
+	unsigned int		wb_max;
+	unsigned int		wb_normal;
+	unsigned int		wb_background;
+
+	unsigned int		inflight;
+	wait_queue_head_t	wait;
+
+	struct timer_list	window_timer;
+	u64			read_min_lat;	/* current window */
+	unsigned int		read_samples;
+	unsigned int		write_samples;
+	u64			last_read_min_lat; /* last window with reads */
+
+	unsigned long		throttled;
+	unsigned long		scale_downs;
+	unsigned long		scale_ups;
+};
+
+static bool rwb_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->min_lat_nsec;
+}
+
+static void rwb_calc_limits(struct rq_wb *rwb)
+{
+	unsigned int depth = max(1U, rwb->max_depth >> rwb->scale_step);
+
+	rwb->wb_max = depth;
+	rwb->wb_normal = (depth + 1) / 2;
+	rwb->wb_background = (depth + 3) / 4;
+}
+
+static void rwb_arm_window(struct rq_wb *rwb)
+{
+	if (!timer_pending(&rwb->window_timer))
+		mod_timer(&rwb->window_timer,
+			  jiffies + msecs_to_jiffies(RWB_WINDOW_MSECS));
+}
+
+static void rwb_scale_up(struct rq_wb *rwb)
+{
+	if (!rwb->scale_step)
+		return;
+
+	rwb->scale_step--;
+	rwb->scale_ups++;
+	rwb_calc_limits(rwb);
+	wake_up_all(&rwb->wait);
+}
+
+static void rwb_scale_down(struct rq_wb *rwb)
+{
+	if (rwb->wb_max == 1)
+		return;
+
+	rwb->scale_step++;
+	rwb->scale_downs++;
+	rwb_calc_limits(rwb);
+}
+
+static void rwb_window_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *)data;
+	struct request_queue *q = rwb->queue;
+	unsigned long flags;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	if (rwb->read_samples) {
+		rwb->last_read_min_lat = rwb->read_min_lat;
+
+		/*
+		 * Even the fastest read of the window missed the target.
+		 * Only writes we limit can be helped, so leave the depth
+		 * alone if there weren't any.
+		 */
+		if (rwb->read_min_lat > rwb->min_lat_nsec) {
+			if (rwb->inflight || rwb->write_samples)
+				rwb_scale_down(rwb);
+		} else
+			rwb_scale_up(rwb);
+	} else
+		rwb_scale_up(rwb);
+
+	rwb->read_samples = 0;
+	rwb->write_samples = 0;
+
+	if (rwb_enabled(rwb) && (rwb->inflight || rwb->scale_step))
+		rwb_arm_window(rwb);
+
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static bool rwb_should_throttle(struct bio *bio)
+{
+	if (bio_data_dir(bio) != WRITE)
+		return false;
+
+	return !(bio->bi_rw & (REQ_SYNC | REQ_FLUSH | REQ_FUA | REQ_DISCARD));
+}
+
+static unsigned int rwb_limit(struct rq_wb *rwb)
+{
+	struct backing_dev_info *bdi = &rwb->queue->backing_dev_info;
+
+	/*
+	 * Don't slow down reclaim, or writeback that dirtiers are
+	 * waiting on in balance_dirty_pages().
+	 */
+	if (current_is_kswapd() ||
+	    (bdi->dirty_sleep && time_before(jiffies, bdi->dirty_sleep + HZ)))
+		return rwb->wb_max;
+
+	if (current->flags & PF_BG_WRITEBACK)
+		return rwb->wb_background;
+
+	return rwb->wb_normal;
+}
+
+/**
+ * blk_wbt_wait - throttle a buffered write before allocating its request
+ * @q:		the request queue
+ * @bio:	bio about to get a new request
+ *
+ * Description:
+ *    Called and returns with the queue lock held, may drop it to sleep.
+ *    Returns %true if the write was counted, in which case the caller
+ *    must mark the request it allocates for @bio with REQ_WBT.
+ */
+bool blk_wbt_wait(struct request_queue *q, struct bio *bio)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	DEFINE_WAIT(wait);
+
+	if (!rwb_enabled(rwb) || !rwb_should_throttle(bio))
+		return false;
+
+	if (rwb->inflight >= rwb_limit(rwb)) {
+		rwb->throttled++;
+		do {
+			prepare_to_wait(&rwb->wait, &wait,
+					TASK_UNINTERRUPTIBLE);
+			spin_unlock_irq(q->queue_lock);
+			io_schedule();
+			spin_lock_irq(q->queue_lock);
+		} while (rwb_enabled(rwb) && !blk_queue_dead(q) &&
+			 rwb->inflight >= rwb_limit(rwb));
+		finish_wait(&rwb->wait, &wait);
+	}
+
+	rwb->inflight++;
+	rwb_arm_window(rwb);
+	return true;
+}
+
+static void rwb_write_done(struct rq_wb *rwb)
+{
+	rwb->inflight--;
+	rwb->write_samples++;
+	if (waitqueue_active(&rwb->wait) && rwb->inflight < rwb->wb_max)
+		wake_up(&rwb->wait);
+}
+
+/*
+ * Drop the count taken by blk_wbt_wait() when no request could be
+ * allocated after all.
+ */
+void blk_wbt_abort(struct request_queue *q)
+{
+	rwb_write_done(q->rq_wb);
+}
+
+/*
+ * Called when @rq is handed to the driver.
+ */
+void blk_wbt_issue(struct request_queue *q, struct request *rq)
+{
+	rq->wbt_issue_time_ns = 0;
+	if (rwb_enabled(q->rq_wb) && rq->cmd_type == REQ_TYPE_FS &&
+	    rq_data_dir(rq) == READ)
+		rq->wbt_issue_time_ns = sched_clock();
+}
+
+/*
+ * Called when @rq is freed, after completion or after it was merged into
+ * another request.
+ */
+void blk_wbt_done(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	u64 lat;
+
+	if (!rwb)
+		return;
+
+	if (rq->cmd_flags & REQ_WBT) {
+		rq->cmd_flags &= ~REQ_WBT;
+		rwb_write_done(rwb);
+		return;
+	}
+
+	if (!rq->wbt_issue_time_ns || !rwb_enabled(rwb))
+		return;
+
+	lat = sched_clock() - rq->wbt_issue_time_ns;
+	rq->wbt_issue_time_ns = 0;
+	if (!rwb->read_samples || lat < rwb->read_min_lat)
+		rwb->read_min_lat = lat;
+	rwb->read_samples++;
+	rwb_arm_window(rwb);
+}
+
+/*
+ * Turn throttling on for a queue that is being registered, with a target
+ * that depends on whether the device seeks.
+ */
+void blk_wbt_enable_default(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	spin_lock_irq(q->queue_lock);
+	if (!rwb->min_lat_nsec)
+		rwb->min_lat_nsec = (u64)NSEC_PER_USEC *
+			(blk_queue_nonrot(q) ? RWB_NONROT_LAT_USEC :
+					       RWB_ROT_LAT_USEC);
+	rwb->max_depth = min_t(unsigned int, RWB_DEF_DEPTH, q->nr_requests);
+	rwb_calc_limits(rwb);
+	spin_unlock_irq(q->queue_lock);
+}
+
+ssize_t blk_wbt_lat_show(struct request_queue *q, char *page)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	return sprintf(page, "%llu\n", rwb ? (unsigned long long)
+		       div_u64(rwb->min_lat_nsec, NSEC_PER_USEC) : 0ULL);
+}
+
+ssize_t blk_wbt_lat_store(struct request_queue *q, const char *page,
+			  size_t count)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned long long val;
+	int err;
+
+	if (!rwb)
+		return -EINVAL;
+
+	err = kstrtoull(page, 10, &val);
+	if (err)
+		return err;
+
+	spin_lock_irq(q->queue_lock);
+	rwb->min_lat_nsec = val * NSEC_PER_USEC;
+	rwb->max_depth = min_t(unsigned int, RWB_DEF_DEPTH, q->nr_requests);
+	rwb->scale_step = 0;
+	rwb_calc_limits(rwb);
+	wake_up_all(&rwb->wait);
+	spin_unlock_irq(q->queue_lock);
+
+	return count;
+}
+
+ssize_t blk_wbt_state_show(struct request_queue *q, char *page)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	ssize_t ret;
+
+	if (!rwb)
+		return sprintf(page, "none\n");
+
+	spin_lock_irq(q->queue_lock);
+	ret = sprintf(page,
+		      "enabled %d\n"
+		      "scale_step %d\n"
+		      "wb_max %u\n"
+		      "wb_normal %u\n"
+		      "wb_background %u\n"
+		      "inflight %u\n"
+		      "read_min_lat_usec %llu\n"
+		      "throttled %lu\n"
+		      "scale_downs %lu\n"
+		      "scale_ups %lu\n",
+		      rwb_enabled(rwb), rwb->scale_step, rwb->wb_max,
+		      rwb->wb_normal, rwb->wb_background, rwb->inflight,
+		      (unsigned long long)div_u64(rwb->last_read_min_lat,
+						  NSEC_PER_USEC),
+		      rwb->throttled, rwb->scale_downs, rwb->scale_ups);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+int blk_wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	if (q->rq_wb)
+		return 0;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->queue = q;
+	rwb->max_depth = RWB_DEF_DEPTH;
+	rwb_calc_limits(rwb);
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, rwb_window_timer_fn,
+		    (unsigned long)rwb);
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void blk_wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window_timer);
+	q->rq_wb = NULL;
+	kfree(rwb);
+}
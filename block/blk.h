@@ -34,6 +34,11 @@ void blk_delete_timer(struct request *);
 void blk_add_timer(struct request *);
 void __generic_unplug_device(struct request_queue *);
 
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule);
+void blk_mq_drain_queue(struct request_queue *q);
+void blk_mq_free_queue(struct request_queue *q);
+ssize_t blk_mq_stats_show(struct request_queue *q, char *page);
+
 /*
  * Internal atomic flags for request handling
  */
@@ -245,4 +250,31 @@ static inline void blk_throtl_exit(struct request_queue *q) { }
 static inline void blk_throtl_release(struct request_queue *q) { }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+#ifdef CONFIG_BLK_WBT
+extern bool blk_wbt_wait(struct request_queue *q, struct bio *bio);
+extern void blk_wbt_abort(struct request_queue *q);
+extern void blk_wbt_issue(struct request_queue *q, struct request *rq);
+extern void blk_wbt_done(struct request_queue *q, struct request *rq);
+extern void blk_wbt_enable_default(struct request_queue *q);
+extern ssize_t blk_wbt_lat_show(struct request_queue *q, char *page);
+extern ssize_t blk_wbt_lat_store(struct request_queue *q, const char *page,
+				 size_t count);
+extern ssize_t blk_wbt_state_show(struct request_queue *q, char *page);
+extern int blk_wbt_init(struct request_queue *q);
+extern void blk_wbt_exit(struct request_queue *q);
+#else /* CONFIG_BLK_WBT */
+static inline bool blk_wbt_wait(struct request_queue *q, struct bio *bio)
+{
+	return false;
+}
+static inline void blk_wbt_abort(struct request_queue *q) { }
+static inline void blk_wbt_issue(struct request_queue *q,
+				 struct request *rq) { }
+static inline void blk_wbt_done(struct request_queue *q,
+				struct request *rq) { }
+static inline void blk_wbt_enable_default(struct request_queue *q) { }
+static inline int blk_wbt_init(struct request_queue *q) { return 0; }
+static inline void blk_wbt_exit(struct request_queue *q) { }
+#endif /* CONFIG_BLK_WBT */
+
 #endif /* BLK_INTERNAL_H */
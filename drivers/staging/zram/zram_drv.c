@@ -24,6 +24,7 @@
 #include <linux/bio.h>
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
@@ -576,6 +577,18 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return 0;
 }
 
+static void zram_queue_bios(struct blk_mq_hw_ctx *hctx, struct bio_list *bios)
+{
+	struct bio *bio;
+
+	while ((bio = bio_list_pop(bios)))
+		zram_make_request(hctx->queue, bio);
+}
+
+static struct blk_mq_ops zram_mq_ops = {
+	.queue_bios	= zram_queue_bios,
+};
+
 void zram_reset_device(struct zram *zram)
 {
 	size_t index;
@@ -714,7 +727,13 @@ static int create_device(struct zram *zram, int device_id)
 		goto out;
 	}
 
-	blk_queue_make_request(zram->queue, zram_make_request);
+	ret = blk_mq_init_queue(zram->queue, &zram_mq_ops, 0);
+	if (ret) {
+		blk_cleanup_queue(zram->queue);
+		pr_err("Error setting up disk queue for device %d\n",
+			device_id);
+		goto out;
+	}
 	zram->queue->queuedata = zram;
 
 	 /* gendisk structure */
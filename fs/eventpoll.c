@@ -87,7 +87,11 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+/* Events that can be asked for together with EPOLLEXCLUSIVE */
+#define EPOLLEXCLUSIVE_OK_BITS (POLLIN | POLLOUT | POLLERR | POLLHUP | \
+				EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -96,6 +100,9 @@
 
 #define EP_UNACTIVE_PTR ((void *) -1L)
 
+/* Events copied to userspace at a time by ep_send_events_proc() */
+#define EP_SEND_BATCH 16
+
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
 struct epoll_filefd {
@@ -881,7 +888,7 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
+	int pwake = 0, ewake = 0;
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
@@ -939,10 +946,14 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
+	if (waitqueue_active(&ep->wq)) {
 		wake_up_locked(&ep->wq);
-	if (waitqueue_active(&ep->poll_wait))
+		ewake = 1;
+	}
+	if (waitqueue_active(&ep->poll_wait)) {
 		pwake++;
+		ewake = 1;
+	}
 
 out_unlock:
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -951,7 +962,15 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+	/*
+	 * The wait queue entry of an EPOLLEXCLUSIVE item is exclusive, so
+	 * returning non zero ends the wakeup of the target file there. Only
+	 * do that if we woke up a waiter, otherwise the event has to go on
+	 * to the next epoll instance. POLLFREE has to reach all of them.
+	 */
+	if (!(epi->event.events & EPOLLEXCLUSIVE))
+		return 1;
+	return ((unsigned long)key & POLLFREE) ? 0 : ewake;
 }
 
 /*
@@ -968,7 +987,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -1261,14 +1283,57 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	return 0;
 }
 
+/*
+ * Copies the @nr events gathered in @batch to userspace in one go and
+ * updates their items for EPOLLONESHOT and level triggering. On a fault
+ * the items go back to the front of @head, in their order, so that the
+ * events are not lost.
+ */
+static int ep_flush_events(struct eventpoll *ep, struct list_head *head,
+			   struct epoll_event __user *uevent,
+			   struct epoll_event *batch, struct epitem **items,
+			   int nr)
+{
+	int i;
+
+	if (__copy_to_user(uevent, batch, nr * sizeof(*batch))) {
+		for (i = nr - 1; i >= 0; i--)
+			list_add(&items[i]->rdllink, head);
+		return -EFAULT;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct epitem *epi = items[i];
+
+		if (epi->event.events & EPOLLONESHOT)
+			epi->event.events &= EP_PRIVATE_BITS;
+		else if (!(epi->event.events & EPOLLET)) {
+			/*
+			 * If this file has been added with Level
+			 * Trigger mode, we need to insert back inside
+			 * the ready list, so that the next call to
+			 * epoll_wait() will check again the events
+			 * availability. At this point, no one can insert
+			 * into ep->rdllist besides us. The epoll_ctl()
+			 * callers are locked out by
+			 * ep_scan_ready_list() holding "mtx" and the
+			 * poll callback will queue them in ep->ovflist.
+			 */
+			list_add_tail(&epi->rdllink, &ep->rdllist);
+		}
+	}
+	return nr;
+}
+
 static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 			       void *priv)
 {
 	struct ep_send_events_data *esed = priv;
-	int eventcnt;
+	int eventcnt, nr, ret;
 	unsigned int revents;
 	struct epitem *epi;
-	struct epoll_event __user *uevent;
+	struct epoll_event batch[EP_SEND_BATCH];
+	struct epitem *items[EP_SEND_BATCH];
 	poll_table pt;
 
 	init_poll_funcptr(&pt, NULL);
@@ -1276,10 +1341,11 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 	/*
 	 * We can loop without lock because we are passed a task private list.
 	 * Items cannot vanish during the loop because ep_scan_ready_list() is
-	 * holding "mtx" during this call.
+	 * holding "mtx" during this call. The events are gathered on the
+	 * stack and copied to userspace EP_SEND_BATCH at a time.
 	 */
-	for (eventcnt = 0, uevent = esed->events;
-	     !list_empty(head) && eventcnt < esed->maxevents;) {
+	for (eventcnt = 0, nr = 0;
+	     !list_empty(head) && eventcnt + nr < esed->maxevents;) {
 		epi = list_first_entry(head, struct epitem, rdllink);
 
 		list_del_init(&epi->rdllink);
@@ -1294,33 +1360,30 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 		 * is holding "mtx", so no operations coming from userspace
 		 * can change the item.
 		 */
-		if (revents) {
-			if (__put_user(revents, &uevent->events) ||
-			    __put_user(epi->event.data, &uevent->data)) {
-				list_add(&epi->rdllink, head);
-				return eventcnt ? eventcnt : -EFAULT;
-			}
-			eventcnt++;
-			uevent++;
-			if (epi->event.events & EPOLLONESHOT)
-				epi->event.events &= EP_PRIVATE_BITS;
-			else if (!(epi->event.events & EPOLLET)) {
-				/*
-				 * If this file has been added with Level
-				 * Trigger mode, we need to insert back inside
-				 * the ready list, so that the next call to
-				 * epoll_wait() will check again the events
-				 * availability. At this point, no one can insert
-				 * into ep->rdllist besides us. The epoll_ctl()
-				 * callers are locked out by
-				 * ep_scan_ready_list() holding "mtx" and the
-				 * poll callback will queue them in ep->ovflist.
-				 */
-				list_add_tail(&epi->rdllink, &ep->rdllist);
-			}
+		if (!revents)
+			continue;
+		batch[nr].events = revents;
+		batch[nr].data = epi->event.data;
+		items[nr++] = epi;
+
+		if (nr == EP_SEND_BATCH) {
+			ret = ep_flush_events(ep, head, esed->events + eventcnt,
+					      batch, items, nr);
+			if (ret < 0)
+				return eventcnt ? eventcnt : ret;
+			eventcnt += ret;
+			nr = 0;
 		}
 	}
 
+	if (nr) {
+		ret = ep_flush_events(ep, head, esed->events + eventcnt,
+				      batch, items, nr);
+		if (ret < 0)
+			return eventcnt ? eventcnt : ret;
+		eventcnt += ret;
+	}
+
 	return eventcnt;
 }
 
@@ -1638,6 +1701,17 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (file == tfile || !is_file_epoll(file))
 		goto error_tgt_fput;
 
+	/*
+	 * The wait queue entries are added at EPOLL_CTL_ADD time only, so
+	 * EPOLLEXCLUSIVE can't be changed by EPOLL_CTL_MOD. Exclusive
+	 * wakeups of nested epoll instances aren't supported.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD || is_file_epoll(tfile) ||
+		    (epds.events & ~EPOLLEXCLUSIVE_OK_BITS))
+			goto error_tgt_fput;
+	}
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
@@ -1698,8 +1772,10 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
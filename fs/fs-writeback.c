@@ -724,6 +724,13 @@ static long wb_writeback(struct bdi_writeback *wb,
 	oldest_jif = jiffies;
 	work->older_than_this = &oldest_jif;
 
+	/*
+	 * Let the block layer tell periodic and background flushing apart
+	 * from writeback somebody is waiting for.
+	 */
+	if (work->for_background || work->for_kupdate)
+		current->flags |= PF_BG_WRITEBACK;
+
 	spin_lock(&wb->list_lock);
 	for (;;) {
 		/*
@@ -801,6 +808,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 		}
 	}
 	spin_unlock(&wb->list_lock);
+	current->flags &= ~PF_BG_WRITEBACK;
 
 	return nr_pages - work->nr_pages;
 }
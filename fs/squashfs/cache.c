@@ -52,94 +52,174 @@
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/pagemap.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs.h"
 
+/* Entries per shard below which a cache is not split any further */
+#define SQUASHFS_CACHE_SHARD_ENTRIES	4
+
+static struct workqueue_struct *squashfs_read_wq;
+
+struct squashfs_readahead {
+	struct work_struct	work;
+	struct super_block	*sb;
+	struct squashfs_cache	*cache;
+	u64			block;
+	int			length;
+	unsigned int		fragment;
+};
+
+static struct squashfs_cache_shard *squashfs_cache_shard(
+	struct squashfs_cache *cache, u64 block)
+{
+	if (cache->shard_bits == 0)
+		return cache->shard;
+	return &cache->shard[hash_64(block, cache->shard_bits)];
+}
+
+
 /*
- * Look-up block in cache, and increment usage count.  If not in cache, read
- * and decompress it from disk.
+ * Find block in shard, returning its index or -1.  Called with the shard
+ * lock held.
  */
-struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
-	struct squashfs_cache *cache, u64 block, int length)
+static int squashfs_cache_find(struct squashfs_cache_shard *shard, u64 block)
+{
+	int i, n;
+
+	for (i = shard->curr_blk, n = 0; n < shard->entries; n++) {
+		if (shard->entry[i].block == block) {
+			shard->curr_blk = i;
+			return i;
+		}
+		i = (i + 1) % shard->entries;
+	}
+
+	return -1;
+}
+
+
+/*
+ * Claim an unused entry of the shard for block.  Called with the shard lock
+ * held and at least one entry unused.
+ */
+static struct squashfs_cache_entry *squashfs_cache_claim(
+	struct squashfs_cache_shard *shard, u64 block)
 {
+	struct squashfs_cache_entry *entry;
 	int i, n;
+
+	/*
+	 * A simple round-robin strategy is used to choose the entry to
+	 * be evicted from the cache.
+	 */
+	i = shard->next_blk;
+	for (n = 0; n < shard->entries; n++) {
+		if (shard->entry[i].refcount == 0)
+			break;
+		i = (i + 1) % shard->entries;
+	}
+
+	shard->next_blk = (i + 1) % shard->entries;
+	entry = &shard->entry[i];
+
+	shard->unused--;
+	entry->block = block;
+	entry->refcount = 1;
+	entry->pending = 1;
+	entry->num_waiters = 0;
+	entry->error = 0;
+	entry->readahead = 0;
+
+	return entry;
+}
+
+
+/*
+ * Read and decompress a claimed entry from disk, and wake up anyone who
+ * found it while it was being filled in.
+ */
+static void squashfs_cache_fill(struct super_block *sb,
+	struct squashfs_cache_entry *entry, int length)
+{
+	struct squashfs_cache *cache = entry->cache;
+	struct squashfs_cache_shard *shard = entry->shard;
+
+	entry->length = squashfs_read_data(sb, entry->data,
+		entry->block, length, &entry->next_index,
+		cache->block_size, cache->pages);
+
+	spin_lock(&shard->lock);
+
+	if (entry->length < 0)
+		entry->error = entry->length;
+
+	entry->pending = 0;
+
+	/*
+	 * While filling this entry one or more other processes
+	 * have looked it up in the cache, and have slept
+	 * waiting for it to become available.
+	 */
+	if (entry->num_waiters) {
+		spin_unlock(&shard->lock);
+		wake_up_all(&entry->wait_queue);
+	} else
+		spin_unlock(&shard->lock);
+}
+
+
+/*
+ * Look-up block in cache, and increment usage count.  If not in cache, read
+ * and decompress it from disk.  If ra is not NULL it is set when the caller
+ * missed in the cache, or is the first user of an entry that was read ahead,
+ * i.e. when it is a good time to read further ahead.
+ */
+static struct squashfs_cache_entry *__squashfs_cache_get(
+	struct super_block *sb, struct squashfs_cache *cache, u64 block,
+	int length, int *ra)
+{
+	int i;
+	struct squashfs_cache_shard *shard = squashfs_cache_shard(cache, block);
 	struct squashfs_cache_entry *entry;
 
-	spin_lock(&cache->lock);
+	spin_lock(&shard->lock);
 
 	while (1) {
-		for (i = cache->curr_blk, n = 0; n < cache->entries; n++) {
-			if (cache->entry[i].block == block) {
-				cache->curr_blk = i;
-				break;
-			}
-			i = (i + 1) % cache->entries;
-		}
+		i = squashfs_cache_find(shard, block);
 
-		if (n == cache->entries) {
+		if (i < 0) {
 			/*
 			 * Block not in cache, if all cache entries are used
 			 * go to sleep waiting for one to become available.
 			 */
-			if (cache->unused == 0) {
-				cache->num_waiters++;
-				spin_unlock(&cache->lock);
-				wait_event(cache->wait_queue, cache->unused);
-				spin_lock(&cache->lock);
-				cache->num_waiters--;
+			if (shard->unused == 0) {
+				shard->num_waiters++;
+				shard->waits++;
+				spin_unlock(&shard->lock);
+				wait_event(shard->wait_queue, shard->unused);
+				spin_lock(&shard->lock);
+				shard->num_waiters--;
 				continue;
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
-			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
-			}
-
-			cache->next_blk = (i + 1) % cache->entries;
-			entry = &cache->entry[i];
-
-			/*
-			 * Initialise chosen cache entry, and fill it in from
-			 * disk.
+			 * At least one unused cache entry.  Claim it and
+			 * fill it in from disk.
 			 */
-			cache->unused--;
-			entry->block = block;
-			entry->refcount = 1;
-			entry->pending = 1;
-			entry->num_waiters = 0;
-			entry->error = 0;
-			spin_unlock(&cache->lock);
-
-			entry->length = squashfs_read_data(sb, entry->data,
-				block, length, &entry->next_index,
-				cache->block_size, cache->pages);
-
-			spin_lock(&cache->lock);
+			shard->misses++;
+			entry = squashfs_cache_claim(shard, block);
+			spin_unlock(&shard->lock);
 
-			if (entry->length < 0)
-				entry->error = entry->length;
-
-			entry->pending = 0;
-
-			/*
-			 * While filling this entry one or more other processes
-			 * have looked it up in the cache, and have slept
-			 * waiting for it to become available.
-			 */
-			if (entry->num_waiters) {
-				spin_unlock(&cache->lock);
-				wake_up_all(&entry->wait_queue);
-			} else
-				spin_unlock(&cache->lock);
+			squashfs_cache_fill(sb, entry, length);
+			if (ra)
+				*ra = 1;
 
 			goto out;
 		}
@@ -150,10 +230,17 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * previously unused there's one less cache entry available
 		 * for reuse.
 		 */
-		entry = &cache->entry[i];
+		entry = &shard->entry[i];
 		if (entry->refcount == 0)
-			cache->unused--;
+			shard->unused--;
 		entry->refcount++;
+		shard->hits++;
+		if (entry->readahead) {
+			entry->readahead = 0;
+			shard->ra_hits++;
+			if (ra)
+				*ra = 1;
+		}
 
 		/*
 		 * If the entry is currently being filled in by another process
@@ -161,10 +248,11 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 */
 		if (entry->pending) {
 			entry->num_waiters++;
-			spin_unlock(&cache->lock);
+			shard->waits++;
+			spin_unlock(&shard->lock);
 			wait_event(entry->wait_queue, !entry->pending);
 		} else
-			spin_unlock(&cache->lock);
+			spin_unlock(&shard->lock);
 
 		goto out;
 	}
@@ -180,30 +268,126 @@ out:
 }
 
 
+struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
+	struct squashfs_cache *cache, u64 block, int length)
+{
+	return __squashfs_cache_get(sb, cache, block, length, NULL);
+}
+
+
 /*
  * Release cache entry, once usage count is zero it can be reused.
  */
 void squashfs_cache_put(struct squashfs_cache_entry *entry)
 {
-	struct squashfs_cache *cache = entry->cache;
+	struct squashfs_cache_shard *shard = entry->shard;
 
-	spin_lock(&cache->lock);
+	spin_lock(&shard->lock);
 	entry->refcount--;
 	if (entry->refcount == 0) {
-		cache->unused++;
+		shard->unused++;
 		/*
 		 * If there's any processes waiting for a block to become
 		 * available, wake one up.
 		 */
-		if (cache->num_waiters) {
-			spin_unlock(&cache->lock);
-			wake_up(&cache->wait_queue);
+		if (shard->num_waiters) {
+			spin_unlock(&shard->lock);
+			wake_up(&shard->wait_queue);
 			return;
 		}
 	}
-	spin_unlock(&cache->lock);
+	spin_unlock(&shard->lock);
+}
+
+
+/*
+ * Read block into the cache ahead of use.  Nothing is done if the block is
+ * already cached, or if that would take the last unused entry of its shard,
+ * readahead must never make a real lookup wait.
+ */
+static void squashfs_cache_prefetch(struct super_block *sb,
+	struct squashfs_cache *cache, u64 block, int length)
+{
+	struct squashfs_cache_shard *shard = squashfs_cache_shard(cache, block);
+	struct squashfs_cache_entry *entry;
+
+	spin_lock(&shard->lock);
+	if (shard->unused < 2 || squashfs_cache_find(shard, block) >= 0) {
+		spin_unlock(&shard->lock);
+		return;
+	}
+
+	entry = squashfs_cache_claim(shard, block);
+	entry->readahead = 1;
+	shard->ra_issued++;
+	spin_unlock(&shard->lock);
+
+	squashfs_cache_fill(sb, entry, length);
+
+	/*
+	 * Don't leave a failed speculative read behind, a later real read
+	 * of the block should retry it.
+	 */
+	if (entry->error) {
+		spin_lock(&shard->lock);
+		entry->block = SQUASHFS_INVALID_BLK;
+		entry->readahead = 0;
+		spin_unlock(&shard->lock);
+	}
+
+	squashfs_cache_put(entry);
+}
+
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead *ra =
+		container_of(work, struct squashfs_readahead, work);
+
+	if (ra->fragment != SQUASHFS_INVALID_FRAG) {
+		ra->length = squashfs_frag_lookup(ra->sb, ra->fragment,
+			&ra->block);
+		if (ra->length < 0)
+			goto out;
+	}
+
+	squashfs_cache_prefetch(ra->sb, ra->cache, ra->block, ra->length);
+
+out:
+	kfree(ra);
+}
+
+
+static void squashfs_cache_readahead(struct super_block *sb,
+	struct squashfs_cache *cache, u64 block, int length,
+	unsigned int fragment)
+{
+	struct squashfs_readahead *ra;
+
+	ra = kmalloc(sizeof(*ra), GFP_NOFS);
+	if (ra == NULL)
+		return;
+
+	INIT_WORK(&ra->work, squashfs_readahead_work);
+	ra->sb = sb;
+	ra->cache = cache;
+	ra->block = block;
+	ra->length = length;
+	ra->fragment = fragment;
+	queue_work(squashfs_read_wq, &ra->work);
+}
+
+
+/*
+ * Wait for outstanding readahead, called before the caches of a
+ * filesystem are deleted.
+ */
+void squashfs_cache_sync(void)
+{
+	flush_workqueue(squashfs_read_wq);
 }
 
+
 /*
  * Delete cache reclaiming all kmalloced buffers.
  */
@@ -214,14 +398,17 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 	if (cache == NULL)
 		return;
 
-	for (i = 0; i < cache->entries; i++) {
-		if (cache->entry[i].data) {
-			for (j = 0; j < cache->pages; j++)
-				kfree(cache->entry[i].data[j]);
-			kfree(cache->entry[i].data);
+	if (cache->entry) {
+		for (i = 0; i < cache->entries; i++) {
+			if (cache->entry[i].data) {
+				for (j = 0; j < cache->pages; j++)
+					kfree(cache->entry[i].data[j]);
+				kfree(cache->entry[i].data);
+			}
 		}
 	}
 
+	kfree(cache->shard);
 	kfree(cache->entry);
 	kfree(cache);
 }
@@ -231,11 +418,14 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
  * Initialise cache allocating the specified number of entries, each of
  * size block_size.  To avoid vmalloc fragmentation issues each entry
  * is allocated as a sequence of kmalloced PAGE_CACHE_SIZE buffers.
+ *
+ * Caches large enough are split into shards, no more than there are
+ * possible cpus.
  */
 struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	int block_size)
 {
-	int i, j;
+	int i, j, shards, first = 0;
 	struct squashfs_cache *cache = kzalloc(sizeof(*cache), GFP_KERNEL);
 
 	if (cache == NULL) {
@@ -249,17 +439,36 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		goto cleanup;
 	}
 
-	cache->curr_blk = 0;
-	cache->next_blk = 0;
-	cache->unused = entries;
+	shards = min_t(int, entries / SQUASHFS_CACHE_SHARD_ENTRIES,
+		roundup_pow_of_two(num_possible_cpus()));
+	shards = shards > 1 ? rounddown_pow_of_two(shards) : 1;
+
+	cache->shard = kcalloc(shards, sizeof(*(cache->shard)), GFP_KERNEL);
+	if (cache->shard == NULL) {
+		ERROR("Failed to allocate %s cache\n", name);
+		goto cleanup;
+	}
+
 	cache->entries = entries;
 	cache->block_size = block_size;
 	cache->pages = block_size >> PAGE_CACHE_SHIFT;
 	cache->pages = cache->pages ? cache->pages : 1;
 	cache->name = name;
-	cache->num_waiters = 0;
-	spin_lock_init(&cache->lock);
-	init_waitqueue_head(&cache->wait_queue);
+	cache->shard_bits = ilog2(shards);
+
+	for (i = 0; i < shards; i++) {
+		struct squashfs_cache_shard *shard = &cache->shard[i];
+
+		shard->entries = entries / shards + (i < entries % shards);
+		shard->unused = shard->entries;
+		shard->entry = &cache->entry[first];
+		spin_lock_init(&shard->lock);
+		init_waitqueue_head(&shard->wait_queue);
+
+		for (j = 0; j < shard->entries; j++)
+			shard->entry[j].shard = shard;
+		first += shard->entries;
+	}
 
 	for (i = 0; i < entries; i++) {
 		struct squashfs_cache_entry *entry = &cache->entry[i];
@@ -327,6 +536,22 @@ int squashfs_copy_data(void *buffer, struct squashfs_cache_entry *entry,
 }
 
 
+/*
+ * Return the end of the inode or directory table that the metadata block
+ * at block belongs to, or 0 for the other tables. Those are looked up at
+ * random and are not read ahead.
+ */
+static u64 squashfs_metadata_ra_end(struct squashfs_sb_info *msblk, u64 block)
+{
+	if (block >= msblk->inode_table && block < msblk->directory_table)
+		return msblk->directory_table;
+	if (block >= msblk->directory_table &&
+			block < msblk->directory_table_end)
+		return msblk->directory_table_end;
+	return 0;
+}
+
+
 /*
  * Read length bytes from metadata position <block, offset> (block is the
  * start of the compressed block on disk, and offset is the offset into
@@ -337,13 +562,15 @@ int squashfs_read_metadata(struct super_block *sb, void *buffer,
 		u64 *block, int *offset, int length)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
-	int bytes, res = length;
+	int bytes, ra, res = length;
 	struct squashfs_cache_entry *entry;
 
 	TRACE("Entered squashfs_read_metadata [%llx:%x]\n", *block, *offset);
 
 	while (length) {
-		entry = squashfs_cache_get(sb, msblk->block_cache, *block, 0);
+		ra = 0;
+		entry = __squashfs_cache_get(sb, msblk->block_cache, *block, 0,
+			&ra);
 		if (entry->error) {
 			res = entry->error;
 			goto error;
@@ -352,6 +579,16 @@ int squashfs_read_metadata(struct super_block *sb, void *buffer,
 			goto error;
 		}
 
+		/*
+		 * Inodes and directories are mostly read sequentially, so
+		 * read the following block ahead, but not past the end of
+		 * the table, where the next one would be garbage.
+		 */
+		if (ra && entry->next_index <
+				squashfs_metadata_ra_end(msblk, entry->block))
+			squashfs_cache_readahead(sb, msblk->block_cache,
+				entry->next_index, 0, SQUASHFS_INVALID_FRAG);
+
 		bytes = squashfs_copy_data(buffer, entry, *offset, length);
 		if (buffer)
 			buffer += bytes;
@@ -376,15 +613,25 @@ error:
 
 /*
  * Look-up in the fragmment cache the fragment located at <start_block> in the
- * filesystem.  If necessary read and decompress it from disk.
+ * filesystem.  If necessary read and decompress it from disk.  Fragments are
+ * written in file order, so on a miss the next fragment is read ahead.
  */
 struct squashfs_cache_entry *squashfs_get_fragment(struct super_block *sb,
-				u64 start_block, int length)
+				u64 start_block, int length, unsigned int fragment)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	struct squashfs_cache_entry *entry;
+	int ra = 0;
+
+	entry = __squashfs_cache_get(sb, msblk->fragment_cache, start_block,
+		length, &ra);
 
-	return squashfs_cache_get(sb, msblk->fragment_cache, start_block,
-		length);
+	if (ra && !entry->error && fragment != SQUASHFS_INVALID_FRAG &&
+			fragment + 1 < msblk->fragments)
+		squashfs_cache_readahead(sb, msblk->fragment_cache, 0, 0,
+			fragment + 1);
+
+	return entry;
 }
 
 
@@ -438,3 +685,120 @@ failed:
 	kfree(table);
 	return ERR_PTR(res);
 }
+
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *squashfs_debugfs_root;
+
+static void squashfs_cache_stats(struct seq_file *m,
+	struct squashfs_cache *cache)
+{
+	unsigned long hits = 0, misses = 0, waits = 0, ra_issued = 0;
+	unsigned long ra_hits = 0;
+	int i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < 1 << cache->shard_bits; i++) {
+		struct squashfs_cache_shard *shard = &cache->shard[i];
+
+		spin_lock(&shard->lock);
+		hits += shard->hits;
+		misses += shard->misses;
+		waits += shard->waits;
+		ra_issued += shard->ra_issued;
+		ra_hits += shard->ra_hits;
+		spin_unlock(&shard->lock);
+	}
+
+	seq_printf(m, "%-8s entries %d shards %d hits %lu misses %lu "
+		"waits %lu readahead %lu used %lu\n", cache->name,
+		cache->entries, 1 << cache->shard_bits, hits, misses, waits,
+		ra_issued, ra_hits);
+}
+
+
+static int squashfs_stats_show(struct seq_file *m, void *v)
+{
+	struct super_block *sb = m->private;
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	squashfs_cache_stats(m, msblk->block_cache);
+	squashfs_cache_stats(m, msblk->fragment_cache);
+	squashfs_cache_stats(m, msblk->read_page);
+
+	return 0;
+}
+
+
+static int squashfs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, squashfs_stats_show, inode->i_private);
+}
+
+
+static const struct file_operations squashfs_stats_fops = {
+	.open		= squashfs_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+
+/*
+ * Cache statistics of a mounted filesystem are exported in
+ * <debugfs>/squashfs/<device>.
+ */
+void squashfs_cache_debugfs_add(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	if (squashfs_debugfs_root)
+		msblk->debugfs = debugfs_create_file(sb->s_id, S_IRUGO,
+			squashfs_debugfs_root, sb, &squashfs_stats_fops);
+}
+
+
+void squashfs_cache_debugfs_remove(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	debugfs_remove(msblk->debugfs);
+	msblk->debugfs = NULL;
+}
+#else
+void squashfs_cache_debugfs_add(struct super_block *sb)
+{
+}
+
+
+void squashfs_cache_debugfs_remove(struct super_block *sb)
+{
+}
+#endif
+
+
+int __init squashfs_cache_setup(void)
+{
+	squashfs_read_wq = alloc_workqueue("squashfs_read", WQ_UNBOUND, 0);
+	if (squashfs_read_wq == NULL)
+		return -ENOMEM;
+
+#ifdef CONFIG_DEBUG_FS
+	squashfs_debugfs_root = debugfs_create_dir("squashfs", NULL);
+	if (IS_ERR(squashfs_debugfs_root))
+		squashfs_debugfs_root = NULL;
+#endif
+
+	return 0;
+}
+
+
+void squashfs_cache_teardown(void)
+{
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove(squashfs_debugfs_root);
+#endif
+	destroy_workqueue(squashfs_read_wq);
+}
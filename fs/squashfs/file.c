@@ -429,7 +429,8 @@ static int squashfs_readpage(struct file *file, struct page *page)
 		 */
 		buffer = squashfs_get_fragment(inode->i_sb,
 				squashfs_i(inode)->fragment_block,
-				squashfs_i(inode)->fragment_size);
+				squashfs_i(inode)->fragment_size,
+				squashfs_i(inode)->fragment);
 
 		if (buffer->error) {
 			ERROR("Unable to read page, block %llx, size %x\n",
@@ -41,10 +41,15 @@ extern int squashfs_copy_data(void *, struct squashfs_cache_entry *, int, int);
 extern int squashfs_read_metadata(struct super_block *, void *, u64 *,
 				int *, int);
 extern struct squashfs_cache_entry *squashfs_get_fragment(struct super_block *,
-				u64, int);
+				u64, int, unsigned int);
 extern struct squashfs_cache_entry *squashfs_get_datablock(struct super_block *,
 				u64, int);
 extern void *squashfs_read_table(struct super_block *, u64, int);
+extern void squashfs_cache_sync(void);
+extern void squashfs_cache_debugfs_add(struct super_block *);
+extern void squashfs_cache_debugfs_remove(struct super_block *);
+extern int squashfs_cache_setup(void);
+extern void squashfs_cache_teardown(void);
 
 /* decompressor.c */
 extern const struct squashfs_decompressor *squashfs_lookup_decompressor(int);
@@ -34,6 +34,7 @@ struct squashfs_inode_info {
 			u64		fragment_block;
 			int		fragment_size;
 			int		fragment_offset;
+			unsigned int	fragment;
 			u64		block_list_start;
 		};
 		struct {
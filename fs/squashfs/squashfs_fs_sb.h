@@ -25,18 +25,36 @@
 
 #include "squashfs_fs.h"
 
-struct squashfs_cache {
-	char			*name;
+/*
+ * Each cache is split into power of two shards, a block always lives in
+ * the shard its number hashes to.  Shards have their own lock and wait
+ * queue so that lookups of unrelated blocks do not serialise.
+ */
+struct squashfs_cache_shard {
 	int			entries;
 	int			curr_blk;
 	int			next_blk;
 	int			num_waiters;
 	int			unused;
-	int			block_size;
-	int			pages;
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache_entry *entry;
+	/* statistics, protected by lock */
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		waits;
+	unsigned long		ra_issued;
+	unsigned long		ra_hits;
+} ____cacheline_aligned_in_smp;
+
+struct squashfs_cache {
+	char			*name;
+	int			entries;
+	int			block_size;
+	int			pages;
+	int			shard_bits;
+	struct squashfs_cache_shard *shard;
+	struct squashfs_cache_entry *entry;
 };
 
 struct squashfs_cache_entry {
@@ -47,8 +65,10 @@ struct squashfs_cache_entry {
 	int			pending;
 	int			error;
 	int			num_waiters;
+	int			readahead;	/* filled ahead, not yet used */
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache	*cache;
+	struct squashfs_cache_shard *shard;
 	void			**data;
 };
 
@@ -70,11 +90,14 @@ struct squashfs_sb_info {
 	__le64					*inode_lookup_table;
 	u64					inode_table;
 	u64					directory_table;
+	u64					directory_table_end;
 	u64					xattr_table;
 	unsigned int				block_size;
 	unsigned short				block_log;
 	long long				bytes_used;
 	unsigned int				inodes;
+	unsigned int				fragments;
 	int					xattr_ids;
+	struct dentry				*debugfs;
 };
 #endif
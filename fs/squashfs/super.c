@@ -74,6 +74,20 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 }
 
 
+/*
+ * Size a cache so that every cpu can have a block in use at the same time,
+ * unless the user asked for a fixed, memory-constrained configuration.
+ */
+static int squashfs_cache_entries(int entries, int per_cpu)
+{
+#ifdef CONFIG_SQUASHFS_EMBEDDED
+	return entries;
+#else
+	return max_t(int, entries, per_cpu * num_online_cpus());
+#endif
+}
+
+
 static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
@@ -201,12 +215,14 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	err = -ENOMEM;
 
 	msblk->block_cache = squashfs_cache_init("metadata",
-			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
+			squashfs_cache_entries(SQUASHFS_CACHED_BLKS, 2),
+			SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
 	/* Allocate read_page block */
-	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
+	msblk->read_page = squashfs_cache_init("data",
+			squashfs_cache_entries(1, 1), msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
@@ -275,8 +291,10 @@ handle_fragments:
 	if (fragments == 0)
 		goto check_directory_table;
 
+	msblk->fragments = fragments;
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		squashfs_cache_entries(SQUASHFS_CACHED_FRAGMENTS, 1),
+		msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -306,6 +324,9 @@ check_directory_table:
 		goto failed_mount;
 	}
 
+	/* The first table after the directory table ends it */
+	msblk->directory_table_end = next_table;
+
 	/* allocate root */
 	root = new_inode(sb);
 	if (!root) {
@@ -328,11 +349,14 @@ check_directory_table:
 		goto failed_mount;
 	}
 
+	squashfs_cache_debugfs_add(sb);
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
 
 failed_mount:
+	squashfs_cache_sync();
 	squashfs_cache_delete(msblk->block_cache);
 	squashfs_cache_delete(msblk->fragment_cache);
 	squashfs_cache_delete(msblk->read_page);
@@ -380,6 +404,8 @@ static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		squashfs_cache_debugfs_remove(sb);
+		squashfs_cache_sync();
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
@@ -436,8 +462,15 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	err = squashfs_cache_setup();
+	if (err) {
+		destroy_inodecache();
+		return err;
+	}
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		squashfs_cache_teardown();
 		destroy_inodecache();
 		return err;
 	}
@@ -452,6 +485,7 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	squashfs_cache_teardown();
 	destroy_inodecache();
 }
 
@@ -34,6 +34,7 @@
 #include "yaffs_allocator.h"
 
 #include "yaffs_attribs.h"
+#include "yaffs_summary.h"
 
 /* Note YAFFS_GC_GOOD_ENOUGH must be <= YAFFS_GC_PASSIVE_THRESHOLD */
 #define YAFFS_GC_GOOD_ENOUGH 2
@@ -450,6 +451,7 @@ static int yaffs_alloc_chunk(struct yaffs_dev *dev, int use_reserver,
 		/* Get next block to allocate off */
 		dev->alloc_block = yaffs_find_alloc_block(dev);
 		dev->alloc_page = 0;
+		yaffs_summary_start(dev, dev->alloc_block);
 	}
 
 	if (!use_reserver && !yaffs_check_alloc_available(dev, 1)) {
@@ -474,8 +476,12 @@ static int yaffs_alloc_chunk(struct yaffs_dev *dev, int use_reserver,
 
 		dev->n_free_chunks--;
 
-		/* If the block is full set the state to full */
-		if (dev->alloc_page >= dev->param.chunks_per_block) {
+		/* If the block is full set the state to full. The last chunk
+		 * of a block we collect a summary for is kept for the summary.
+		 */
+		if (dev->alloc_page >= dev->param.chunks_per_block ||
+		    (dev->alloc_block == dev->sum_block &&
+		     dev->alloc_page >= dev->chunks_per_summary)) {
 			bi->block_state = YAFFS_BLOCK_STATE_FULL;
 			dev->alloc_block = -1;
 		}
@@ -604,6 +610,8 @@ static int yaffs_write_new_chunk(struct yaffs_dev *dev,
 		/* Copy the data into the robustification buffer */
 		yaffs_handle_chunk_wr_ok(dev, chunk, data, tags);
 
+		yaffs_summary_add(dev, tags, chunk);
+
 	} while (write_ok != YAFFS_OK &&
 		 (yaffs_wr_attempts <= 0 || attempts <= yaffs_wr_attempts));
 
@@ -4938,6 +4946,9 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	if (!yaffs_init_tmp_buffers(dev))
 		init_failed = 1;
 
+	if (!init_failed && !yaffs_summary_init(dev))
+		init_failed = 1;
+
 	dev->cache = NULL;
 	dev->gc_cleanup_list = NULL;
 
@@ -5090,6 +5101,8 @@ void yaffs_deinitialise(struct yaffs_dev *dev)
 
 		kfree(dev->gc_cleanup_list);
 
+		yaffs_summary_deinit(dev);
+
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
 			kfree(dev->temp_buffer[i].buffer);
 
@@ -81,6 +81,7 @@
 /* Pseudo object ids for checkpointing */
 #define YAFFS_OBJECTID_SB_HEADER	0x10
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
+#define YAFFS_OBJECTID_SUMMARY		0x10
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
 #define YAFFS_MAX_SHORT_OP_CACHES	20
@@ -565,6 +566,7 @@ struct yaffs_param {
 	/* Debug control flags. Don't use unless you know what you're doing */
 	int use_header_file_size;	/* Flag to determine if we should use file sizes from the header */
 	int disable_lazy_load;	/* Disable lazy loading on this device */
+	int disable_summary;	/* Don't write block summaries (yaffs2) */
 	int wide_tnodes_disabled;	/* Set to disable wide tnodes */
 	int disable_soft_del;	/* yaffs 1 only: Set to disable the use of softdeletion. */
 
@@ -632,6 +634,11 @@ struct yaffs_dev {
 
 	int checkpoint_blocks_required;	/* Number of blocks needed to store current checkpoint set */
 
+	/* Block summaries */
+	int chunks_per_summary;	/* 0 if summaries are disabled */
+	struct yaffs_summary_tags *sum_tags;
+	int sum_block;		/* Block the tags are collected for, or -1 */
+
 	/* Block Info */
 	struct yaffs_block_info *block_info;
 	u8 *chunk_bits;		/* bitmap of chunks in use */
@@ -734,6 +741,9 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 n_sum_writes;
+	u32 n_sum_scans;	/* blocks scanned from their summary */
+	u32 n_tag_scans;	/* blocks scanned chunk by chunk */
 
 };
 
@@ -0,0 +1,263 @@
+/*
+ * YAFFS: Yet Another Flash File System. A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2010 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Block summaries.
+ *
+ * While a block is being allocated from, the tags of every chunk written
+ * to it are collected in dev->sum_tags. The last chunk of the block is
+ * not handed out by the allocator; once the chunk before it is written
+ * the collected tags are written there. The summary chunk is never marked
+ * in use, so it is accounted as a free chunk just like the chunks skipped
+ * by yaffs_skip_rest_of_block() and is reclaimed when the block is erased.
+ *
+ * The checkpoint still covers clean unmounts. Summaries cover the unclean
+ * case: a backwards scan reads one summary chunk per full block instead of
+ * the tags of every chunk, and only the block that was being written at
+ * the time (and any block abandoned part way through) is scanned chunk by
+ * chunk.
+ */
+
+#include "yaffs_summary.h"
+#include "yaffs_nand.h"
+#include "yaffs_tagsvalidity.h"
+#include "yaffs_getblockinfo.h"
+#include "yaffs_trace.h"
+
+#define YAFFS_SUMMARY_VERSION	1
+
+struct yaffs_summary_header {
+	u32 version;
+	u32 block;
+	u32 seq;
+	u32 sum;
+};
+
+/* What a backwards scan needs from the tags of a chunk */
+struct yaffs_summary_tags {
+	u32 obj_id;
+	u32 chunk_id;
+	u32 n_bytes;
+};
+
+static int yaffs_summary_bytes(struct yaffs_dev *dev)
+{
+	return dev->chunks_per_summary * sizeof(struct yaffs_summary_tags);
+}
+
+static u32 yaffs_summary_sum(struct yaffs_dev *dev)
+{
+	u8 *sum_buffer = (u8 *) dev->sum_tags;
+	int n = yaffs_summary_bytes(dev);
+	u32 sum = 0;
+
+	while (n--)
+		sum += *sum_buffer++;
+
+	return sum;
+}
+
+int yaffs_summary_init(struct yaffs_dev *dev)
+{
+	int chunks = dev->param.chunks_per_block - 1;
+	int n_bytes;
+
+	dev->chunks_per_summary = 0;
+	dev->sum_tags = NULL;
+	dev->sum_block = -1;
+
+	if (!dev->param.is_yaffs2 || dev->param.disable_summary)
+		return YAFFS_OK;
+
+	n_bytes = sizeof(struct yaffs_summary_header) +
+	    chunks * sizeof(struct yaffs_summary_tags);
+	if (chunks < 1 || n_bytes > dev->data_bytes_per_chunk) {
+		yaffs_trace(YAFFS_TRACE_ALWAYS,
+			"Block summary needs %d bytes, chunk holds %d: summaries disabled",
+			n_bytes, dev->data_bytes_per_chunk);
+		return YAFFS_OK;
+	}
+
+	dev->sum_tags = kmalloc(chunks * sizeof(struct yaffs_summary_tags),
+				GFP_NOFS);
+	if (!dev->sum_tags)
+		return YAFFS_FAIL;
+
+	dev->chunks_per_summary = chunks;
+
+	return YAFFS_OK;
+}
+
+void yaffs_summary_deinit(struct yaffs_dev *dev)
+{
+	kfree(dev->sum_tags);
+	dev->sum_tags = NULL;
+	dev->chunks_per_summary = 0;
+	dev->sum_block = -1;
+}
+
+/*
+ * Start collecting tags for a freshly allocated block. Blocks that were
+ * already partly written when we mounted never get a summary since we
+ * don't know the tags of the chunks written before.
+ */
+void yaffs_summary_start(struct yaffs_dev *dev, int blk)
+{
+	if (!dev->chunks_per_summary)
+		return;
+
+	memset(dev->sum_tags, 0, yaffs_summary_bytes(dev));
+	dev->sum_block = blk;
+}
+
+static void yaffs_summary_write(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_header hdr;
+	struct yaffs_ext_tags tags;
+	int n_bytes = yaffs_summary_bytes(dev);
+	int chunk;
+	int result;
+	u8 *buffer;
+
+	hdr.version = YAFFS_SUMMARY_VERSION;
+	hdr.block = blk;
+	hdr.seq = bi->seq_number;
+	hdr.sum = yaffs_summary_sum(dev);
+
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+	memset(buffer, 0xff, dev->data_bytes_per_chunk);
+	memcpy(buffer, &hdr, sizeof(hdr));
+	memcpy(buffer + sizeof(hdr), dev->sum_tags, n_bytes);
+
+	yaffs_init_tags(&tags);
+	tags.obj_id = YAFFS_OBJECTID_SUMMARY;
+	tags.chunk_id = 1;
+	tags.n_bytes = sizeof(hdr) + n_bytes;
+
+	chunk = blk * dev->param.chunks_per_block + dev->chunks_per_summary;
+	result = yaffs_wr_chunk_tags_nand(dev, chunk, buffer, &tags);
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+
+	/*
+	 * A failed summary write costs nothing but scan time: the block is
+	 * scanned chunk by chunk next time.
+	 */
+	if (result == YAFFS_OK)
+		dev->n_sum_writes++;
+	else
+		yaffs_trace(YAFFS_TRACE_ERROR,
+			"Failed to write summary for block %d", blk);
+
+	dev->sum_block = -1;
+}
+
+/*
+ * Record the tags of a chunk that has just been written successfully and
+ * write out the summary once the block is full.
+ */
+void yaffs_summary_add(struct yaffs_dev *dev,
+		       const struct yaffs_ext_tags *tags, int chunk_in_nand)
+{
+	int blk = chunk_in_nand / dev->param.chunks_per_block;
+	int c = chunk_in_nand % dev->param.chunks_per_block;
+	struct yaffs_summary_tags *sum_tags;
+
+	if (!dev->chunks_per_summary || blk != dev->sum_block ||
+	    c >= dev->chunks_per_summary)
+		return;
+
+	sum_tags = &dev->sum_tags[c];
+	sum_tags->obj_id = tags->obj_id;
+	sum_tags->chunk_id = tags->chunk_id;
+	sum_tags->n_bytes = tags->n_bytes;
+
+	if (c == dev->chunks_per_summary - 1)
+		yaffs_summary_write(dev, blk);
+}
+
+/*
+ * Load the summary of a block into dev->sum_tags. Only used while
+ * scanning, before anything is allocated.
+ */
+int yaffs_summary_read(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_header hdr;
+	struct yaffs_ext_tags tags;
+	int n_bytes = yaffs_summary_bytes(dev);
+	int ok = 0;
+	int chunk;
+	u8 *buffer;
+
+	if (!dev->chunks_per_summary)
+		return YAFFS_FAIL;
+
+	dev->sum_block = -1;
+
+	chunk = blk * dev->param.chunks_per_block + dev->chunks_per_summary;
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+
+	if (yaffs_rd_chunk_tags_nand(dev, chunk, buffer, &tags) == YAFFS_OK &&
+	    tags.chunk_used &&
+	    tags.ecc_result <= YAFFS_ECC_RESULT_FIXED &&
+	    tags.obj_id == YAFFS_OBJECTID_SUMMARY &&
+	    tags.chunk_id == 1 &&
+	    tags.n_bytes == sizeof(hdr) + n_bytes &&
+	    tags.seq_number == bi->seq_number) {
+		memcpy(&hdr, buffer, sizeof(hdr));
+		memcpy(dev->sum_tags, buffer + sizeof(hdr), n_bytes);
+
+		ok = hdr.version == YAFFS_SUMMARY_VERSION &&
+		    hdr.block == blk &&
+		    hdr.seq == bi->seq_number &&
+		    hdr.sum == yaffs_summary_sum(dev);
+	}
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+
+	if (!ok)
+		yaffs_trace(YAFFS_TRACE_SCAN,
+			"Block %d has no valid summary", blk);
+
+	return ok ? YAFFS_OK : YAFFS_FAIL;
+}
+
+/*
+ * Make up the tags of a chunk from the summary loaded by
+ * yaffs_summary_read(). The summary chunk itself, and any slot that was
+ * never filled, come back as a chunk the scan will ignore.
+ */
+void yaffs_summary_fetch(struct yaffs_dev *dev,
+			 struct yaffs_ext_tags *tags, int blk, int chunk_in_block)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_tags *sum_tags;
+
+	yaffs_init_tags(tags);
+	tags->chunk_used = 1;
+	tags->ecc_result = YAFFS_ECC_RESULT_NO_ERROR;
+	tags->seq_number = bi->seq_number;
+
+	if (chunk_in_block < dev->chunks_per_summary &&
+	    dev->sum_tags[chunk_in_block].obj_id) {
+		sum_tags = &dev->sum_tags[chunk_in_block];
+		tags->obj_id = sum_tags->obj_id;
+		tags->chunk_id = sum_tags->chunk_id;
+		tags->n_bytes = sum_tags->n_bytes;
+	} else {
+		tags->obj_id = YAFFS_OBJECTID_SUMMARY;
+		tags->chunk_id = 1;
+	}
+}
@@ -0,0 +1,39 @@
+/*
+ * YAFFS: Yet another Flash File System . A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2010 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * Note: Only YAFFS headers are LGPL, YAFFS C code is covered by GPL.
+ */
+
+/*
+ * Block summaries
+ *
+ * The last chunk of each full yaffs2 block holds a copy of the tags of all
+ * the other chunks in the block. A scan after an unclean shutdown reads the
+ * summary instead of the tags of every chunk, and only falls back to reading
+ * each chunk for blocks that were still being written.
+ */
+
+#ifndef __YAFFS_SUMMARY_H__
+#define __YAFFS_SUMMARY_H__
+
+#include "yaffs_guts.h"
+
+int yaffs_summary_init(struct yaffs_dev *dev);
+void yaffs_summary_deinit(struct yaffs_dev *dev);
+void yaffs_summary_start(struct yaffs_dev *dev, int blk);
+void yaffs_summary_add(struct yaffs_dev *dev,
+		       const struct yaffs_ext_tags *tags, int chunk_in_nand);
+int yaffs_summary_read(struct yaffs_dev *dev, int blk);
+void yaffs_summary_fetch(struct yaffs_dev *dev,
+			 struct yaffs_ext_tags *tags, int blk, int chunk_in_block);
+
+#endif
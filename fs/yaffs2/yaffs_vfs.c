@@ -1777,6 +1777,8 @@ struct yaffs_options {
 	int lazy_loading_overridden;
 	int empty_lost_and_found;
 	int empty_lost_and_found_overridden;
+	int summary_enabled;
+	int summary_overridden;
 };
 
 #define MAX_OPT_LEN 30
@@ -1824,6 +1826,12 @@ static int yaffs_parse_options(struct yaffs_options *options,
 		} else if (!strcmp(cur_opt, "empty-lost-and-found-on")) {
 			options->empty_lost_and_found = 1;
 			options->empty_lost_and_found_overridden = 1;
+		} else if (!strcmp(cur_opt, "summary-off")) {
+			options->summary_enabled = 0;
+			options->summary_overridden = 1;
+		} else if (!strcmp(cur_opt, "summary-on")) {
+			options->summary_enabled = 1;
+			options->summary_overridden = 1;
 		} else if (!strcmp(cur_opt, "no-cache")) {
 			options->no_cache = 1;
 		} else if (!strcmp(cur_opt, "no-checkpoint-read")) {
@@ -2251,6 +2259,12 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	if (options.tags_ecc_overridden)
 		param->no_tags_ecc = !options.tags_ecc_on;
 
+#ifdef CONFIG_YAFFS_DISABLE_SUMMARY
+	param->disable_summary = 1;
+#endif
+	if (options.summary_overridden)
+		param->disable_summary = !options.summary_enabled;
+
 #ifdef CONFIG_YAFFS_EMPTY_LOST_AND_FOUND
 	param->empty_lost_n_found = 1;
 #endif
@@ -2452,6 +2466,8 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 			param->n_reserved_blocks);
 	buf += sprintf(buf, "always_check_erased... %d\n",
 			param->always_check_erased);
+	buf += sprintf(buf, "disable_summary....... %d\n",
+			param->disable_summary);
 
 	return buf;
 }
@@ -2496,6 +2512,9 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_tags_ecc_unfixed.... %u\n",
 		    dev->n_tags_ecc_unfixed);
 	buf += sprintf(buf, "cache_hits............ %u\n", dev->cache_hits);
+	buf += sprintf(buf, "n_sum_writes.......... %u\n", dev->n_sum_writes);
+	buf += sprintf(buf, "n_sum_scans........... %u\n", dev->n_sum_scans);
+	buf += sprintf(buf, "n_tag_scans........... %u\n", dev->n_tag_scans);
 	buf +=
 	    sprintf(buf, "n_deleted_files....... %u\n", dev->n_deleted_files);
 	buf +=
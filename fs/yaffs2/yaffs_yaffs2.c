@@ -20,6 +20,7 @@
 #include "yaffs_getblockinfo.h"
 #include "yaffs_verify.h"
 #include "yaffs_attribs.h"
+#include "yaffs_summary.h"
 
 /*
  * Checkpoints are really no benefit on very small partitions.
@@ -983,6 +984,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	int found_chunks;
 	int equiv_id;
 	int alloc_failed = 0;
+	int summary_available;
 
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
@@ -1102,6 +1104,15 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		deleted = 0;
 
+		/* A full block may carry a summary of its tags in the last
+		 * chunk, which saves reading the tags of every chunk.
+		 */
+		summary_available = yaffs_summary_read(dev, blk);
+		if (summary_available)
+			dev->n_sum_scans++;
+		else
+			dev->n_tag_scans++;
+
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
 		for (c = dev->param.chunks_per_block - 1;
@@ -1114,8 +1125,13 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 			chunk = blk * dev->param.chunks_per_block + c;
 
-			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
-							  &tags);
+			if (summary_available) {
+				yaffs_summary_fetch(dev, &tags, blk, c);
+				result = YAFFS_OK;
+			} else {
+				result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
+								  &tags);
+			}
 
 			/* Let's have a good look at this chunk... */
 
@@ -1177,6 +1193,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 				dev->n_free_chunks++;
 
 			} else if (tags.obj_id > YAFFS_MAX_OBJECT_ID ||
+				   tags.obj_id == YAFFS_OBJECTID_SUMMARY ||
 				   tags.chunk_id > YAFFS_MAX_CHUNK_ID ||
 				   (tags.chunk_id > 0
 				    && tags.n_bytes > dev->data_bytes_per_chunk)
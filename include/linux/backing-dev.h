@@ -91,6 +91,7 @@ struct backing_dev_info {
 
 	struct prop_local_percpu completions;
 	int dirty_exceeded;
+	unsigned long dirty_sleep;	/* last time a dirtier was throttled */
 
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
@@ -0,0 +1,76 @@
+#ifndef BLK_MQ_H
+#define BLK_MQ_H
+
+#include <linux/blkdev.h>
+
+struct blk_mq_hw_ctx;
+
+/*
+ * Dispatch a batch of bios to a hardware context. The list is private to
+ * the callee, which must complete every bio on it.
+ */
+typedef void (blk_mq_queue_bios_fn)(struct blk_mq_hw_ctx *, struct bio_list *);
+
+struct blk_mq_ops {
+	blk_mq_queue_bios_fn	*queue_bios;
+};
+
+/*
+ * Per-cpu software submission queue. Bios are staged here under a lock
+ * that is only ever contended by the hardware context draining it.
+ */
+struct blk_mq_ctx {
+	spinlock_t		lock;
+	struct bio_list		list;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+	struct blk_mq_hw_ctx	*hctx;
+
+	unsigned long		queued;
+	unsigned long		dispatched;
+} ____cacheline_aligned_in_smp;
+
+/*
+ * Hardware dispatch context. One or more software queues map onto each
+ * hardware context; only one CPU at a time runs a given context.
+ */
+struct blk_mq_hw_ctx {
+	unsigned long		state;		/* BLK_MQ_S_* flags */
+	unsigned long		*ctx_map;	/* software queues with bios */
+
+	struct blk_mq_ctx	**ctxs;
+	unsigned int		nr_ctx;
+	unsigned int		queue_num;
+
+	struct request_queue	*queue;
+	struct work_struct	run_work;
+	void			*driver_data;
+
+	unsigned long		runs;
+	unsigned long		dispatched;
+	unsigned long		max_batch;
+} ____cacheline_aligned_in_smp;
+
+enum {
+	BLK_MQ_S_RUNNING	= 0,
+};
+
+/* Bios staged in a plug before they are pushed to the software queues */
+#define BLK_MQ_MAX_PLUGGED	32
+
+extern int blk_mq_init_queue(struct request_queue *, struct blk_mq_ops *,
+			     unsigned int);
+extern void blk_mq_run_queues(struct request_queue *, bool);
+
+static inline struct blk_mq_hw_ctx *blk_mq_hctx(struct request_queue *q,
+						unsigned int index)
+{
+	return q->queue_hw_ctx[index];
+}
+
+#define queue_for_each_hw_ctx(q, hctx, i)				\
+	for ((i) = 0; (i) < (q)->nr_hw_queues &&			\
+	     ({ hctx = (q)->queue_hw_ctx[i]; 1; }); (i)++)
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _LINUX_LATENCY_TEST_H
+#define _LINUX_LATENCY_TEST_H
+
+/*
+ * Helpers for the latency test modules: samples are kept as u32
+ * nanoseconds and reported as percentiles with lib/latency_test.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+
+/* Time from start to end in ns, clamped to what a sample can hold */
+static inline u32 latency_test_ns(ktime_t start, ktime_t end)
+{
+	s64 ns = ktime_to_ns(ktime_sub(end, start));
+
+	return clamp_t(s64, ns, 0, UINT_MAX);
+}
+
+extern void latency_test_report(const char *name, const char *what,
+				u32 *ns, unsigned int nr);
+
+#endif /* _LINUX_LATENCY_TEST_H */
@@ -0,0 +1,71 @@
+/*
+ * MCS lock: a queued spinlock for optimistic spinners
+ *
+ * Every cpu spinning for the lock adds a node on its stack to the tail of
+ * a queue and then spins on a flag in its own node only, until the cpu
+ * ahead of it in the queue hands the lock over. So a cacheline is only
+ * written when the lock changes hands, instead of all the spinners
+ * bouncing the cacheline of the lock word between them.
+ *
+ * Waiting in the queue can not be aborted, so spinners must only hold
+ * the lock for a bounded time and with preemption disabled, and give it
+ * up when they need to reschedule.
+ */
+#ifndef _LINUX_MCS_SPINLOCK_H
+#define _LINUX_MCS_SPINLOCK_H
+
+#include <linux/compiler.h>
+#include <linux/mutex.h>
+#include <asm/system.h>
+
+struct mcs_spinlock {
+	struct mcs_spinlock *next;
+	int locked;		/* 1 if lock acquired */
+};
+
+/*
+ * Take the lock whose queue tail is *lock, using node as this cpu's
+ * entry in the queue until mcs_spin_unlock().
+ */
+static inline
+void mcs_spin_lock(struct mcs_spinlock **lock, struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *prev;
+
+	node->locked = 0;
+	node->next = NULL;
+
+	prev = xchg(lock, node);
+	if (likely(prev == NULL))
+		return;
+	ACCESS_ONCE(prev->next) = node;
+
+	/* Wait until the lock holder passes the lock down */
+	while (!ACCESS_ONCE(node->locked))
+		arch_mutex_cpu_relax();
+	/* Nothing of the critical section may be done before we own it */
+	smp_mb();
+}
+
+/*
+ * Release the lock, handing it to the next cpu in the queue if any.
+ */
+static inline
+void mcs_spin_unlock(struct mcs_spinlock **lock, struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *next = ACCESS_ONCE(node->next);
+
+	if (likely(!next)) {
+		/* Release the lock by setting it to NULL */
+		if (cmpxchg(lock, node, NULL) == node)
+			return;
+		/* Wait until the next cpu linked itself in */
+		while (!(next = ACCESS_ONCE(node->next)))
+			arch_mutex_cpu_relax();
+	}
+	/* The critical section must be done before the next one starts */
+	smp_mb();
+	ACCESS_ONCE(next->locked) = 1;
+}
+
+#endif /* _LINUX_MCS_SPINLOCK_H */
@@ -21,6 +21,18 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+/**
+ * page_lruvec - which lruvec holds the page's LRU lists?
+ * @page: the page to look up
+ *
+ * The page's LRU list and reclaim statistics are protected by the
+ * lru_lock of the lruvec returned.
+ */
+static inline struct lruvec *page_lruvec(struct page *page)
+{
+	return zone_lruvec(page_zone(page), page_to_pfn(page));
+}
+
 static inline void
 __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 		       struct list_head *head)
@@ -33,7 +45,7 @@ __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
-	__add_page_to_lru_list(zone, page, l, &zone->lru[l].list);
+	__add_page_to_lru_list(zone, page, l, &page_lruvec(page)->lists[l]);
 }
 
 static inline void
@@ -62,7 +62,7 @@ struct free_area {
 struct pglist_data;
 
 /*
- * zone->lock and zone->lru_lock are two of the hottest locks in the kernel.
+ * zone->lock and the lru_locks are some of the hottest locks in the kernel.
  * So add a wild amount of padding here to ensure that they fall into separate
  * cachelines.  There are very few zone structures in the machine, so space
  * consumption is not a concern here.
@@ -106,6 +106,8 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaults activated as working set */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -175,15 +177,29 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * The pcp-lists also hold blocks up to PAGE_ALLOC_COSTLY_ORDER, so that
+ * slabs, kernel stacks and network buffers don't take zone->lock either.
+ * There is one list per order and migrate type, and count, high and
+ * batch are in base pages.
+ */
+#define NR_PCP_ORDERS		(PAGE_ALLOC_COSTLY_ORDER + 1)
+#define NR_PCP_LISTS		(MIGRATE_PCPTYPES * NR_PCP_ORDERS)
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, one per order and migrate type */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
+static inline int pcp_list_index(unsigned int order, int migratetype)
+{
+	return order * MIGRATE_PCPTYPES + migratetype;
+}
+
 struct per_cpu_pageset {
 	struct per_cpu_pages pcp;
 #ifdef CONFIG_NUMA
@@ -281,6 +297,28 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+/*
+ * The LRU lists of a zone are split into NR_ZONE_LRUVECS lruvecs, each
+ * with its own lock, so that reclaimers and pagevec drains on different
+ * cpus mostly take different locks. A page belongs to the lruvec of its
+ * pageblock, see zone_lruvec(): compound pages and the pfn ranges that
+ * compaction scans stay within one lruvec. The memory controller keeps
+ * the pages of a zone on its own lists as well, under the same lock, so
+ * a zone has a single lruvec when it is configured.
+ */
+#if defined(CONFIG_SMP) && !defined(CONFIG_CGROUP_MEM_RES_CTLR)
+#define LRUVECS_SHIFT		2
+#else
+#define LRUVECS_SHIFT		0
+#endif
+#define NR_ZONE_LRUVECS		(1 << LRUVECS_SHIFT)
+
+struct lruvec {
+	spinlock_t		lru_lock;
+	struct list_head	lists[NR_LRU_LISTS];
+	struct zone_reclaim_stat reclaim_stat;
+} ____cacheline_aligned_in_smp;
+
 struct zone {
 	/* Fields commonly accessed by the page allocator */
 
@@ -340,17 +378,20 @@ struct zone {
 	 */
 	unsigned int		compact_considered;
 	unsigned int		compact_defer_shift;
+
+	/* Where background compaction continues on its next run */
+	unsigned long		compact_cached_migrate_pfn;
+	unsigned long		compact_cached_free_pfn;
 #endif
 
 	ZONE_PADDING(_pad1_)
 
 	/* Fields commonly accessed by the page reclaim scanner */
-	spinlock_t		lru_lock;	
-	struct zone_lru {
-		struct list_head list;
-	} lru[NR_LRU_LISTS];
+	struct lruvec		lruvec[NR_ZONE_LRUVECS];
+	unsigned int		lruvec_cursor;	/* next lruvec to shrink */
 
-	struct zone_reclaim_stat reclaim_stat;
+	/* Evictions and activations of inactive file pages, see workingset.c */
+	atomic_long_t		inactive_age;
 
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
@@ -460,6 +501,16 @@ static inline int zone_is_oom_locked(const struct zone *zone)
 	return test_bit(ZONE_OOM_LOCKED, &zone->flags);
 }
 
+/* The lruvec that holds the LRU pages of pfn, which must be in zone */
+static inline struct lruvec *zone_lruvec(struct zone *zone, unsigned long pfn)
+{
+	return &zone->lruvec[(pfn >> pageblock_order) & (NR_ZONE_LRUVECS - 1)];
+}
+
+#define for_each_zone_lruvec(lruvec, zone)				\
+	for (lruvec = (zone)->lruvec;					\
+	     lruvec < (zone)->lruvec + NR_ZONE_LRUVECS; lruvec++)
+
 /*
  * The "priority" of VM scanning is how much of the queues we will scan in one
  * go. A value of 12 for DEF_PRIORITY implies that we will scan 1/4096th of the
@@ -642,6 +693,12 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
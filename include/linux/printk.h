@@ -92,7 +92,16 @@ extern asmlinkage __printf(1, 2)
 void early_printk(const char *fmt, ...);
 
 extern int printk_needs_cpu(int cpu);
+#ifdef CONFIG_IRQ_WORK
+static inline void printk_tick(void)
+{
+}
+#else
 extern void printk_tick(void);
+#endif
+
+extern void printk_emergency_enter(void);
+extern void printk_emergency_exit(void);
 
 #ifdef CONFIG_PRINTK
 asmlinkage __printf(1, 0)
@@ -120,6 +129,7 @@ extern int dmesg_restrict;
 extern int kptr_restrict;
 
 void log_buf_kexec_setup(void);
+void log_buf_kexec_save(void);
 void __init setup_log_buf(int early);
 #else
 static inline __printf(1, 0)
@@ -151,6 +161,10 @@ static inline void log_buf_kexec_setup(void)
 {
 }
 
+static inline void log_buf_kexec_save(void)
+{
+}
+
 static inline void setup_log_buf(int early)
 {
 }
@@ -24,6 +24,14 @@ struct rw_semaphore {
 	__s32			activity;
 	raw_spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	/*
+	 * Write owner, for spinning while it runs, and the queue of the
+	 * spinners, so that only one of them polls activity at a time.
+	 */
+	struct task_struct	*owner;
+	struct mcs_spinlock	*osq;
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map dep_map;
 #endif
@@ -141,6 +141,13 @@ extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long get_avg_nr_running(unsigned int cpu);
 extern unsigned long avg_nr_running(void);
+#ifdef CONFIG_SMP
+extern unsigned long sched_get_cpu_util(int cpu);
+extern unsigned long sched_get_cpu_load(int cpu);
+#else
+static inline unsigned long sched_get_cpu_util(int cpu) { return 0; }
+static inline unsigned long sched_get_cpu_load(int cpu) { return 0; }
+#endif
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
 
@@ -1206,6 +1213,26 @@ struct sched_statistics {
 };
 #endif
 
+#ifdef CONFIG_SMP
+/*
+ * Per-entity load tracking. Time is split in periods of 1024us; the
+ * time an entity was runnable (queued or running) and running in each
+ * period adds up geometrically, with the period before contributing y
+ * times as much, where y^32 = 1/2. The sums converge to LOAD_AVG_MAX,
+ * so a task that was always runnable has load_avg_contrib equal to its
+ * weight, and one that always ran has util_avg SCHED_POWER_SCALE.
+ */
+struct sched_avg {
+	u32			runnable_avg_sum;
+	u32			running_avg_sum;
+	u32			avg_period;
+	u64			last_update;
+	u64			blocked_since;	/* rq->clock at sleep */
+	unsigned long		load_avg_contrib;
+	unsigned long		util_avg;
+};
+#endif
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1219,6 +1246,10 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+#ifdef CONFIG_SMP
+	struct sched_avg	avg;
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
@@ -1824,6 +1855,7 @@ extern int task_free_unregister(struct notifier_block *n);
 #define PF_FROZEN	0x00010000	/* frozen for system suspend */
 #define PF_FSTRANS	0x00020000	/* inside a filesystem transaction */
 #define PF_KSWAPD	0x00040000	/* I am kswapd */
+#define PF_BG_WRITEBACK	0x00080000	/* doing background or kupdate writeback */
 #define PF_LESS_THROTTLE 0x00100000	/* Throttle me less: I clean memory */
 #define PF_KTHREAD	0x00200000	/* I am a kernel thread */
 #define PF_RANDOMIZE	0x00400000	/* randomize virtual address space */
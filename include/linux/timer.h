@@ -22,6 +22,8 @@ struct timer_list {
 	unsigned long data;
 
 	int slack;
+	/* Bucket of the timer wheel the timer is queued in */
+	unsigned int idx;
 
 #ifdef CONFIG_TIMER_STATS
 	int start_pid;
@@ -0,0 +1,58 @@
+#ifndef _LINUX_TRACE_MMAP_H
+#define _LINUX_TRACE_MMAP_H
+
+/*
+ * Mapping a per-cpu trace buffer
+ *
+ * mmap() of per_cpu/cpuN/trace_pipe_raw maps, read only, a meta page
+ * followed by the sub-buffers of the buffer of that cpu, in the order
+ * of their ids. A sub-buffer has the layout of events/header_page: a
+ * 64-bit time stamp, the commit field and the events, each of which
+ * has the layout of events/header_event.
+ *
+ * TRACE_MMAP_IOCTL_GET_READER consumes the events handed out by the
+ * previous call and hands out the following ones, without copying
+ * them: they are read in place from offset reader.read up to
+ * reader.commit of the data of the sub-buffer reader.id. The ioctl
+ * does not block: it fails with EAGAIN when there is nothing to read.
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/**
+ * struct trace_buffer_meta - the first page of a mapped trace buffer
+ * @meta_page_size:	size of this page
+ * @meta_struct_len:	size of this structure
+ * @subbuf_size:	size of a sub-buffer
+ * @nr_subbufs:		number of sub-buffers following the meta page
+ * @reader.lost_events:	events overwritten before this sub-buffer
+ * @reader.id:		id of the sub-buffer of the reader
+ * @reader.read:	offset of the first event handed out in its data
+ * @reader.commit:	offset of the end of the events handed out
+ * @entries:		events in the buffer
+ * @overrun:		events overwritten
+ * @read:		events consumed
+ */
+struct trace_buffer_meta {
+	__u32	meta_page_size;
+	__u32	meta_struct_len;
+	__u32	subbuf_size;
+	__u32	nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+		__u32	commit;
+		__u32	__reserved;
+	} reader;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('R', 0x20)
+
+#endif /* _LINUX_TRACE_MMAP_H */
@@ -11,6 +11,7 @@
 #include <linux/lockdep.h>
 #include <linux/threads.h>
 #include <linux/atomic.h>
+#include <linux/cpumask.h>
 
 struct workqueue_struct;
 
@@ -257,6 +258,7 @@ enum {
 
 	WQ_DRAINING		= 1 << 6, /* internal: workqueue is draining */
 	WQ_RESCUER		= 1 << 7, /* internal: workqueue has rescuer */
+	__WQ_ORDERED		= 1 << 8, /* internal: workqueue is ordered */
 
 	WQ_MAX_ACTIVE		= 512,	  /* I like 512, better ideas? */
 	WQ_MAX_UNBOUND_PER_CPU	= 4,	  /* 4 * #cpus for unbound wq */
@@ -267,6 +269,15 @@ enum {
 #define WQ_UNBOUND_MAX_ACTIVE	\
 	max_t(int, WQ_MAX_ACTIVE, num_possible_cpus() * WQ_MAX_UNBOUND_PER_CPU)
 
+/*
+ * Attributes of the workers serving an unbound workqueue.  Unbound
+ * workqueues with the same attributes share their worker pools.
+ */
+struct workqueue_attrs {
+	int			nice;		/* nice level of the workers */
+	cpumask_var_t		cpumask;	/* cpus the workers may run on */
+};
+
 /*
  * System-wide workqueues which are always present.
  *
@@ -348,23 +359,31 @@ __alloc_workqueue_key(const char *fmt, unsigned int flags, int max_active,
  *
  * Allocate an ordered workqueue.  An ordered workqueue executes at
  * most one work item at any given time in the queued order.  They are
- * implemented as unbound workqueues with @max_active of one.
+ * implemented as unbound workqueues with @max_active of one which,
+ * unlike other unbound workqueues, queue all work items to a single
+ * worker pool regardless of the cpu they are queued on.
  *
  * RETURNS:
  * Pointer to the allocated workqueue on success, %NULL on failure.
  */
 #define alloc_ordered_workqueue(fmt, flags, args...)		\
-	alloc_workqueue(fmt, WQ_UNBOUND | (flags), 1, ##args)
+	alloc_workqueue(fmt, WQ_UNBOUND | __WQ_ORDERED | (flags), 1, ##args)
 
 #define create_workqueue(name)					\
 	alloc_workqueue((name), WQ_MEM_RECLAIM, 1)
 #define create_freezable_workqueue(name)			\
-	alloc_workqueue((name), WQ_FREEZABLE | WQ_UNBOUND | WQ_MEM_RECLAIM, 1)
+	alloc_workqueue((name), WQ_FREEZABLE | WQ_UNBOUND | __WQ_ORDERED | \
+			WQ_MEM_RECLAIM, 1)
 #define create_singlethread_workqueue(name)			\
-	alloc_workqueue((name), WQ_UNBOUND | WQ_MEM_RECLAIM, 1)
+	alloc_ordered_workqueue((name), WQ_MEM_RECLAIM)
 
 extern void destroy_workqueue(struct workqueue_struct *wq);
 
+extern struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask);
+extern void free_workqueue_attrs(struct workqueue_attrs *attrs);
+extern int apply_workqueue_attrs(struct workqueue_struct *wq,
+				 const struct workqueue_attrs *attrs);
+
 extern int queue_work(struct workqueue_struct *wq, struct work_struct *work);
 extern int queue_work_on(int cpu, struct workqueue_struct *wq,
 			struct work_struct *work);
@@ -426,6 +426,63 @@ TRACE_EVENT(sched_pi_setprio,
 			__entry->oldprio, __entry->newprio)
 );
 
+#ifdef CONFIG_SMP
+/*
+ * Tracepoint for the per-entity load average of a task, on each decay.
+ */
+TRACE_EVENT(sched_pelt_se,
+
+	TP_PROTO(struct task_struct *tsk),
+
+	TP_ARGS(tsk),
+
+	TP_STRUCT__entry(
+		__array( char,	comm,	TASK_COMM_LEN	)
+		__field( pid_t,	pid			)
+		__field( int,	cpu			)
+		__field( unsigned long,	load		)
+		__field( unsigned long,	util		)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, tsk->comm, TASK_COMM_LEN);
+		__entry->pid		= tsk->pid;
+		__entry->cpu		= task_cpu(tsk);
+		__entry->load		= tsk->se.avg.load_avg_contrib;
+		__entry->util		= tsk->se.avg.util_avg;
+	),
+
+	TP_printk("comm=%s pid=%d cpu=%d load=%lu util=%lu",
+			__entry->comm, __entry->pid, __entry->cpu,
+			__entry->load, __entry->util)
+);
+
+/*
+ * Tracepoint for the CFS load and utilisation averages of a cpu.
+ */
+TRACE_EVENT(sched_pelt_cpu,
+
+	TP_PROTO(int cpu, unsigned long load, unsigned long util),
+
+	TP_ARGS(cpu, load, util),
+
+	TP_STRUCT__entry(
+		__field( int,		cpu		)
+		__field( unsigned long,	load		)
+		__field( unsigned long,	util		)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->load		= load;
+		__entry->util		= util;
+	),
+
+	TP_printk("cpu=%d load=%lu util=%lu",
+			__entry->cpu, __entry->load, __entry->util)
+);
+#endif /* CONFIG_SMP */
+
 #endif /* _TRACE_SCHED_H */
 
 /* This part must be outside protection */
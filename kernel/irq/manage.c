@@ -111,6 +111,41 @@ void irq_set_thread_affinity(struct irq_desc *desc)
 	}
 }
 
+/*
+ * Wake the threads that were told to adjust their affinity, so that
+ * they move before the next interrupt arrives instead of handling it
+ * on the old cpu. Called without desc->lock, which must not nest the
+ * runqueue locks; it is only retaken to find the threads one by one.
+ */
+static void irq_wake_thread_affinity(struct irq_desc *desc)
+{
+	struct irqaction *action;
+	struct task_struct *t;
+	unsigned long flags;
+	int i, n;
+
+	for (n = 0; ; n++) {
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		action = desc->action;
+		for (i = 0; action && i < n; i++)
+			action = action->next;
+		t = NULL;
+		if (action && action->thread &&
+		    test_bit(IRQTF_AFFINITY, &action->thread_flags)) {
+			t = action->thread;
+			get_task_struct(t);
+		}
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+		if (!action)
+			break;
+		if (t) {
+			wake_up_process(t);
+			put_task_struct(t);
+		}
+	}
+}
+
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 static inline bool irq_can_move_pcntxt(struct irq_data *data)
 {
@@ -189,6 +224,7 @@ int irq_set_affinity(unsigned int irq, const struct cpumask *mask)
 	raw_spin_lock_irqsave(&desc->lock, flags);
 	ret =  __irq_set_affinity_locked(irq_desc_get_irq_data(desc), mask);
 	raw_spin_unlock_irqrestore(&desc->lock, flags);
+	irq_wake_thread_affinity(desc);
 	return ret;
 }
 
@@ -330,6 +366,7 @@ int irq_select_affinity_usr(unsigned int irq, struct cpumask *mask)
 	raw_spin_lock_irqsave(&desc->lock, flags);
 	ret = setup_affinity(irq, desc, mask);
 	raw_spin_unlock_irqrestore(&desc->lock, flags);
+	irq_wake_thread_affinity(desc);
 	return ret;
 }
 
@@ -618,8 +655,44 @@ static irqreturn_t irq_nested_primary_handler(int irq, void *dev_id)
 	return IRQ_NONE;
 }
 
-static int irq_wait_for_interrupt(struct irqaction *action)
+#ifdef CONFIG_SMP
+/*
+ * Check whether we need to chasnge the affinity of the interrupt thread.
+ */
+static void
+irq_thread_check_affinity(struct irq_desc *desc, struct irqaction *action)
+{
+	cpumask_var_t mask;
+
+	if (!test_and_clear_bit(IRQTF_AFFINITY, &action->thread_flags))
+		return;
+
+	/*
+	 * In case we are out of memory we set IRQTF_AFFINITY again and
+	 * try again next time
+	 */
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL)) {
+		set_bit(IRQTF_AFFINITY, &action->thread_flags);
+		return;
+	}
+
+	raw_spin_lock_irq(&desc->lock);
+	cpumask_copy(mask, desc->irq_data.affinity);
+	raw_spin_unlock_irq(&desc->lock);
+
+	set_cpus_allowed_ptr(current, mask);
+	free_cpumask_var(mask);
+}
+#else
+static inline void
+irq_thread_check_affinity(struct irq_desc *desc, struct irqaction *action) { }
+#endif
+
+static int irq_wait_for_interrupt(struct irq_desc *desc,
+				  struct irqaction *action)
 {
+	bool moved = false;
+
 	set_current_state(TASK_INTERRUPTIBLE);
 
 	while (!kthread_should_stop()) {
@@ -629,8 +702,22 @@ static int irq_wait_for_interrupt(struct irqaction *action)
 			__set_current_state(TASK_RUNNING);
 			return 0;
 		}
+		/*
+		 * Follow an affinity change right away instead of on
+		 * the next interrupt, which would then run on the old
+		 * cpu while the hard interrupt arrives on the new one.
+		 * Only once per wakeup, the check can fail for memory.
+		 */
+		if (!moved && test_bit(IRQTF_AFFINITY, &action->thread_flags)) {
+			__set_current_state(TASK_RUNNING);
+			irq_thread_check_affinity(desc, action);
+			set_current_state(TASK_INTERRUPTIBLE);
+			moved = true;
+			continue;
+		}
 		schedule();
 		set_current_state(TASK_INTERRUPTIBLE);
+		moved = false;
 	}
 	__set_current_state(TASK_RUNNING);
 	return -1;
@@ -690,39 +777,6 @@ out_unlock:
 	chip_bus_sync_unlock(desc);
 }
 
-#ifdef CONFIG_SMP
-/*
- * Check whether we need to chasnge the affinity of the interrupt thread.
- */
-static void
-irq_thread_check_affinity(struct irq_desc *desc, struct irqaction *action)
-{
-	cpumask_var_t mask;
-
-	if (!test_and_clear_bit(IRQTF_AFFINITY, &action->thread_flags))
-		return;
-
-	/*
-	 * In case we are out of memory we set IRQTF_AFFINITY again and
-	 * try again next time
-	 */
-	if (!alloc_cpumask_var(&mask, GFP_KERNEL)) {
-		set_bit(IRQTF_AFFINITY, &action->thread_flags);
-		return;
-	}
-
-	raw_spin_lock_irq(&desc->lock);
-	cpumask_copy(mask, desc->irq_data.affinity);
-	raw_spin_unlock_irq(&desc->lock);
-
-	set_cpus_allowed_ptr(current, mask);
-	free_cpumask_var(mask);
-}
-#else
-static inline void
-irq_thread_check_affinity(struct irq_desc *desc, struct irqaction *action) { }
-#endif
-
 /*
  * Interrupts which are not explicitely requested as threaded
  * interrupts rely on the implicit bh/preempt disable of the hard irq
@@ -779,7 +833,7 @@ static int irq_thread(void *data)
 	sched_setscheduler(current, SCHED_FIFO, &param);
 	current->irqaction = action;
 
-	while (!irq_wait_for_interrupt(action)) {
+	while (!irq_wait_for_interrupt(desc, action)) {
 
 		irq_thread_check_affinity(desc, action);
 
@@ -947,6 +1001,11 @@ __setup_irq(unsigned int irq, struct irq_desc *desc, struct irqaction *new)
 		 */
 		get_task_struct(t);
 		new->thread = t;
+		/*
+		 * Have the thread take the affinity of the interrupt
+		 * before it handles the first one.
+		 */
+		set_bit(IRQTF_AFFINITY, &new->thread_flags);
 	}
 
 	if (!alloc_cpumask_var(&mask, GFP_KERNEL)) {
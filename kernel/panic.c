@@ -11,6 +11,7 @@
 #include <linux/debug_locks.h>
 #include <linux/interrupt.h>
 #include <linux/kmsg_dump.h>
+#include <linux/console.h>
 #include <linux/kallsyms.h>
 #include <linux/notifier.h>
 #include <linux/module.h>
@@ -79,6 +80,8 @@ NORET_TYPE void panic(const char * fmt, ...)
 	 */
 	preempt_disable();
 
+	/* Don't leave the messages to a thread that may never run again */
+	printk_emergency_enter();
 	console_verbose();
 	bust_spinlocks(1);
 	va_start(args, fmt);
@@ -104,6 +107,7 @@ NORET_TYPE void panic(const char * fmt, ...)
 	 * situation.
 	 */
 	smp_send_stop();
+	console_flush_on_panic();
 
 	atomic_notifier_call_chain(&panic_notifier_list, 0, buf);
 
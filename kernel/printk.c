@@ -41,6 +41,11 @@
 #include <linux/cpu.h>
 #include <linux/notifier.h>
 #include <linux/rculist.h>
+#include <linux/kthread.h>
+#include <linux/irq_work.h>
+#include <linux/hardirq.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
 
 #include <asm/uaccess.h>
 
@@ -95,24 +100,6 @@ EXPORT_SYMBOL_GPL(console_drivers);
  */
 static int console_locked, console_suspended;
 
-/*
- * logbuf_lock protects log_buf, log_start, log_end, con_start and logged_chars
- * It is also used in interesting ways to provide interlocking in
- * console_unlock();.
- */
-static DEFINE_RAW_SPINLOCK(logbuf_lock);
-
-#define LOG_BUF_MASK (log_buf_len-1)
-#define LOG_BUF(idx) (log_buf[(idx) & LOG_BUF_MASK])
-
-/*
- * The indices into log_buf are not constrained to log_buf_len - they
- * must be masked before subscripting
- */
-static unsigned log_start;	/* Index into log_buf: next char to be read by syslog() */
-static unsigned con_start;	/* Index into log_buf: next char to be sent to consoles */
-static unsigned log_end;	/* Index into log_buf: most-recently-written-char + 1 */
-
 /*
  * If exclusive_console is non-NULL then only this console is to be printed to.
  */
@@ -142,14 +129,203 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/*
+ * Once the system is up, printk() only stores the message and leaves the
+ * console output to the printk thread, so that a burst of messages on a
+ * slow console doesn't stall whoever happens to print them. Messages are
+ * written out by the caller as before during boot and shutdown, when
+ * printk.synchronous is set, while oopsing and between
+ * printk_emergency_enter() and printk_emergency_exit().
+ */
+static struct task_struct *printk_kthread;
+static atomic_t printk_emergency = ATOMIC_INIT(0);
+
+static bool printk_sync;
+module_param_named(synchronous, printk_sync, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(synchronous, "print to the consoles from printk() itself");
+
+static bool printk_offload(void)
+{
+	return printk_kthread && !printk_sync && !oops_in_progress &&
+	       !atomic_read(&printk_emergency) &&
+	       system_state == SYSTEM_RUNNING;
+}
+
+/**
+ * printk_emergency_enter - write messages out from printk() itself
+ *
+ * Until the matching printk_emergency_exit(), printk() prints to the
+ * consoles before it returns instead of waking up the printk thread,
+ * which may never get to run again, e.g. on panic.
+ */
+void printk_emergency_enter(void)
+{
+	atomic_inc(&printk_emergency);
+}
+
+void printk_emergency_exit(void)
+{
+	atomic_dec(&printk_emergency);
+}
+
+/*
+ * Work printk() can't do in its own context, because it may be called
+ * with the runqueue locks held or from NMI, is left to an irq_work, or
+ * to the next tick on architectures without it.
+ */
+#define PRINTK_PENDING_WAKEUP	0x01
+#define PRINTK_PENDING_OUTPUT	0x02
+
+static DEFINE_PER_CPU(int, printk_pending);
+
+static void printk_work_func(struct irq_work *work)
+{
+	int pending = __this_cpu_xchg(printk_pending, 0);
+
+	if (pending & PRINTK_PENDING_OUTPUT) {
+		if (printk_offload())
+			wake_up_process(printk_kthread);
+		else if (console_trylock())
+			console_unlock();
+	}
+
+	if (pending & PRINTK_PENDING_WAKEUP)
+		wake_up_interruptible(&log_wait);
+}
+
+#ifdef CONFIG_IRQ_WORK
+static DEFINE_PER_CPU(struct irq_work, printk_work) = {
+	.func = printk_work_func,
+};
+#else
+void printk_tick(void)
+{
+	if (__this_cpu_read(printk_pending))
+		printk_work_func(NULL);
+}
+#endif
+
+static void printk_defer(int pending)
+{
+	preempt_disable();
+	this_cpu_or(printk_pending, pending);
+#ifdef CONFIG_IRQ_WORK
+	irq_work_queue(&__get_cpu_var(printk_work));
+#endif
+	preempt_enable();
+}
+
+int printk_needs_cpu(int cpu)
+{
+	/* A cpu going offline won't get to run its irq_work or tick */
+	if (cpu_is_offline(cpu) && __this_cpu_read(printk_pending))
+		printk_work_func(NULL);
+	return __this_cpu_read(printk_pending);
+}
+
+void wake_up_klogd(void)
+{
+	if (waitqueue_active(&log_wait))
+		printk_defer(PRINTK_PENDING_WAKEUP);
+}
+
 #ifdef CONFIG_PRINTK
 
+/*
+ * The log is a ring of records. Every record has a descriptor in
+ * log_descs and the text it added to log_buf, which keeps the
+ * "<level>[time] message" lines that kmsg_dump(), kdb and the crash
+ * tools read as plain text.
+ *
+ * log_head and log_tail pack the sequence number of a record into their
+ * upper half and the position of its text in log_buf into the lower
+ * one. A writer reserves a descriptor and the text of its record by
+ * moving log_head on with a cmpxchg, after pushing log_tail past the
+ * oldest records if they are in the way, then fills both in and commits
+ * the record by storing its sequence number in the descriptor. Nothing
+ * is locked, so printk() works from any context including NMI. A reader
+ * copies a record and then checks that log_tail hasn't passed it in the
+ * meantime.
+ */
 static char __log_buf[__LOG_BUF_LEN];
 static char *log_buf = __log_buf;
-static int log_buf_len = __LOG_BUF_LEN;
-static unsigned logged_chars; /* Number of chars produced since last read+clear operation */
+static u32 log_buf_len = __LOG_BUF_LEN;
 static int saved_console_loglevel = -1;
 
+struct log_desc {
+	u32	seq;		/* sequence number, stored last */
+	u32	text_pos;	/* position of the text in log_buf */
+	u64	ts_nsec;	/* local_clock() when it was logged */
+	u16	text_len;
+	u8	level;
+	u8	flags;
+};
+
+/* The record starts in the middle of a line logged before it */
+#define LOG_CONT	0x01
+/* The record ends with a newline */
+#define LOG_NEWLINE	0x02
+
+/* One descriptor per 64 bytes of log_buf */
+#define LOG_DESC_SHIFT	6
+
+static struct log_desc __log_descs[__LOG_BUF_LEN >> LOG_DESC_SHIFT];
+static struct log_desc *log_descs = __log_descs;
+static u32 log_desc_count = __LOG_BUF_LEN >> LOG_DESC_SHIFT;
+
+/*
+ * The positions take 31 bits, the lowest bit of log_head tells whether
+ * the newest record left its last line open. Sequence numbers start at
+ * one so that the zeroed descriptors don't look committed.
+ */
+#define LOG_POS_MASK	0x7fffffffU
+#define LOG_OPEN	1ULL
+#define LOG_FIRST_SEQ	1U
+
+static atomic64_t log_head = ATOMIC64_INIT((u64)LOG_FIRST_SEQ << 32);
+static atomic64_t log_tail = ATOMIC64_INIT((u64)LOG_FIRST_SEQ << 32);
+
+/* Messages thrown away because the oldest record was still being written */
+static atomic_t log_dropped = ATOMIC_INIT(0);
+
+/* Longest message and longest record with all its line prefixes */
+#define LOG_LINE_MAX	1024
+#define LOG_REC_MAX	2048
+
+#define LOG_BUF(pos)	(log_buf[(pos) & (log_buf_len - 1)])
+
+static inline u32 log_seq(u64 v)
+{
+	return v >> 32;
+}
+
+static inline u32 log_pos(u64 v)
+{
+	return (u32)v >> 1;
+}
+
+static inline u64 log_mk(u32 seq, u32 pos, bool open)
+{
+	return (u64)seq << 32 | (u64)(pos & LOG_POS_MASK) << 1 | open;
+}
+
+static inline struct log_desc *log_desc(u32 seq)
+{
+	return &log_descs[seq & (log_desc_count - 1)];
+}
+
+/* The record has been overwritten */
+static inline bool log_lost(u32 seq)
+{
+	return (s32)(seq - log_seq(atomic64_read(&log_tail))) < 0;
+}
+
+/* Next record for syslog(2), and the first one not cleared from it */
+static u32 syslog_seq = LOG_FIRST_SEQ;
+static size_t syslog_partial;
+static u32 clear_seq = LOG_FIRST_SEQ;
+static DEFINE_MUTEX(syslog_mutex);
+
 #ifdef CONFIG_KEXEC
 /*
  * This appends the listed symbols to /proc/vmcoreinfo
@@ -158,13 +334,27 @@ static int saved_console_loglevel = -1;
  * obtain access to symbols that are otherwise very difficult to locate.  These
  * symbols are specifically used so that utilities can access and extract the
  * dmesg log from a vmcore file after a crash.
+ *
+ * Tools that predate the record ring still find log_end and logged_chars,
+ * which log_buf_kexec_save() fills in when the crash happens.
  */
+static unsigned log_end, logged_chars;
+
 void log_buf_kexec_setup(void)
 {
 	VMCOREINFO_SYMBOL(log_buf);
 	VMCOREINFO_SYMBOL(log_end);
 	VMCOREINFO_SYMBOL(log_buf_len);
 	VMCOREINFO_SYMBOL(logged_chars);
+	VMCOREINFO_SYMBOL(log_descs);
+	VMCOREINFO_SYMBOL(log_desc_count);
+	VMCOREINFO_SYMBOL(log_head);
+	VMCOREINFO_SYMBOL(log_tail);
+	VMCOREINFO_STRUCT_SIZE(log_desc);
+	VMCOREINFO_OFFSET(log_desc, seq);
+	VMCOREINFO_OFFSET(log_desc, text_pos);
+	VMCOREINFO_OFFSET(log_desc, ts_nsec);
+	VMCOREINFO_OFFSET(log_desc, text_len);
 }
 #endif
 
@@ -188,22 +378,29 @@ early_param("log_buf_len", log_buf_len_setup);
 void __init setup_log_buf(int early)
 {
 	unsigned long flags;
-	unsigned start, dest_idx, offset;
+	struct log_desc *new_log_descs;
+	u32 new_desc_count, pos, seq;
+	size_t desc_size;
 	char *new_log_buf;
+	u64 head, tail;
 	int free;
 
 	if (!new_log_buf_len)
 		return;
 
+	new_desc_count = new_log_buf_len >> LOG_DESC_SHIFT;
+	desc_size = new_desc_count * sizeof(struct log_desc);
+
 	if (early) {
 		unsigned long mem;
 
-		mem = memblock_alloc(new_log_buf_len, PAGE_SIZE);
+		mem = memblock_alloc(new_log_buf_len + desc_size, PAGE_SIZE);
 		if (!mem)
 			return;
 		new_log_buf = __va(mem);
 	} else {
-		new_log_buf = alloc_bootmem_nopanic(new_log_buf_len);
+		new_log_buf = alloc_bootmem_nopanic(new_log_buf_len +
+						    desc_size);
 	}
 
 	if (unlikely(!new_log_buf)) {
@@ -211,28 +408,28 @@ void __init setup_log_buf(int early)
 			new_log_buf_len);
 		return;
 	}
+	new_log_descs = (struct log_desc *)(new_log_buf + new_log_buf_len);
+	memset(new_log_descs, 0, desc_size);
+
+	/* Only the boot cpu is up, the records keep their positions */
+	local_irq_save(flags);
+	head = atomic64_read(&log_head);
+	tail = atomic64_read(&log_tail);
+	for (pos = log_pos(tail); pos != log_pos(head);
+	     pos = (pos + 1) & LOG_POS_MASK)
+		new_log_buf[pos & (new_log_buf_len - 1)] = LOG_BUF(pos);
+	for (seq = log_seq(tail); seq != log_seq(head); seq++)
+		new_log_descs[seq & (new_desc_count - 1)] = *log_desc(seq);
 
-	raw_spin_lock_irqsave(&logbuf_lock, flags);
 	log_buf_len = new_log_buf_len;
 	log_buf = new_log_buf;
+	log_desc_count = new_desc_count;
+	log_descs = new_log_descs;
 	new_log_buf_len = 0;
-	free = __LOG_BUF_LEN - log_end;
-
-	offset = start = min(con_start, log_start);
-	dest_idx = 0;
-	while (start != log_end) {
-		unsigned log_idx_mask = start & (__LOG_BUF_LEN - 1);
-
-		log_buf[dest_idx] = __log_buf[log_idx_mask];
-		start++;
-		dest_idx++;
-	}
-	log_start -= offset;
-	con_start -= offset;
-	log_end -= offset;
-	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+	local_irq_restore(flags);
 
-	pr_info("log_buf_len: %d\n", log_buf_len);
+	free = __LOG_BUF_LEN - ((log_pos(head) - log_pos(tail)) & LOG_POS_MASK);
+	pr_info("log_buf_len: %u\n", log_buf_len);
 	pr_info("early log buf free: %d(%d%%)\n",
 		free, (free * 100) / __LOG_BUF_LEN);
 }
@@ -290,20 +487,125 @@ static inline void boot_delay_msec(void)
 }
 #endif
 
+static u32 log_store(u32 pos, const char *text, size_t len)
+{
+	u32 idx = pos & (log_buf_len - 1);
+	size_t n = min_t(size_t, len, log_buf_len - idx);
+
+	memcpy(log_buf + idx, text, n);
+	memcpy(log_buf, text + n, len - n);
+	return pos + len;
+}
+
+static void log_copy(u32 pos, char *buf, size_t len)
+{
+	u32 idx = pos & (log_buf_len - 1);
+	size_t n = min_t(size_t, len, log_buf_len - idx);
+
+	memcpy(buf, log_buf + idx, n);
+	memcpy(buf + n, log_buf, len - n);
+}
+
 /*
- * Return the number of unread characters in the log buffer.
+ * Push log_tail past the oldest records until @size more bytes of text
+ * and one more descriptor fit after @head. Fails if the oldest record
+ * is still being written.
  */
-static int log_buf_get_len(void)
+static bool log_make_room(u64 head, u32 size)
 {
-	return logged_chars;
+	for (;;) {
+		u64 tail = atomic64_read(&log_tail);
+		u32 seq = log_seq(tail);
+		struct log_desc *desc;
+
+		if (((log_pos(head) + size - log_pos(tail)) & LOG_POS_MASK) <=
+		    log_buf_len && log_seq(head) + 1 - seq <= log_desc_count)
+			return true;
+		/* @head is stale, the caller's cmpxchg will fail */
+		if ((s32)(log_seq(head) - seq) <= 0)
+			return true;
+
+		desc = log_desc(seq);
+		if (ACCESS_ONCE(desc->seq) != seq) {
+			if (atomic64_read(&log_tail) != tail)
+				continue;
+			return false;
+		}
+		smp_rmb();
+		atomic64_cmpxchg(&log_tail, tail,
+				 log_mk(seq + 1, log_pos(tail) + desc->text_len,
+					false));
+	}
 }
 
+/*
+ * Copy the descriptor of record @seq to @d and up to @size bytes of its
+ * text to @buf. Returns the length of the text, 0 if the record is not
+ * committed yet and -1 if it has been overwritten.
+ */
+static int log_read(u32 seq, struct log_desc *d, char *buf, size_t size)
+{
+	struct log_desc *desc = log_desc(seq);
+
+	if (log_lost(seq))
+		return -1;
+	if (ACCESS_ONCE(desc->seq) != seq) {
+		smp_rmb();
+		return log_lost(seq) ? -1 : 0;
+	}
+	smp_rmb();
+	*d = *desc;
+	if (buf)
+		log_copy(d->text_pos, buf, min_t(size_t, d->text_len, size));
+	smp_rmb();
+	if (log_lost(seq))
+		return -1;
+	return d->text_len;
+}
+
+/*
+ * Positions in log_buf of the text of the records that haven't been
+ * cleared, up to the first one that isn't committed yet. The dumpers
+ * read it without any locking, just like they did before.
+ */
+static void log_text_range(u32 *start, u32 *end)
+{
+	u32 seq = log_seq(atomic64_read(&log_tail));
+	struct log_desc d;
+
+	if ((s32)(clear_seq - seq) > 0)
+		seq = clear_seq;
+
+	*start = *end = 0;
+	if (log_read(seq, &d, NULL, 0) <= 0)
+		return;
+	*start = d.text_pos;
+	do {
+		*end = d.text_pos + d.text_len;
+	} while (log_read(++seq, &d, NULL, 0) > 0);
+}
+
+#ifdef CONFIG_KEXEC
+/*
+ * Point log_end and logged_chars at the committed text in log_buf,
+ * as they did when they were the log buffer's own indices.
+ */
+void log_buf_kexec_save(void)
+{
+	u32 start, end;
+
+	log_text_range(&start, &end);
+	log_end = end;
+	logged_chars = min((end - start) & LOG_POS_MASK, log_buf_len);
+}
+#endif
+
 /*
  * Clears the ring-buffer
  */
 void log_buf_clear(void)
 {
-	logged_chars = 0;
+	clear_seq = log_seq(atomic64_read(&log_head));
 }
 
 /*
@@ -311,30 +613,17 @@ void log_buf_clear(void)
  */
 int log_buf_copy(char *dest, int idx, int len)
 {
-	int ret, max;
-	bool took_lock = false;
+	u32 start, end, max;
 
-	if (!oops_in_progress) {
-		raw_spin_lock_irq(&logbuf_lock);
-		took_lock = true;
-	}
+	log_text_range(&start, &end);
+	max = (end - start) & LOG_POS_MASK;
+	if (idx < 0 || idx >= max)
+		return -1;
 
-	max = log_buf_get_len();
-	if (idx < 0 || idx >= max) {
-		ret = -1;
-	} else {
-		if (len > max - idx)
-			len = max - idx;
-		ret = len;
-		idx += (log_end - max);
-		while (len-- > 0)
-			dest[len] = LOG_BUF(idx + len);
-	}
-
-	if (took_lock)
-		raw_spin_unlock_irq(&logbuf_lock);
-
-	return ret;
+	if (len > max - idx)
+		len = max - idx;
+	log_copy(start + idx, dest, len);
+	return len;
 }
 
 #ifdef CONFIG_SECURITY_DMESG_RESTRICT
@@ -376,11 +665,104 @@ static int check_syslog_permissions(int type, bool from_file)
 	return 0;
 }
 
+/* Skip the records that were overwritten before syslog(2) got to them */
+static void syslog_catch_up(void)
+{
+	if (log_lost(syslog_seq)) {
+		syslog_seq = log_seq(atomic64_read(&log_tail));
+		syslog_partial = 0;
+	}
+}
+
+static bool syslog_pending(void)
+{
+	struct log_desc d;
+
+	return log_read(syslog_seq, &d, NULL, 0) != 0;
+}
+
+/* Read from where the last read stopped, with syslog_mutex held */
+static int syslog_read(char __user *buf, int len, char *text)
+{
+	struct log_desc d;
+	int i = 0, n;
+
+	while (i < len) {
+		syslog_catch_up();
+		n = log_read(syslog_seq, &d, text, LOG_REC_MAX);
+		if (n < 0)
+			continue;
+		if (!n)
+			break;
+
+		n = min_t(int, n - syslog_partial, len - i);
+		if (copy_to_user(buf + i, text + syslog_partial, n))
+			return i ? i : -EFAULT;
+		i += n;
+		syslog_partial += n;
+		if (syslog_partial == d.text_len) {
+			syslog_seq++;
+			syslog_partial = 0;
+		}
+	}
+	return i;
+}
+
+/*
+ * Read the newest records since the last clear that fit in @len bytes,
+ * with syslog_mutex held.
+ */
+static int syslog_read_all(char __user *buf, int len, char *text, bool clear)
+{
+	u32 seq, end, tail = log_seq(atomic64_read(&log_tail));
+	struct log_desc d;
+	size_t total = 0;
+	int i = 0, n;
+
+	seq = (s32)(clear_seq - tail) > 0 ? clear_seq : tail;
+	for (end = seq; (n = log_read(end, &d, NULL, 0)) > 0; end++)
+		total += n;
+
+	/* Records overwritten meanwhile only make the cut larger */
+	for (; seq != end && total > (size_t)len; seq++) {
+		n = log_read(seq, &d, NULL, 0);
+		total -= max(n, 0);
+	}
+
+	for (; seq != end; seq++) {
+		n = log_read(seq, &d, text, LOG_REC_MAX);
+		if (n <= 0)
+			continue;
+		if (i + n > len)
+			break;
+		if (copy_to_user(buf + i, text, n))
+			return -EFAULT;
+		i += n;
+		cond_resched();
+	}
+
+	if (clear)
+		clear_seq = end;
+	return i;
+}
+
+/* Bytes left to read, with syslog_mutex held */
+static int syslog_unread(void)
+{
+	struct log_desc d;
+	u32 seq;
+	int n, count = 0;
+
+	syslog_catch_up();
+	for (seq = syslog_seq; (n = log_read(seq, &d, NULL, 0)) > 0; seq++)
+		count += n;
+	return count ? count - syslog_partial : 0;
+}
+
 int do_syslog(int type, char __user *buf, int len, bool from_file)
 {
-	unsigned i, j, limit, count;
-	int do_clear = 0;
-	char c;
+	bool do_clear = false;
+	char *text;
 	int error;
 
 	error = check_syslog_permissions(type, from_file);
@@ -407,29 +789,22 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 			error = -EFAULT;
 			goto out;
 		}
-		error = wait_event_interruptible(log_wait,
-							(log_start - log_end));
+		error = wait_event_interruptible(log_wait, syslog_pending());
 		if (error)
 			goto out;
-		i = 0;
-		raw_spin_lock_irq(&logbuf_lock);
-		while (!error && (log_start != log_end) && i < len) {
-			c = LOG_BUF(log_start);
-			log_start++;
-			raw_spin_unlock_irq(&logbuf_lock);
-			error = __put_user(c,buf);
-			buf++;
-			i++;
-			cond_resched();
-			raw_spin_lock_irq(&logbuf_lock);
+		text = kmalloc(LOG_REC_MAX, GFP_KERNEL);
+		if (!text) {
+			error = -ENOMEM;
+			goto out;
 		}
-		raw_spin_unlock_irq(&logbuf_lock);
-		if (!error)
-			error = i;
+		mutex_lock(&syslog_mutex);
+		error = syslog_read(buf, len, text);
+		mutex_unlock(&syslog_mutex);
+		kfree(text);
 		break;
 	/* Read/clear last kernel messages */
 	case SYSLOG_ACTION_READ_CLEAR:
-		do_clear = 1;
+		do_clear = true;
 		/* FALL THRU */
 	/* Read last kernel messages */
 	case SYSLOG_ACTION_READ_ALL:
@@ -443,51 +818,21 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 			error = -EFAULT;
 			goto out;
 		}
-		count = len;
-		if (count > log_buf_len)
-			count = log_buf_len;
-		raw_spin_lock_irq(&logbuf_lock);
-		if (count > logged_chars)
-			count = logged_chars;
-		if (do_clear)
-			logged_chars = 0;
-		limit = log_end;
-		/*
-		 * __put_user() could sleep, and while we sleep
-		 * printk() could overwrite the messages
-		 * we try to copy to user space. Therefore
-		 * the messages are copied in reverse. <manfreds>
-		 */
-		for (i = 0; i < count && !error; i++) {
-			j = limit-1-i;
-			if (j + log_buf_len < log_end)
-				break;
-			c = LOG_BUF(j);
-			raw_spin_unlock_irq(&logbuf_lock);
-			error = __put_user(c,&buf[count-1-i]);
-			cond_resched();
-			raw_spin_lock_irq(&logbuf_lock);
-		}
-		raw_spin_unlock_irq(&logbuf_lock);
-		if (error)
-			break;
-		error = i;
-		if (i != count) {
-			int offset = count-error;
-			/* buffer overflow during copy, correct user buffer. */
-			for (i = 0; i < error; i++) {
-				if (__get_user(c,&buf[i+offset]) ||
-				    __put_user(c,&buf[i])) {
-					error = -EFAULT;
-					break;
-				}
-				cond_resched();
-			}
+		text = kmalloc(LOG_REC_MAX, GFP_KERNEL);
+		if (!text) {
+			error = -ENOMEM;
+			goto out;
 		}
+		mutex_lock(&syslog_mutex);
+		error = syslog_read_all(buf, len, text, do_clear);
+		mutex_unlock(&syslog_mutex);
+		kfree(text);
 		break;
 	/* Clear ring buffer */
 	case SYSLOG_ACTION_CLEAR:
-		logged_chars = 0;
+		mutex_lock(&syslog_mutex);
+		clear_seq = log_seq(atomic64_read(&log_head));
+		mutex_unlock(&syslog_mutex);
 		break;
 	/* Disable logging to console */
 	case SYSLOG_ACTION_CONSOLE_OFF:
@@ -516,7 +861,9 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 		break;
 	/* Number of chars in the log buffer */
 	case SYSLOG_ACTION_SIZE_UNREAD:
-		error = log_end - log_start;
+		mutex_lock(&syslog_mutex);
+		error = syslog_unread();
+		mutex_unlock(&syslog_mutex);
 		break;
 	/* Size of the log buffer */
 	case SYSLOG_ACTION_SIZE_BUFFER:
@@ -543,18 +890,20 @@ SYSCALL_DEFINE3(syslog, int, type, char __user *, buf, int, len)
  */
 void kdb_syslog_data(char *syslog_data[4])
 {
+	u32 start, end;
+
+	log_text_range(&start, &end);
 	syslog_data[0] = log_buf;
 	syslog_data[1] = log_buf + log_buf_len;
-	syslog_data[2] = log_buf + log_end -
-		(logged_chars < log_buf_len ? logged_chars : log_buf_len);
-	syslog_data[3] = log_buf + log_end;
+	syslog_data[2] = log_buf + (start & (log_buf_len - 1));
+	syslog_data[3] = syslog_data[2] + ((end - start) & LOG_POS_MASK);
 }
 #endif	/* CONFIG_KGDB_KDB */
 
 /*
- * Call the console drivers on a range of log_buf
+ * Call the console drivers on a piece of text
  */
-static void __call_console_drivers(unsigned start, unsigned end)
+static void __call_console_drivers(const char *text, size_t len)
 {
 	struct console *con;
 
@@ -564,7 +913,7 @@ static void __call_console_drivers(unsigned start, unsigned end)
 		if ((con->flags & CON_ENABLED) && con->write &&
 				(cpu_online(smp_processor_id()) ||
 				(con->flags & CON_ANYTIME)))
-			con->write(con, &LOG_BUF(start), end - start);
+			con->write(con, text, len);
 	}
 }
 
@@ -586,20 +935,12 @@ MODULE_PARM_DESC(ignore_loglevel, "ignore loglevel setting, to"
 /*
  * Write out chars from start to end - 1 inclusive
  */
-static void _call_console_drivers(unsigned start,
-				unsigned end, int msg_log_level)
+static void _call_console_drivers(const char *start, const char *end,
+				  int msg_log_level)
 {
 	if ((msg_log_level < console_loglevel || ignore_loglevel) &&
-			console_drivers && start != end) {
-		if ((start & LOG_BUF_MASK) > (end & LOG_BUF_MASK)) {
-			/* wrapped write */
-			__call_console_drivers(start & LOG_BUF_MASK,
-						log_buf_len);
-			__call_console_drivers(0, end & LOG_BUF_MASK);
-		} else {
-			__call_console_drivers(start, end);
-		}
-	}
+			console_drivers && start != end)
+		__call_console_drivers(start, end - start);
 }
 
 /*
@@ -664,60 +1005,120 @@ static size_t log_prefix(const char *p, unsigned int *level, char *special)
 	return len;
 }
 
+/* Level of the line the consoles are in the middle of, or -1 */
+static int console_msg_level = -1;
+
 /*
- * Call the console drivers, asking them to write out
- * log_buf[start] to log_buf[end - 1].
+ * Call the console drivers, asking them to write out the
+ * NUL terminated text[0] to text[len - 1].
  * The console_lock must be held.
  */
-static void call_console_drivers(unsigned start, unsigned end)
+static void call_console_drivers(const char *text, size_t len)
 {
-	unsigned cur_index, start_print;
-	static int msg_level = -1;
-
-	BUG_ON(((int)(start - end)) > 0);
+	const char *cur = text, *end = text + len, *start_print = text;
 
-	cur_index = start;
-	start_print = start;
-	while (cur_index != end) {
-		if (msg_level < 0 && ((end - cur_index) > 2)) {
+	while (cur != end) {
+		if (console_msg_level < 0 && end - cur > 2) {
 			/* strip log prefix */
-			cur_index += log_prefix(&LOG_BUF(cur_index), &msg_level, NULL);
-			start_print = cur_index;
+			cur += log_prefix(cur, &console_msg_level, NULL);
+			start_print = cur;
 		}
-		while (cur_index != end) {
-			char c = LOG_BUF(cur_index);
+		while (cur != end) {
+			char c = *cur++;
 
-			cur_index++;
 			if (c == '\n') {
-				if (msg_level < 0) {
-					/*
-					 * printk() has already given us loglevel tags in
-					 * the buffer.  This code is here in case the
-					 * log buffer has wrapped right round and scribbled
-					 * on those tags
-					 */
-					msg_level = default_message_loglevel;
-				}
-				_call_console_drivers(start_print, cur_index, msg_level);
-				msg_level = -1;
-				start_print = cur_index;
+				if (console_msg_level < 0)
+					console_msg_level =
+						default_message_loglevel;
+				_call_console_drivers(start_print, cur,
+						      console_msg_level);
+				console_msg_level = -1;
+				start_print = cur;
 				break;
 			}
 		}
 	}
-	_call_console_drivers(start_print, end, msg_level);
+	_call_console_drivers(start_print, end, console_msg_level);
+}
+
+/* Next record for the consoles and what they missed, under console_sem */
+static u32 console_seq = LOG_FIRST_SEQ;
+static u32 console_lost;
+static char console_text[LOG_REC_MAX + 1];
+
+static bool console_pending(void)
+{
+	struct log_desc d;
+
+	return log_read(console_seq, &d, NULL, 0) != 0;
 }
 
-static void emit_log_char(char c)
+/* Replay the records syslog(2) hasn't read to a new console */
+static void console_replay(void)
 {
-	LOG_BUF(log_end) = c;
-	log_end++;
-	if (log_end - log_start > log_buf_len)
-		log_start = log_end - log_buf_len;
-	if (log_end - con_start > log_buf_len)
-		con_start = log_end - log_buf_len;
-	if (logged_chars < log_buf_len)
-		logged_chars++;
+	u32 tail = log_seq(atomic64_read(&log_tail));
+
+	console_seq = (s32)(syslog_seq - tail) > 0 ? syslog_seq : tail;
+	console_lost = 0;
+}
+
+/*
+ * Print the next record on the consoles. Returns false once there is
+ * none left that is committed. The console_lock must be held.
+ */
+static bool console_emit_next(void)
+{
+	u32 seq = console_seq;
+	unsigned int dropped;
+	unsigned long flags;
+	struct log_desc d;
+	int len;
+
+	len = log_read(seq, &d, NULL, 0);
+	if (len < 0) {
+		console_seq = log_seq(atomic64_read(&log_tail));
+		console_lost += console_seq - seq;
+		return true;
+	}
+	if (!len)
+		return false;
+
+	/* Skip whole lines below the console loglevel without copying them */
+	if (!(d.flags & LOG_CONT) && d.level >= console_loglevel &&
+	    !ignore_loglevel) {
+		console_msg_level = d.flags & LOG_NEWLINE ? -1 : d.level;
+		console_seq = seq + 1;
+		return true;
+	}
+
+	len = log_read(seq, &d, console_text, LOG_REC_MAX);
+	if (len < 0)
+		return true;
+	console_text[len] = '\0';
+	console_seq = seq + 1;
+
+	local_irq_save(flags);
+	stop_critical_timings();	/* don't trace print latency */
+	if (!(d.flags & LOG_CONT)) {
+		dropped = atomic_read(&log_dropped) ?
+			  atomic_xchg(&log_dropped, 0) : 0;
+		if (console_lost || dropped) {
+			char notice[80];
+			int n;
+
+			n = scnprintf(notice, sizeof(notice),
+				      "<%u>** %u printk messages lost, "
+				      "%u dropped **\n",
+				      d.level, console_lost, dropped);
+			call_console_drivers(notice, n);
+			console_lost = 0;
+		}
+	}
+	call_console_drivers(console_text, len);
+	start_critical_timings();
+	local_irq_restore(flags);
+
+	return true;
 }
 
 /*
@@ -736,9 +1137,7 @@ static void zap_locks(void)
 	oops_timestamp = jiffies;
 
 	debug_locks_off();
-	/* If a crash is occurring, make sure we can't deadlock */
-	raw_spin_lock_init(&logbuf_lock);
-	/* And make sure that we print immediately */
+	/* Make sure that we print immediately */
 	sema_init(&console_sem, 1);
 }
 
@@ -774,7 +1173,8 @@ static int have_callable_console(void)
  * call the console drivers.  If we fail to get the semaphore we place the output
  * into the log buffer and return.  The current holder of the console_sem will
  * notice the new output in console_unlock(); and will send it to the
- * consoles before releasing the lock.
+ * consoles before releasing the lock. Once the system is running, we only
+ * log the output and leave the console drivers to the printk thread.
  *
  * One effect of this deferred printing is that code which calls printk() and
  * then changes console_loglevel may break. This is because console_loglevel
@@ -806,9 +1206,6 @@ asmlinkage int printk(const char *fmt, ...)
 	return r;
 }
 
-/* cpu currently holding logbuf_lock */
-static volatile unsigned int printk_cpu = UINT_MAX;
-
 /*
  * Can we actually use the console at this time on this cpu?
  *
@@ -827,42 +1224,35 @@ static inline int can_use_console(unsigned int cpu)
  * messages from a 'printk'. Return true (and with the
  * console_lock held, and 'console_locked' set) if it
  * is successful, false otherwise.
- *
- * This gets called with the 'logbuf_lock' spinlock held and
- * interrupts disabled. It should return with 'lockbuf_lock'
- * released but interrupts still disabled.
  */
 static int console_trylock_for_printk(unsigned int cpu)
-	__releases(&logbuf_lock)
 {
-	int retval = 0, wake = 0;
-
-	if (console_trylock()) {
-		retval = 1;
+	if (!console_trylock())
+		return 0;
 
-		/*
-		 * If we can't use the console, we need to release
-		 * the console semaphore by hand to avoid flushing
-		 * the buffer. We need to hold the console semaphore
-		 * in order to do this test safely.
-		 */
-		if (!can_use_console(cpu)) {
-			console_locked = 0;
-			wake = 1;
-			retval = 0;
-		}
-	}
-	printk_cpu = UINT_MAX;
-	if (wake)
+	/*
+	 * If we can't use the console, we need to release
+	 * the console semaphore by hand to avoid flushing
+	 * the buffer. We need to hold the console semaphore
+	 * in order to do this test safely.
+	 */
+	if (!can_use_console(cpu)) {
+		console_locked = 0;
 		up(&console_sem);
-	raw_spin_unlock(&logbuf_lock);
-	return retval;
+		return 0;
+	}
+	return 1;
 }
 static const char recursion_bug_msg [] =
 		KERN_CRIT "BUG: recent printk recursion!\n";
 static int recursion_bug;
-static int new_text_line = 1;
-static char printk_buf[1024];
+
+/* Messages are formatted here, the second buffer is for NMIs */
+struct printk_buf {
+	char	text[LOG_LINE_MAX];
+	int	busy;
+};
+static DEFINE_PER_CPU(struct printk_buf [2], printk_bufs);
 
 int printk_delay_msec __read_mostly;
 
@@ -878,27 +1268,143 @@ static inline void printk_delay(void)
 	}
 }
 
-asmlinkage int vprintk(const char *fmt, va_list args)
+/*
+ * Length of the start of @text that fits in @max bytes once a prefix of
+ * @plen bytes is put in front of every line after the first one. The
+ * size that takes is returned in @size.
+ */
+static size_t log_fit(const char *text, size_t len, size_t plen, size_t max,
+		      size_t *size)
 {
-	int printed_len = 0;
-	int current_log_level = default_message_loglevel;
+	size_t i, n = 0;
+
+	for (i = 0; i < len; i++) {
+		size_t c = i && text[i - 1] == '\n' ? plen + 1 : 1;
+
+		if (n + c > max)
+			break;
+		n += c;
+	}
+	*size = n;
+	return i;
+}
+
+/*
+ * Add a formatted message to the log as one record, with a log level
+ * prefix, and the time if printk_time is set, at the start of every
+ * line. Returns the size of the record.
+ */
+static int log_message(const char *text, size_t len)
+{
+	unsigned int level = default_message_loglevel;
+	size_t hlen, plen, body_size;
+	bool newline = false, open, lead_nl, lead_prefix, still_open;
+	char prefix[48], special = 0;
+	struct log_desc *desc;
+	u32 seq, pos, size;
+	u64 head, next, ts;
+	size_t i, j;
+
+	/* Read log level and handle special printk prefix */
+	hlen = log_prefix(text, &level, &special);
+	if (hlen) {
+		/* Anything but KERN_CONT starts a new line */
+		newline = special != 'c';
+		text += hlen;
+		len -= hlen;
+	}
+
+	/* Keep the original prefix, with the facility of /dev/kmsg writes */
+	if (hlen && !special && hlen <= 16) {
+		memcpy(prefix, text - hlen, hlen);
+		plen = hlen;
+	} else {
+		plen = sprintf(prefix, "<%u>", level);
+	}
+
+	ts = local_clock();
+	if (printk_time) {
+		u64 t = ts;
+		unsigned long nanosec_rem = do_div(t, 1000000000);
+
+		plen += sprintf(prefix + plen, "[%5lu.%06lu] ",
+				(unsigned long)t, nanosec_rem / 1000);
+	}
+
+	/* Room for a newline and the prefix of the first line */
+	len = log_fit(text, len, plen, LOG_REC_MAX - 1 - plen, &body_size);
+
+	/*
+	 * Whether the line of the record before this one is still open
+	 * decides about the newline and the prefix at the start, so the
+	 * size is worked out again whenever the cmpxchg fails.
+	 */
+	for (;;) {
+		head = atomic64_read(&log_head);
+		open = head & LOG_OPEN;
+		lead_nl = open && newline;
+		lead_prefix = len && (!open || newline);
+		size = lead_nl + (lead_prefix ? plen : 0) + body_size;
+		if (!size)
+			return 0;
+		still_open = len ? text[len - 1] != '\n' : open && !newline;
+
+		if (!log_make_room(head, size)) {
+			atomic_inc(&log_dropped);
+			return 0;
+		}
+		seq = log_seq(head);
+		pos = log_pos(head);
+		next = log_mk(seq + 1, pos + size, still_open);
+		if (atomic64_cmpxchg(&log_head, head, next) == head)
+			break;
+	}
+
+	desc = log_desc(seq);
+	desc->text_pos = pos;
+	if (lead_nl)
+		pos = log_store(pos, "\n", 1);
+	if (lead_prefix)
+		pos = log_store(pos, prefix, plen);
+	for (i = 0; i < len; i = j) {
+		const char *nl = memchr(text + i, '\n', len - i);
+
+		j = nl ? nl - text + 1 : len;
+		pos = log_store(pos, text + i, j - i);
+		if (j < len)
+			pos = log_store(pos, prefix, plen);
+	}
+	desc->text_len = size;
+	desc->ts_nsec = ts;
+	desc->level = level;
+	desc->flags = (open ? LOG_CONT : 0) | (still_open ? 0 : LOG_NEWLINE);
+
+	/* Commit, see log_read() */
+	smp_wmb();
+	desc->seq = seq;
+
+	return size;
+}
+
+static __printf(2, 0)
+int vprintk_emit(bool deferred, const char *fmt, va_list args)
+{
+	int printed_len = 0, pending = 0;
+	struct printk_buf *pb;
 	unsigned long flags;
-	int this_cpu;
-	char *p;
-	size_t plen;
-	char special;
+	int this_cpu, len;
 
 	boot_delay_msec();
 	printk_delay();
 
-	/* This stops the holder of console_sem just where we want him */
 	local_irq_save(flags);
 	this_cpu = smp_processor_id();
+	pb = &per_cpu(printk_bufs, this_cpu)[in_nmi() ? 1 : 0];
 
 	/*
 	 * Ouch, printk recursed into itself!
 	 */
-	if (unlikely(printk_cpu == this_cpu)) {
+	if (unlikely(pb->busy)) {
 		/*
 		 * If a crash is occurring during printk() on this CPU,
 		 * then try to get the crash message out but make sure
@@ -914,118 +1420,66 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	}
 
 	lockdep_off();
-	raw_spin_lock(&logbuf_lock);
-	printk_cpu = this_cpu;
+	pb->busy = 1;
 
 	if (recursion_bug) {
 		recursion_bug = 0;
-		strcpy(printk_buf, recursion_bug_msg);
-		printed_len = strlen(recursion_bug_msg);
+		log_message(recursion_bug_msg, strlen(recursion_bug_msg));
 	}
 	/* Emit the output into the temporary buffer */
-	printed_len += vscnprintf(printk_buf + printed_len,
-				  sizeof(printk_buf) - printed_len, fmt, args);
+	len = vscnprintf(pb->text, sizeof(pb->text), fmt, args);
 
-
-	p = printk_buf;
 #ifdef CONFIG_LGE_CRASH_HANDLER
-	store_crash_log(p);
+	store_crash_log(pb->text);
 #endif
 
-	/* Read log level and handle special printk prefix */
-	plen = log_prefix(p, &current_log_level, &special);
-	if (plen) {
-		p += plen;
-
-		switch (special) {
-		case 'c': /* Strip <c> KERN_CONT, continue line */
-			plen = 0;
-			break;
-		case 'd': /* Strip <d> KERN_DEFAULT, start new line */
-			plen = 0;
-		default:
-			if (!new_text_line) {
-				emit_log_char('\n');
-				new_text_line = 1;
-			}
-		}
-	}
+	printed_len = log_message(pb->text, len);
+	pb->busy = 0;
 
 	/*
-	 * Copy the output into log_buf. If the caller didn't provide
-	 * the appropriate log prefix, we insert them here
+	 * Print the record right away unless the printk thread takes
+	 * care of it, or we are in NMI or below the runqueue locks, where
+	 * that's left to the irq_work along with waking up klogd.
 	 */
-	for (; *p; p++) {
-		if (new_text_line) {
-			new_text_line = 0;
-
-			if (plen) {
-				/* Copy original log prefix */
-				int i;
-
-				for (i = 0; i < plen; i++)
-					emit_log_char(printk_buf[i]);
-				printed_len += plen;
-			} else {
-				/* Add log prefix */
-				emit_log_char('<');
-				emit_log_char(current_log_level + '0');
-				emit_log_char('>');
-				printed_len += 3;
-			}
-
-			if (printk_time) {
-				/* Add the current time stamp */
-				char tbuf[50], *tp;
-				unsigned tlen;
-				unsigned long long t;
-				unsigned long nanosec_rem;
-
-				t = cpu_clock(printk_cpu);
-				nanosec_rem = do_div(t, 1000000000);
-				tlen = sprintf(tbuf, "[%5lu.%06lu] ",
-						(unsigned long) t,
-						nanosec_rem / 1000);
-
-				for (tp = tbuf; tp < tbuf + tlen; tp++)
-					emit_log_char(*tp);
-				printed_len += tlen;
-			}
-
-			if (!*p)
-				break;
-		}
-
-		emit_log_char(*p);
-		if (*p == '\n')
-			new_text_line = 1;
-	}
-
-	/*
-	 * Try to acquire and then immediately release the
-	 * console semaphore. The release will do all the
-	 * actual magic (print out buffers, wake up klogd,
-	 * etc). 
-	 *
-	 * The console_trylock_for_printk() function
-	 * will release 'logbuf_lock' regardless of whether it
-	 * actually gets the semaphore or not.
-	 */
-	if (console_trylock_for_printk(this_cpu))
+	if (deferred || in_nmi() || printk_offload())
+		pending |= PRINTK_PENDING_OUTPUT;
+	else if (console_trylock_for_printk(this_cpu))
 		console_unlock();
 
+	/* Pairs with the barrier in wait_event() */
+	smp_mb();
+	if (waitqueue_active(&log_wait))
+		pending |= PRINTK_PENDING_WAKEUP;
+	if (pending)
+		printk_defer(pending);
+
 	lockdep_on();
 out_restore_irqs:
 	local_irq_restore(flags);
 
 	return printed_len;
 }
+
+asmlinkage int vprintk(const char *fmt, va_list args)
+{
+	return vprintk_emit(false, fmt, args);
+}
 EXPORT_SYMBOL(printk);
 EXPORT_SYMBOL(vprintk);
 
 #else
 
-static void call_console_drivers(unsigned start, unsigned end)
+static bool console_pending(void)
+{
+	return false;
+}
+
+static bool console_emit_next(void)
+{
+	return false;
+}
+
+static void console_replay(void)
 {
 }
 
@@ -1177,6 +1631,9 @@ void suspend_console(void)
 		return;
 	printk("Suspending console(s) (use no_console_suspend to debug)\n");
 	console_lock();
+	/* Don't leave anything for the printk thread to print after resume */
+	while (console_emit_next())
+		;
 	console_suspended = 1;
 	up(&console_sem);
 }
@@ -1261,43 +1718,6 @@ int is_console_locked(void)
 	return console_locked;
 }
 
-/*
- * Delayed printk facility, for scheduler-internal messages:
- */
-#define PRINTK_BUF_SIZE		512
-
-#define PRINTK_PENDING_WAKEUP	0x01
-#define PRINTK_PENDING_SCHED	0x02
-
-static DEFINE_PER_CPU(int, printk_pending);
-static DEFINE_PER_CPU(char [PRINTK_BUF_SIZE], printk_sched_buf);
-
-void printk_tick(void)
-{
-	if (__this_cpu_read(printk_pending)) {
-		int pending = __this_cpu_xchg(printk_pending, 0);
-		if (pending & PRINTK_PENDING_SCHED) {
-			char *buf = __get_cpu_var(printk_sched_buf);
-			printk(KERN_WARNING "[sched_delayed] %s", buf);
-		}
-		if (pending & PRINTK_PENDING_WAKEUP)
-			wake_up_interruptible(&log_wait);
-	}
-}
-
-int printk_needs_cpu(int cpu)
-{
-	if (cpu_is_offline(cpu))
-		printk_tick();
-	return __this_cpu_read(printk_pending);
-}
-
-void wake_up_klogd(void)
-{
-	if (waitqueue_active(&log_wait))
-		this_cpu_or(printk_pending, PRINTK_PENDING_WAKEUP);
-}
-
 /**
  * console_unlock - unlock the console system
  *
@@ -1306,39 +1726,38 @@ void wake_up_klogd(void)
  *
  * While the console_lock was held, console output may have been buffered
  * by printk().  If this is the case, console_unlock(); emits
- * the output prior to releasing the lock.
- *
- * If there is output waiting for klogd, we wake it up.
+ * the output prior to releasing the lock, or leaves it to the printk
+ * thread if printk() does so as well.
  *
  * console_unlock(); may be called from any context.
  */
 void console_unlock(void)
 {
-	unsigned long flags;
-	unsigned _con_start, _log_end;
-	unsigned wake_klogd = 0, retry = 0;
+	bool may_schedule, retry;
 
 	if (console_suspended) {
 		up(&console_sem);
 		return;
 	}
 
+	/* A new console replays the log from the context registering it */
+	if (printk_offload() && current != printk_kthread &&
+	    !exclusive_console) {
+		console_locked = 0;
+		up(&console_sem);
+		if (console_pending())
+			printk_defer(PRINTK_PENDING_OUTPUT);
+		return;
+	}
+
+	/* Only the printk thread is known to take console_lock() to print */
+	may_schedule = console_may_schedule && current == printk_kthread;
 	console_may_schedule = 0;
 
 again:
-	for ( ; ; ) {
-		raw_spin_lock_irqsave(&logbuf_lock, flags);
-		wake_klogd |= log_start - log_end;
-		if (con_start == log_end)
-			break;			/* Nothing to print */
-		_con_start = con_start;
-		_log_end = log_end;
-		con_start = log_end;		/* Flush */
-		raw_spin_unlock(&logbuf_lock);
-		stop_critical_timings();	/* don't trace print latency */
-		call_console_drivers(_con_start, _log_end);
-		start_critical_timings();
-		local_irq_restore(flags);
+	while (console_emit_next()) {
+		if (may_schedule)
+			cond_resched();
 	}
 	console_locked = 0;
 
@@ -1346,8 +1765,6 @@ again:
 	if (unlikely(exclusive_console))
 		exclusive_console = NULL;
 
-	raw_spin_unlock(&logbuf_lock);
-
 	up(&console_sem);
 
 	/*
@@ -1356,15 +1773,9 @@ again:
 	 * there's a new owner and the console_unlock() from them will do the
 	 * flush, no worries.
 	 */
-	raw_spin_lock(&logbuf_lock);
-	retry = con_start != log_end;
-	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
-
+	retry = console_pending();
 	if (retry && console_trylock())
 		goto again;
-
-	if (wake_klogd)
-		wake_up_klogd();
 }
 EXPORT_SYMBOL(console_unlock);
 
@@ -1406,6 +1817,22 @@ void console_unblank(void)
 	console_unlock();
 }
 
+/**
+ * console_flush_on_panic - print the remaining messages on panic
+ *
+ * The other cpus have been stopped, and one of them may have held the
+ * console_lock, e.g. the printk thread. Take it over and print what has
+ * not been printed yet.
+ */
+void console_flush_on_panic(void)
+{
+	/* The owner, if any, is never going to release it */
+	console_trylock();
+	console_locked = 1;
+	console_may_schedule = 0;
+	console_unlock();
+}
+
 /*
  * Return the console tty driver structure and its associated index
  */
@@ -1481,7 +1908,6 @@ early_param("keep_bootcon", keep_bootcon_setup);
 void register_console(struct console *newcon)
 {
 	int i;
-	unsigned long flags;
 	struct console *bcon = NULL;
 
 	/*
@@ -1592,9 +2018,7 @@ void register_console(struct console *newcon)
 		 * console_unlock(); will print out the buffered messages
 		 * for us.
 		 */
-		raw_spin_lock_irqsave(&logbuf_lock, flags);
-		con_start = log_start;
-		raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+		console_replay();
 		/*
 		 * We're about to replay the log buffer.  Only do this to the
 		 * just-registered console to avoid excessive message spam to
@@ -1669,6 +2093,35 @@ int unregister_console(struct console *console)
 }
 EXPORT_SYMBOL(unregister_console);
 
+#ifdef CONFIG_PRINTK
+static int printk_thread(void *unused)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (console_suspended || !console_pending())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static void __init printk_start_kthread(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(printk_thread, NULL, "printk");
+	if (!IS_ERR(task))
+		printk_kthread = task;
+}
+#else
+static inline void printk_start_kthread(void)
+{
+}
+#endif
+
 static int __init printk_late_init(void)
 {
 	struct console *con;
@@ -1681,29 +2134,26 @@ static int __init printk_late_init(void)
 		}
 	}
 	hotcpu_notifier(console_cpu_notify, 0);
+	printk_start_kthread();
 	return 0;
 }
 late_initcall(printk_late_init);
 
 #if defined CONFIG_PRINTK
 
+/*
+ * Like printk(), but leaves the console output and the wakeups to the
+ * irq_work, as the caller holds the runqueue locks.
+ */
 int printk_sched(const char *fmt, ...)
 {
-	unsigned long flags;
 	va_list args;
-	char *buf;
 	int r;
 
-	local_irq_save(flags);
-	buf = __get_cpu_var(printk_sched_buf);
-
 	va_start(args, fmt);
-	r = vsnprintf(buf, PRINTK_BUF_SIZE, fmt, args);
+	r = vprintk_emit(true, fmt, args);
 	va_end(args);
 
-	__this_cpu_or(printk_pending, PRINTK_PENDING_SCHED);
-	local_irq_restore(flags);
-
 	return r;
 }
 
@@ -1811,12 +2261,10 @@ EXPORT_SYMBOL_GPL(kmsg_dump_unregister);
  */
 void kmsg_dump(enum kmsg_dump_reason reason)
 {
-	unsigned long end;
-	unsigned chars;
 	struct kmsg_dumper *dumper;
 	const char *s1, *s2;
 	unsigned long l1, l2;
-	unsigned long flags;
+	u32 start, end, idx, chars;
 
 	if ((reason > KMSG_DUMP_OOPS) && !always_kmsg_dump)
 		return;
@@ -1824,22 +2272,21 @@ void kmsg_dump(enum kmsg_dump_reason reason)
 	/* Theoretically, the log could move on after we do this, but
 	   there's not a lot we can do about that. The new messages
 	   will overwrite the start of what we dump. */
-	raw_spin_lock_irqsave(&logbuf_lock, flags);
-	end = log_end & LOG_BUF_MASK;
-	chars = logged_chars;
-	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+	log_text_range(&start, &end);
+	idx = start & (log_buf_len - 1);
+	chars = (end - start) & LOG_POS_MASK;
 
-	if (chars > end) {
-		s1 = log_buf + log_buf_len - chars + end;
-		l1 = chars - end;
+	if (idx + chars > log_buf_len) {
+		s1 = log_buf + idx;
+		l1 = log_buf_len - idx;
 
 		s2 = log_buf;
-		l2 = end;
+		l2 = chars - l1;
 	} else {
 		s1 = "";
 		l1 = 0;
 
-		s2 = log_buf + end - chars;
+		s2 = log_buf + idx;
 		l2 = chars;
 	}
 
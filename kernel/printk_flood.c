@@ -0,0 +1,140 @@
+/*
+ * printk flood latency test
+ *
+ * Starts threads= threads, by default one per online cpu, that each log
+ * nr_msgs messages of len bytes at loglevel level= as fast as they can.
+ * Reports the 50th, 90th, 99th and 99.9th percentile and the maximum
+ * latency of printk() over all threads, and the throughput. With a slow
+ * console, e.g. a 115200 baud serial port, and a level that passes the
+ * console loglevel, compare the default against printk.synchronous=1 to
+ * see what printing to the console costs the callers.
+ *
+ *   modprobe printk_flood threads=4 nr_msgs=2000 len=80 level=6
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/latency_test.h>
+
+static unsigned int threads;
+module_param(threads, uint, 0444);
+MODULE_PARM_DESC(threads, "threads, 0 for one per online cpu");
+
+static unsigned int nr_msgs = 2000;
+module_param(nr_msgs, uint, 0444);
+MODULE_PARM_DESC(nr_msgs, "messages per thread");
+
+static unsigned int len = 80;
+module_param(len, uint, 0444);
+MODULE_PARM_DESC(len, "length of a message");
+
+static unsigned int level = 6;
+module_param(level, uint, 0444);
+MODULE_PARM_DESC(level, "loglevel of the messages");
+
+struct flood_thread {
+	struct task_struct	*task;
+	struct completion	done;
+	unsigned int		id;
+	u32			*ns;
+	unsigned int		nr;
+};
+
+static int flood_thread_fn(void *data)
+{
+	struct flood_thread *ft = data;
+	char *text;
+	unsigned int i;
+	ktime_t start;
+
+	text = kmalloc(len + 1, GFP_KERNEL);
+	if (!text)
+		goto out;
+	memset(text, 'x', len);
+	text[len] = '\0';
+
+	for (i = 0; i < nr_msgs; i++) {
+		start = ktime_get();
+		printk("<%u>printk_flood/%u: %6u %s\n", level, ft->id, i, text);
+		ft->ns[ft->nr++] = latency_test_ns(start, ktime_get());
+
+		cond_resched();
+	}
+	kfree(text);
+out:
+	complete(&ft->done);
+	return 0;
+}
+
+static int __init printk_flood_init(void)
+{
+	struct flood_thread *fts;
+	unsigned int i, nr = 0;
+	ktime_t start;
+	s64 usecs;
+	u32 *ns;
+	int ret = 0;
+
+	if (!threads)
+		threads = num_online_cpus();
+	if (!nr_msgs || level > 7)
+		return -EINVAL;
+
+	fts = kcalloc(threads, sizeof(*fts), GFP_KERNEL);
+	/* Sampled outside the timed calls, the buffers are merged below */
+	ns = vmalloc((size_t)threads * nr_msgs * sizeof(u32));
+	if (!fts || !ns) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	start = ktime_get();
+	for (i = 0; i < threads; i++) {
+		struct flood_thread *ft = &fts[i];
+
+		init_completion(&ft->done);
+		ft->id = i;
+		ft->ns = ns + (size_t)i * nr_msgs;
+		ft->task = kthread_run(flood_thread_fn, ft,
+				       "printk_flood/%u", i);
+		if (IS_ERR(ft->task))
+			complete(&ft->done);
+	}
+
+	for (i = 0; i < threads; i++) {
+		struct flood_thread *ft = &fts[i];
+
+		wait_for_completion(&ft->done);
+		/* Compact the samples of all threads at the front */
+		memmove(ns + nr, ft->ns, ft->nr * sizeof(u32));
+		nr += ft->nr;
+	}
+	usecs = ktime_us_delta(ktime_get(), start);
+	if (!nr)
+		goto out;
+
+	pr_info("printk_flood: %u threads, %u messages of %u bytes, "
+		"%lld usecs, %llu messages/s\n", threads, nr, len, usecs,
+		usecs ? div64_u64((u64)nr * USEC_PER_SEC, usecs) : 0ULL);
+	latency_test_report("printk_flood", "printk", ns, nr);
+
+out:
+	vfree(ns);
+	kfree(fts);
+	return ret;
+}
+
+static void __exit printk_flood_exit(void)
+{
+}
+
+module_init(printk_flood_init);
+module_exit(printk_flood_exit);
+
+MODULE_DESCRIPTION("printk flood latency test");
+MODULE_LICENSE("GPL");
@@ -46,6 +46,7 @@
 #include <linux/stat.h>
 #include <linux/srcu.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <asm/byteorder.h>
 
 MODULE_LICENSE("GPL");
@@ -72,6 +73,9 @@ static int stall_cpu_holdoff = 10; /* Time to wait until stall (s).  */
 static int test_boost = 1;	/* Test RCU prio boost: 0=no, 1=maybe, 2=yes. */
 static int test_boost_interval = 7; /* Interval between boost tests, seconds. */
 static int test_boost_duration = 4; /* Duration of each boost test, seconds. */
+static int cbflood_n;		/* Callbacks per flood, 0 to disable. */
+static int cbflood_inter_holdoff = 3; /* Wait time between floods (s). */
+static int cbflood_intra_holdoff = 1; /* Wait time within floods (jiffies). */
 static char *torture_type = "rcu"; /* What RCU implementation to torture. */
 
 module_param(nreaders, int, 0444);
@@ -112,6 +116,13 @@ module_param(test_boost_interval, int, 0444);
 MODULE_PARM_DESC(test_boost_interval, "Interval between boost tests, seconds.");
 module_param(test_boost_duration, int, 0444);
 MODULE_PARM_DESC(test_boost_duration, "Duration of each boost test, seconds.");
+module_param(cbflood_n, int, 0444);
+MODULE_PARM_DESC(cbflood_n, "Callbacks per flood, zero to disable.");
+module_param(cbflood_inter_holdoff, int, 0444);
+MODULE_PARM_DESC(cbflood_inter_holdoff, "Wait time between floods (s)");
+module_param(cbflood_intra_holdoff, int, 0444);
+MODULE_PARM_DESC(cbflood_intra_holdoff,
+		 "Holdoff time within floods (jiffies)");
 module_param(torture_type, charp, 0444);
 MODULE_PARM_DESC(torture_type, "Type of RCU to torture (rcu, rcu_bh, srcu)");
 
@@ -133,6 +144,7 @@ static struct task_struct *stats_task;
 static struct task_struct *shuffler_task;
 static struct task_struct *stutter_task;
 static struct task_struct *fqs_task;
+static struct task_struct *cbflood_task;
 static struct task_struct *boost_tasks[NR_CPUS];
 static struct task_struct *shutdown_task;
 #ifdef CONFIG_HOTPLUG_CPU
@@ -173,6 +185,10 @@ static long n_offline_attempts;
 static long n_offline_successes;
 static long n_online_attempts;
 static long n_online_successes;
+static long n_cbflood_posted;
+static atomic_long_t n_cbflood_invoked;
+static atomic_long_t n_cbflood_task;
+static atomic_long_t n_cbflood_error;
 static struct list_head rcu_torture_removed;
 static cpumask_var_t shuffle_tmp_mask;
 
@@ -327,6 +343,7 @@ struct rcu_torture_ops {
 	int (*completed)(void);
 	void (*deferred_free)(struct rcu_torture *p);
 	void (*sync)(void);
+	void (*call)(struct rcu_head *head, void (*func)(struct rcu_head *rcu));
 	void (*cb_barrier)(void);
 	void (*fqs)(void);
 	int (*stats)(char *page);
@@ -417,6 +434,7 @@ static struct rcu_torture_ops rcu_ops = {
 	.completed	= rcu_torture_completed,
 	.deferred_free	= rcu_torture_deferred_free,
 	.sync		= synchronize_rcu,
+	.call		= call_rcu,
 	.cb_barrier	= rcu_barrier,
 	.fqs		= rcu_force_quiescent_state,
 	.stats		= NULL,
@@ -519,6 +537,7 @@ static struct rcu_torture_ops rcu_bh_ops = {
 	.completed	= rcu_bh_torture_completed,
 	.deferred_free	= rcu_bh_torture_deferred_free,
 	.sync		= synchronize_rcu_bh,
+	.call		= call_rcu_bh,
 	.cb_barrier	= rcu_barrier_bh,
 	.fqs		= rcu_bh_force_quiescent_state,
 	.stats		= NULL,
@@ -714,6 +733,7 @@ static struct rcu_torture_ops sched_ops = {
 	.completed	= rcu_no_completed,
 	.deferred_free	= rcu_sched_torture_deferred_free,
 	.sync		= synchronize_sched,
+	.call		= call_rcu_sched,
 	.cb_barrier	= rcu_barrier_sched,
 	.fqs		= rcu_sched_force_quiescent_state,
 	.stats		= NULL,
@@ -1102,6 +1122,66 @@ rcu_torture_reader(void *arg)
 	return 0;
 }
 
+/*
+ * RCU torture callback-flood kthread.  Repeatedly queues floods of
+ * callbacks from whatever CPU it happens to run on, then waits for them
+ * with the flavor's barrier.  Each callback remembers the CPU it was
+ * queued on, so that callbacks of CPUs whose callbacks are offloaded
+ * can be checked to never be invoked from softirq.
+ */
+#define CBFLOOD_BLOCK	100	/* Callbacks queued between holdoffs. */
+
+struct rcu_cbflood {
+	struct rcu_head rh;
+	int cpu;
+};
+
+static struct rcu_cbflood *rcu_cbflood_heads;
+
+static void rcu_torture_cbflood_cb(struct rcu_head *rhp)
+{
+	struct rcu_cbflood *cbp = container_of(rhp, struct rcu_cbflood, rh);
+
+	atomic_long_inc(&n_cbflood_invoked);
+	if (!in_serving_softirq())
+		atomic_long_inc(&n_cbflood_task);
+	else if (rcu_is_nocb_cpu(cbp->cpu))
+		atomic_long_inc(&n_cbflood_error);
+}
+
+static int
+rcu_torture_cbflood(void *arg)
+{
+	int i;
+	struct rcu_cbflood *cbp;
+
+	VERBOSE_PRINTK_STRING("rcu_torture_cbflood task started");
+	do {
+		schedule_timeout_interruptible(cbflood_inter_holdoff * HZ);
+		for (i = 0; i < cbflood_n && !kthread_should_stop(); i++) {
+			cbp = &rcu_cbflood_heads[i];
+			preempt_disable();
+			cbp->cpu = smp_processor_id();
+			cur_ops->call(&cbp->rh, rcu_torture_cbflood_cb);
+			preempt_enable();
+			n_cbflood_posted++;
+			if ((i + 1) % CBFLOOD_BLOCK == 0)
+				schedule_timeout_interruptible(
+						cbflood_intra_holdoff);
+		}
+		/* The barrier must wait for offloaded callbacks as well. */
+		cur_ops->cb_barrier();
+		if (atomic_long_read(&n_cbflood_invoked) != n_cbflood_posted)
+			atomic_long_inc(&n_cbflood_error);
+		rcu_stutter_wait("rcu_torture_cbflood");
+	} while (!kthread_should_stop() && fullstop == FULLSTOP_DONTSTOP);
+	VERBOSE_PRINTK_STRING("rcu_torture_cbflood task stopping");
+	rcutorture_shutdown_absorb("rcu_torture_cbflood");
+	while (!kthread_should_stop())
+		schedule_timeout_uninterruptible(1);
+	return 0;
+}
+
 /*
  * Create an RCU-torture statistics message in the specified buffer.
  */
@@ -1129,7 +1209,8 @@ rcu_torture_printk(char *page)
 		       "rtc: %p ver: %lu tfle: %d rta: %d rtaf: %d rtf: %d "
 		       "rtmbe: %d rtbke: %ld rtbre: %ld "
 		       "rtbf: %ld rtb: %ld nt: %ld "
-		       "onoff: %ld/%ld:%ld/%ld",
+		       "onoff: %ld/%ld:%ld/%ld "
+		       "cbf: %ld/%ld:%ld:%ld",
 		       rcu_torture_current,
 		       rcu_torture_current_version,
 		       list_empty(&rcu_torture_freelist),
@@ -1145,11 +1226,16 @@ rcu_torture_printk(char *page)
 		       n_online_successes,
 		       n_online_attempts,
 		       n_offline_successes,
-		       n_offline_attempts);
+		       n_offline_attempts,
+		       atomic_long_read(&n_cbflood_invoked),
+		       n_cbflood_posted,
+		       atomic_long_read(&n_cbflood_task),
+		       atomic_long_read(&n_cbflood_error));
 	if (atomic_read(&n_rcu_torture_mberror) != 0 ||
 	    n_rcu_torture_boost_ktrerror != 0 ||
 	    n_rcu_torture_boost_rterror != 0 ||
-	    n_rcu_torture_boost_failure != 0)
+	    n_rcu_torture_boost_failure != 0 ||
+	    atomic_long_read(&n_cbflood_error) != 0)
 		cnt += sprintf(&page[cnt], " !!!");
 	cnt += sprintf(&page[cnt], "\n%s%s ", torture_type, TORTURE_FLAG);
 	if (i > 1) {
@@ -1310,13 +1396,16 @@ rcu_torture_print_module_parms(struct rcu_torture_ops *cur_ops, char *tag)
 		"fqs_duration=%d fqs_holdoff=%d fqs_stutter=%d "
 		"test_boost=%d/%d test_boost_interval=%d "
 		"test_boost_duration=%d shutdown_secs=%d "
-		"onoff_interval=%d onoff_holdoff=%d\n",
+		"onoff_interval=%d onoff_holdoff=%d "
+		"cbflood_n=%d cbflood_inter_holdoff=%d "
+		"cbflood_intra_holdoff=%d\n",
 		torture_type, tag, nrealreaders, nfakewriters,
 		stat_interval, verbose, test_no_idle_hz, shuffle_interval,
 		stutter, irqreader, fqs_duration, fqs_holdoff, fqs_stutter,
 		test_boost, cur_ops->can_boost,
 		test_boost_interval, test_boost_duration, shutdown_secs,
-		onoff_interval, onoff_holdoff);
+		onoff_interval, onoff_holdoff, cbflood_n,
+		cbflood_inter_holdoff, cbflood_intra_holdoff);
 }
 
 static struct notifier_block rcutorture_shutdown_nb = {
@@ -1655,6 +1744,14 @@ rcu_torture_cleanup(void)
 		kthread_stop(fqs_task);
 	}
 	fqs_task = NULL;
+
+	if (cbflood_task) {
+		VERBOSE_PRINTK_STRING("Stopping rcu_torture_cbflood task");
+		kthread_stop(cbflood_task);
+	}
+	cbflood_task = NULL;
+	vfree(rcu_cbflood_heads);
+	rcu_cbflood_heads = NULL;
 	if ((test_boost == 1 && cur_ops->can_boost) ||
 	    test_boost == 2) {
 		unregister_cpu_notifier(&rcutorture_cpu_nb);
@@ -1753,6 +1850,10 @@ rcu_torture_init(void)
 	n_rcu_torture_boost_rterror = 0;
 	n_rcu_torture_boost_failure = 0;
 	n_rcu_torture_boosts = 0;
+	n_cbflood_posted = 0;
+	atomic_long_set(&n_cbflood_invoked, 0);
+	atomic_long_set(&n_cbflood_task, 0);
+	atomic_long_set(&n_cbflood_error, 0);
 	for (i = 0; i < RCU_TORTURE_PIPE_LEN + 1; i++)
 		atomic_set(&rcu_torture_wcount[i], 0);
 	for_each_possible_cpu(cpu) {
@@ -1866,6 +1967,23 @@ rcu_torture_init(void)
 			goto unwind;
 		}
 	}
+	if (cbflood_n > 0 && cur_ops->call && cur_ops->cb_barrier) {
+		/* Create the callback-flood thread */
+		rcu_cbflood_heads = vmalloc(cbflood_n *
+					    sizeof(*rcu_cbflood_heads));
+		if (!rcu_cbflood_heads) {
+			firsterr = -ENOMEM;
+			goto unwind;
+		}
+		cbflood_task = kthread_run(rcu_torture_cbflood, NULL,
+					   "rcu_torture_cbflood");
+		if (IS_ERR(cbflood_task)) {
+			firsterr = PTR_ERR(cbflood_task);
+			VERBOSE_PRINTK_ERRSTRING("Failed to create cbflood");
+			cbflood_task = NULL;
+			goto unwind;
+		}
+	}
 	if (test_boost_interval < 1)
 		test_boost_interval = 1;
 	if (test_boost_duration < 2)
@@ -25,6 +25,7 @@
  */
 
 #include <linux/delay.h>
+#include <linux/bootmem.h>
 
 #define RCU_KTHREAD_PRIO 1
 
@@ -70,11 +71,12 @@ static void __init rcu_bootup_announce_oddness(void)
 #if NUM_RCU_LVL_4 != 0
 	printk(KERN_INFO "\tExperimental four-level hierarchy is enabled.\n");
 #endif
+	rcu_nocb_announce();
 }
 
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
-struct rcu_state rcu_preempt_state = RCU_STATE_INITIALIZER(rcu_preempt);
+struct rcu_state rcu_preempt_state = RCU_STATE_INITIALIZER(rcu_preempt, 'p');
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -700,7 +702,7 @@ static void rcu_preempt_do_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 0);
+	__call_rcu(head, func, &rcu_preempt_state, 0, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -714,7 +716,7 @@ EXPORT_SYMBOL_GPL(call_rcu);
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 1);
+	__call_rcu(head, func, &rcu_preempt_state, 1, true);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -1132,7 +1134,7 @@ static void rcu_preempt_process_callbacks(void)
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state, 1);
+	__call_rcu(head, func, &rcu_sched_state, 1, true);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -2299,3 +2301,312 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-selected set of CPUs in
+ * rcu_nocb_mask.  Callbacks queued on these CPUs go to a lockless
+ * per-CPU list that a per-CPU per-flavor "rcuo" kthread takes in one
+ * go.  The kthread then waits for a grace period and invokes the whole
+ * batch in process context, so the offloaded CPUs never run callbacks
+ * in softirq.  The kthreads start out on the CPUs that are not
+ * offloaded, and may be moved anywhere else with sched_setaffinity().
+ */
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Tell them which CPUs have their callbacks offloaded. */
+static void __init rcu_nocb_announce(void)
+{
+	static char nocb_buf[NR_CPUS * 5] __initdata;
+
+	if (!have_rcu_nocb_mask)
+		return;
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	cpulist_scnprintf(nocb_buf, sizeof(nocb_buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n",
+	       nocb_buf);
+}
+
+/* Is the specified CPU a no-CBs CPU? */
+bool rcu_is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+EXPORT_SYMBOL_GPL(rcu_is_nocb_cpu);
+
+/*
+ * Enqueue the specified callback onto the specified CPU's offload list,
+ * waking up the rcuo kthread if the list was empty.  The kthread's
+ * wakeup is left to the next RCU_SOFTIRQ on this CPU when the caller
+ * runs with interrupts disabled, as it might hold scheduler locks.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp, bool lazy,
+				    bool defer)
+{
+	struct rcu_head **old_rhpp;
+	long len;
+
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	len = atomic_long_inc_return(&rdp->nocb_q_count);
+	if (lazy)
+		atomic_long_inc(&rdp->nocb_q_count_lazy);
+	if (len > rdp->qlen_max)
+		rdp->qlen_max = len;
+
+	/* Only the first callback of a batch needs to wake the kthread. */
+	if (old_rhpp != &rdp->nocb_head || !ACCESS_ONCE(rdp->nocb_kthread))
+		return;
+	if (defer)
+		ACCESS_ONCE(rdp->nocb_defer_wakeup) = true;
+	else
+		wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * Queue the callback onto this CPU's offload list if this CPU's
+ * callbacks are offloaded, returning true if so.  Called by __call_rcu()
+ * with interrupts disabled, flags being the caller's interrupt state.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy, unsigned long flags)
+{
+	if (!rcu_is_nocb_cpu(rdp->cpu))
+		return false;
+	__call_rcu_nocb_enqueue(rdp, rhp, lazy, irqs_disabled_flags(flags));
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+				(unsigned long)rhp->func,
+				atomic_long_read(&rdp->nocb_q_count_lazy),
+				atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+	return true;
+}
+
+/* Does this CPU's rcuo kthread of the given flavor need a wakeup? */
+static bool rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
+{
+	return ACCESS_ONCE(rdp->nocb_defer_wakeup);
+}
+
+/* Does any of this CPU's rcuo kthreads need a wakeup? */
+static bool rcu_nocb_cpu_needs_wakeup(int cpu)
+{
+	return rcu_nocb_need_deferred_wakeup(&per_cpu(rcu_sched_data, cpu)) ||
+	       rcu_nocb_need_deferred_wakeup(&per_cpu(rcu_bh_data, cpu)) ||
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	       rcu_nocb_need_deferred_wakeup(&per_cpu(rcu_preempt_data, cpu)) ||
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	       false;
+}
+
+/* Do the wakeup that __call_rcu_nocb_enqueue() had to defer. */
+static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
+{
+	if (!rcu_nocb_need_deferred_wakeup(rdp))
+		return;
+	ACCESS_ONCE(rdp->nocb_defer_wakeup) = false;
+	wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * Queue an rcu_barrier() callback behind the callbacks already on each
+ * offload list, whether the CPU is online or not: an offline CPU's rcuo
+ * kthread keeps invoking what was queued before the CPU went away.
+ */
+static void rcu_barrier_nocb(struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_head *head;
+
+	if (!have_rcu_nocb_mask)
+		return;
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		head = &per_cpu(rcu_barrier_head, cpu);
+		debug_rcu_head_queue(head);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		__call_rcu_nocb_enqueue(per_cpu_ptr(rsp->rda, cpu), head,
+					false, false);
+	}
+}
+
+/*
+ * Wait for a grace period of the kthread's flavor to elapse.  The
+ * callback goes onto the regular list of whatever CPU the kthread runs
+ * on, even an offloaded one, so that the RCU core handles it.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_synchronize rcu;
+
+	init_rcu_head_on_stack(&rcu.head);
+	init_completion(&rcu.completion);
+	__call_rcu(&rcu.head, wakeme_after_rcu, rdp->rsp, 0, false);
+	wait_for_completion(&rcu.completion);
+	destroy_rcu_head_on_stack(&rcu.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for offloaded CPUs.  Each kthread
+ * takes everything queued since its last pass, waits for a grace
+ * period and invokes the callbacks.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	int c, cl;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	for (;;) {
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			flush_signals(current);
+			continue;
+		}
+
+		/* Take the whole list, then wait for a grace period. */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
+		rdp->n_nocb_batches++;
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for an enqueue still linking in its callback. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			cond_resched();
+			list = next;
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!rdp->nocb_head,
+				    0, 0, 1);
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+		rdp->n_cbs_invoked += c;
+	}
+	return 0;
+}
+
+/* Initialize per-rcu_data variables for offloading. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/* Create an rcuo kthread for each offloaded CPU of the given flavor. */
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp,
+					   const struct cpumask *cm)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		t = kthread_create(rcu_nocb_kthread, rdp,
+				   "rcuo%c/%d", rsp->abbr, cpu);
+		BUG_ON(IS_ERR(t));
+		/* Keep off the offloaded CPUs if there is anywhere else. */
+		if (!cpumask_empty(cm))
+			set_cpus_allowed_ptr(t, cm);
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+		wake_up_process(t);
+	}
+}
+
+/*
+ * Spawn the rcuo kthreads.  Callbacks queued on offloaded CPUs before
+ * then simply wait on the offload lists.
+ */
+static int __init rcu_spawn_nocb_kthreads_all(void)
+{
+	cpumask_var_t cm;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	if (!zalloc_cpumask_var(&cm, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(cm, cpu_possible_mask, rcu_nocb_mask);
+	rcu_spawn_nocb_kthreads(&rcu_sched_state, cm);
+	rcu_spawn_nocb_kthreads(&rcu_bh_state, cm);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads(&rcu_preempt_state, cm);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	free_cpumask_var(cm);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads_all);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static void __init rcu_nocb_announce(void)
+{
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy, unsigned long flags)
+{
+	return false;
+}
+
+static bool rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
+{
+	return false;
+}
+
+static bool rcu_nocb_cpu_needs_wakeup(int cpu)
+{
+	return false;
+}
+
+static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
+{
+}
+
+static void rcu_barrier_nocb(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
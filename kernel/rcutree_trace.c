@@ -82,6 +82,14 @@ static void print_one_rcu_data(struct seq_file *m, struct rcu_data *rdp)
 		   ".W"[rdp->nxttail[RCU_DONE_TAIL] !=
 			rdp->nxttail[RCU_WAIT_TAIL]],
 		   ".D"[&rdp->nxtlist != rdp->nxttail[RCU_DONE_TAIL]]);
+	seq_printf(m, " qm=%ld", rdp->qlen_max);
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_printf(m, " oq=%ld/%ld op=%ld/%ld ob=%lu",
+		   atomic_long_read(&rdp->nocb_q_count_lazy),
+		   atomic_long_read(&rdp->nocb_q_count),
+		   rdp->nocb_p_count_lazy, rdp->nocb_p_count,
+		   rdp->n_nocb_batches);
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 #ifdef CONFIG_RCU_BOOST
 	seq_printf(m, " kt=%d/%c/%d ktl=%x",
 		   per_cpu(rcu_cpu_has_work, rdp->cpu),
@@ -153,6 +161,14 @@ static void print_one_rcu_data_csv(struct seq_file *m, struct rcu_data *rdp)
 		   ".W"[rdp->nxttail[RCU_DONE_TAIL] !=
 			rdp->nxttail[RCU_WAIT_TAIL]],
 		   ".D"[&rdp->nxtlist != rdp->nxttail[RCU_DONE_TAIL]]);
+	seq_printf(m, ",%ld", rdp->qlen_max);
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_printf(m, ",%ld,%ld,%ld,%ld,%lu",
+		   atomic_long_read(&rdp->nocb_q_count_lazy),
+		   atomic_long_read(&rdp->nocb_q_count),
+		   rdp->nocb_p_count_lazy, rdp->nocb_p_count,
+		   rdp->n_nocb_batches);
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 #ifdef CONFIG_RCU_BOOST
 	seq_printf(m, ",%d,\"%c\"",
 		   per_cpu(rcu_cpu_has_work, rdp->cpu),
@@ -168,7 +184,10 @@ static int show_rcudata_csv(struct seq_file *m, void *unused)
 {
 	seq_puts(m, "\"CPU\",\"Online?\",\"c\",\"g\",\"pq\",\"pgp\",\"pq\",");
 	seq_puts(m, "\"dt\",\"dt nesting\",\"dt NMI nesting\",\"df\",");
-	seq_puts(m, "\"of\",\"qll\",\"ql\",\"qs\"");
+	seq_puts(m, "\"of\",\"qll\",\"ql\",\"qs\",\"qm\"");
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_puts(m, ",\"oql\",\"oq\",\"opl\",\"op\",\"ob\"");
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 #ifdef CONFIG_RCU_BOOST
 	seq_puts(m, "\"kt\",\"ktl\"");
 #endif /* #ifdef CONFIG_RCU_BOOST */
@@ -979,6 +979,330 @@ static inline void update_entity_shares_tick(struct cfs_rq *cfs_rq)
 }
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
+#ifdef CONFIG_SMP
+/*
+ * Per-entity load tracking
+ *
+ * The runnable and running time of an entity is accumulated in 1024us
+ * periods, each period weighing y times the one after it, y^32 = 1/2:
+ *
+ *   sum = u_0 + u_1*y + u_2*y^2 + ...
+ *
+ * where u_i is the time (in us, at most 1024) that the entity was
+ * runnable i periods ago. Only the current, partial period needs to be
+ * kept apart; folding it in decays everything else by one step.
+ */
+#define LOAD_AVG_PERIOD	32
+#define LOAD_AVG_MAX	47742	/* maximum possible sum */
+#define LOAD_AVG_MAX_N	345	/* periods until the sum reaches LOAD_AVG_MAX */
+
+/* Precomputed fixed inverse multiplies for y^n, n < LOAD_AVG_PERIOD */
+static const u32 runnable_avg_yN_inv[] = {
+	0xffffffff, 0xfa83b2db, 0xf5257d15, 0xefe4b99b, 0xeac0c6e7, 0xe5b906e7,
+	0xe0ccdeec, 0xdbfbb797, 0xd744fcca, 0xd2a81d91, 0xce248c15, 0xc9b9bd86,
+	0xc5672a11, 0xc12c4cca, 0xbd08a39f, 0xb8fbaf47, 0xb504f333, 0xb123f581,
+	0xad583eea, 0xa9a15ab4, 0xa5fed6a9, 0xa2704303, 0x9ef53260, 0x9b8d39b9,
+	0x9837f051, 0x94f4efa8, 0x91c3d373, 0x8ea4398b, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/* 1024 * sum(y^k) for k = 1..n, the sum of n full periods */
+static const u32 runnable_avg_yN_sum[] = {
+	    0, 1002, 1982, 2942, 3881, 4800, 5699, 6579, 7440, 8282,
+	 9107, 9914, 10704, 11476, 12232, 12972, 13696, 14405, 15098, 15777,
+	16441, 17091, 17726, 18349, 18957, 19553, 20136, 20707, 21265, 21812,
+	22346, 22870, 23382,
+};
+
+/* Approximately val * y^n */
+static u64 decay_load(u64 val, u64 n)
+{
+	unsigned int local_n;
+
+	if (!n)
+		return val;
+	else if (unlikely(n > LOAD_AVG_PERIOD * 63))
+		return 0;
+
+	local_n = n;
+	/* y^32 = 1/2, so whole half-lives are shifts */
+	if (unlikely(local_n >= LOAD_AVG_PERIOD)) {
+		val >>= local_n / LOAD_AVG_PERIOD;
+		local_n %= LOAD_AVG_PERIOD;
+	}
+
+	val *= runnable_avg_yN_inv[local_n];
+	return val >> 32;
+}
+
+/* The contribution of n full periods of runnable time: 1024 * sum(y^k) */
+static u32 __compute_runnable_contrib(u64 n)
+{
+	u32 contrib = 0;
+
+	if (likely(n <= LOAD_AVG_PERIOD))
+		return runnable_avg_yN_sum[n];
+	else if (unlikely(n >= LOAD_AVG_MAX_N))
+		return LOAD_AVG_MAX;
+
+	/* Add in whole half-lives, each one halving what came before */
+	do {
+		contrib /= 2;
+		contrib += runnable_avg_yN_sum[LOAD_AVG_PERIOD];
+		n -= LOAD_AVG_PERIOD;
+	} while (n > LOAD_AVG_PERIOD);
+
+	contrib = decay_load(contrib, n);
+	return contrib + runnable_avg_yN_sum[n];
+}
+
+/*
+ * Bring the sums of @sa up to @now, the time since the last update having
+ * been spent @runnable and @running or not. Returns non-zero when at least
+ * one period boundary was crossed and the sums have decayed.
+ */
+static int __update_entity_runnable_avg(u64 now, struct sched_avg *sa,
+					int runnable, int running)
+{
+	u64 delta, periods;
+	u32 contrib;
+	int delta_w, decayed = 0;
+
+	delta = now - sa->last_update;
+	/*
+	 * The clock went backwards, as after a migration between cpus
+	 * whose clocks are not in sync. Start over from here.
+	 */
+	if ((s64)delta < 0) {
+		sa->last_update = now;
+		return 0;
+	}
+
+	/* Use 1024ns as the unit of measurement, it is close enough to 1us */
+	delta >>= 10;
+	if (!delta)
+		return 0;
+	sa->last_update = now;
+
+	/* Time already accumulated in the current period */
+	delta_w = sa->avg_period % 1024;
+	if (delta + delta_w >= 1024) {
+		decayed = 1;
+
+		/* Complete the current period */
+		delta_w = 1024 - delta_w;
+		if (runnable)
+			sa->runnable_avg_sum += delta_w;
+		if (running)
+			sa->running_avg_sum += delta_w;
+		sa->avg_period += delta_w;
+		delta -= delta_w;
+
+		/* Decay it along with the full periods that followed */
+		periods = delta / 1024;
+		delta %= 1024;
+		sa->runnable_avg_sum = decay_load(sa->runnable_avg_sum,
+						  periods + 1);
+		sa->running_avg_sum = decay_load(sa->running_avg_sum,
+						 periods + 1);
+		sa->avg_period = decay_load(sa->avg_period, periods + 1);
+
+		/* And add in what those full periods contributed */
+		contrib = __compute_runnable_contrib(periods);
+		if (runnable)
+			sa->runnable_avg_sum += contrib;
+		if (running)
+			sa->running_avg_sum += contrib;
+		sa->avg_period += contrib;
+	}
+
+	/* The remainder starts the new current period */
+	if (runnable)
+		sa->runnable_avg_sum += delta;
+	if (running)
+		sa->running_avg_sum += delta;
+	sa->avg_period += delta;
+
+	return decayed;
+}
+
+/*
+ * Recompute the load @se contributes to its cfs_rq from its runnable
+ * average and weight, and its utilisation. Returns the change of the
+ * load contribution.
+ */
+static long __update_entity_avg_contrib(struct sched_entity *se)
+{
+	struct sched_avg *sa = &se->avg;
+	long old_contrib = sa->load_avg_contrib;
+	u64 contrib;
+
+	contrib = (u64)sa->runnable_avg_sum * scale_load_down(se->load.weight);
+	sa->load_avg_contrib = scale_load(div_u64(contrib, sa->avg_period + 1));
+	sa->util_avg = sa->running_avg_sum * SCHED_POWER_SCALE /
+		       (sa->avg_period + 1);
+
+	return sa->load_avg_contrib - old_contrib;
+}
+
+/* Update the averages of @se and its part of cfs_rq->runnable_load_avg */
+static void update_entity_load_avg(struct sched_entity *se)
+{
+	struct cfs_rq *cfs_rq = cfs_rq_of(se);
+	long contrib_delta;
+
+	if (!__update_entity_runnable_avg(rq_of(cfs_rq)->clock_task, &se->avg,
+					  se->on_rq, cfs_rq->curr == se))
+		return;
+
+	contrib_delta = __update_entity_avg_contrib(se);
+	if (se->on_rq)
+		cfs_rq->runnable_load_avg += contrib_delta;
+
+	if (entity_is_task(se))
+		trace_sched_pelt_se(task_of(se));
+}
+
+/*
+ * Track how much of the time @cfs_rq had something queued and something
+ * running. For the root cfs_rq this is the cpu utilisation by CFS tasks.
+ */
+static void update_cfs_rq_util(struct cfs_rq *cfs_rq)
+{
+	struct sched_avg *sa = &cfs_rq->avg;
+	struct rq *rq = rq_of(cfs_rq);
+
+	if (!__update_entity_runnable_avg(rq->clock_task, sa,
+					  cfs_rq->nr_running != 0,
+					  cfs_rq->curr != NULL))
+		return;
+
+	sa->util_avg = sa->running_avg_sum * SCHED_POWER_SCALE /
+		       (sa->avg_period + 1);
+
+	if (cfs_rq == &rq->cfs)
+		trace_sched_pelt_cpu(cpu_of(rq), cfs_rq->runnable_load_avg,
+				     sa->util_avg);
+}
+
+/*
+ * Add the contribution of @se to @cfs_rq on enqueue. On wakeup, the
+ * average is rewound to when @se went to sleep and decayed for all of
+ * the sleep, which is measured in rq->clock as the sleep statistics are:
+ * that clock is comparable between cpus and up to date on the rq @se is
+ * enqueued on, whether or not the cpu it slept on went idle meanwhile.
+ * A task that moves while runnable has no time to decay and continues
+ * from this cpu's clock.
+ */
+static void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
+				    struct sched_entity *se, int flags)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	u64 now = rq->clock_task;
+	s64 slept;
+
+	if (flags & ENQUEUE_WAKEUP) {
+		slept = rq->clock - se->avg.blocked_since;
+		se->avg.last_update = now - clamp_t(s64, slept, 0, now);
+		__update_entity_runnable_avg(now, &se->avg, 0, 0);
+	} else {
+		se->avg.last_update = now;
+	}
+
+	__update_entity_avg_contrib(se);
+	cfs_rq->runnable_load_avg += se->avg.load_avg_contrib;
+}
+
+static void dequeue_entity_load_avg(struct cfs_rq *cfs_rq,
+				    struct sched_entity *se, int flags)
+{
+	update_entity_load_avg(se);
+	cfs_rq->runnable_load_avg -= min(cfs_rq->runnable_load_avg,
+					 se->avg.load_avg_contrib);
+	if (flags & DEQUEUE_SLEEP)
+		se->avg.blocked_since = rq_of(cfs_rq)->clock;
+}
+
+/*
+ * Give a new task the load of a task that was runnable for all of its
+ * first slice, so that a burst of forks is not placed as if it were free.
+ */
+static void init_task_runnable_average(struct task_struct *p,
+				       struct cfs_rq *cfs_rq)
+{
+	u32 slice = sched_slice(cfs_rq, &p->se) >> 10;
+
+	p->se.avg.runnable_avg_sum = slice;
+	p->se.avg.avg_period = slice;
+	p->se.avg.last_update = rq_of(cfs_rq)->clock_task;
+	__update_entity_avg_contrib(&p->se);
+}
+
+/**
+ * sched_get_cpu_util - CFS utilisation of a cpu
+ * @cpu: the cpu
+ *
+ * Returns the decayed fraction of time @cpu spent running CFS tasks,
+ * SCHED_POWER_SCALE being busy all the time. Meant for cpufreq and
+ * hotplug governors that so far sampled the idle time or nr_running.
+ */
+unsigned long sched_get_cpu_util(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long util = ACCESS_ONCE(rq->cfs.avg.util_avg);
+	u64 last_update = ACCESS_ONCE(rq->cfs.avg.last_update);
+	s64 delta;
+
+	/*
+	 * An idle cpu does not update its average until it runs again;
+	 * decay it for the time it has been idle so far.
+	 */
+	if (idle_cpu(cpu)) {
+		delta = sched_clock_cpu(cpu) - last_update;
+		if (delta > 0)
+			util = decay_load(util, delta >> 20);
+	}
+	return util;
+}
+EXPORT_SYMBOL_GPL(sched_get_cpu_util);
+
+/**
+ * sched_get_cpu_load - decayed CFS load of a cpu
+ * @cpu: the cpu
+ *
+ * Returns the sum of the load contributions of the CFS entities queued
+ * on @cpu, a task that is always runnable counting for its weight.
+ */
+unsigned long sched_get_cpu_load(int cpu)
+{
+	return ACCESS_ONCE(cpu_rq(cpu)->cfs.runnable_load_avg);
+}
+EXPORT_SYMBOL_GPL(sched_get_cpu_load);
+#else /* CONFIG_SMP */
+static inline void update_entity_load_avg(struct sched_entity *se)
+{
+}
+
+static inline void update_cfs_rq_util(struct cfs_rq *cfs_rq)
+{
+}
+
+static inline void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
+					   struct sched_entity *se, int flags)
+{
+}
+
+static inline void dequeue_entity_load_avg(struct cfs_rq *cfs_rq,
+					   struct sched_entity *se, int flags)
+{
+}
+
+static inline void init_task_runnable_average(struct task_struct *p,
+					      struct cfs_rq *cfs_rq)
+{
+}
+#endif /* CONFIG_SMP */
+
 static void enqueue_sleeper(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
 #ifdef CONFIG_SCHEDSTATS
@@ -1105,6 +1429,8 @@ enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	 */
 	update_curr(cfs_rq);
 	update_cfs_load(cfs_rq, 0);
+	update_cfs_rq_util(cfs_rq);
+	enqueue_entity_load_avg(cfs_rq, se, flags);
 	account_entity_enqueue(cfs_rq, se);
 	update_cfs_shares(cfs_rq);
 
@@ -1196,6 +1522,8 @@ dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 
 	clear_buddies(cfs_rq, se);
 
+	update_cfs_rq_util(cfs_rq);
+	dequeue_entity_load_avg(cfs_rq, se, flags);
 	if (se != cfs_rq->curr)
 		__dequeue_entity(cfs_rq, se);
 	se->on_rq = 0;
@@ -1269,8 +1597,10 @@ set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		 */
 		update_stats_wait_end(cfs_rq, se);
 		__dequeue_entity(cfs_rq, se);
+		update_entity_load_avg(se);
 	}
 
+	update_cfs_rq_util(cfs_rq);
 	update_stats_curr_start(cfs_rq, se);
 	cfs_rq->curr = se;
 #ifdef CONFIG_SCHEDSTATS
@@ -1348,7 +1678,9 @@ static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
 		update_stats_wait_start(cfs_rq, prev);
 		/* Put 'current' back into the tree. */
 		__enqueue_entity(cfs_rq, prev);
+		update_entity_load_avg(prev);
 	}
+	update_cfs_rq_util(cfs_rq);
 	cfs_rq->curr = NULL;
 }
 
@@ -1365,6 +1697,12 @@ entity_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr, int queued)
 	 */
 	update_entity_shares_tick(cfs_rq);
 
+	/*
+	 * Decay the load and utilisation averages of the running entity.
+	 */
+	update_entity_load_avg(curr);
+	update_cfs_rq_util(cfs_rq);
+
 #ifdef CONFIG_SCHED_HRTICK
 	/*
 	 * queued ticks are scheduled to match the slice, so don't bother
@@ -2287,9 +2625,19 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 /* Used instead of source_load when we know the type == 0 */
 static unsigned long weighted_cpuload(const int cpu)
 {
+	if (sched_feat(PELT_LOAD))
+		return cpu_rq(cpu)->cfs.runnable_load_avg;
 	return cpu_rq(cpu)->load.weight;
 }
 
+/* The load @p adds to the runqueue it is placed on */
+static unsigned long task_load(struct task_struct *p)
+{
+	if (sched_feat(PELT_LOAD))
+		return p->se.avg.load_avg_contrib;
+	return p->se.load.weight;
+}
+
 /*
  * Return a low guess at the load of a migration-source cpu weighted
  * according to the scheduling class and "nice" value.
@@ -2334,7 +2682,7 @@ static unsigned long cpu_avg_load_per_task(int cpu)
 	unsigned long nr_running = ACCESS_ONCE(rq->nr_running);
 
 	if (nr_running)
-		return rq->load.weight / nr_running;
+		return weighted_cpuload(cpu) / nr_running;
 
 	return 0;
 }
@@ -2499,14 +2847,14 @@ static int wake_affine(struct sched_domain *sd, struct task_struct *p, int sync)
 	 */
 	if (sync) {
 		tg = task_group(current);
-		weight = current->se.load.weight;
+		weight = task_load(current);
 
 		this_load += effective_load(tg, this_cpu, -weight, -weight);
 		load += effective_load(tg, prev_cpu, 0, -weight);
 	}
 
 	tg = task_group(p);
-	weight = p->se.load.weight;
+	weight = task_load(p);
 
 	/*
 	 * In low-load situations, where prev_cpu is idle and this_cpu is idle
@@ -3375,7 +3723,11 @@ static int tg_load_down(struct task_group *tg, void *data)
 	long cpu = (long)data;
 
 	if (!tg->parent) {
-		load = cpu_rq(cpu)->load.weight;
+		load = weighted_cpuload(cpu);
+	} else if (sched_feat(PELT_LOAD)) {
+		load = tg->parent->cfs_rq[cpu]->h_load;
+		load *= tg->se[cpu]->avg.load_avg_contrib;
+		load /= tg->parent->cfs_rq[cpu]->runnable_load_avg + 1;
 	} else {
 		load = tg->parent->cfs_rq[cpu]->h_load;
 		load *= tg->se[cpu]->load.weight;
@@ -3397,12 +3749,16 @@ static void update_h_load(long cpu)
 static unsigned long task_h_load(struct task_struct *p)
 {
 	struct cfs_rq *cfs_rq = task_cfs_rq(p);
-	unsigned long load;
+	unsigned long weight;
+	u64 load;
 
-	load = p->se.load.weight;
-	load = div_u64(load * cfs_rq->h_load, cfs_rq->load.weight + 1);
+	if (sched_feat(PELT_LOAD))
+		weight = cfs_rq->runnable_load_avg;
+	else
+		weight = cfs_rq->load.weight;
 
-	return load;
+	load = task_load(p);
+	return div_u64(load * cfs_rq->h_load, weight + 1);
 }
 #else
 static inline void update_shares(int cpu)
@@ -3415,7 +3771,7 @@ static inline void update_h_load(long cpu)
 
 static unsigned long task_h_load(struct task_struct *p)
 {
-	return p->se.load.weight;
+	return task_load(p);
 }
 #endif
 
@@ -5210,6 +5566,7 @@ static void task_fork_fair(struct task_struct *p)
 	}
 
 	update_curr(cfs_rq);
+	init_task_runnable_average(p, cfs_rq);
 
 	if (curr)
 		se->vruntime = curr->vruntime;
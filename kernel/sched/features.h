@@ -69,3 +69,9 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
+
+/*
+ * Balance and place wakeups on the decayed per-entity load averages
+ * instead of the instantaneous runqueue weights.
+ */
+SCHED_FEAT(PELT_LOAD, true)
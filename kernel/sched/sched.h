@@ -222,6 +222,16 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	/*
+	 * runnable_load_avg is the sum of the load_avg_contrib of the
+	 * entities queued here; avg tracks how often the cfs_rq itself
+	 * had something queued and something running.
+	 */
+	unsigned long runnable_load_avg;
+	struct sched_avg avg;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -0,0 +1,235 @@
+/*
+ * Timer storm latency test
+ *
+ * Starts threads= threads, by default one per online cpu, each bound to
+ * its cpu and owning nr_timers timers with random timeouts of up to
+ * timeout_ms. The timers re-arm themselves when they fire and every
+ * millisecond the thread pushes rearm= random ones of them forward, the
+ * way network and keepalive timers are re-armed on every packet. A
+ * hrtimer fires every probe_us on each cpu meanwhile and records how
+ * late its interrupt ran, which is what a timer softirq holding the base
+ * lock with interrupts disabled delays. After secs= seconds reports the
+ * 50th, 90th, 99th and 99.9th percentile and the maximum of the interrupt
+ * latency and of the cost of mod_timer(), over all threads.
+ *
+ *   modprobe timer_storm nr_timers=20000 timeout_ms=10000 secs=10
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/hrtimer.h>
+#include <linux/timer.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/delay.h>
+#include <linux/sched.h>
+#include <linux/latency_test.h>
+
+static unsigned int threads;
+module_param(threads, uint, 0444);
+MODULE_PARM_DESC(threads, "threads, 0 for one per online cpu");
+
+static unsigned int nr_timers = 20000;
+module_param(nr_timers, uint, 0444);
+MODULE_PARM_DESC(nr_timers, "timers per thread");
+
+static unsigned int timeout_ms = 10000;
+module_param(timeout_ms, uint, 0444);
+MODULE_PARM_DESC(timeout_ms, "longest timeout of a timer");
+
+static unsigned int rearm = 32;
+module_param(rearm, uint, 0444);
+MODULE_PARM_DESC(rearm, "timers pushed forward per millisecond");
+
+static unsigned int probe_us = 100;
+module_param(probe_us, uint, 0444);
+MODULE_PARM_DESC(probe_us, "period of the latency probe");
+
+static unsigned int secs = 10;
+module_param(secs, uint, 0444);
+MODULE_PARM_DESC(secs, "duration of the test");
+
+struct storm_thread;
+
+struct storm_timer {
+	struct timer_list	timer;
+	struct storm_thread	*st;
+};
+
+struct storm_thread {
+	struct task_struct	*task;
+	struct completion	done;
+	struct storm_timer	*timers;
+	struct hrtimer		probe;
+	bool			stop;
+	atomic_t		fired;
+	u32			*irq_ns;
+	unsigned int		nr_irq, max_irq;
+	u32			*mod_ns;
+	unsigned int		nr_mod, max_mod;
+};
+
+static unsigned long timeout_jiffies;
+
+static unsigned long random_expiry(void)
+{
+	return jiffies + 1 + random32() % timeout_jiffies;
+}
+
+static void storm_timer_fn(unsigned long data)
+{
+	struct storm_timer *t = (struct storm_timer *)data;
+
+	atomic_inc(&t->st->fired);
+	if (!ACCESS_ONCE(t->st->stop))
+		mod_timer(&t->timer, random_expiry());
+}
+
+static enum hrtimer_restart storm_probe_fn(struct hrtimer *hrt)
+{
+	struct storm_thread *st = container_of(hrt, struct storm_thread, probe);
+	ktime_t now = ktime_get();
+
+	if (st->nr_irq < st->max_irq)
+		st->irq_ns[st->nr_irq++] =
+			latency_test_ns(hrtimer_get_expires(hrt), now);
+	hrtimer_forward(hrt, now, ns_to_ktime((u64)probe_us * NSEC_PER_USEC));
+	return HRTIMER_RESTART;
+}
+
+static int storm_thread_fn(void *data)
+{
+	struct storm_thread *st = data;
+	unsigned long end = jiffies + secs * HZ;
+	unsigned int i;
+	ktime_t start;
+
+	for (i = 0; i < nr_timers; i++) {
+		struct storm_timer *t = &st->timers[i];
+
+		t->st = st;
+		setup_timer(&t->timer, storm_timer_fn, (unsigned long)t);
+		mod_timer(&t->timer, random_expiry());
+	}
+
+	hrtimer_init(&st->probe, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	st->probe.function = storm_probe_fn;
+	hrtimer_start(&st->probe, ns_to_ktime((u64)probe_us * NSEC_PER_USEC),
+		      HRTIMER_MODE_REL_PINNED);
+
+	while (time_before(jiffies, end)) {
+		for (i = 0; i < rearm; i++) {
+			struct storm_timer *t;
+
+			t = &st->timers[random32() % nr_timers];
+			start = ktime_get();
+			mod_timer(&t->timer, jiffies + timeout_jiffies);
+			if (st->nr_mod < st->max_mod)
+				st->mod_ns[st->nr_mod++] =
+					latency_test_ns(start, ktime_get());
+		}
+		usleep_range(1000, 1100);
+	}
+
+	hrtimer_cancel(&st->probe);
+	st->stop = true;
+	for (i = 0; i < nr_timers; i++)
+		del_timer_sync(&st->timers[i].timer);
+
+	complete(&st->done);
+	return 0;
+}
+
+static int __init timer_storm_init(void)
+{
+	struct storm_thread *sts;
+	unsigned int i, cpu, max_irq, max_mod, nr_irq = 0, nr_mod = 0;
+	unsigned long fired = 0;
+	u32 *irq_ns, *mod_ns;
+	int ret = 0;
+
+	if (!threads || threads > num_online_cpus())
+		threads = num_online_cpus();
+	if (!nr_timers || !timeout_ms || !rearm || !probe_us || !secs)
+		return -EINVAL;
+	timeout_jiffies = msecs_to_jiffies(timeout_ms);
+
+	max_irq = div_u64((u64)secs * USEC_PER_SEC, probe_us);
+	max_mod = secs * MSEC_PER_SEC * rearm;
+
+	sts = kcalloc(threads, sizeof(*sts), GFP_KERNEL);
+	irq_ns = vmalloc((size_t)threads * max_irq * sizeof(u32));
+	mod_ns = vmalloc((size_t)threads * max_mod * sizeof(u32));
+	if (!sts || !irq_ns || !mod_ns) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	i = 0;
+	for_each_online_cpu(cpu) {
+		struct storm_thread *st = &sts[i];
+
+		if (i == threads)
+			break;
+		init_completion(&st->done);
+		atomic_set(&st->fired, 0);
+		st->irq_ns = irq_ns + (size_t)i * max_irq;
+		st->max_irq = max_irq;
+		st->mod_ns = mod_ns + (size_t)i * max_mod;
+		st->max_mod = max_mod;
+		i++;
+
+		st->timers = vmalloc(nr_timers * sizeof(*st->timers));
+		if (!st->timers) {
+			complete(&st->done);
+			continue;
+		}
+		st->task = kthread_create(storm_thread_fn, st,
+					  "timer_storm/%u", cpu);
+		if (IS_ERR(st->task)) {
+			complete(&st->done);
+			continue;
+		}
+		kthread_bind(st->task, cpu);
+		wake_up_process(st->task);
+	}
+	threads = i;
+
+	for (i = 0; i < threads; i++) {
+		struct storm_thread *st = &sts[i];
+
+		wait_for_completion(&st->done);
+		vfree(st->timers);
+		fired += atomic_read(&st->fired);
+		/* Compact the samples of all threads at the front */
+		memmove(irq_ns + nr_irq, st->irq_ns, st->nr_irq * sizeof(u32));
+		nr_irq += st->nr_irq;
+		memmove(mod_ns + nr_mod, st->mod_ns, st->nr_mod * sizeof(u32));
+		nr_mod += st->nr_mod;
+	}
+
+	pr_info("timer_storm: %u threads, %u timers each, %u ms timeouts, "
+		"%lu expired, %u re-armed in %u s\n", threads, nr_timers,
+		timeout_ms, fired, nr_mod, secs);
+	latency_test_report("timer_storm", "irq", irq_ns, nr_irq);
+	latency_test_report("timer_storm", "mod_timer", mod_ns, nr_mod);
+
+out:
+	vfree(mod_ns);
+	vfree(irq_ns);
+	kfree(sts);
+	return ret;
+}
+
+static void __exit timer_storm_exit(void)
+{
+}
+
+module_init(timer_storm_init);
+module_exit(timer_storm_exit);
+
+MODULE_DESCRIPTION("timer storm latency test");
+MODULE_LICENSE("GPL");
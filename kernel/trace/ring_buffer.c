@@ -5,6 +5,7 @@
  */
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
+#include <linux/trace_mmap.h>
 #include <linux/spinlock.h>
 #include <linux/debugfs.h>
 #include <linux/uaccess.h>
@@ -17,6 +18,7 @@
 #include <linux/init.h>
 #include <linux/hash.h>
 #include <linux/list.h>
+#include <linux/highmem.h>
 #include <linux/cpu.h>
 #include <linux/fs.h>
 
@@ -380,6 +382,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* index in a user space mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -496,6 +499,11 @@ struct ring_buffer_per_cpu {
 	unsigned long			read;
 	u64				write_stamp;
 	u64				read_stamp;
+	/* user space mappings, see ring_buffer_map() */
+	int				mapped;
+	unsigned int			nr_subbufs;
+	struct buffer_page		**subbuf_ids;
+	struct trace_buffer_meta	*meta_page;
 };
 
 struct ring_buffer {
@@ -1120,6 +1128,8 @@ static void rb_free_cpu_buffer(struct ring_buffer_per_cpu *cpu_buffer)
 		free_buffer_page(bpage);
 	}
 
+	free_page((unsigned long)cpu_buffer->meta_page);
+	kfree(cpu_buffer->subbuf_ids);
 	kfree(cpu_buffer);
 }
 
@@ -1349,6 +1359,12 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size)
 	mutex_lock(&buffer->mutex);
 	get_online_cpus();
 
+	/* The pages of a mapped buffer are in user page tables */
+	for_each_buffer_cpu(buffer, cpu) {
+		if (buffer->buffers[cpu]->mapped)
+			goto out_busy;
+	}
+
 	nr_pages = DIV_ROUND_UP(size, BUF_PAGE_SIZE);
 
 	if (size < buffer_size) {
@@ -1430,6 +1446,12 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size)
 	atomic_dec(&buffer->record_disabled);
 	return -ENOMEM;
 
+ out_busy:
+	put_online_cpus();
+	mutex_unlock(&buffer->mutex);
+	atomic_dec(&buffer->record_disabled);
+	return -EBUSY;
+
 	/*
 	 * Something went totally wrong, and we are too paranoid
 	 * to even clean up the mess.
@@ -3339,7 +3361,9 @@ ring_buffer_consume(struct ring_buffer *buffer, int cpu, u64 *ts,
 	if (dolock)
 		spin_lock(&cpu_buffer->reader_lock);
 
-	event = rb_buffer_peek(cpu_buffer, ts, lost_events);
+	/* A mapped buffer is consumed through ring_buffer_map_get_reader() */
+	if (!cpu_buffer->mapped)
+		event = rb_buffer_peek(cpu_buffer, ts, lost_events);
 	if (event) {
 		cpu_buffer->lost_events = 0;
 		rb_advance_reader(cpu_buffer);
@@ -3697,6 +3721,11 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (atomic_read(&cpu_buffer_b->record_disabled))
 		goto out;
 
+	ret = -EBUSY;
+
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	/*
 	 * We can't do a synchronize_sched here because this
 	 * function can be called in atomic context.
@@ -3843,6 +3872,12 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 
 	spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
+	/* Swapping pages would pull them out from under the mapping */
+	if (cpu_buffer->mapped) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		goto out_unlock;
@@ -3971,6 +4006,242 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->entries = rb_num_of_entries(cpu_buffer);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+}
+
+/*
+ * Number the reader page 0 and the pages of the ring from 1 on, in
+ * ring order, and describe the buffer in the meta page. The pages
+ * keep their ids while they move in and out of the reader page, as
+ * nothing swaps the data page of a buffer page while it is mapped.
+ */
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				   struct buffer_page **subbuf_ids,
+				   struct trace_buffer_meta *meta)
+{
+	struct buffer_page *first, *bpage;
+	unsigned int id;
+
+	cpu_buffer->reader_page->id = 0;
+	subbuf_ids[0] = cpu_buffer->reader_page;
+
+	first = bpage = list_entry(cpu_buffer->pages, struct buffer_page, list);
+	for (id = 1; id <= cpu_buffer->buffer->pages; id++) {
+		bpage->id = id;
+		subbuf_ids[id] = bpage;
+		bpage = list_entry(rb_list_head(bpage->list.next),
+				   struct buffer_page, list);
+	}
+	RB_WARN_ON(cpu_buffer, bpage != first);
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = id;
+	meta->reader.id = 0;
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->reader.commit = meta->reader.read;
+
+	cpu_buffer->subbuf_ids = subbuf_ids;
+	cpu_buffer->nr_subbufs = id;
+	cpu_buffer->meta_page = meta;
+	rb_update_meta_page(cpu_buffer);
+}
+
+/**
+ * ring_buffer_map - prepare a cpu buffer for a mapping to user space
+ * @buffer: the ring buffer
+ * @cpu: the cpu buffer to map
+ *
+ * Allocates the meta page, a struct trace_buffer_meta, on the first
+ * mapping of the cpu buffer. The pages to map are then returned by
+ * ring_buffer_map_page() and the reader moves on with
+ * ring_buffer_map_get_reader(). While a cpu buffer is mapped the ring
+ * buffer can not be resized, nor the cpu buffer swapped, and reading
+ * it page by page or event by event fails or finds it empty.
+ *
+ * Every successful call must be paired with ring_buffer_unmap().
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta = NULL;
+	struct buffer_page **subbuf_ids = NULL;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	if (!cpu_buffer->mapped) {
+		meta = (void *)get_zeroed_page(GFP_KERNEL);
+		subbuf_ids = kcalloc(buffer->pages + 1, sizeof(*subbuf_ids),
+				     GFP_KERNEL);
+		if (!meta || !subbuf_ids) {
+			free_page((unsigned long)meta);
+			kfree(subbuf_ids);
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	spin_lock_irq(&cpu_buffer->reader_lock);
+	if (!cpu_buffer->mapped)
+		rb_setup_ids_meta_page(cpu_buffer, subbuf_ids, meta);
+	cpu_buffer->mapped++;
+	spin_unlock_irq(&cpu_buffer->reader_lock);
+ out:
+	mutex_unlock(&buffer->mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_unmap - release a mapping of a cpu buffer
+ * @buffer: the ring buffer
+ * @cpu: the cpu buffer that was mapped
+ */
+void ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta = NULL;
+	struct buffer_page **subbuf_ids = NULL;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	spin_lock_irq(&cpu_buffer->reader_lock);
+	if (!RB_WARN_ON(cpu_buffer, !cpu_buffer->mapped) &&
+	    !--cpu_buffer->mapped) {
+		meta = cpu_buffer->meta_page;
+		subbuf_ids = cpu_buffer->subbuf_ids;
+		cpu_buffer->meta_page = NULL;
+		cpu_buffer->subbuf_ids = NULL;
+		cpu_buffer->nr_subbufs = 0;
+	}
+	spin_unlock_irq(&cpu_buffer->reader_lock);
+	mutex_unlock(&buffer->mutex);
+
+	/* User page tables still hold their own reference to the pages */
+	free_page((unsigned long)meta);
+	kfree(subbuf_ids);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_page - return a page of a mapped cpu buffer
+ * @buffer: the ring buffer
+ * @cpu: the mapped cpu buffer
+ * @pgoff: the page offset in the mapping
+ *
+ * Page 0 is the meta page and page 1 + id the sub-buffer @id.
+ * Returns NULL if @pgoff is past the end or the cpu buffer is
+ * not mapped.
+ */
+struct page *ring_buffer_map_page(struct ring_buffer *buffer, int cpu,
+				  unsigned long pgoff)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct page *page = NULL;
+	unsigned long flags;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return NULL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (!cpu_buffer->mapped || pgoff > cpu_buffer->nr_subbufs)
+		goto out;
+	if (!pgoff)
+		page = virt_to_page(cpu_buffer->meta_page);
+	else
+		page = virt_to_page(cpu_buffer->subbuf_ids[pgoff - 1]->page);
+ out:
+	spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return page;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_page);
+
+/**
+ * ring_buffer_map_get_reader - hand the next events to a mapped reader
+ * @buffer: the ring buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * Consumes the events the previous call handed out and hands out the
+ * committed events that follow them, all on one sub-buffer: the one
+ * the reader is on if it has more, or the next one from the ring. The
+ * reader then reads the events from reader.read to reader.commit in
+ * the data of the sub-buffer reader.id of the meta page, in place,
+ * until the next call. reader.lost_events counts the events that were
+ * overwritten since the previous sub-buffer.
+ *
+ * Returns 0 if events were handed out, -EAGAIN if there are none and
+ * -EINVAL if the cpu buffer is not mapped.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	struct buffer_page *reader;
+	unsigned long flags;
+	unsigned int commit;
+	int ret = -EINVAL;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (!cpu_buffer->mapped)
+		goto out;
+	meta = cpu_buffer->meta_page;
+
+	ret = -EAGAIN;
+	reader = rb_get_reader_page(cpu_buffer);
+	if (!reader)
+		goto out;
+
+	meta->reader.id = reader->id;
+	meta->reader.read = reader->read;
+	meta->reader.lost_events = cpu_buffer->lost_events;
+	cpu_buffer->lost_events = 0;
+
+	/*
+	 * The writer may still be adding to this page: hand out only what
+	 * is committed now and consume it right away, so the next call
+	 * starts after it. The events stay on the page until the reader
+	 * is moved off it, by the next call at the earliest.
+	 */
+	commit = rb_page_commit(reader);
+	while (reader->read < commit)
+		rb_advance_reader(cpu_buffer);
+	meta->reader.commit = commit;
+	rb_update_meta_page(cpu_buffer);
+
+	flush_dcache_page(virt_to_page(reader->page));
+	ret = 0;
+ out:
+	spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 #ifdef CONFIG_TRACING
 static ssize_t
 rb_simple_read(struct file *filp, char __user *ubuf,
@@ -4,10 +4,13 @@
  * Copyright (C) 2009 Steven Rostedt <srostedt@redhat.com>
  */
 #include <linux/ring_buffer.h>
+#include <linux/trace_mmap.h>
 #include <linux/completion.h>
 #include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
 #include <asm/local.h>
 
 struct rb_page {
@@ -31,6 +34,7 @@ static struct ring_buffer *buffer;
 static struct task_struct *producer;
 static struct task_struct *consumer;
 static unsigned long read;
+static u64 read_ns;
 
 static int disable_reader;
 module_param(disable_reader, uint, 0644);
@@ -58,7 +62,21 @@ MODULE_PARM_DESC(producer_fifo, "fifo prio for producer");
 module_param(consumer_fifo, uint, 0644);
 MODULE_PARM_DESC(consumer_fifo, "fifo prio for consumer");
 
-static int read_events;
+enum read_mode {
+	READ_EVENTS,
+	READ_PAGES,
+	READ_MAPPED,
+	NR_READ_MODES,
+};
+
+static const char *read_mode_names[NR_READ_MODES] = {
+	[READ_EVENTS]	= "events",
+	[READ_PAGES]	= "pages",
+	[READ_MAPPED]	= "mapped pages",
+};
+
+static int read_mode = NR_READ_MODES - 1;
+static DEFINE_PER_CPU(struct trace_buffer_meta *, read_meta);
 
 static int kill_test;
 
@@ -95,76 +113,83 @@ static enum event_status read_event(int cpu)
 	return EVENT_FOUND;
 }
 
-static enum event_status read_page(int cpu)
+static void read_page_events(int cpu, struct rb_page *rpage,
+			     unsigned long start, unsigned long commit)
 {
 	struct ring_buffer_event *event;
-	struct rb_page *rpage;
-	unsigned long commit;
-	void *bpage;
 	int *entry;
-	int ret;
 	int inc;
 	int i;
 
-	bpage = ring_buffer_alloc_read_page(buffer, cpu);
-	if (!bpage)
-		return EVENT_DROPPED;
+	for (i = start; i < commit && !kill_test; i += inc) {
 
-	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
-	if (ret >= 0) {
-		rpage = bpage;
-		/* The commit may have missed event flags set, clear them */
-		commit = local_read(&rpage->commit) & 0xfffff;
-		for (i = 0; i < commit && !kill_test; i += inc) {
+		if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+			KILL_TEST();
+			break;
+		}
 
-			if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+		inc = -1;
+		event = (void *)&rpage->data[i];
+		switch (event->type_len) {
+		case RINGBUF_TYPE_PADDING:
+			/* failed writes may be discarded events */
+			if (!event->time_delta)
+				KILL_TEST();
+			inc = event->array[0] + 4;
+			break;
+		case RINGBUF_TYPE_TIME_EXTEND:
+			inc = 8;
+			break;
+		case 0:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				KILL_TEST();
 				break;
 			}
-
-			inc = -1;
-			event = (void *)&rpage->data[i];
-			switch (event->type_len) {
-			case RINGBUF_TYPE_PADDING:
-				/* failed writes may be discarded events */
-				if (!event->time_delta)
-					KILL_TEST();
-				inc = event->array[0] + 4;
-				break;
-			case RINGBUF_TYPE_TIME_EXTEND:
-				inc = 8;
-				break;
-			case 0:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					KILL_TEST();
-					break;
-				}
-				read++;
-				if (!event->array[0]) {
-					KILL_TEST();
-					break;
-				}
-				inc = event->array[0] + 4;
+			read++;
+			if (!event->array[0]) {
+				KILL_TEST();
 				break;
-			default:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					KILL_TEST();
-					break;
-				}
-				read++;
-				inc = ((event->type_len + 1) * 4);
 			}
-			if (kill_test)
-				break;
-
-			if (inc <= 0) {
+			inc = event->array[0] + 4;
+			break;
+		default:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				KILL_TEST();
 				break;
 			}
+			read++;
+			inc = ((event->type_len + 1) * 4);
+		}
+		if (kill_test)
+			break;
+
+		if (inc <= 0) {
+			KILL_TEST();
+			break;
 		}
 	}
+}
+
+static enum event_status read_page(int cpu)
+{
+	struct rb_page *rpage;
+	unsigned long commit;
+	void *bpage;
+	int ret;
+
+	bpage = ring_buffer_alloc_read_page(buffer, cpu);
+	if (!bpage)
+		return EVENT_DROPPED;
+
+	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
+	if (ret >= 0) {
+		rpage = bpage;
+		/* The commit may have missed event flags set, clear them */
+		commit = local_read(&rpage->commit) & 0xfffff;
+		read_page_events(cpu, rpage, 0, commit);
+	}
 	ring_buffer_free_read_page(buffer, bpage);
 
 	if (ret < 0)
@@ -172,13 +197,61 @@ static enum event_status read_page(int cpu)
 	return EVENT_FOUND;
 }
 
+/* Read the events in place, the way a reader of the mapping does */
+static enum event_status read_mapped(int cpu)
+{
+	struct trace_buffer_meta *meta = per_cpu(read_meta, cpu);
+	struct page *page;
+
+	if (!meta || ring_buffer_map_get_reader(buffer, cpu))
+		return EVENT_DROPPED;
+
+	page = ring_buffer_map_page(buffer, cpu, meta->reader.id + 1);
+	if (!page) {
+		KILL_TEST();
+		return EVENT_DROPPED;
+	}
+	read_page_events(cpu, page_address(page), meta->reader.read,
+			 meta->reader.commit);
+
+	return EVENT_FOUND;
+}
+
+static void map_buffers(void)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		if (ring_buffer_map(buffer, cpu))
+			continue;
+		per_cpu(read_meta, cpu) =
+			page_address(ring_buffer_map_page(buffer, cpu, 0));
+	}
+}
+
+static void unmap_buffers(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (!per_cpu(read_meta, cpu))
+			continue;
+		per_cpu(read_meta, cpu) = NULL;
+		ring_buffer_unmap(buffer, cpu);
+	}
+}
+
 static void ring_buffer_consumer(void)
 {
-	/* toggle between reading pages and events */
-	read_events ^= 1;
+	/* cycle through reading events, pages and mapped pages */
+	read_mode = (read_mode + 1) % NR_READ_MODES;
+	if (read_mode == READ_MAPPED)
+		map_buffers();
 
 	read = 0;
+	read_ns = 0;
 	while (!reader_finish && !kill_test) {
+		ktime_t start = ktime_get();
 		int found;
 
 		do {
@@ -188,10 +261,16 @@ static void ring_buffer_consumer(void)
 			for_each_online_cpu(cpu) {
 				enum event_status stat;
 
-				if (read_events)
+				switch (read_mode) {
+				case READ_EVENTS:
 					stat = read_event(cpu);
-				else
+					break;
+				case READ_PAGES:
 					stat = read_page(cpu);
+					break;
+				default:
+					stat = read_mapped(cpu);
+				}
 
 				if (kill_test)
 					break;
@@ -199,6 +278,7 @@ static void ring_buffer_consumer(void)
 					found = 1;
 			}
 		} while (found && !kill_test);
+		read_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (reader_finish)
@@ -207,6 +287,9 @@ static void ring_buffer_consumer(void)
 		schedule();
 		__set_current_state(TASK_RUNNING);
 	}
+	__set_current_state(TASK_RUNNING);
+	if (read_mode == READ_MAPPED)
+		unmap_buffers();
 	reader_finish = 0;
 	complete(&read_done);
 }
@@ -315,9 +398,14 @@ static void ring_buffer_producer(void)
 	trace_printk("Overruns: %lld\n", overruns);
 	if (disable_reader)
 		trace_printk("Read:     (reader disabled)\n");
-	else
+	else {
 		trace_printk("Read:     %ld  (by %s)\n", read,
-			read_events ? "events" : "pages");
+			read_mode_names[read_mode]);
+		/* Time the consumer spent reading, not waiting for events */
+		if (read)
+			trace_printk("Consumer: %llu ns per entry\n",
+				     div64_u64(read_ns, read));
+	}
 	trace_printk("Entries:  %lld\n", entries);
 	trace_printk("Total:    %lld\n", entries + overruns + read);
 	trace_printk("Missed:   %ld\n", missed);
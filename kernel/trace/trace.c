@@ -12,6 +12,7 @@
  *  Copyright (C) 2004 William Lee Irwin III
  */
 #include <linux/ring_buffer.h>
+#include <linux/trace_mmap.h>
 #include <generated/utsrelease.h>
 #include <linux/stacktrace.h>
 #include <linux/writeback.h>
@@ -250,6 +251,9 @@ static struct tracer		*current_trace __read_mostly;
  */
 static DEFINE_MUTEX(trace_types_lock);
 
+/* Mappings of trace_pipe_raw files, protected by trace_types_lock */
+static int tracing_buffers_mapped;
+
 /*
  * serialize the access of the ring buffer
  *
@@ -2997,6 +3001,10 @@ static int tracing_set_tracer(const char *buf)
 	}
 	if (t == current_trace)
 		goto out;
+	if (t->use_max_tr && tracing_buffers_mapped) {
+		ret = -EBUSY;
+		goto out;
+	}
 
 	trace_branch_disable();
 	if (current_trace && current_trace->reset)
@@ -3763,6 +3771,7 @@ struct ftrace_buffer_info {
 	void			*spare;
 	int			cpu;
 	unsigned int		read;
+	struct ring_buffer	*mapped;
 };
 
 static int tracing_buffers_open(struct inode *inode, struct file *filp)
@@ -3846,6 +3855,110 @@ static int tracing_buffers_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	mutex_lock(&trace_types_lock);
+	if (!WARN_ON(ring_buffer_map(info->mapped, info->cpu)))
+		tracing_buffers_mapped++;
+	mutex_unlock(&trace_types_lock);
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	mutex_lock(&trace_types_lock);
+	ring_buffer_unmap(info->mapped, info->cpu);
+	tracing_buffers_mapped--;
+	mutex_unlock(&trace_types_lock);
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+};
+
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	unsigned long i, nr_pages = vma_pages(vma);
+	struct ring_buffer *buffer;
+	struct page *page;
+	int ret = 0;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_RESERVED;
+
+	mutex_lock(&trace_types_lock);
+
+	/* Latency tracers swap the buffers from under the reader */
+	if (current_trace && current_trace->use_max_tr) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	/* A mapped buffer can not be resized any more */
+	if (!ring_buffer_expanded) {
+		ret = __tracing_resize_ring_buffer(trace_buf_size);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (!info->mapped)
+		info->mapped = info->tr->buffer;
+	buffer = info->mapped;
+
+	ret = ring_buffer_map(buffer, info->cpu);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < nr_pages; i++) {
+		page = ring_buffer_map_page(buffer, info->cpu,
+					    vma->vm_pgoff + i);
+		if (!page) {
+			ret = -EINVAL;
+			break;
+		}
+		ret = vm_insert_page(vma, vma->vm_start + i * PAGE_SIZE, page);
+		if (ret)
+			break;
+	}
+	if (ret) {
+		ring_buffer_unmap(buffer, info->cpu);
+		goto out;
+	}
+
+	vma->vm_ops = &tracing_buffers_vmops;
+	tracing_buffers_mapped++;
+ out:
+	mutex_unlock(&trace_types_lock);
+
+	return ret;
+}
+
+static long tracing_buffers_ioctl(struct file *filp, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct ring_buffer *buffer = ACCESS_ONCE(info->mapped);
+	int ret;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+	if (!buffer)
+		return -EINVAL;
+
+	trace_access_lock(info->cpu);
+	ret = ring_buffer_map_get_reader(buffer, info->cpu);
+	trace_access_unlock(info->cpu);
+
+	return ret;
+}
+
 struct buffer_ref {
 	struct ring_buffer	*buffer;
 	void			*page;
@@ -4015,6 +4128,9 @@ static const struct file_operations tracing_buffers_fops = {
 	.read		= tracing_buffers_read,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.mmap		= tracing_buffers_mmap,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.compat_ioctl	= tracing_buffers_ioctl,
 	.llseek		= no_llseek,
 };
 
@@ -17,8 +17,9 @@
  * This is the generic async execution mechanism.  Work items as are
  * executed in process context.  The worker pool is shared and
  * automatically managed.  There is one worker pool for each CPU and
- * one extra for works which are better served by workers which are
- * not bound to any specific CPU.
+ * unbound pools for works which are better served by workers which
+ * are not bound to any specific CPU, one for each set of attributes
+ * and cluster of CPUs in use.
  *
  * Please read Documentation/workqueue.txt for details.
  */
@@ -41,6 +42,8 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/mutex.h>
+#include <linux/topology.h>
 
 #include "workqueue_sched.h"
 
@@ -86,6 +89,8 @@ enum {
 	CREATE_COOLDOWN		= HZ,		/* time to breath after fail */
 	TRUSTEE_COOLDOWN	= HZ / 10,	/* for trustee draining */
 
+	MAX_UNBOUND_POOLS	= 64,		/* attrs and clusters in use */
+
 	/*
 	 * Rescue workers are used only on emergencies and shared by
 	 * all cpus.  Give -20.
@@ -112,6 +117,11 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * M: wq_pool_mutex protected.
+ *
+ * A: Appended to with wq_pool_mutex, wq->flush_mutex and workqueue_lock
+ *    held, never removed from while in use.  Can be walked locklessly.
  */
 
 struct global_cwq;
@@ -148,7 +158,9 @@ struct global_cwq {
 	spinlock_t		lock;		/* the gcwq lock */
 	struct list_head	worklist;	/* L: list of pending works */
 	unsigned int		cpu;		/* I: the associated cpu */
+	unsigned int		id;		/* I: id recorded in work data */
 	unsigned int		flags;		/* L: GCWQ_* flags */
+	struct workqueue_attrs	*attrs;		/* I: attrs of an unbound pool */
 
 	int			nr_workers;	/* L: total number of workers */
 	int			nr_idle;	/* L: currently idle ones */
@@ -184,6 +196,7 @@ struct cpu_workqueue_struct {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
+	struct list_head	unbound_node;	/* A: on wq->unbound_cwqs */
 };
 
 /*
@@ -218,16 +231,19 @@ typedef unsigned long mayday_mask_t;
 
 /*
  * The externally visible workqueue abstraction is an array of
- * per-CPU workqueues:
+ * per-CPU workqueues.  An unbound workqueue has a cwq for each unbound
+ * pool it queues to, and a table with the one to use for each cpu.
  */
 struct workqueue_struct {
 	unsigned int		flags;		/* W: WQ_* flags */
 	union {
 		struct cpu_workqueue_struct __percpu	*pcpu;
-		struct cpu_workqueue_struct		*single;
+		struct cpu_workqueue_struct		**unbound; /* M */
 		unsigned long				v;
 	} cpu_wq;				/* I: cwq's */
-	struct list_head	list;		/* W: list of all workqueues */
+	struct list_head	unbound_cwqs;	/* A: cwqs of unbound wq */
+	struct workqueue_attrs	*unbound_attrs;	/* M: attrs of unbound wq */
+	struct list_head	list;		/* W+M: list of all workqueues */
 
 	struct mutex		flush_mutex;	/* protects wq flushing */
 	int			work_color;	/* F: current work color */
@@ -283,24 +299,22 @@ static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 	return WORK_CPU_NONE;
 }
 
-static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
-				struct workqueue_struct *wq)
-{
-	return __next_gcwq_cpu(cpu, mask, !(wq->flags & WQ_UNBOUND) ? 1 : 2);
-}
-
 /*
  * CPU iterators
  *
  * An extra gcwq is defined for an invalid cpu number
- * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
+ * (WORK_CPU_UNBOUND) to host the unbound pool with the default
+ * attributes.  The following iterators are similar to for_each_*_cpu()
+ * iterators but also considers that gcwq.
  *
  * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
  * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
- * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
- *				  WORK_CPU_UNBOUND for unbound workqueues
+ *
+ * The following iterate over gcwqs and cwqs instead.
+ *
+ * for_each_gcwq()		: gcwqs of possible CPUs + all unbound pools
+ * for_each_cwq()		: cwqs of possible CPUs for bound workqueues,
+ *				  cwqs of all pools used for unbound ones
  */
 #define for_each_gcwq_cpu(cpu)						\
 	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
@@ -312,10 +326,12 @@ static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
 	     (cpu) < WORK_CPU_NONE;					\
 	     (cpu) = __next_gcwq_cpu((cpu), cpu_online_mask, 3))
 
-#define for_each_cwq_cpu(cpu, wq)					\
-	for ((cpu) = __next_wq_cpu(-1, cpu_possible_mask, (wq));	\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_wq_cpu((cpu), cpu_possible_mask, (wq)))
+#define for_each_gcwq(gcwq, i)						\
+	for ((i) = -1; ((gcwq) = __next_gcwq(&(i))); )
+
+#define for_each_cwq(cwq, wq, cpu)					\
+	for ((cpu) = -1, (cwq) = __next_cwq((wq), NULL, &(cpu));	\
+	     (cwq); (cwq) = __next_cwq((wq), (cwq), &(cpu)))
 
 #ifdef CONFIG_DEBUG_OBJECTS_WORK
 
@@ -454,6 +470,17 @@ static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, gcwq_nr_running);
 static struct global_cwq unbound_global_cwq;
 static atomic_t unbound_gcwq_nr_running = ATOMIC_INIT(0);	/* always 0 */
 
+/*
+ * Unbound pools.  The first one is unbound_global_cwq, which serves the
+ * default attributes.  Pools for other attributes and for the clusters
+ * are created as workqueues need them and, like the per-cpu gcwqs,
+ * never go away.  Pool n other than the first is identified by
+ * WORK_CPU_LAST + n in the work data.
+ */
+static DEFINE_MUTEX(wq_pool_mutex);
+static struct global_cwq *unbound_pools[MAX_UNBOUND_POOLS]; /* M */
+static int nr_unbound_pools;			/* M+W: published pools */
+
 static int worker_thread(void *__worker);
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
@@ -464,6 +491,31 @@ static struct global_cwq *get_gcwq(unsigned int cpu)
 		return &unbound_global_cwq;
 }
 
+static struct global_cwq *get_gcwq_by_id(unsigned int id)
+{
+	if (id <= WORK_CPU_UNBOUND) {
+		BUG_ON(id >= nr_cpu_ids && id != WORK_CPU_UNBOUND);
+		return get_gcwq(id);
+	}
+	id -= WORK_CPU_LAST;
+	BUG_ON(id >= ACCESS_ONCE(nr_unbound_pools));
+	smp_rmb();
+	return unbound_pools[id];
+}
+
+static struct global_cwq *__next_gcwq(int *i)
+{
+	while (++*i < nr_cpu_ids)
+		if (cpu_possible(*i))
+			return get_gcwq(*i);
+
+	if (*i - nr_cpu_ids < ACCESS_ONCE(nr_unbound_pools)) {
+		smp_rmb();
+		return unbound_pools[*i - nr_cpu_ids];
+	}
+	return NULL;
+}
+
 static atomic_t *get_gcwq_nr_running(unsigned int cpu)
 {
 	if (cpu != WORK_CPU_UNBOUND)
@@ -472,14 +524,67 @@ static atomic_t *get_gcwq_nr_running(unsigned int cpu)
 		return &unbound_gcwq_nr_running;
 }
 
+/*
+ * For an unbound workqueue, @cpu selects the cwq serving the works
+ * queued on it, WORK_CPU_UNBOUND the one of the local cpu.
+ */
 static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 					    struct workqueue_struct *wq)
 {
+	struct cpu_workqueue_struct *cwq;
+
 	if (!(wq->flags & WQ_UNBOUND)) {
 		if (likely(cpu < nr_cpu_ids))
 			return per_cpu_ptr(wq->cpu_wq.pcpu, cpu);
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
-		return wq->cpu_wq.single;
+		return NULL;
+	}
+
+	if (cpu == WORK_CPU_UNBOUND)
+		cpu = raw_smp_processor_id();
+	if (unlikely(cpu >= nr_cpu_ids))
+		return NULL;
+
+	/* pairs with the smp_wmb() in wq_map_unbound() */
+	cwq = ACCESS_ONCE(wq->cpu_wq.unbound[cpu]);
+	smp_read_barrier_depends();
+	return cwq;
+}
+
+static struct cpu_workqueue_struct *__next_cwq(struct workqueue_struct *wq,
+					      struct cpu_workqueue_struct *cwq,
+					      int *cpu)
+{
+	struct list_head *pos, *next;
+
+	if (!(wq->flags & WQ_UNBOUND)) {
+		*cpu = cpumask_next(*cpu, cpu_possible_mask);
+		if (*cpu < nr_cpu_ids)
+			return per_cpu_ptr(wq->cpu_wq.pcpu, *cpu);
+		return NULL;
+	}
+
+	/* unbound cwqs are only ever appended, see link_unbound_cwq() */
+	pos = cwq ? &cwq->unbound_node : &wq->unbound_cwqs;
+	next = ACCESS_ONCE(pos->next);
+	smp_read_barrier_depends();
+	if (next == &wq->unbound_cwqs)
+		return NULL;
+	return list_entry(next, struct cpu_workqueue_struct, unbound_node);
+}
+
+/* @wq's cwq for @gcwq, %NULL if it hasn't queued anything there */
+static struct cpu_workqueue_struct *find_cwq(struct global_cwq *gcwq,
+					     struct workqueue_struct *wq)
+{
+	struct cpu_workqueue_struct *cwq;
+	int cpu;
+
+	if (!(wq->flags & WQ_UNBOUND))
+		return gcwq->cpu < nr_cpu_ids ? get_cwq(gcwq->cpu, wq) : NULL;
+
+	for_each_cwq(cwq, wq, cpu)
+		if (cwq->gcwq == gcwq)
+			return cwq;
 	return NULL;
 }
 
@@ -502,11 +607,12 @@ static int work_next_color(int color)
 /*
  * A work's data points to the cwq with WORK_STRUCT_CWQ set while the
  * work is on queue.  Once execution starts, WORK_STRUCT_CWQ is
- * cleared and the work data contains the cpu number it was last on.
+ * cleared and the work data contains the id of the gcwq it was last
+ * on, which is the cpu number for per-cpu gcwqs.
  *
- * set_work_{cwq|cpu}() and clear_work_data() can be used to set the
- * cwq, cpu or clear work->data.  These functions should only be
- * called while the work is owned - ie. while the PENDING bit is set.
+ * set_work_{cwq|gcwq_id}() and clear_work_data() can be used to set
+ * the cwq, gcwq id or clear work->data.  These functions should only
+ * be called while the work is owned - ie. while the PENDING bit is set.
  *
  * get_work_[g]cwq() can be used to obtain the gcwq or cwq
  * corresponding to a work.  gcwq is available once the work has been
@@ -528,9 +634,9 @@ static void set_work_cwq(struct work_struct *work,
 		      WORK_STRUCT_PENDING | WORK_STRUCT_CWQ | extra_flags);
 }
 
-static void set_work_cpu(struct work_struct *work, unsigned int cpu)
+static void set_work_gcwq_id(struct work_struct *work, unsigned int id)
 {
-	set_work_data(work, cpu << WORK_STRUCT_FLAG_BITS, WORK_STRUCT_PENDING);
+	set_work_data(work, id << WORK_STRUCT_FLAG_BITS, WORK_STRUCT_PENDING);
 }
 
 static void clear_work_data(struct work_struct *work)
@@ -551,18 +657,17 @@ static struct cpu_workqueue_struct *get_work_cwq(struct work_struct *work)
 static struct global_cwq *get_work_gcwq(struct work_struct *work)
 {
 	unsigned long data = atomic_long_read(&work->data);
-	unsigned int cpu;
+	unsigned int id;
 
 	if (data & WORK_STRUCT_CWQ)
 		return ((struct cpu_workqueue_struct *)
 			(data & WORK_STRUCT_WQ_DATA_MASK))->gcwq;
 
-	cpu = data >> WORK_STRUCT_FLAG_BITS;
-	if (cpu == WORK_CPU_NONE)
+	id = data >> WORK_STRUCT_FLAG_BITS;
+	if (id == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
-	return get_gcwq(cpu);
+	return get_gcwq_by_id(id);
 }
 
 /*
@@ -951,11 +1056,11 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
  */
 static bool is_chained_work(struct workqueue_struct *wq)
 {
+	struct global_cwq *gcwq;
 	unsigned long flags;
-	unsigned int cpu;
+	int id;
 
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
+	for_each_gcwq(gcwq, id) {
 		struct worker *worker;
 		struct hlist_node *pos;
 		int i;
@@ -1023,13 +1128,39 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			}
 		} else
 			spin_lock_irqsave(&gcwq->lock, flags);
+
+		cwq = get_cwq(gcwq->cpu, wq);
 	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
-		spin_lock_irqsave(&gcwq->lock, flags);
+		struct global_cwq *last_gcwq;
+
+		/*
+		 * Queue to the pool of the submitting cpu's cluster,
+		 * unless @work is still running in the unbound pool it
+		 * was last queued to, in which case it's queued there
+		 * again so that it doesn't run concurrently with itself.
+		 */
+		cwq = get_cwq(cpu, wq);
+		gcwq = cwq->gcwq;
+		if ((last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq &&
+		    last_gcwq->cpu == WORK_CPU_UNBOUND) {
+			struct worker *worker;
+
+			spin_lock_irqsave(&last_gcwq->lock, flags);
+
+			worker = find_worker_executing_work(last_gcwq, work);
+
+			if (worker && worker->current_cwq->wq == wq) {
+				gcwq = last_gcwq;
+				cwq = worker->current_cwq;
+			} else {
+				spin_unlock_irqrestore(&last_gcwq->lock, flags);
+				spin_lock_irqsave(&gcwq->lock, flags);
+			}
+		} else
+			spin_lock_irqsave(&gcwq->lock, flags);
 	}
 
-	/* gcwq determined, get cwq and queue */
-	cwq = get_cwq(gcwq->cpu, wq);
+	/* gcwq and cwq determined, queue */
 	trace_workqueue_queue_work(cpu, cwq, work);
 
 	BUG_ON(!list_empty(&work->entry));
@@ -1139,6 +1270,7 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 	struct work_struct *work = &dwork->work;
 
 	if (!test_and_set_bit(WORK_STRUCT_PENDING_BIT, work_data_bits(work))) {
+		struct cpu_workqueue_struct *cwq;
 		unsigned int lcpu;
 
 		BUG_ON(timer_pending(timer));
@@ -1158,10 +1290,16 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 				lcpu = gcwq->cpu;
 			else
 				lcpu = raw_smp_processor_id();
-		} else
-			lcpu = WORK_CPU_UNBOUND;
+			cwq = get_cwq(lcpu, wq);
+		} else {
+			struct global_cwq *gcwq = get_work_gcwq(work);
 
-		set_work_cwq(work, get_cwq(lcpu, wq), 0);
+			cwq = gcwq ? find_cwq(gcwq, wq) : NULL;
+			if (!cwq)
+				cwq = get_cwq(raw_smp_processor_id(), wq);
+		}
+
+		set_work_cwq(work, cwq, 0);
 
 		timer->expires = jiffies + delay;
 		timer->data = (unsigned long)dwork;
@@ -1379,12 +1517,22 @@ static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 						      worker,
 						      cpu_to_node(gcwq->cpu),
 						      "kworker/%u:%d", gcwq->cpu, id);
-	else
+	else if (gcwq == &unbound_global_cwq)
 		worker->task = kthread_create(worker_thread, worker,
 					      "kworker/u:%d", id);
+	else
+		worker->task = kthread_create(worker_thread, worker,
+					      "kworker/u%u:%d",
+					      gcwq->id - WORK_CPU_LAST, id);
 	if (IS_ERR(worker->task))
 		goto fail;
 
+	/* has to be done before PF_THREAD_BOUND is set */
+	if (gcwq->attrs) {
+		set_user_nice(worker->task, gcwq->attrs->nice);
+		set_cpus_allowed_ptr(worker->task, gcwq->attrs->cpumask);
+	}
+
 	/*
 	 * A rogue worker will become a regular one if CPU comes
 	 * online later on.  Make sure every worker has
@@ -1836,8 +1984,8 @@ __acquires(&gcwq->lock)
 	worker->current_cwq = cwq;
 	work_color = get_work_color(work);
 
-	/* record the current cpu number in the work data and dequeue */
-	set_work_cpu(work, gcwq->cpu);
+	/* record the current gcwq in the work data and dequeue */
+	set_work_gcwq_id(work, gcwq->id);
 	list_del_init(&work->entry);
 
 	/*
@@ -1939,6 +2087,16 @@ static int worker_thread(void *__worker)
 	/* tell the scheduler that this is a workqueue worker */
 	worker->task->flags |= PF_WQ_WORKER;
 woke_up:
+	/*
+	 * The scheduler lets the workers of an unbound pool run anywhere
+	 * once all the cpus of the pool have gone offline.  Move back
+	 * when they're around again.
+	 */
+	if (gcwq->attrs &&
+	    unlikely(!cpumask_equal(tsk_cpus_allowed(current),
+				    gcwq->attrs->cpumask)))
+		set_cpus_allowed_ptr(current, gcwq->attrs->cpumask);
+
 	spin_lock_irq(&gcwq->lock);
 
 	/* DIE can be set only while we're idle, checking here is enough */
@@ -2007,6 +2165,48 @@ sleep:
 	goto woke_up;
 }
 
+/**
+ * rescue_cwq - process the works of a cwq as its rescuer
+ * @rescuer: self
+ * @cwq: cwq to rescue
+ *
+ * Process the works of @cwq which are pending on its gcwq.
+ *
+ * CONTEXT:
+ * Might sleep.  Called without any lock.
+ */
+static void rescue_cwq(struct worker *rescuer, struct cpu_workqueue_struct *cwq)
+{
+	struct list_head *scheduled = &rescuer->scheduled;
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct work_struct *work, *n;
+
+	/* migrate to the target cpu if possible */
+	rescuer->gcwq = gcwq;
+	worker_maybe_bind_and_lock(rescuer);
+
+	/*
+	 * Slurp in all works issued via this workqueue and
+	 * process'em.
+	 */
+	BUG_ON(!list_empty(&rescuer->scheduled));
+	list_for_each_entry_safe(work, n, &gcwq->worklist, entry)
+		if (get_work_cwq(work) == cwq)
+			move_linked_works(work, scheduled, &n);
+
+	process_scheduled_works(rescuer);
+
+	/*
+	 * Leave this gcwq.  If keep_working() is %true, notify a
+	 * regular worker; otherwise, we end up with 0 concurrency
+	 * and stalling the execution.
+	 */
+	if (keep_working(gcwq))
+		wake_up_worker(gcwq);
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
 /**
  * rescuer_thread - the rescuer thread function
  * @__wq: the associated workqueue
@@ -2030,9 +2230,9 @@ static int rescuer_thread(void *__wq)
 {
 	struct workqueue_struct *wq = __wq;
 	struct worker *rescuer = wq->rescuer;
-	struct list_head *scheduled = &rescuer->scheduled;
+	struct cpu_workqueue_struct *cwq;
 	bool is_unbound = wq->flags & WQ_UNBOUND;
-	unsigned int cpu;
+	int cpu, tcpu;
 
 	set_user_nice(current, RESCUER_NICE_LEVEL);
 repeat:
@@ -2043,41 +2243,18 @@ repeat:
 
 	/*
 	 * See whether any cpu is asking for help.  Unbounded
-	 * workqueues use cpu 0 in mayday_mask for CPU_UNBOUND.
+	 * workqueues use cpu 0 in mayday_mask for all their pools,
+	 * rescue the works of all of them.
 	 */
 	for_each_mayday_cpu(cpu, wq->mayday_mask) {
-		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
-		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
-		struct global_cwq *gcwq = cwq->gcwq;
-		struct work_struct *work, *n;
-
 		__set_current_state(TASK_RUNNING);
 		mayday_clear_cpu(cpu, wq->mayday_mask);
 
-		/* migrate to the target cpu if possible */
-		rescuer->gcwq = gcwq;
-		worker_maybe_bind_and_lock(rescuer);
-
-		/*
-		 * Slurp in all works issued via this workqueue and
-		 * process'em.
-		 */
-		BUG_ON(!list_empty(&rescuer->scheduled));
-		list_for_each_entry_safe(work, n, &gcwq->worklist, entry)
-			if (get_work_cwq(work) == cwq)
-				move_linked_works(work, scheduled, &n);
-
-		process_scheduled_works(rescuer);
-
-		/*
-		 * Leave this gcwq.  If keep_working() is %true, notify a
-		 * regular worker; otherwise, we end up with 0 concurrency
-		 * and stalling the execution.
-		 */
-		if (keep_working(gcwq))
-			wake_up_worker(gcwq);
-
-		spin_unlock_irq(&gcwq->lock);
+		if (!is_unbound)
+			rescue_cwq(rescuer, get_cwq(cpu, wq));
+		else
+			for_each_cwq(cwq, wq, tcpu)
+				rescue_cwq(rescuer, cwq);
 	}
 
 	schedule();
@@ -2190,16 +2367,16 @@ static void insert_wq_barrier(struct cpu_workqueue_struct *cwq,
 static bool flush_workqueue_prep_cwqs(struct workqueue_struct *wq,
 				      int flush_color, int work_color)
 {
+	struct cpu_workqueue_struct *cwq;
 	bool wait = false;
-	unsigned int cpu;
+	int cpu;
 
 	if (flush_color >= 0) {
 		BUG_ON(atomic_read(&wq->nr_cwqs_to_flush));
 		atomic_set(&wq->nr_cwqs_to_flush, 1);
 	}
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	for_each_cwq(cwq, wq, cpu) {
 		struct global_cwq *gcwq = cwq->gcwq;
 
 		spin_lock_irq(&gcwq->lock);
@@ -2397,8 +2574,9 @@ EXPORT_SYMBOL_GPL(flush_workqueue);
  */
 void drain_workqueue(struct workqueue_struct *wq)
 {
+	struct cpu_workqueue_struct *cwq;
 	unsigned int flush_cnt = 0;
-	unsigned int cpu;
+	int cpu;
 
 	/*
 	 * __queue_work() needs to test whether there are drainers, is much
@@ -2412,8 +2590,7 @@ void drain_workqueue(struct workqueue_struct *wq)
 reflush:
 	flush_workqueue(wq);
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	for_each_cwq(cwq, wq, cpu) {
 		bool drained;
 
 		spin_lock_irq(&cwq->gcwq->lock);
@@ -2543,16 +2720,17 @@ static bool wait_on_cpu_work(struct global_cwq *gcwq, struct work_struct *work)
 
 static bool wait_on_work(struct work_struct *work)
 {
+	struct global_cwq *gcwq;
 	bool ret = false;
-	int cpu;
+	int id;
 
 	might_sleep();
 
 	lock_map_acquire(&work->lockdep_map);
 	lock_map_release(&work->lockdep_map);
 
-	for_each_gcwq_cpu(cpu)
-		ret |= wait_on_cpu_work(get_gcwq(cpu), work);
+	for_each_gcwq(gcwq, id)
+		ret |= wait_on_cpu_work(gcwq, work);
 	return ret;
 }
 
@@ -2889,49 +3067,442 @@ int keventd_up(void)
 	return system_wq != NULL;
 }
 
+/*
+ * cwqs are forced aligned according to WORK_STRUCT_FLAG_BITS.  Make
+ * sure that the alignment isn't lower than that of unsigned long long.
+ */
+#define CWQ_ALIGN	max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,	\
+			      __alignof__(unsigned long long))
+
 static int alloc_cwqs(struct workqueue_struct *wq)
 {
-	/*
-	 * cwqs are forced aligned according to WORK_STRUCT_FLAG_BITS.
-	 * Make sure that the alignment isn't lower than that of
-	 * unsigned long long.
-	 */
 	const size_t size = sizeof(struct cpu_workqueue_struct);
-	const size_t align = max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,
-				   __alignof__(unsigned long long));
-
-	if (!(wq->flags & WQ_UNBOUND))
-		wq->cpu_wq.pcpu = __alloc_percpu(size, align);
-	else {
-		void *ptr;
 
-		/*
-		 * Allocate enough room to align cwq and put an extra
-		 * pointer at the end pointing back to the originally
-		 * allocated pointer which will be used for free.
-		 */
-		ptr = kzalloc(size + align + sizeof(void *), GFP_KERNEL);
-		if (ptr) {
-			wq->cpu_wq.single = PTR_ALIGN(ptr, align);
-			*(void **)(wq->cpu_wq.single + 1) = ptr;
-		}
+	if (!(wq->flags & WQ_UNBOUND)) {
+		wq->cpu_wq.pcpu = __alloc_percpu(size, CWQ_ALIGN);
+		/* just in case, make sure it's actually aligned */
+		BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, CWQ_ALIGN));
+	} else {
+		/* the cwqs are allocated as the pools are, see get_ucwq() */
+		wq->unbound_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+		if (!wq->unbound_attrs)
+			return -ENOMEM;
+		wq->cpu_wq.unbound = kcalloc(nr_cpu_ids, sizeof(void *),
+					     GFP_KERNEL);
 	}
 
-	/* just in case, make sure it's actually aligned */
-	BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, align));
 	return wq->cpu_wq.v ? 0 : -ENOMEM;
 }
 
 static void free_cwqs(struct workqueue_struct *wq)
 {
-	if (!(wq->flags & WQ_UNBOUND))
+	struct cpu_workqueue_struct *cwq, *n;
+
+	if (!(wq->flags & WQ_UNBOUND)) {
 		free_percpu(wq->cpu_wq.pcpu);
-	else if (wq->cpu_wq.single) {
+		return;
+	}
+
+	list_for_each_entry_safe(cwq, n, &wq->unbound_cwqs, unbound_node) {
 		/* the pointer to free is stored right after the cwq */
-		kfree(*(void **)(wq->cpu_wq.single + 1));
+		kfree(*(void **)(cwq + 1));
+	}
+	kfree(wq->cpu_wq.unbound);
+	free_workqueue_attrs(wq->unbound_attrs);
+}
+
+/**
+ * free_workqueue_attrs - free a workqueue_attrs
+ * @attrs: workqueue_attrs to free
+ *
+ * Undo alloc_workqueue_attrs().
+ */
+void free_workqueue_attrs(struct workqueue_attrs *attrs)
+{
+	if (attrs) {
+		free_cpumask_var(attrs->cpumask);
+		kfree(attrs);
+	}
+}
+EXPORT_SYMBOL_GPL(free_workqueue_attrs);
+
+/**
+ * alloc_workqueue_attrs - allocate a workqueue_attrs
+ * @gfp_mask: allocation mask to use
+ *
+ * Allocate a new workqueue_attrs, initialize with default settings and
+ * return it.  Returns NULL on failure.
+ */
+struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask)
+{
+	struct workqueue_attrs *attrs;
+
+	attrs = kzalloc(sizeof(*attrs), gfp_mask);
+	if (!attrs)
+		return NULL;
+	if (!alloc_cpumask_var(&attrs->cpumask, gfp_mask)) {
+		kfree(attrs);
+		return NULL;
 	}
+
+	cpumask_copy(attrs->cpumask, cpu_possible_mask);
+	return attrs;
+}
+EXPORT_SYMBOL_GPL(alloc_workqueue_attrs);
+
+static void copy_workqueue_attrs(struct workqueue_attrs *to,
+				 const struct workqueue_attrs *from)
+{
+	to->nice = from->nice;
+	cpumask_copy(to->cpumask, from->cpumask);
+}
+
+static bool wqattrs_equal(const struct workqueue_attrs *a,
+			  const struct workqueue_attrs *b)
+{
+	return a->nice == b->nice && cpumask_equal(a->cpumask, b->cpumask);
+}
+
+static void init_gcwq(struct global_cwq *gcwq, unsigned int cpu)
+{
+	int i;
+
+	spin_lock_init(&gcwq->lock);
+	INIT_LIST_HEAD(&gcwq->worklist);
+	gcwq->cpu = cpu;
+	gcwq->id = cpu;
+	gcwq->flags |= GCWQ_DISASSOCIATED;
+
+	INIT_LIST_HEAD(&gcwq->idle_list);
+	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
+
+	init_timer_deferrable(&gcwq->idle_timer);
+	gcwq->idle_timer.function = idle_worker_timeout;
+	gcwq->idle_timer.data = (unsigned long)gcwq;
+
+	setup_timer(&gcwq->mayday_timer, gcwq_mayday_timeout,
+		    (unsigned long)gcwq);
+
+	ida_init(&gcwq->worker_ida);
+
+	gcwq->trustee_state = TRUSTEE_DONE;
+	init_waitqueue_head(&gcwq->trustee_wait);
 }
 
+/**
+ * get_unbound_gcwq - get the unbound pool for a set of attributes
+ * @attrs: attributes of the pool
+ *
+ * Find the unbound pool serving @attrs, or create it with its first
+ * worker.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_pool_mutex).  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * The pool, %NULL if it doesn't exist and can't be created.
+ */
+static struct global_cwq *get_unbound_gcwq(const struct workqueue_attrs *attrs)
+{
+	struct global_cwq *gcwq;
+	struct worker *worker;
+	int i;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	for (i = 0; i < nr_unbound_pools; i++)
+		if (wqattrs_equal(unbound_pools[i]->attrs, attrs))
+			return unbound_pools[i];
+
+	if (nr_unbound_pools == MAX_UNBOUND_POOLS) {
+		pr_warn_once("workqueue: out of unbound pools\n");
+		return NULL;
+	}
+
+	gcwq = kzalloc(sizeof(*gcwq), GFP_KERNEL);
+	if (!gcwq)
+		return NULL;
+	gcwq->attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!gcwq->attrs)
+		goto fail;
+	copy_workqueue_attrs(gcwq->attrs, attrs);
+
+	init_gcwq(gcwq, WORK_CPU_UNBOUND);
+	gcwq->id = WORK_CPU_LAST + nr_unbound_pools;
+
+	worker = create_worker(gcwq, true);
+	if (!worker)
+		goto fail;
+
+	/* publish, a pool created while freezing starts out frozen */
+	spin_lock(&workqueue_lock);
+	spin_lock_irq(&gcwq->lock);
+	if (workqueue_freezing)
+		gcwq->flags |= GCWQ_FREEZING;
+	start_worker(worker);
+	spin_unlock_irq(&gcwq->lock);
+
+	unbound_pools[nr_unbound_pools] = gcwq;
+	/* pairs with the smp_rmb()s in get_gcwq_by_id() and __next_gcwq() */
+	smp_wmb();
+	nr_unbound_pools++;
+	spin_unlock(&workqueue_lock);
+
+	return gcwq;
+fail:
+	ida_destroy(&gcwq->worker_ida);
+	free_workqueue_attrs(gcwq->attrs);
+	kfree(gcwq);
+	return NULL;
+}
+
+/**
+ * get_ucwq - get the cwq of an unbound workqueue for a pool
+ * @wq: the unbound workqueue
+ * @gcwq: the unbound pool, may be %NULL
+ *
+ * Find the cwq through which @wq queues to @gcwq, or allocate it and
+ * add it to the cwqs of @wq.  The cwqs of @wq stay around until it's
+ * destroyed.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_pool_mutex).  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * The cwq, %NULL if @gcwq is %NULL or on allocation failure.
+ */
+static struct cpu_workqueue_struct *get_ucwq(struct workqueue_struct *wq,
+					     struct global_cwq *gcwq)
+{
+	const size_t size = sizeof(struct cpu_workqueue_struct);
+	struct cpu_workqueue_struct *cwq;
+	void *ptr;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (!gcwq)
+		return NULL;
+	cwq = find_cwq(gcwq, wq);
+	if (cwq)
+		return cwq;
+
+	/*
+	 * Allocate enough room to align cwq and put an extra pointer at
+	 * the end pointing back to the originally allocated pointer
+	 * which will be used for free.
+	 */
+	ptr = kzalloc(size + CWQ_ALIGN + sizeof(void *), GFP_KERNEL);
+	if (!ptr)
+		return NULL;
+	cwq = PTR_ALIGN(ptr, CWQ_ALIGN);
+	*(void **)(cwq + 1) = ptr;
+
+	cwq->gcwq = gcwq;
+	cwq->wq = wq;
+	cwq->flush_color = -1;
+	INIT_LIST_HEAD(&cwq->delayed_works);
+
+	/*
+	 * The work color has to match that of the other cwqs, which
+	 * flush_mutex keeps still, and workqueue_lock keeps the freezer
+	 * and workqueue_set_max_active() away while max_active is set.
+	 */
+	mutex_lock(&wq->flush_mutex);
+	spin_lock(&workqueue_lock);
+	cwq->work_color = wq->work_color;
+	if (workqueue_freezing && wq->flags & WQ_FREEZABLE)
+		cwq->max_active = 0;
+	else
+		cwq->max_active = wq->saved_max_active;
+	list_add_tail_rcu(&cwq->unbound_node, &wq->unbound_cwqs);
+	spin_unlock(&workqueue_lock);
+	mutex_unlock(&wq->flush_mutex);
+
+	return cwq;
+}
+
+/*
+ * Unbound works are queued to a pool serving the cluster of the cpu
+ * they're queued on, which is the cpus sharing its package as
+ * topology_core_cpumask() reports it, e.g. the big or the little
+ * cluster of a big.LITTLE SoC, so that they don't drag their data
+ * across clusters.  A cpu only shows up there while it's online, so the
+ * clusters are accumulated as cpus come up, and they're left alone
+ * until all the boot cpus are up so that booting doesn't leave pools
+ * for partial clusters behind.  A cpu without siblings is served by the
+ * pool for all the cpus of the workqueue.
+ */
+static DEFINE_PER_CPU(cpumask_var_t, wq_cluster_mask);	/* M */
+static bool wq_clusters_enabled;			/* M */
+
+static bool wq_cluster_attrs(struct workqueue_struct *wq,
+			     const struct workqueue_attrs *attrs, int cpu,
+			     struct workqueue_attrs *cluster)
+{
+	if (wq->flags & __WQ_ORDERED || !wq_clusters_enabled)
+		return false;
+
+	cluster->nice = attrs->nice;
+	return cpumask_and(cluster->cpumask, attrs->cpumask,
+			   per_cpu(wq_cluster_mask, cpu));
+}
+
+/**
+ * wq_map_unbound - point the cwqs of an unbound workqueue at its pools
+ * @wq: the unbound workqueue
+ * @attrs: attributes to map @wq for
+ * @cpus: cpus to map
+ *
+ * Make the works queued to @wq on @cpus go to the pools for the part of
+ * @attrs->cpumask within their cluster.  Ordered workqueues, cpus whose
+ * cluster isn't known and cpus outside @attrs->cpumask go to the pool
+ * for all of @attrs->cpumask, so do the others if there's no pool to
+ * spare for their cluster.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_pool_mutex).  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * 0 on success, -ENOMEM if there's no pool for @attrs, in which case
+ * the mapping of @wq is left alone.
+ */
+static int wq_map_unbound(struct workqueue_struct *wq,
+			  const struct workqueue_attrs *attrs,
+			  const struct cpumask *cpus)
+{
+	struct cpu_workqueue_struct *dfl_cwq, *cwq;
+	struct workqueue_attrs *cluster;
+	int cpu;
+
+	dfl_cwq = get_ucwq(wq, get_unbound_gcwq(attrs));
+	if (!dfl_cwq)
+		return -ENOMEM;
+
+	cluster = alloc_workqueue_attrs(GFP_KERNEL);
+
+	for_each_cpu(cpu, cpus) {
+		cwq = NULL;
+		if (cluster && wq_cluster_attrs(wq, attrs, cpu, cluster))
+			cwq = get_ucwq(wq, get_unbound_gcwq(cluster));
+
+		/* pairs with smp_read_barrier_depends() in get_cwq() */
+		smp_wmb();
+		wq->cpu_wq.unbound[cpu] = cwq ?: dfl_cwq;
+	}
+
+	free_workqueue_attrs(cluster);
+	return 0;
+}
+
+/**
+ * wq_update_clusters - learn the cluster of a cpu
+ * @cpu: cpu which came online
+ *
+ * Add the siblings @cpu reports to the clusters of their cpus and remap
+ * the unbound workqueues for the cpus whose cluster grew.
+ *
+ * CONTEXT:
+ * Might sleep.
+ */
+static void wq_update_clusters(int cpu)
+{
+	const struct cpumask *core = topology_core_cpumask(cpu);
+	struct workqueue_struct *wq;
+	cpumask_var_t changed;
+	int c;
+
+	if (cpumask_weight(core) < 2)
+		return;
+	if (!zalloc_cpumask_var(&changed, GFP_KERNEL))
+		return;
+
+	mutex_lock(&wq_pool_mutex);
+
+	if (!wq_clusters_enabled)
+		goto out_unlock;
+
+	for_each_cpu(c, core) {
+		struct cpumask *mask = per_cpu(wq_cluster_mask, c);
+
+		if (!cpumask_subset(core, mask)) {
+			cpumask_or(mask, mask, core);
+			cpumask_set_cpu(c, changed);
+		}
+	}
+
+	if (!cpumask_empty(changed))
+		list_for_each_entry(wq, &workqueues, list)
+			if (wq->flags & WQ_UNBOUND)
+				wq_map_unbound(wq, wq->unbound_attrs, changed);
+out_unlock:
+	mutex_unlock(&wq_pool_mutex);
+	free_cpumask_var(changed);
+}
+
+static int __init wq_init_clusters(void)
+{
+	int cpu;
+
+	mutex_lock(&wq_pool_mutex);
+	wq_clusters_enabled = true;
+	mutex_unlock(&wq_pool_mutex);
+
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		wq_update_clusters(cpu);
+	put_online_cpus();
+	return 0;
+}
+late_initcall(wq_init_clusters);
+
+/**
+ * apply_workqueue_attrs - change the attributes of an unbound workqueue
+ * @wq: the unbound workqueue
+ * @attrs: the new attributes
+ *
+ * Make the works queued to @wq from now on run on pools with @attrs,
+ * split by cluster.  Works already queued finish where they are.
+ * Ordered workqueues can't change their attributes since that would
+ * break their ordering.
+ *
+ * CONTEXT:
+ * Might sleep.
+ *
+ * RETURNS:
+ * 0 on success, -errno on failure.
+ */
+int apply_workqueue_attrs(struct workqueue_struct *wq,
+			  const struct workqueue_attrs *attrs)
+{
+	struct workqueue_attrs *new;
+	int ret;
+
+	if (WARN_ON(!(wq->flags & WQ_UNBOUND) || wq->flags & __WQ_ORDERED))
+		return -EINVAL;
+	if (attrs->nice < -20 || attrs->nice > 19)
+		return -EINVAL;
+
+	new = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+	copy_workqueue_attrs(new, attrs);
+	if (!cpumask_and(new->cpumask, new->cpumask, cpu_possible_mask)) {
+		free_workqueue_attrs(new);
+		return -EINVAL;
+	}
+
+	mutex_lock(&wq_pool_mutex);
+	ret = wq_map_unbound(wq, new, cpu_possible_mask);
+	if (!ret)
+		swap(wq->unbound_attrs, new);
+	mutex_unlock(&wq_pool_mutex);
+
+	free_workqueue_attrs(new);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(apply_workqueue_attrs);
+
 static int wq_clamp_max_active(int max_active, unsigned int flags,
 			       const char *name)
 {
@@ -2953,8 +3524,9 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 {
 	va_list args, args1;
 	struct workqueue_struct *wq;
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
 	size_t namelen;
+	int cpu;
 
 	/* determine namelen, allocate wq and format name */
 	va_start(args, lock_name);
@@ -2983,6 +3555,13 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if (flags & WQ_UNBOUND)
 		flags |= WQ_HIGHPRI;
 
+	/*
+	 * Unbound workqueues with @max_active of one were ordered before
+	 * alloc_ordered_workqueue() was around and users still rely on it.
+	 */
+	if (flags & WQ_UNBOUND && max_active == 1)
+		flags |= __WQ_ORDERED;
+
 	max_active = max_active ?: WQ_DFL_ACTIVE;
 	max_active = wq_clamp_max_active(max_active, flags, wq->name);
 
@@ -2993,6 +3572,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	atomic_set(&wq->nr_cwqs_to_flush, 0);
 	INIT_LIST_HEAD(&wq->flusher_queue);
 	INIT_LIST_HEAD(&wq->flusher_overflow);
+	INIT_LIST_HEAD(&wq->unbound_cwqs);
 
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
 	INIT_LIST_HEAD(&wq->list);
@@ -3000,32 +3580,41 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if (alloc_cwqs(wq) < 0)
 		goto err;
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-		struct global_cwq *gcwq = get_gcwq(cpu);
-
-		BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
-		cwq->gcwq = gcwq;
-		cwq->wq = wq;
-		cwq->flush_color = -1;
-		cwq->max_active = max_active;
-		INIT_LIST_HEAD(&cwq->delayed_works);
+	if (!(flags & WQ_UNBOUND)) {
+		for_each_cwq(cwq, wq, cpu) {
+			BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
+			cwq->gcwq = get_gcwq(cpu);
+			cwq->wq = wq;
+			cwq->flush_color = -1;
+			cwq->max_active = max_active;
+			INIT_LIST_HEAD(&cwq->delayed_works);
+		}
 	}
 
+	/*
+	 * wq_pool_mutex keeps the cluster updates away until @wq is on
+	 * the workqueues list.
+	 */
+	mutex_lock(&wq_pool_mutex);
+
+	if (flags & WQ_UNBOUND &&
+	    wq_map_unbound(wq, wq->unbound_attrs, cpu_possible_mask) < 0)
+		goto err_unlock;
+
 	if (flags & WQ_RESCUER) {
 		struct worker *rescuer;
 
 		if (!alloc_mayday_mask(&wq->mayday_mask, GFP_KERNEL))
-			goto err;
+			goto err_unlock;
 
 		wq->rescuer = rescuer = alloc_worker();
 		if (!rescuer)
-			goto err;
+			goto err_unlock;
 
 		rescuer->task = kthread_create(rescuer_thread, wq, "%s",
 					       wq->name);
 		if (IS_ERR(rescuer->task))
-			goto err;
+			goto err_unlock;
 
 		rescuer->task->flags |= PF_THREAD_BOUND;
 		wake_up_process(rescuer->task);
@@ -3039,14 +3628,17 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	spin_lock(&workqueue_lock);
 
 	if (workqueue_freezing && wq->flags & WQ_FREEZABLE)
-		for_each_cwq_cpu(cpu, wq)
-			get_cwq(cpu, wq)->max_active = 0;
+		for_each_cwq(cwq, wq, cpu)
+			cwq->max_active = 0;
 
 	list_add(&wq->list, &workqueues);
 
 	spin_unlock(&workqueue_lock);
+	mutex_unlock(&wq_pool_mutex);
 
 	return wq;
+err_unlock:
+	mutex_unlock(&wq_pool_mutex);
 err:
 	if (wq) {
 		free_cwqs(wq);
@@ -3066,7 +3658,8 @@ EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
  */
 void destroy_workqueue(struct workqueue_struct *wq)
 {
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
+	int cpu;
 
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
@@ -3075,13 +3668,14 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	 * wq list is used to freeze wq, remove from list after
 	 * flushing is complete in case freeze races us.
 	 */
+	mutex_lock(&wq_pool_mutex);
 	spin_lock(&workqueue_lock);
 	list_del(&wq->list);
 	spin_unlock(&workqueue_lock);
+	mutex_unlock(&wq_pool_mutex);
 
 	/* sanity check */
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	for_each_cwq(cwq, wq, cpu) {
 		int i;
 
 		for (i = 0; i < WORK_NR_COLORS; i++)
@@ -3113,7 +3707,8 @@ EXPORT_SYMBOL_GPL(destroy_workqueue);
  */
 void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 {
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
+	int cpu;
 
 	max_active = wq_clamp_max_active(max_active, wq->flags, wq->name);
 
@@ -3121,14 +3716,14 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 
 	wq->saved_max_active = max_active;
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
+	for_each_cwq(cwq, wq, cpu) {
+		struct global_cwq *gcwq = cwq->gcwq;
 
 		spin_lock_irq(&gcwq->lock);
 
 		if (!(wq->flags & WQ_FREEZABLE) ||
 		    !(gcwq->flags & GCWQ_FREEZING))
-			get_cwq(gcwq->cpu, wq)->max_active = max_active;
+			cwq->max_active = max_active;
 
 		spin_unlock_irq(&gcwq->lock);
 	}
@@ -3579,6 +4174,9 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 
 	spin_unlock_irqrestore(&gcwq->lock, flags);
 
+	if (action == CPU_ONLINE)
+		wq_update_clusters(cpu);
+
 	return notifier_from_errno(0);
 }
 
@@ -3643,15 +4241,15 @@ EXPORT_SYMBOL_GPL(work_on_cpu);
  */
 void freeze_workqueues_begin(void)
 {
-	unsigned int cpu;
+	struct global_cwq *gcwq;
+	int id;
 
 	spin_lock(&workqueue_lock);
 
 	BUG_ON(workqueue_freezing);
 	workqueue_freezing = true;
 
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
+	for_each_gcwq(gcwq, id) {
 		struct workqueue_struct *wq;
 
 		spin_lock_irq(&gcwq->lock);
@@ -3660,7 +4258,7 @@ void freeze_workqueues_begin(void)
 		gcwq->flags |= GCWQ_FREEZING;
 
 		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+			struct cpu_workqueue_struct *cwq = find_cwq(gcwq, wq);
 
 			if (cwq && wq->flags & WQ_FREEZABLE)
 				cwq->max_active = 0;
@@ -3687,21 +4285,22 @@ void freeze_workqueues_begin(void)
  */
 bool freeze_workqueues_busy(void)
 {
-	unsigned int cpu;
+	struct global_cwq *gcwq;
 	bool busy = false;
+	int id;
 
 	spin_lock(&workqueue_lock);
 
 	BUG_ON(!workqueue_freezing);
 
-	for_each_gcwq_cpu(cpu) {
+	for_each_gcwq(gcwq, id) {
 		struct workqueue_struct *wq;
 		/*
 		 * nr_active is monotonically decreasing.  It's safe
 		 * to peek without lock.
 		 */
 		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+			struct cpu_workqueue_struct *cwq = find_cwq(gcwq, wq);
 
 			if (!cwq || !(wq->flags & WQ_FREEZABLE))
 				continue;
@@ -3729,15 +4328,15 @@ out_unlock:
  */
 void thaw_workqueues(void)
 {
-	unsigned int cpu;
+	struct global_cwq *gcwq;
+	int id;
 
 	spin_lock(&workqueue_lock);
 
 	if (!workqueue_freezing)
 		goto out_unlock;
 
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
+	for_each_gcwq(gcwq, id) {
 		struct workqueue_struct *wq;
 
 		spin_lock_irq(&gcwq->lock);
@@ -3746,7 +4345,7 @@ void thaw_workqueues(void)
 		gcwq->flags &= ~GCWQ_FREEZING;
 
 		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+			struct cpu_workqueue_struct *cwq = find_cwq(gcwq, wq);
 
 			if (!cwq || !(wq->flags & WQ_FREEZABLE))
 				continue;
@@ -3773,35 +4372,22 @@ out_unlock:
 static int __init init_workqueues(void)
 {
 	unsigned int cpu;
-	int i;
 
 	cpu_notifier(workqueue_cpu_callback, CPU_PRI_WORKQUEUE);
 
 	/* initialize gcwqs */
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-
-		spin_lock_init(&gcwq->lock);
-		INIT_LIST_HEAD(&gcwq->worklist);
-		gcwq->cpu = cpu;
-		gcwq->flags |= GCWQ_DISASSOCIATED;
-
-		INIT_LIST_HEAD(&gcwq->idle_list);
-		for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
-			INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
-
-		init_timer_deferrable(&gcwq->idle_timer);
-		gcwq->idle_timer.function = idle_worker_timeout;
-		gcwq->idle_timer.data = (unsigned long)gcwq;
-
-		setup_timer(&gcwq->mayday_timer, gcwq_mayday_timeout,
-			    (unsigned long)gcwq);
+	for_each_gcwq_cpu(cpu)
+		init_gcwq(get_gcwq(cpu), cpu);
 
-		ida_init(&gcwq->worker_ida);
+	/* the unbound gcwq is the pool for the default attributes */
+	unbound_global_cwq.attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	BUG_ON(!unbound_global_cwq.attrs);
+	unbound_pools[0] = &unbound_global_cwq;
+	nr_unbound_pools = 1;
 
-		gcwq->trustee_state = TRUSTEE_DONE;
-		init_waitqueue_head(&gcwq->trustee_wait);
-	}
+	for_each_possible_cpu(cpu)
+		BUG_ON(!zalloc_cpumask_var(&per_cpu(wq_cluster_mask, cpu),
+					   GFP_KERNEL));
 
 	/* create the initial worker */
 	for_each_online_gcwq_cpu(cpu) {
@@ -0,0 +1,242 @@
+/*
+ * Workqueue throughput and latency test
+ *
+ * Starts threads= threads, by default one per online cpu, each bound to
+ * its cpu. Each thread fills the buffers of batch= work items with
+ * work_bytes bytes, queues them and waits for all of them to finish,
+ * rounds= times over. The work items read their buffer back, as the
+ * deferred half of a driver or filesystem operation would. This is done
+ * on a bound workqueue and then on an unbound one. Reports the throughput
+ * and the 50th, 90th, 99th and 99.9th percentile and the maximum of the
+ * latency from queueing a work item to its start for each, and how many
+ * work items ran outside the cluster of the cpu that queued them.
+ *
+ *   modprobe workqueue_bench batch=64 rounds=1000 work_bytes=4096
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
+#include <linux/topology.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/latency_test.h>
+
+static unsigned int threads;
+module_param(threads, uint, 0444);
+MODULE_PARM_DESC(threads, "threads, 0 for one per online cpu");
+
+static unsigned int batch = 64;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "work items queued at a time per thread");
+
+static unsigned int rounds = 1000;
+module_param(rounds, uint, 0444);
+MODULE_PARM_DESC(rounds, "batches per thread");
+
+static unsigned int work_bytes = 4096;
+module_param(work_bytes, uint, 0444);
+MODULE_PARM_DESC(work_bytes, "bytes of the buffer of a work item");
+
+struct bench_thread;
+
+struct bench_item {
+	struct work_struct	work;
+	struct bench_thread	*bt;
+	ktime_t			queued;
+	unsigned long		*buf;
+	unsigned long		sum;
+};
+
+struct bench_thread {
+	struct task_struct	*task;
+	struct completion	done;
+	struct completion	batch_done;
+	unsigned int		cpu;
+	struct bench_item	*items;
+	atomic_t		pending;
+	atomic_t		remote;
+	atomic_t		nr;
+	u32			*ns;
+	unsigned int		max;
+};
+
+static struct workqueue_struct *bench_wq;
+
+static void bench_work_fn(struct work_struct *work)
+{
+	struct bench_item *item = container_of(work, struct bench_item, work);
+	struct bench_thread *bt = item->bt;
+	u32 ns = latency_test_ns(item->queued, ktime_get());
+	unsigned long sum = 0;
+	unsigned int i, idx;
+
+	idx = atomic_inc_return(&bt->nr) - 1;
+	if (idx < bt->max)
+		bt->ns[idx] = ns;
+	if (!cpumask_test_cpu(raw_smp_processor_id(),
+			      topology_core_cpumask(bt->cpu)))
+		atomic_inc(&bt->remote);
+
+	for (i = 0; i < work_bytes / sizeof(long); i++)
+		sum += item->buf[i];
+	ACCESS_ONCE(item->sum) = sum;
+
+	if (atomic_dec_and_test(&bt->pending))
+		complete(&bt->batch_done);
+}
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	unsigned int r, i;
+
+	for (r = 0; r < rounds; r++) {
+		INIT_COMPLETION(bt->batch_done);
+		atomic_set(&bt->pending, batch);
+		for (i = 0; i < batch; i++) {
+			struct bench_item *item = &bt->items[i];
+
+			memset(item->buf, r + i, work_bytes);
+			item->queued = ktime_get();
+			queue_work(bench_wq, &item->work);
+		}
+		wait_for_completion(&bt->batch_done);
+		cond_resched();
+	}
+
+	complete(&bt->done);
+	return 0;
+}
+
+static void run(const char *what, struct bench_thread *bts, u32 *ns)
+{
+	unsigned int i, cpu, nr = 0;
+	unsigned long remote = 0;
+	ktime_t start;
+	s64 usecs;
+
+	bench_wq = alloc_workqueue("wq_bench_%s",
+				   strcmp(what, "unbound") ? 0 : WQ_UNBOUND,
+				   0, what);
+	if (!bench_wq)
+		return;
+
+	start = ktime_get();
+	i = 0;
+	for_each_online_cpu(cpu) {
+		struct bench_thread *bt = &bts[i];
+
+		if (i == threads)
+			break;
+		i++;
+		init_completion(&bt->done);
+		init_completion(&bt->batch_done);
+		bt->cpu = cpu;
+		atomic_set(&bt->remote, 0);
+		atomic_set(&bt->nr, 0);
+
+		bt->task = kthread_create(bench_thread_fn, bt,
+					  "wq_bench/%u", cpu);
+		if (IS_ERR(bt->task)) {
+			complete(&bt->done);
+			continue;
+		}
+		kthread_bind(bt->task, cpu);
+		wake_up_process(bt->task);
+	}
+
+	for (i = 0; i < threads; i++) {
+		struct bench_thread *bt = &bts[i];
+		unsigned int n;
+
+		wait_for_completion(&bt->done);
+		remote += atomic_read(&bt->remote);
+		n = min_t(unsigned int, atomic_read(&bt->nr), bt->max);
+		/* Compact the samples of all threads at the front */
+		memmove(ns + nr, bt->ns, n * sizeof(u32));
+		nr += n;
+	}
+	usecs = ktime_us_delta(ktime_get(), start);
+	destroy_workqueue(bench_wq);
+
+	pr_info("workqueue_bench: %s: %u work items, %lld usecs, "
+		"%llu work items/s, %lu outside the cluster\n", what, nr, usecs,
+		usecs ? div64_u64((u64)nr * USEC_PER_SEC, usecs) : 0ULL,
+		remote);
+	latency_test_report("workqueue_bench", what, ns, nr);
+}
+
+static int __init workqueue_bench_init(void)
+{
+	struct bench_thread *bts;
+	unsigned int i, j, max;
+	u32 *ns;
+	int ret = 0;
+
+	if (!threads || threads > num_online_cpus())
+		threads = num_online_cpus();
+	if (!batch || !rounds || work_bytes < sizeof(long))
+		return -EINVAL;
+	max = rounds * batch;
+
+	bts = kcalloc(threads, sizeof(*bts), GFP_KERNEL);
+	ns = vmalloc((size_t)threads * max * sizeof(u32));
+	if (!bts || !ns) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < threads; i++) {
+		struct bench_thread *bt = &bts[i];
+
+		bt->ns = ns + (size_t)i * max;
+		bt->max = max;
+		bt->items = kcalloc(batch, sizeof(*bt->items), GFP_KERNEL);
+		if (!bt->items) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		for (j = 0; j < batch; j++) {
+			struct bench_item *item = &bt->items[j];
+
+			INIT_WORK(&item->work, bench_work_fn);
+			item->bt = bt;
+			item->buf = kmalloc(work_bytes, GFP_KERNEL);
+			if (!item->buf) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+	}
+
+	pr_info("workqueue_bench: %u threads, %u rounds of %u work items "
+		"of %u bytes\n", threads, rounds, batch, work_bytes);
+	run("bound", bts, ns);
+	run("unbound", bts, ns);
+
+out:
+	for (i = 0; bts && i < threads; i++) {
+		struct bench_thread *bt = &bts[i];
+
+		for (j = 0; bt->items && j < batch; j++)
+			kfree(bt->items[j].buf);
+		kfree(bt->items);
+	}
+	vfree(ns);
+	kfree(bts);
+	return ret;
+}
+
+static void __exit workqueue_bench_exit(void)
+{
+}
+
+module_init(workqueue_bench_init);
+module_exit(workqueue_bench_exit);
+
+MODULE_DESCRIPTION("workqueue throughput and latency test");
+MODULE_LICENSE("GPL");
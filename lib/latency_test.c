@@ -0,0 +1,45 @@
+/*
+ * Latency percentiles for the test modules
+ *
+ * Sorts the samples of a test and prints the 50th, 90th, 99th and 99.9th
+ * percentile and the maximum, one line each, prefixed with the name of
+ * the test and what was measured.
+ */
+#include <linux/module.h>
+#include <linux/latency_test.h>
+#include <linux/sort.h>
+#include <linux/math64.h>
+
+static int cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Per mille of the samples */
+static const unsigned int percentiles[] = { 500, 900, 990, 999 };
+
+/**
+ * latency_test_report - print the latency percentiles of a test
+ * @name:	name of the test, prefixed to every line
+ * @what:	what the samples measured
+ * @ns:		the samples in nanoseconds, sorted in place
+ * @nr:		number of samples, nothing is printed without any
+ */
+void latency_test_report(const char *name, const char *what,
+			 u32 *ns, unsigned int nr)
+{
+	unsigned int i;
+
+	if (!nr)
+		return;
+
+	sort(ns, nr, sizeof(*ns), cmp_u32, NULL);
+	for (i = 0; i < ARRAY_SIZE(percentiles); i++)
+		pr_info("%s: %-9s p%u.%u %10u ns\n", name, what,
+			percentiles[i] / 10, percentiles[i] % 10,
+			ns[div_u64((u64)nr * percentiles[i], 1000)]);
+	pr_info("%s: %-9s max   %10u ns\n", name, what, ns[nr - 1]);
+}
+EXPORT_SYMBOL_GPL(latency_test_report);
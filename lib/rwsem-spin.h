@@ -0,0 +1,139 @@
+/* rwsem-spin.h: optimistic spinning on the write owner of an rwsem
+ *
+ * Shared by lib/rwsem.c and lib/rwsem-spinlock.c, which each provide
+ * rwsem_try_write_lock_unqueued() and rwsem_try_read_lock_unqueued() for
+ * their own representation of the lock state.
+ */
+#ifndef _LIB_RWSEM_SPIN_H
+#define _LIB_RWSEM_SPIN_H
+
+#include <linux/rwsem.h>
+#include <linux/sched.h>
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+#include <linux/mcs_spinlock.h>
+
+static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem);
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem);
+
+/*
+ * Spinning only pays off behind a writer that is running: readers are
+ * not tracked and may hold the rwsem for long.
+ */
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	bool on_cpu = false;
+
+	if (need_resched())
+		return false;
+
+	rcu_read_lock();
+	owner = ACCESS_ONCE(sem->owner);
+	if (owner)
+		on_cpu = owner->on_cpu;
+	rcu_read_unlock();
+
+	return on_cpu;
+}
+
+static inline bool owner_running(struct rw_semaphore *sem,
+				 struct task_struct *owner)
+{
+	if (sem->owner != owner)
+		return false;
+
+	/*
+	 * Ensure we emit the owner->on_cpu, dereference _after_ checking
+	 * sem->owner still matches owner, if that fails, owner might
+	 * point to free()d memory, if it still matches, the rcu_read_lock()
+	 * ensures the memory stays valid.
+	 */
+	barrier();
+
+	return owner->on_cpu;
+}
+
+static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem,
+					 struct task_struct *owner)
+{
+	rcu_read_lock();
+	while (owner_running(sem, owner)) {
+		if (need_resched())
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	rcu_read_unlock();
+
+	/*
+	 * We break out the loop above on need_resched() or when the owner
+	 * changed, which is a sign for heavy contention. Return success
+	 * only when sem->owner is NULL.
+	 */
+	return ACCESS_ONCE(sem->owner) == NULL;
+}
+
+/*
+ * Spin for the rwsem while its write owner runs, instead of sleeping
+ * right away. The spinners queue up on sem->osq, so that only the one
+ * at its head polls the owner and the count.
+ */
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool write)
+{
+	struct mcs_spinlock node;
+	struct task_struct *owner;
+	bool taken = false;
+
+	preempt_disable();
+	mcs_spin_lock(&sem->osq, &node);
+
+	for (;;) {
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		if (write ? rwsem_try_write_lock_unqueued(sem) :
+			    rwsem_try_read_lock_unqueued(sem)) {
+			taken = true;
+			break;
+		}
+
+		/*
+		 * A reader only waits for the writer to go away: if the
+		 * rwsem is still not available, it is read owned, or has
+		 * waiters which it must not overtake.
+		 */
+		if (!write)
+			break;
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the lock and setting the owner field. If
+		 * we're an RT task that will live-lock because we won't let
+		 * the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+
+	mcs_spin_unlock(&sem->osq, &node);
+	preempt_enable();
+	return taken;
+}
+#else
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline bool rwsem_optimistic_spin(struct rw_semaphore *sem,
+					 bool write)
+{
+	return false;
+}
+#endif
+
+#endif /* _LIB_RWSEM_SPIN_H */
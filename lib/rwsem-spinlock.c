@@ -9,6 +9,8 @@
 #include <linux/sched.h>
 #include <linux/export.h>
 
+#include "rwsem-spin.h"
+
 struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
@@ -46,6 +48,10 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->activity = 0;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+	sem->osq = NULL;
+#endif
 }
 EXPORT_SYMBOL(__init_rwsem);
 
@@ -136,6 +142,24 @@ __rwsem_wake_one_writer(struct rw_semaphore *sem)
 	return sem;
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * The releases hand the semaphore straight to the waiters, so it is never
+ * seen free while there are any, and the spinners can't overtake them.
+ * Only take the spinlock once the semaphore looks available, to keep the
+ * spinners from bouncing it.
+ */
+static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	return ACCESS_ONCE(sem->activity) == 0 && __down_write_trylock(sem);
+}
+
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	return ACCESS_ONCE(sem->activity) >= 0 && __down_read_trylock(sem);
+}
+#endif
+
 /*
  * get a read lock on the semaphore
  */
@@ -145,6 +169,10 @@ void __sched __down_read(struct rw_semaphore *sem)
 	struct task_struct *tsk;
 	unsigned long flags;
 
+	/* spin rather than sleep while a running writer holds it */
+	if (rwsem_can_spin_on_owner(sem) && rwsem_optimistic_spin(sem, false))
+		return;
+
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
 
 	if (sem->activity >= 0 && list_empty(&sem->wait_list)) {
@@ -212,6 +240,9 @@ void __sched __down_write_nested(struct rw_semaphore *sem, int subclass)
 	struct task_struct *tsk;
 	unsigned long flags;
 
+	if (rwsem_can_spin_on_owner(sem) && rwsem_optimistic_spin(sem, true))
+		return;
+
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
 
 	if (sem->activity == 0 && list_empty(&sem->wait_list)) {
@@ -8,6 +8,8 @@
 #include <linux/init.h>
 #include <linux/export.h>
 
+#include "rwsem-spin.h"
+
 /*
  * Initialize an rwsem:
  */
@@ -24,6 +26,10 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+	sem->osq = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -38,11 +44,14 @@ struct rwsem_waiter {
 
 /* Wake types for __rwsem_do_wake().  Note that RWSEM_WAKE_NO_ACTIVE and
  * RWSEM_WAKE_READ_OWNED imply that the spinlock must have been kept held
- * since the rwsem value was observed.
+ * since the rwsem value was observed.  Optimistic spinners may still take
+ * the rwsem for write whenever it has no active lockers, so only
+ * RWSEM_WAKE_DOWNGRADE guarantees that no writer can get it meanwhile.
  */
 #define RWSEM_WAKE_ANY        0 /* Wake whatever's at head of wait list */
 #define RWSEM_WAKE_NO_ACTIVE  1 /* rwsem was observed with no active thread */
 #define RWSEM_WAKE_READ_OWNED 2 /* rwsem was observed to be read owned */
+#define RWSEM_WAKE_DOWNGRADE  3 /* rwsem is read owned by the caller */
 
 /*
  * handle the lock release when processes blocked on it that can now run
@@ -66,7 +75,8 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 	if (!(waiter->flags & RWSEM_WAITING_FOR_WRITE))
 		goto readers_only;
 
-	if (wake_type == RWSEM_WAKE_READ_OWNED)
+	if (wake_type == RWSEM_WAKE_READ_OWNED ||
+	    wake_type == RWSEM_WAKE_DOWNGRADE)
 		/* Another active reader was observed, so wakeup is not
 		 * likely to succeed. Save the atomic op.
 		 */
@@ -101,22 +111,27 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
  readers_only:
 	/* If we come here from up_xxxx(), another thread might have reached
 	 * rwsem_down_failed_common() before we acquired the spinlock and
-	 * woken up a waiter, making it now active.  We prefer to check for
-	 * this first in order to not spend too much time with the spinlock
-	 * held if we're not going to be able to wake up readers in the end.
-	 *
-	 * Note that we do not need to update the rwsem count: any writer
-	 * trying to acquire rwsem will run rwsem_down_write_failed() due
-	 * to the waiting threads and block trying to acquire the spinlock.
-	 *
-	 * We use a dummy atomic update in order to acquire the cache line
-	 * exclusively since we expect to succeed and run the final rwsem
-	 * count adjustment pretty soon.
+	 * woken up a waiter, making it now active.  And a writer spinning
+	 * in rwsem_optimistic_spin() may take the rwsem whenever it has no
+	 * active lockers, without the spinlock.  So grant the first read
+	 * lock right away, before counting the readers to wake, and back
+	 * off if a writer got there first.  A downgrading writer holds a
+	 * read lock itself, so nobody can.
 	 */
-	if (wake_type == RWSEM_WAKE_ANY &&
-	    rwsem_atomic_update(0, sem) < RWSEM_WAITING_BIAS)
-		/* Someone grabbed the sem for write already */
-		goto out;
+	adjustment = 0;
+	if (wake_type != RWSEM_WAKE_DOWNGRADE) {
+		adjustment = RWSEM_ACTIVE_READ_BIAS;
+ try_reader_grant:
+		oldcount = rwsem_atomic_update(adjustment, sem) - adjustment;
+		if (unlikely(oldcount < RWSEM_WAITING_BIAS)) {
+			/* Someone grabbed the sem for write already */
+			if (rwsem_atomic_update(-adjustment, sem) &
+			    RWSEM_ACTIVE_MASK)
+				goto out;
+			/* The writer left meanwhile, try again */
+			goto try_reader_grant;
+		}
+	}
 
 	/* Grant an infinite number of read locks to the readers at the front
 	 * of the queue.  Note we increment the 'active part' of the count by
@@ -134,12 +149,14 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 
 	} while (waiter->flags & RWSEM_WAITING_FOR_READ);
 
-	adjustment = woken * RWSEM_ACTIVE_READ_BIAS;
+	/* Less the read lock granted above already */
+	adjustment = woken * RWSEM_ACTIVE_READ_BIAS - adjustment;
 	if (waiter->flags & RWSEM_WAITING_FOR_READ)
 		/* hit end of list above */
 		adjustment -= RWSEM_WAITING_BIAS;
 
-	rwsem_atomic_add(adjustment, sem);
+	if (adjustment)
+		rwsem_atomic_add(adjustment, sem);
 
 	next = sem->wait_list.next;
 	for (loop = woken; loop > 0; loop--) {
@@ -166,6 +183,44 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 	goto try_again_write;
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Take the rwsem for write, without queueing, if it has no active lockers.
+ * This may steal it from the waiters, like a mutex spinner does.
+ */
+static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (count == 0 || count == RWSEM_WAITING_BIAS) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return true;
+		count = old;
+	}
+	return false;
+}
+
+/*
+ * Take the rwsem for read, without queueing, if it has neither a writer
+ * nor waiters.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (count >= 0) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count)
+			return true;
+		count = old;
+	}
+	return false;
+}
+#endif
+
 /*
  * wait for a lock to be granted
  */
@@ -177,6 +232,17 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	struct task_struct *tsk = current;
 	signed long count;
 
+	/* Spin while a running writer holds the lock, before queueing up.
+	 * Give up our active count first, or the writer could never hand
+	 * the lock over to another spinner.
+	 */
+	if (rwsem_can_spin_on_owner(sem)) {
+		rwsem_atomic_add(adjustment, sem);
+		if (rwsem_optimistic_spin(sem, flags & RWSEM_WAITING_FOR_WRITE))
+			return sem;
+		adjustment = 0;
+	}
+
 	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
 
 	/* set up my own style of waitqueue */
@@ -201,7 +267,7 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	if (count == RWSEM_WAITING_BIAS)
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_NO_ACTIVE);
 	else if (count > RWSEM_WAITING_BIAS &&
-		 adjustment == -RWSEM_ACTIVE_WRITE_BIAS)
+		 (flags & RWSEM_WAITING_FOR_WRITE))
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -269,7 +335,7 @@ struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem)
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_DOWNGRADE);
 
 	raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
 
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -41,7 +43,12 @@ struct compact_control {
 
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
+	int extfrag_threshold;		/* see __compaction_suitable() */
 	struct zone *zone;
+
+	/* Background compaction only */
+	bool resume;			/* Start at the zone's cached scanners */
+	unsigned long max_scan;		/* Migrate scanner budget, 0 = none */
 };
 
 static unsigned long release_freepages(struct list_head *freelist)
@@ -269,6 +276,7 @@ static isolate_migrate_t isolate_migratepages(struct zone *zone,
 	unsigned long last_pageblock_nr = 0, pageblock_nr;
 	unsigned long nr_scanned = 0, nr_isolated = 0;
 	struct list_head *migratelist = &cc->migratepages;
+	struct lruvec *lruvec;
 
 	/* Do not scan outside zone boundaries */
 	low_pfn = max(cc->migrate_pfn, zone->zone_start_pfn);
@@ -300,25 +308,31 @@ static isolate_migrate_t isolate_migratepages(struct zone *zone,
 
 	/* Time to isolate some pages for migration */
 	cond_resched();
-	spin_lock_irq(&zone->lru_lock);
+	lruvec = zone_lruvec(zone, low_pfn);
+	spin_lock_irq(&lruvec->lru_lock);
 	for (; low_pfn < end_pfn; low_pfn++) {
 		struct page *page;
 		bool locked = true;
 
-		/* give a chance to irqs before checking need_resched() */
-		if (!((low_pfn+1) % SWAP_CLUSTER_MAX)) {
-			spin_unlock_irq(&zone->lru_lock);
+		/*
+		 * give a chance to irqs before checking need_resched(), and
+		 * switch locks when the scan enters another lruvec's pageblock
+		 */
+		if (!((low_pfn+1) % SWAP_CLUSTER_MAX) ||
+		    zone_lruvec(zone, low_pfn) != lruvec) {
+			spin_unlock_irq(&lruvec->lru_lock);
+			lruvec = zone_lruvec(zone, low_pfn);
 			locked = false;
 		}
-		if (need_resched() || spin_is_contended(&zone->lru_lock)) {
+		if (need_resched() || spin_is_contended(&lruvec->lru_lock)) {
 			if (locked)
-				spin_unlock_irq(&zone->lru_lock);
+				spin_unlock_irq(&lruvec->lru_lock);
 			cond_resched();
-			spin_lock_irq(&zone->lru_lock);
+			spin_lock_irq(&lruvec->lru_lock);
 			if (fatal_signal_pending(current))
 				break;
 		} else if (!locked)
-			spin_lock_irq(&zone->lru_lock);
+			spin_lock_irq(&lruvec->lru_lock);
 
 		if (!pfn_valid_within(low_pfn))
 			continue;
@@ -375,7 +389,7 @@ static isolate_migrate_t isolate_migratepages(struct zone *zone,
 
 	acct_isolated(zone, cc);
 
-	spin_unlock_irq(&zone->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 	cc->migrate_pfn = low_pfn;
 
 	trace_mm_compaction_isolate_migratepages(nr_scanned, nr_isolated);
@@ -477,7 +491,8 @@ static int compact_finished(struct zone *zone,
  *   COMPACT_PARTIAL  - If the allocation would succeed without compaction
  *   COMPACT_CONTINUE - If compaction should run now
  */
-unsigned long compaction_suitable(struct zone *zone, int order)
+static unsigned long __compaction_suitable(struct zone *zone, int order,
+					  int extfrag_threshold)
 {
 	int fragindex;
 	unsigned long watermark;
@@ -510,7 +525,7 @@ unsigned long compaction_suitable(struct zone *zone, int order)
 	 * Only compact if a failure would be due to fragmentation.
 	 */
 	fragindex = fragmentation_index(zone, order);
-	if (fragindex >= 0 && fragindex <= sysctl_extfrag_threshold)
+	if (fragindex >= 0 && fragindex <= extfrag_threshold)
 		return COMPACT_SKIPPED;
 
 	if (fragindex == -1000 && zone_watermark_ok(zone, order, watermark,
@@ -520,11 +535,17 @@ unsigned long compaction_suitable(struct zone *zone, int order)
 	return COMPACT_CONTINUE;
 }
 
+unsigned long compaction_suitable(struct zone *zone, int order)
+{
+	return __compaction_suitable(zone, order, sysctl_extfrag_threshold);
+}
+
 static int compact_zone(struct zone *zone, struct compact_control *cc)
 {
+	unsigned long start_pfn;
 	int ret;
 
-	ret = compaction_suitable(zone, cc->order);
+	ret = __compaction_suitable(zone, cc->order, cc->extfrag_threshold);
 	switch (ret) {
 	case COMPACT_PARTIAL:
 	case COMPACT_SKIPPED:
@@ -540,12 +561,30 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
 	cc->free_pfn &= ~(pageblock_nr_pages-1);
 
+	/*
+	 * Background compaction picks up where its last run stopped, as
+	 * long as the saved scanners are still inside the zone.
+	 */
+	if (cc->resume &&
+	    zone->compact_cached_migrate_pfn > cc->migrate_pfn &&
+	    zone->compact_cached_free_pfn <= cc->free_pfn &&
+	    zone->compact_cached_migrate_pfn < zone->compact_cached_free_pfn) {
+		cc->migrate_pfn = zone->compact_cached_migrate_pfn;
+		cc->free_pfn = zone->compact_cached_free_pfn;
+	}
+	start_pfn = cc->migrate_pfn;
+
 	migrate_prep_local();
 
 	while ((ret = compact_finished(zone, cc)) == COMPACT_CONTINUE) {
 		unsigned long nr_migrate, nr_remaining;
 		int err;
 
+		if (cc->max_scan && cc->migrate_pfn - start_pfn >= cc->max_scan) {
+			ret = COMPACT_PARTIAL;
+			break;
+		}
+
 		switch (isolate_migratepages(zone, cc)) {
 		case ISOLATE_ABORT:
 			ret = COMPACT_PARTIAL;
@@ -583,6 +622,16 @@ out:
 	cc->nr_freepages -= release_freepages(&cc->freepages);
 	VM_BUG_ON(cc->nr_freepages != 0);
 
+	if (cc->resume) {
+		if (ret == COMPACT_COMPLETE) {
+			zone->compact_cached_migrate_pfn = 0;
+			zone->compact_cached_free_pfn = 0;
+		} else {
+			zone->compact_cached_migrate_pfn = cc->migrate_pfn;
+			zone->compact_cached_free_pfn = cc->free_pfn;
+		}
+	}
+
 	return ret;
 }
 
@@ -595,6 +644,7 @@ unsigned long compact_zone_order(struct zone *zone,
 		.nr_migratepages = 0,
 		.order = order,
 		.migratetype = allocflags_to_migratetype(gfp_mask),
+		.extfrag_threshold = sysctl_extfrag_threshold,
 		.zone = zone,
 		.sync = sync,
 	};
@@ -673,6 +723,7 @@ static int compact_node(int nid)
 			.nr_freepages = 0,
 			.nr_migratepages = 0,
 			.order = -1,
+			.extfrag_threshold = sysctl_extfrag_threshold,
 		};
 
 		zone = &pgdat->node_zones[zoneid];
@@ -724,6 +775,260 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * Background compaction.
+ *
+ * Each node has a kcompactd thread. It is woken when a high-order
+ * allocation enters the slow path, and it wakes up by itself every
+ * kcompactd_interval_centisecs to check the orders set in kcompactd_orders.
+ * Either way it compacts the zones of the node in which the order is below
+ * its watermark and a failure would be due to fragmentation rather than
+ * lack of memory (fragmentation index above kcompactd_extfrag_threshold).
+ *
+ * A run migrates asynchronously and scans at most KCOMPACTD_MAX_SCAN pages
+ * of a zone. The next run continues where it stopped, so a large zone is
+ * compacted a piece at a time and kcompactd never holds on to a cpu for
+ * long.
+ */
+int sysctl_kcompactd_orders = (1 << 3) | (1 << 4);
+int sysctl_kcompactd_extfrag_threshold = 500;
+int sysctl_kcompactd_interval_centisecs = 50;
+
+#define KCOMPACTD_MAX_SCAN	(32 * pageblock_nr_pages)
+
+/* Bumped when the sysctls change so that sleeping threads notice */
+static atomic_t kcompactd_config_seq = ATOMIC_INIT(0);
+
+static bool kcompactd_zone_suitable(struct zone *zone, int order)
+{
+	return __compaction_suitable(zone, order,
+			sysctl_kcompactd_extfrag_threshold) == COMPACT_CONTINUE;
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    enum zone_type classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (populated_zone(zone) &&
+		    kcompactd_zone_suitable(zone, order))
+			return true;
+	}
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat, int order,
+			      enum zone_type classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+			.extfrag_threshold =
+				sysctl_kcompactd_extfrag_threshold,
+			.zone = zone,
+			.sync = false,
+			.resume = true,
+			.max_scan = KCOMPACTD_MAX_SCAN,
+		};
+
+		if (!populated_zone(zone) ||
+		    !kcompactd_zone_suitable(zone, order))
+			continue;
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		/* Page migration frees to the pcp lists but we want merging */
+		drain_local_pages(NULL);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			/* Direct compaction may try this zone again */
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+			count_vm_event(KCOMPACTD_SUCCESS);
+		} else
+			count_vm_event(KCOMPACTD_FAIL);
+
+		if (kthread_should_stop())
+			return;
+	}
+}
+
+/* Check the orders kcompactd keeps available, highest first */
+static void kcompactd_proactive(pg_data_t *pgdat)
+{
+	int order;
+
+	for (order = MAX_ORDER - 1; order > 0; order--) {
+		if (!(sysctl_kcompactd_orders & (1 << order)))
+			continue;
+		if (!kcompactd_node_suitable(pgdat, order, pgdat->nr_zones - 1))
+			continue;
+
+		count_vm_event(KCOMPACTD_PROACTIVE);
+		kcompactd_do_work(pgdat, order, pgdat->nr_zones - 1);
+		if (kthread_should_stop())
+			return;
+	}
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	int seq;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		unsigned long timeout = MAX_SCHEDULE_TIMEOUT;
+		int order;
+		enum zone_type classzone_idx;
+
+		if (sysctl_kcompactd_orders)
+			timeout = msecs_to_jiffies(
+				sysctl_kcompactd_interval_centisecs * 10);
+
+		seq = atomic_read(&kcompactd_config_seq);
+		if (wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				pgdat->kcompactd_max_order ||
+				atomic_read(&kcompactd_config_seq) != seq ||
+				kthread_should_stop(), timeout) &&
+		    !pgdat->kcompactd_max_order)
+			/* Woken up for a new configuration */
+			continue;
+		if (kthread_should_stop())
+			break;
+
+		order = pgdat->kcompactd_max_order;
+		classzone_idx = pgdat->kcompactd_classzone_idx;
+		pgdat->kcompactd_max_order = 0;
+		pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+		if (order)
+			kcompactd_do_work(pgdat, order, classzone_idx);
+		else
+			kcompactd_proactive(pgdat);
+	}
+
+	return 0;
+}
+
+/**
+ * wakeup_kcompactd - ask kcompactd to compact for a high-order allocation
+ * @zone: preferred zone of the allocation
+ * @order: order of the allocation
+ * @classzone_idx: highest zone the allocation may use
+ *
+ * Called from the allocator slow path. kcompactd is only woken if a zone
+ * of the node is fragmented for @order, so it does not spin when memory
+ * is simply short and kswapd has to reclaim first.
+ */
+void wakeup_kcompactd(struct zone *zone, int order,
+		      enum zone_type classzone_idx)
+{
+	pg_data_t *pgdat = zone->zone_pgdat;
+
+	if (!order || !populated_zone(zone))
+		return;
+
+	if (pgdat->kcompactd_max_order < order) {
+		pgdat->kcompactd_max_order = order;
+		pgdat->kcompactd_classzone_idx =
+			min(pgdat->kcompactd_classzone_idx, classzone_idx);
+	}
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	count_vm_event(KCOMPACTD_WAKE);
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * Start kcompactd for a node. Called at boot and when a node gets memory
+ * through hotplug.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+/* Wake the threads so that a new interval or order set takes effect */
+int sysctl_kcompactd_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret;
+	int nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	atomic_inc(&kcompactd_config_seq);
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		wake_up_interruptible(&NODE_DATA(nid)->kcompactd_wait);
+
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
@@ -0,0 +1,209 @@
+/*
+ * Frontswap frontend
+ *
+ * This code provides the generic "frontend" layer to call a matching
+ * "backend" driver implementation of frontswap, which can keep swapped
+ * out anonymous pages somewhere other than the swap device, for example
+ * compressed in RAM. See Documentation/vm/frontswap.txt for more
+ * information.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/frontswap.h>
+
+#include "internal.h"
+
+/*
+ * As for cleancache, this flag is checked on every swap in and swap out,
+ * so it is a global rather than a check of frontswap_ops.
+ */
+int frontswap_enabled;
+EXPORT_SYMBOL(frontswap_enabled);
+
+/*
+ * frontswap_ops is set by frontswap_register_ops to contain the pointers
+ * to the frontswap "backend" implementation functions.
+ */
+static struct frontswap_ops frontswap_ops;
+
+/* useful stats available in /sys/kernel/mm/frontswap */
+static unsigned long frontswap_succ_stores;
+static unsigned long frontswap_failed_stores;
+static unsigned long frontswap_loads;
+static unsigned long frontswap_flushes;
+
+/*
+ * register operations for frontswap, returning previous thus allowing
+ * detection of multiple backends and possible nesting
+ */
+struct frontswap_ops frontswap_register_ops(struct frontswap_ops *ops)
+{
+	struct frontswap_ops old = frontswap_ops;
+
+	frontswap_ops = *ops;
+	frontswap_enabled = 1;
+	return old;
+}
+EXPORT_SYMBOL(frontswap_register_ops);
+
+/* Called when a swap device is swapon'd */
+void __frontswap_init(unsigned type)
+{
+	struct swap_info_struct *sis = swap_info[type];
+
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map == NULL)
+		return;
+	(*frontswap_ops.init)(type);
+}
+EXPORT_SYMBOL(__frontswap_init);
+
+/*
+ * "Store" data from a page to frontswap and associate it with the page's
+ * swap type and offset. Page must be locked and in the swap cache. If a
+ * store of a page that is already in frontswap fails, the older copy is
+ * flushed so that the page is read back from the swap device, which the
+ * caller writes it to.
+ */
+int __frontswap_store(struct page *page)
+{
+	int ret, dup;
+	swp_entry_t entry = { .val = page_private(page), };
+	unsigned type = swp_type(entry);
+	struct swap_info_struct *sis = swap_info[type];
+	pgoff_t offset = swp_offset(entry);
+
+	VM_BUG_ON(!PageLocked(page));
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map == NULL)
+		return -1;
+
+	dup = test_bit(offset, sis->frontswap_map);
+	ret = (*frontswap_ops.store)(type, offset, page);
+	if (ret == 0) {
+		frontswap_succ_stores++;
+		if (!dup) {
+			set_bit(offset, sis->frontswap_map);
+			atomic_inc(&sis->frontswap_pages);
+		}
+	} else {
+		frontswap_failed_stores++;
+		if (dup) {
+			clear_bit(offset, sis->frontswap_map);
+			atomic_dec(&sis->frontswap_pages);
+			(*frontswap_ops.flush_page)(type, offset);
+		}
+	}
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_store);
+
+/*
+ * "Load" data from frontswap associated with the page's swap type and
+ * offset and, if found, fill the page with it and return 0. Page must be
+ * locked and in the swap cache.
+ */
+int __frontswap_load(struct page *page)
+{
+	int ret = -1;
+	swp_entry_t entry = { .val = page_private(page), };
+	unsigned type = swp_type(entry);
+	struct swap_info_struct *sis = swap_info[type];
+	pgoff_t offset = swp_offset(entry);
+
+	VM_BUG_ON(!PageLocked(page));
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map && test_bit(offset, sis->frontswap_map))
+		ret = (*frontswap_ops.load)(type, offset, page);
+	if (ret == 0)
+		frontswap_loads++;
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_load);
+
+/*
+ * Flush any data from frontswap associated with the swap type and offset
+ * so that a subsequent "load" will fail. Called with swap_lock held when
+ * the swap slot is freed.
+ */
+void __frontswap_flush_page(unsigned type, pgoff_t offset)
+{
+	struct swap_info_struct *sis = swap_info[type];
+
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map && test_bit(offset, sis->frontswap_map)) {
+		(*frontswap_ops.flush_page)(type, offset);
+		clear_bit(offset, sis->frontswap_map);
+		atomic_dec(&sis->frontswap_pages);
+		frontswap_flushes++;
+	}
+}
+EXPORT_SYMBOL(__frontswap_flush_page);
+
+/*
+ * Flush all data from frontswap associated with the swap type. Called by
+ * swapoff once all pages of the swap area have been brought back in.
+ */
+void __frontswap_flush_area(unsigned type)
+{
+	struct swap_info_struct *sis = swap_info[type];
+
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map == NULL)
+		return;
+	(*frontswap_ops.flush_area)(type);
+	atomic_set(&sis->frontswap_pages, 0);
+	memset(sis->frontswap_map, 0,
+	       BITS_TO_LONGS(sis->max) * sizeof(long));
+}
+EXPORT_SYMBOL(__frontswap_flush_area);
+
+#ifdef CONFIG_SYSFS
+
+/* see Documentation/ABI/testing/sysfs-kernel-mm-frontswap */
+
+#define FRONTSWAP_SYSFS_RO(_name) \
+	static ssize_t frontswap_##_name##_show(struct kobject *kobj, \
+				struct kobj_attribute *attr, char *buf) \
+	{ \
+		return sprintf(buf, "%lu\n", frontswap_##_name); \
+	} \
+	static struct kobj_attribute frontswap_##_name##_attr = { \
+		.attr = { .name = __stringify(_name), .mode = 0444 }, \
+		.show = frontswap_##_name##_show, \
+	}
+
+FRONTSWAP_SYSFS_RO(succ_stores);
+FRONTSWAP_SYSFS_RO(failed_stores);
+FRONTSWAP_SYSFS_RO(loads);
+FRONTSWAP_SYSFS_RO(flushes);
+
+static struct attribute *frontswap_attrs[] = {
+	&frontswap_succ_stores_attr.attr,
+	&frontswap_failed_stores_attr.attr,
+	&frontswap_loads_attr.attr,
+	&frontswap_flushes_attr.attr,
+	NULL,
+};
+
+static struct attribute_group frontswap_attr_group = {
+	.attrs = frontswap_attrs,
+	.name = "frontswap",
+};
+
+#endif /* CONFIG_SYSFS */
+
+static int __init init_frontswap(void)
+{
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &frontswap_attr_group))
+		pr_warn("frontswap: can't create sysfs files\n");
+#endif /* CONFIG_SYSFS */
+	return 0;
+}
+module_init(init_frontswap)
@@ -0,0 +1,155 @@
+/*
+ * High-order allocation latency test
+ *
+ * Allocates nr_allocs blocks of each order set in the orders bitmask,
+ * keeping up to hold blocks allocated at a time, and reports the
+ * allocation latencies as a log2 histogram with min, average and max.
+ * With memory fragmented by movable pages this shows how often high-order
+ * allocations stall in direct compaction, and how much of that
+ * background compaction by kcompactd takes off them.
+ *
+ *   modprobe highorder_latency orders=24 nr_allocs=2000 interval_ms=5
+ *
+ * tools/testing/bench/highorder-latency.sh fragments memory and runs
+ * the test with kcompactd's periodic checks on and off.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+
+static unsigned int orders = (1 << 3) | (1 << 4);
+module_param(orders, uint, 0444);
+MODULE_PARM_DESC(orders, "bitmask of the orders to test");
+
+static unsigned int nr_allocs = 1000;
+module_param(nr_allocs, uint, 0444);
+MODULE_PARM_DESC(nr_allocs, "allocations per order");
+
+static unsigned int hold = 64;
+module_param(hold, uint, 0444);
+MODULE_PARM_DESC(hold, "blocks kept allocated at a time");
+
+static unsigned int interval_ms = 5;
+module_param(interval_ms, uint, 0444);
+MODULE_PARM_DESC(interval_ms, "pause between allocations");
+
+/* Histogram buckets: < 1us, < 2us, < 4us, ... */
+#define HIST_BUCKETS	24
+
+struct latency_stats {
+	u64		min;
+	u64		max;
+	u64		total;
+	unsigned int	nr;
+	unsigned int	failed;
+	unsigned int	hist[HIST_BUCKETS];
+};
+
+static void latency_add(struct latency_stats *st, u64 usecs)
+{
+	unsigned int bucket = usecs ? ilog2(usecs) + 1 : 0;
+
+	if (!st->nr || usecs < st->min)
+		st->min = usecs;
+	if (usecs > st->max)
+		st->max = usecs;
+	st->total += usecs;
+	st->nr++;
+	st->hist[min_t(unsigned int, bucket, HIST_BUCKETS - 1)]++;
+}
+
+static void latency_report(unsigned int order, struct latency_stats *st)
+{
+	unsigned int i, seen = 0;
+
+	pr_info("highorder_latency: order %u: %u allocations, %u failed, "
+		"min %llu avg %llu max %llu usecs\n", order, st->nr,
+		st->failed, st->min,
+		st->nr ? div_u64(st->total, st->nr) : 0ULL, st->max);
+
+	for (i = 0; i < HIST_BUCKETS && seen < st->nr; i++) {
+		if (!st->hist[i])
+			continue;
+		seen += st->hist[i];
+		pr_info("highorder_latency:   < %8lu usecs %8u\n",
+			1UL << i, st->hist[i]);
+	}
+}
+
+static void test_order(unsigned int order, struct page **held)
+{
+	struct latency_stats st;
+	unsigned int i, slot = 0;
+	ktime_t start;
+	struct page *page;
+
+	memset(&st, 0, sizeof(st));
+
+	for (i = 0; i < nr_allocs; i++) {
+		/* Release the oldest block to keep the demand steady */
+		if (held[slot]) {
+			__free_pages(held[slot], order);
+			held[slot] = NULL;
+		}
+
+		start = ktime_get();
+		page = alloc_pages(GFP_KERNEL | __GFP_NOWARN, order);
+		latency_add(&st, ktime_us_delta(ktime_get(), start));
+
+		if (page)
+			held[slot] = page;
+		else
+			st.failed++;
+		slot = (slot + 1) % hold;
+
+		if (interval_ms)
+			msleep(interval_ms);
+		else
+			cond_resched();
+	}
+
+	for (i = 0; i < hold; i++) {
+		if (held[i]) {
+			__free_pages(held[i], order);
+			held[i] = NULL;
+		}
+	}
+
+	latency_report(order, &st);
+}
+
+static int __init highorder_latency_init(void)
+{
+	struct page **held;
+	unsigned int order;
+
+	if (!nr_allocs || !hold || !(orders & ((1 << MAX_ORDER) - 2)))
+		return -EINVAL;
+
+	held = kcalloc(hold, sizeof(*held), GFP_KERNEL);
+	if (!held)
+		return -ENOMEM;
+
+	for (order = 1; order < MAX_ORDER; order++)
+		if (orders & (1 << order))
+			test_order(order, held);
+
+	kfree(held);
+	return 0;
+}
+
+static void __exit highorder_latency_exit(void)
+{
+}
+
+module_init(highorder_latency_init);
+module_exit(highorder_latency_exit);
+
+MODULE_DESCRIPTION("High-order allocation latency test");
+MODULE_LICENSE("GPL");
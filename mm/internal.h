@@ -91,6 +91,11 @@ extern unsigned long highest_memmap_pfn;
 extern int isolate_lru_page(struct page *page);
 extern void putback_lru_page(struct page *page);
 
+/*
+ * in mm/swapfile.c
+ */
+extern struct swap_info_struct *swap_info[];
+
 /*
  * in mm/page_alloc.c
  */
@@ -36,6 +36,8 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/workqueue.h>
+#include <linux/vmalloc.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -115,11 +117,13 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @checksum: checksum of the ksm page, counted in the stable filter
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	u32 checksum;
 };
 
 /**
@@ -171,6 +175,16 @@ static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
 static struct kmem_cache *mm_slot_cache;
 
+/*
+ * The stable filter counts the stable tree pages by checksum, in one
+ * saturating counter per bucket. A page whose checksum falls in an empty
+ * bucket has no twin in the stable tree, and is not searched for there:
+ * most pages scanned are not, and each search costs a memcmp of a page
+ * per level of the tree. Without the filter, every page is searched for.
+ */
+static u8 *ksm_stable_filter;
+static unsigned long ksm_stable_filter_mask;
+
 /* The number of nodes in the stable tree */
 static unsigned long ksm_pages_shared;
 
@@ -189,6 +203,12 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Threads checksumming the pages ksmd scans, ksmd included */
+static unsigned int ksm_scan_threads = 1;
+
+/* Adjust ksm_thread_pages_to_scan to the merge yield */
+static unsigned int ksm_auto_tune;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -261,6 +281,48 @@ static inline void free_stable_node(struct stable_node *stable_node)
 	kmem_cache_free(stable_node_cache, stable_node);
 }
 
+#define STABLE_FILTER_SATURATED	0xff
+
+static void stable_filter_add(u32 checksum)
+{
+	u8 *count;
+
+	if (!ksm_stable_filter)
+		return;
+	count = &ksm_stable_filter[checksum & ksm_stable_filter_mask];
+	if (*count != STABLE_FILTER_SATURATED)
+		(*count)++;
+}
+
+static void stable_filter_del(u32 checksum)
+{
+	u8 *count;
+
+	if (!ksm_stable_filter)
+		return;
+	count = &ksm_stable_filter[checksum & ksm_stable_filter_mask];
+	/* A saturated count no longer knows how many pages it stands for */
+	if (*count != STABLE_FILTER_SATURATED)
+		(*count)--;
+}
+
+static inline bool stable_filter_may_contain(u32 checksum)
+{
+	return !ksm_stable_filter ||
+		ksm_stable_filter[checksum & ksm_stable_filter_mask];
+}
+
+/* One bucket for every 4 pages of memory: stable pages are a fraction */
+static void __init stable_filter_init(void)
+{
+	unsigned long buckets;
+
+	buckets = roundup_pow_of_two(max(totalram_pages / 4, 1024UL));
+	ksm_stable_filter = vzalloc(buckets);
+	if (ksm_stable_filter)
+		ksm_stable_filter_mask = buckets - 1;
+}
+
 static inline struct mm_slot *alloc_mm_slot(void)
 {
 	if (!mm_slot_cache)	/* initialization failed */
@@ -459,6 +521,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 	}
 
 	rb_erase(&stable_node->node, &root_stable_tree);
+	stable_filter_del(stable_node->checksum);
 	free_stable_node(stable_node);
 }
 
@@ -979,11 +1042,13 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  *
  * This function checks if there is a page inside the stable tree
  * with identical content to the page that we are scanning right now.
+ * @checksum is the checksum of the page, checked against the stable
+ * filter first.
  *
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page, u32 checksum)
 {
 	struct rb_node *node = root_stable_tree.rb_node;
 	struct stable_node *stable_node;
@@ -994,6 +1059,9 @@ static struct page *stable_tree_search(struct page *page)
 		return page;
 	}
 
+	if (!stable_filter_may_contain(checksum))
+		return NULL;
+
 	while (node) {
 		struct page *tree_page;
 		int ret;
@@ -1070,6 +1138,9 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	/* Write-protected by now, the checksum will stay right */
+	stable_node->checksum = calc_checksum(kpage);
+	stable_filter_add(stable_node->checksum);
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1167,20 +1238,21 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
+ * @checksum: the checksum of the page, just calculated
  */
-static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
+static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item,
+			       u32 checksum)
 {
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
 	struct stable_node *stable_node;
 	struct page *kpage;
-	unsigned int checksum;
 	int err;
 
 	remove_rmap_item_from_tree(rmap_item);
 
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(page, checksum);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1202,7 +1274,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1272,7 +1343,14 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * Return the next rmap_item to scan and its page, or NULL at the end of a
+ * full scan. With @stop_at_mm_end, also return NULL at the end of the mm
+ * being scanned, before moving on: that may free rmap_items of the mm which
+ * the caller still holds in its batch.
+ */
+static struct rmap_item *scan_get_next_rmap_item(struct page **page,
+						 bool stop_at_mm_end)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
@@ -1358,6 +1436,11 @@ next_mm:
 		}
 	}
 
+	if (stop_at_mm_end) {
+		up_read(&mm->mmap_sem);
+		return NULL;
+	}
+
 	if (ksm_test_exit(mm)) {
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
@@ -1403,24 +1486,158 @@ next_mm:
 	return NULL;
 }
 
+/*
+ * ksmd scans pages in batches of up to KSM_SCAN_BATCH pages per scan
+ * thread. The pages of a batch are checksummed first, spread over the
+ * scan threads, then compared and merged by ksmd alone: the trees are
+ * only ever changed under ksm_thread_mutex.
+ */
+#define KSM_SCAN_BATCH		32
+#define KSM_MAX_SCAN_THREADS	16
+
+struct ksm_scan_item {
+	struct rmap_item *rmap_item;
+	struct page *page;
+	u32 checksum;
+	bool merge;		/* not already in the stable tree */
+};
+
+struct ksm_checksum_work {
+	struct work_struct work;
+	struct ksm_scan_item *items;
+	int nr;
+};
+
+/* Used by ksmd under ksm_thread_mutex */
+static struct ksm_scan_item ksm_scan_items[KSM_SCAN_BATCH *
+					   KSM_MAX_SCAN_THREADS];
+static struct ksm_checksum_work ksm_checksum_works[KSM_MAX_SCAN_THREADS];
+static struct workqueue_struct *ksm_checksum_wq;
+
+static void ksm_checksum_items(struct ksm_scan_item *items, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (items[i].merge)
+			items[i].checksum = calc_checksum(items[i].page);
+}
+
+static void ksm_checksum_work_fn(struct work_struct *work)
+{
+	struct ksm_checksum_work *cw;
+
+	cw = container_of(work, struct ksm_checksum_work, work);
+	ksm_checksum_items(cw->items, cw->nr);
+}
+
+/*
+ * Checksum a batch: each of the other scan threads takes a share on the
+ * unbound workqueue, ksmd does the first one itself.
+ */
+static void ksm_checksum_batch(struct ksm_scan_item *items, int nr,
+			       unsigned int threads)
+{
+	int share = DIV_ROUND_UP(nr, threads);
+	int i, queued = 0;
+
+	for (i = 1; i < threads && i * share < nr; i++) {
+		struct ksm_checksum_work *cw = &ksm_checksum_works[i];
+
+		cw->items = items + i * share;
+		cw->nr = min(share, nr - i * share);
+		queue_work(ksm_checksum_wq, &cw->work);
+		queued = i;
+	}
+
+	ksm_checksum_items(items, min(share, nr));
+
+	for (i = 1; i <= queued; i++)
+		flush_work(&ksm_checksum_works[i].work);
+}
+
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
+ *
+ * Returns the number of pages scanned.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static unsigned int ksm_do_scan(unsigned int scan_npages)
 {
+	unsigned int threads = ksm_checksum_wq ? ksm_scan_threads : 1;
+	unsigned int batch = KSM_SCAN_BATCH * threads;
+	unsigned int scanned = 0;
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	int nr, i;
 
-	while (scan_npages-- && likely(!freezing(current))) {
-		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
-		if (!rmap_item)
-			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
-		put_page(page);
+	while (scanned < scan_npages && likely(!freezing(current))) {
+		for (nr = 0; nr < min(batch, scan_npages - scanned); nr++) {
+			struct ksm_scan_item *item = &ksm_scan_items[nr];
+
+			cond_resched();
+			rmap_item = scan_get_next_rmap_item(&page, nr != 0);
+			if (!rmap_item)
+				break;
+			item->rmap_item = rmap_item;
+			item->page = page;
+			item->merge = !PageKsm(page) ||
+				      !in_stable_tree(rmap_item);
+		}
+		/* End of a full scan, or out of memory for rmap_items */
+		if (!nr)
+			break;
+
+		if (threads > 1)
+			ksm_checksum_batch(ksm_scan_items, nr, threads);
+		else
+			ksm_checksum_items(ksm_scan_items, nr);
+
+		for (i = 0; i < nr; i++) {
+			struct ksm_scan_item *item = &ksm_scan_items[i];
+
+			if (item->merge)
+				cmp_and_merge_page(item->page, item->rmap_item,
+						   item->checksum);
+			put_page(item->page);
+		}
+		scanned += nr;
 	}
+	return scanned;
+}
+
+/*
+ * Auto tuning: over windows of KSM_AUTO_TUNE_WINDOW batches, double
+ * pages_to_scan while at least 1 in 20 pages scanned gets merged, and
+ * halve it while fewer than 1 in 500 do, between KSM_AUTO_TUNE_MIN and
+ * KSM_AUTO_TUNE_MAX pages.
+ */
+#define KSM_AUTO_TUNE_WINDOW	16
+#define KSM_AUTO_TUNE_MIN	100
+#define KSM_AUTO_TUNE_MAX	(128 * KSM_AUTO_TUNE_MIN)
+
+static unsigned long ksm_tune_scanned;
+static unsigned long ksm_tune_merged;
+static unsigned int ksm_tune_batches;
+
+static void ksm_tune_pages_to_scan(unsigned int scanned, long merged)
+{
+	unsigned int pages = ksm_thread_pages_to_scan;
+
+	ksm_tune_scanned += scanned;
+	if (merged > 0)
+		ksm_tune_merged += merged;
+	if (++ksm_tune_batches < KSM_AUTO_TUNE_WINDOW)
+		return;
+
+	if (ksm_tune_merged * 20 >= ksm_tune_scanned)
+		pages = min_t(unsigned int, pages * 2, KSM_AUTO_TUNE_MAX);
+	else if (ksm_tune_merged * 500 < ksm_tune_scanned)
+		pages = max_t(unsigned int, pages / 2, KSM_AUTO_TUNE_MIN);
+	ksm_thread_pages_to_scan = pages;
+
+	ksm_tune_scanned = ksm_tune_merged = 0;
+	ksm_tune_batches = 0;
 }
 
 static int ksmd_should_run(void)
@@ -1435,8 +1652,16 @@ static int ksm_scan_thread(void *nothing)
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+		if (ksmd_should_run()) {
+			unsigned long merged;
+			unsigned int scanned;
+
+			merged = ksm_pages_shared + ksm_pages_sharing;
+			scanned = ksm_do_scan(ksm_thread_pages_to_scan);
+			merged = ksm_pages_shared + ksm_pages_sharing - merged;
+			if (ksm_auto_tune)
+				ksm_tune_pages_to_scan(scanned, merged);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1872,6 +2097,61 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t scan_threads_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_scan_threads);
+}
+
+static ssize_t scan_threads_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	int err;
+	unsigned long threads;
+
+	err = strict_strtoul(buf, 10, &threads);
+	if (err || !threads || threads > KSM_MAX_SCAN_THREADS)
+		return -EINVAL;
+
+	/* ksmd reads it once per batch of scans */
+	mutex_lock(&ksm_thread_mutex);
+	ksm_scan_threads = threads;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(scan_threads);
+
+static ssize_t auto_tune_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_tune);
+}
+
+static ssize_t auto_tune_store(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	int err;
+	unsigned long tune;
+
+	err = strict_strtoul(buf, 10, &tune);
+	if (err || tune > 1)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (ksm_auto_tune != tune) {
+		ksm_auto_tune = tune;
+		ksm_tune_scanned = ksm_tune_merged = 0;
+		ksm_tune_batches = 0;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(auto_tune);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1969,6 +2249,8 @@ KSM_ATTR_RO(full_scans);
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&scan_threads_attr.attr,
+	&auto_tune_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
@@ -1987,12 +2269,20 @@ static struct attribute_group ksm_attr_group = {
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
-	int err;
+	int err, i;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
+	stable_filter_init();
+
+	/* Without it, ksmd checksums all the pages itself */
+	ksm_checksum_wq = alloc_workqueue("ksm_checksum", WQ_UNBOUND,
+					  KSM_MAX_SCAN_THREADS);
+	for (i = 0; i < KSM_MAX_SCAN_THREADS; i++)
+		INIT_WORK(&ksm_checksum_works[i].work, ksm_checksum_work_fn);
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
@@ -2022,6 +2312,9 @@ static int __init ksm_init(void)
 	return 0;
 
 out_free:
+	if (ksm_checksum_wq)
+		destroy_workqueue(ksm_checksum_wq);
+	vfree(ksm_stable_filter);
 	ksm_slab_free();
 out:
 	return err;
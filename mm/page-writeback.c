@@ -744,6 +744,7 @@ static void balance_dirty_pages(struct address_space *mapping,
 			if (pages_written >= write_chunk)
 				break;		/* We've done our duty */
 		}
+		bdi->dirty_sleep = jiffies;
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		io_schedule_timeout(pause);
 		trace_balance_dirty_wait(bdi);
@@ -0,0 +1,189 @@
+/*
+ * Parallel small high-order allocation test
+ *
+ * Starts threads= threads, by default one per online cpu, that each make
+ * nr_loops rounds of page allocations shaped like one of two loads,
+ * keeping the blocks of the last hold rounds allocated:
+ *
+ *   load=fork	a THREAD_SIZE kernel stack and three page table
+ *		pages per round, GFP_KERNEL, like fork() and exit()
+ *   load=net	one block per round cycling through orders 0 to 3,
+ *		GFP_ATOMIC, like skb heads and page frags
+ *
+ * Reports the time taken and the pages allocated per second over all
+ * threads. With blocks of order 1 to 3 served from the per cpu lists
+ * zone->lock should rarely be taken, see the pcp_highorder_hit and
+ * pcp_highorder_miss counters in /proc/vmstat and zone->lock in
+ * /proc/lock_stat.
+ *
+ *   modprobe page_alloc_parallel load=net threads=4 nr_loops=100000
+ *
+ * tools/testing/bench/parallel-alloc.sh runs it with one to N
+ * threads and prints the counters.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+
+static unsigned int threads;
+module_param(threads, uint, 0444);
+MODULE_PARM_DESC(threads, "threads, 0 for one per online cpu");
+
+static unsigned int nr_loops = 100000;
+module_param(nr_loops, uint, 0444);
+MODULE_PARM_DESC(nr_loops, "rounds of allocations per thread");
+
+static unsigned int hold = 16;
+module_param(hold, uint, 0444);
+MODULE_PARM_DESC(hold, "rounds whose blocks each thread keeps allocated");
+
+static char *load = "fork";
+module_param(load, charp, 0444);
+MODULE_PARM_DESC(load, "fork or net");
+
+/* Blocks allocated per round at most */
+#define ROUND_BLOCKS	4
+
+struct round {
+	struct page	*page[ROUND_BLOCKS];
+	unsigned int	order[ROUND_BLOCKS];
+	unsigned int	nr;
+};
+
+struct alloc_thread {
+	struct task_struct	*task;
+	struct completion	done;
+	unsigned long		pages;
+	unsigned int		failed;
+};
+
+static bool load_net;
+
+static void round_alloc(struct round *r, unsigned int loop,
+			struct alloc_thread *at)
+{
+	unsigned int i;
+
+	if (load_net) {
+		r->order[0] = loop % (PAGE_ALLOC_COSTLY_ORDER + 1);
+		r->nr = 1;
+	} else {
+		r->order[0] = get_order(THREAD_SIZE);
+		for (i = 1; i < ROUND_BLOCKS; i++)
+			r->order[i] = 0;
+		r->nr = ROUND_BLOCKS;
+	}
+
+	for (i = 0; i < r->nr; i++) {
+		r->page[i] = alloc_pages(load_net ?
+					 GFP_ATOMIC | __GFP_NOWARN :
+					 GFP_KERNEL | __GFP_NOWARN,
+					 r->order[i]);
+		if (r->page[i])
+			at->pages += 1 << r->order[i];
+		else
+			at->failed++;
+	}
+}
+
+static void round_free(struct round *r)
+{
+	unsigned int i;
+
+	for (i = 0; i < r->nr; i++)
+		if (r->page[i])
+			__free_pages(r->page[i], r->order[i]);
+	r->nr = 0;
+}
+
+static int alloc_thread_fn(void *data)
+{
+	struct alloc_thread *at = data;
+	struct round *rounds;
+	unsigned int i;
+
+	rounds = kcalloc(hold, sizeof(*rounds), GFP_KERNEL);
+	if (!rounds)
+		goto out;
+
+	for (i = 0; i < nr_loops; i++) {
+		struct round *r = &rounds[i % hold];
+
+		round_free(r);
+		round_alloc(r, i, at);
+		if (!(i % 64))
+			cond_resched();
+	}
+
+	for (i = 0; i < hold; i++)
+		round_free(&rounds[i]);
+	kfree(rounds);
+out:
+	complete(&at->done);
+	return 0;
+}
+
+static int __init page_alloc_parallel_init(void)
+{
+	struct alloc_thread *ats;
+	unsigned int i, failed = 0;
+	unsigned long pages = 0;
+	ktime_t start;
+	s64 usecs;
+
+	if (!strcmp(load, "net"))
+		load_net = true;
+	else if (strcmp(load, "fork"))
+		return -EINVAL;
+	if (!threads)
+		threads = num_online_cpus();
+	if (!nr_loops || !hold)
+		return -EINVAL;
+
+	ats = kcalloc(threads, sizeof(*ats), GFP_KERNEL);
+	if (!ats)
+		return -ENOMEM;
+
+	start = ktime_get();
+	for (i = 0; i < threads; i++) {
+		struct alloc_thread *at = &ats[i];
+
+		init_completion(&at->done);
+		at->task = kthread_run(alloc_thread_fn, at,
+				       "page_alloc_par/%u", i);
+		if (IS_ERR(at->task))
+			complete(&at->done);
+	}
+
+	for (i = 0; i < threads; i++) {
+		wait_for_completion(&ats[i].done);
+		pages += ats[i].pages;
+		failed += ats[i].failed;
+	}
+	usecs = ktime_us_delta(ktime_get(), start);
+
+	pr_info("page_alloc_parallel: load %s, %u threads, %lu pages "
+		"allocated, %u failed, %lld usecs, %llu pages/s\n",
+		load, threads, pages, failed, usecs,
+		usecs ? div64_u64((u64)pages * USEC_PER_SEC, usecs) : 0ULL);
+
+	kfree(ats);
+	return 0;
+}
+
+static void __exit page_alloc_parallel_exit(void)
+{
+}
+
+module_init(page_alloc_parallel_init);
+module_exit(page_alloc_parallel_exit);
+
+MODULE_DESCRIPTION("Parallel small high-order allocation test");
+MODULE_LICENSE("GPL");
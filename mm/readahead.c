@@ -177,7 +177,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_readahead(mapping);
@@ -195,8 +195,10 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		count_vm_events(RA_PAGES, ret);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
@@ -297,6 +299,100 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
 	return min(newsize, max);
 }
 
+/*
+ * Readahead feedback.
+ *
+ * The window limit of a file is ra_pages scaled by 2^ra->adapt. Windows
+ * that get used up push it up to RA_ADAPT_MAX: a file streamed through
+ * RA_GROW_STREAK full size windows in a row gets a larger window. A cache
+ * miss inside the current window means pages we read ahead were reclaimed
+ * before the reader got to them, and a random seek that leaves most of
+ * the window unread means they were read for nothing. Both pull the limit
+ * down to RA_ADAPT_MIN. While the limit is below ra_pages the next window
+ * is also started later, halfway through the current one, so fewer pages
+ * sit in the page cache waiting for the reader.
+ */
+#define RA_ADAPT_MAX	2
+#define RA_ADAPT_MIN	(-3)
+#define RA_GROW_STREAK	4
+#define RA_MIN_PAGES	4
+
+static unsigned long ra_window_limit(struct file_ra_state *ra)
+{
+	unsigned long max = ra->ra_pages;
+
+	if (ra->adapt > 0)
+		max <<= ra->adapt;
+	else if (ra->adapt < 0)
+		max = max(max >> -ra->adapt,
+			  min_t(unsigned long, max, RA_MIN_PAGES));
+
+	return max_sane_readahead(max);
+}
+
+static unsigned long ra_async_size(struct file_ra_state *ra)
+{
+	if (ra->adapt < 0)
+		return (ra->size + 1) / 2;
+	return ra->size;
+}
+
+static void ra_shrink(struct file_ra_state *ra)
+{
+	ra->streak = 0;
+	if (ra->adapt > RA_ADAPT_MIN) {
+		ra->adapt--;
+		count_vm_event(RA_WINDOW_SHRINK);
+	}
+}
+
+/*
+ * The reader got to the end of the current window.
+ */
+static void ra_window_used(struct file_ra_state *ra, unsigned long max)
+{
+	count_vm_events(RA_HIT, ra->size);
+
+	if (ra->size < max)
+		return;
+
+	if (++ra->streak >= RA_GROW_STREAK) {
+		ra->streak = 0;
+		if (ra->adapt < RA_ADAPT_MAX) {
+			ra->adapt++;
+			count_vm_event(RA_WINDOW_GROW);
+		}
+	}
+}
+
+/*
+ * Cache miss at @offset inside the current window: the pages from there
+ * on were read ahead and reclaimed unused.
+ */
+static void ra_window_evicted(struct file_ra_state *ra, pgoff_t offset)
+{
+	count_vm_events(RA_EVICTED, ra->start + ra->size - offset);
+	ra_shrink(ra);
+}
+
+/*
+ * The reader moved elsewhere; account what it left of the current window.
+ */
+static void ra_window_abandoned(struct file_ra_state *ra)
+{
+	pgoff_t last = ra->prev_pos >> PAGE_CACHE_SHIFT;
+	unsigned long unused;
+
+	if (!ra->size || ra->prev_pos == -1 ||
+	    last < ra->start || last >= ra->start + ra->size)
+		return;
+
+	unused = ra->start + ra->size - 1 - last;
+	count_vm_events(RA_UNUSED, unused);
+	if (unused > ra->size / 2)
+		ra_shrink(ra);
+}
+
 /*
  * On-demand readahead design.
  *
@@ -349,7 +445,7 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
@@ -382,9 +478,10 @@ static int try_context_readahead(struct address_space *mapping,
 	if (size >= offset)
 		size *= 2;
 
+	ra_window_abandoned(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(size + req_size, max);
-	ra->async_size = ra->size;
+	ra->async_size = ra_async_size(ra);
 
 	return 1;
 }
@@ -398,7 +495,7 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = ra_window_limit(ra);
 
 	/*
 	 * start of file
@@ -412,12 +509,26 @@ ondemand_readahead(struct address_space *mapping,
 	 */
 	if ((offset == (ra->start + ra->size - ra->async_size) ||
 	     offset == (ra->start + ra->size))) {
+		ra_window_used(ra, max);
+		max = ra_window_limit(ra);
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
-		ra->async_size = ra->size;
+		ra->async_size = ra_async_size(ra);
 		goto readit;
 	}
 
+	/*
+	 * Cache miss inside the window we read ahead: the pages were
+	 * reclaimed before they were used. Start over from here with a
+	 * smaller window.
+	 */
+	if (!hit_readahead_marker && ra->size &&
+	    offset > ra->start && offset < ra->start + ra->size) {
+		ra_window_evicted(ra, offset);
+		max = ra_window_limit(ra);
+		goto initial_readahead;
+	}
+
 	/*
 	 * Hit a marked page without valid readahead state.
 	 * E.g. interleaved reads.
@@ -428,17 +539,18 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset + 1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
 			return 0;
 
+		count_vm_events(RA_HIT, start - offset);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max);
-		ra->async_size = ra->size;
+		ra->async_size = ra_async_size(ra);
 		goto readit;
 	}
 
@@ -446,13 +558,13 @@ ondemand_readahead(struct address_space *mapping,
 	 * oversize read
 	 */
 	if (req_size > max)
-		goto initial_readahead;
+		goto abandon_readahead;
 
 	/*
 	 * sequential cache miss
 	 */
 	if (offset - (ra->prev_pos >> PAGE_CACHE_SHIFT) <= 1UL)
-		goto initial_readahead;
+		goto abandon_readahead;
 
 	/*
 	 * Query the page cache and look for the traces(cached history pages)
@@ -467,10 +579,13 @@ ondemand_readahead(struct address_space *mapping,
 	 */
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
+abandon_readahead:
+	ra_window_abandoned(ra);
 initial_readahead:
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
+	ra->async_size = min_t(unsigned int, ra->async_size, ra_async_size(ra));
 
 readit:
 	/*
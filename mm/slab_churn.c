@@ -0,0 +1,240 @@
+/*
+ * Slab churn benchmark
+ *
+ * Runs 1..N threads, each bound to its own cpu. Every thread allocates
+ * batches of objects from a private cache and hands them to the thread on
+ * the next cpu, which frees them. Almost all frees are therefore remote
+ * frees, which is the pattern of network and VFS objects that are
+ * allocated on one cpu and released on another. Reports the number of
+ * objects allocated and freed per second at each thread count.
+ *
+ *   modprobe slab_churn obj_size=256 run_time=5
+ *   modprobe slab_churn obj_size=256 run_time=5 cpu_partial=0
+ *
+ * With SLUB the second run disables the per cpu partial lists of the
+ * benchmark cache. With CONFIG_LOCK_STAT, compare the contention on the
+ * node list_lock in /proc/lock_stat between the two runs; with
+ * CONFIG_SLUB_STATS, /sys/kernel/slab/slab_churn shows where objects
+ * came from while the module is loaded.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/jiffies.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+static unsigned int obj_size = 256;
+module_param(obj_size, uint, 0444);
+MODULE_PARM_DESC(obj_size, "object size in bytes");
+
+static unsigned int batch = 64;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "objects allocated before handing them over");
+
+static unsigned int run_time = 5;
+module_param(run_time, uint, 0444);
+MODULE_PARM_DESC(run_time, "seconds per thread count");
+
+static unsigned int max_threads;
+module_param(max_threads, uint, 0444);
+MODULE_PARM_DESC(max_threads, "highest thread count (default online cpus)");
+
+static int cpu_partial = -1;
+module_param(cpu_partial, int, 0444);
+MODULE_PARM_DESC(cpu_partial,
+		 "SLUB per cpu partial objects for the cache (-1 = default)");
+
+/* Batches waiting in an inbox before the sender backs off */
+#define CHURN_MAX_PENDING	16
+
+/*
+ * Objects of a batch are chained through their first word, batches in an
+ * inbox through the second word of their first object.
+ */
+struct churn_obj {
+	struct churn_obj	*next;
+	struct churn_obj	*next_batch;
+};
+
+struct churn_thread {
+	struct churn_obj	*inbox;
+	atomic_t		pending;
+	struct churn_thread	*peer;
+	unsigned long		allocs;
+	unsigned long		frees;
+	unsigned long		failed;
+	struct completion	exited;
+};
+
+static struct kmem_cache *churn_cache;
+
+/* Keeps the cache from being merged with others of the same size */
+static void churn_ctor(void *obj)
+{
+	((struct churn_obj *)obj)->next = NULL;
+}
+
+static void churn_send(struct churn_thread *ct, struct churn_obj *head)
+{
+	struct churn_obj *old;
+
+	do {
+		old = ACCESS_ONCE(ct->inbox);
+		head->next_batch = old;
+	} while (cmpxchg(&ct->inbox, old, head) != old);
+	atomic_inc(&ct->pending);
+}
+
+static unsigned long churn_drain(struct churn_thread *ct)
+{
+	struct churn_obj *head = xchg(&ct->inbox, NULL);
+	unsigned long n = 0;
+
+	while (head) {
+		struct churn_obj *next_batch = head->next_batch;
+		struct churn_obj *obj = head;
+
+		atomic_dec(&ct->pending);
+		while (obj) {
+			struct churn_obj *next = obj->next;
+
+			kmem_cache_free(churn_cache, obj);
+			obj = next;
+			n++;
+		}
+		head = next_batch;
+	}
+	return n;
+}
+
+static int churn_thread_fn(void *data)
+{
+	struct churn_thread *ct = data;
+	unsigned long end = jiffies + run_time * HZ;
+	unsigned int i;
+
+	while (time_before(jiffies, end)) {
+		ct->frees += churn_drain(ct);
+
+		if (atomic_read(&ct->peer->pending) < CHURN_MAX_PENDING) {
+			struct churn_obj *head = NULL;
+
+			for (i = 0; i < batch; i++) {
+				struct churn_obj *obj;
+
+				obj = kmem_cache_alloc(churn_cache, GFP_KERNEL);
+				if (!obj) {
+					ct->failed++;
+					break;
+				}
+				obj->next = head;
+				head = obj;
+				ct->allocs++;
+			}
+			if (head)
+				churn_send(ct->peer, head);
+		}
+		cond_resched();
+	}
+
+	complete(&ct->exited);
+	return 0;
+}
+
+static unsigned long churn_run(struct churn_thread *threads, unsigned int nr)
+{
+	struct task_struct *tsk;
+	unsigned long ops = 0, failed = 0;
+	unsigned int i, cpu = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct churn_thread *ct = &threads[i];
+
+		ct->inbox = NULL;
+		atomic_set(&ct->pending, 0);
+		ct->peer = &threads[(i + 1) % nr];
+		ct->allocs = ct->frees = ct->failed = 0;
+		init_completion(&ct->exited);
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct churn_thread *ct = &threads[i];
+
+		cpu = i ? cpumask_next(cpu, cpu_online_mask) :
+			  cpumask_first(cpu_online_mask);
+		tsk = kthread_create(churn_thread_fn, ct, "slab-churn/%u", cpu);
+		if (IS_ERR(tsk)) {
+			complete(&ct->exited);
+			continue;
+		}
+		kthread_bind(tsk, cpu);
+		wake_up_process(tsk);
+	}
+
+	for (i = 0; i < nr; i++)
+		wait_for_completion(&threads[i].exited);
+
+	/* Objects still in flight when the threads stopped */
+	for (i = 0; i < nr; i++) {
+		churn_drain(&threads[i]);
+		ops += threads[i].allocs + threads[i].frees;
+		failed += threads[i].failed;
+	}
+
+	if (failed)
+		pr_warn("slab-churn: %lu allocations failed\n", failed);
+
+	return ops / run_time;
+}
+
+static int __init slab_churn_init(void)
+{
+	struct churn_thread *threads;
+	unsigned int nr;
+
+	if (!run_time || !batch || obj_size < sizeof(struct churn_obj))
+		return -EINVAL;
+
+	if (!max_threads || max_threads > num_online_cpus())
+		max_threads = num_online_cpus();
+
+	threads = kcalloc(max_threads, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	churn_cache = kmem_cache_create("slab_churn", obj_size, 0, 0,
+					churn_ctor);
+	if (!churn_cache) {
+		kfree(threads);
+		return -ENOMEM;
+	}
+
+#ifdef CONFIG_SLUB
+	if (cpu_partial >= 0)
+		churn_cache->cpu_partial = cpu_partial;
+	pr_info("slab-churn: %u byte objects, batch %u, cpu_partial %u, %us per run\n",
+		obj_size, batch, churn_cache->cpu_partial, run_time);
+#else
+	pr_info("slab-churn: %u byte objects, batch %u, %us per run\n",
+		obj_size, batch, run_time);
+#endif
+	for (nr = 1; nr <= max_threads; nr++)
+		pr_info("slab-churn: %2u threads: %10lu ops/s\n", nr,
+			churn_run(threads, nr));
+
+	kfree(threads);
+	return 0;
+}
+
+static void __exit slab_churn_exit(void)
+{
+	kmem_cache_destroy(churn_cache);
+}
+
+module_init(slab_churn_init);
+module_exit(slab_churn_exit);
+
+MODULE_DESCRIPTION("Slab allocator cross cpu churn benchmark");
+MODULE_LICENSE("GPL");
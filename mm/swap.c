@@ -37,9 +37,30 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
-static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
-static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+/*
+ * Pages are added to the LRU, rotated, activated and deactivated through
+ * per cpu caches, so that the lru_lock is taken once per batch. They are
+ * not on the stack, so they hold more pages than a pagevec does: 63
+ * pointers + a long make 512 bytes.
+ */
+#define LRU_CACHE_SIZE	63
+
+struct lru_cache {
+	unsigned long nr;
+	struct page *pages[LRU_CACHE_SIZE];
+};
+
+/* Returns the number of slots left, like pagevec_add() */
+static inline unsigned lru_cache_add_page(struct lru_cache *lc,
+					  struct page *page)
+{
+	lc->pages[lc->nr++] = page;
+	return LRU_CACHE_SIZE - lc->nr;
+}
+
+static DEFINE_PER_CPU(struct lru_cache[NR_LRU_LISTS], lru_add_caches);
+static DEFINE_PER_CPU(struct lru_cache, lru_rotate_caches);
+static DEFINE_PER_CPU(struct lru_cache, lru_deactivate_caches);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -50,12 +71,13 @@ static void __page_cache_release(struct page *page)
 	if (PageLRU(page)) {
 		unsigned long flags;
 		struct zone *zone = page_zone(page);
+		struct lruvec *lruvec = page_lruvec(page);
 
-		spin_lock_irqsave(&zone->lru_lock, flags);
+		spin_lock_irqsave(&lruvec->lru_lock, flags);
 		VM_BUG_ON(!PageLRU(page));
 		__ClearPageLRU(page);
 		del_page_from_lru(zone, page);
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 	}
 }
 
@@ -202,55 +224,71 @@ void put_pages_list(struct list_head *pages)
 }
 EXPORT_SYMBOL(put_pages_list);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
-				void (*move_fn)(struct page *page, void *arg),
-				void *arg)
+static void lru_move_pages(struct page **pages, int nr, int cold,
+			   void (*move_fn)(struct page *page, void *arg),
+			   void *arg)
 {
 	int i;
-	struct zone *zone = NULL;
+	struct lruvec *lruvec = NULL;
 	unsigned long flags = 0;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
-		struct zone *pagezone = page_zone(page);
-
-		if (pagezone != zone) {
-			if (zone)
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-			zone = pagezone;
-			spin_lock_irqsave(&zone->lru_lock, flags);
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+		struct lruvec *pagelruvec = page_lruvec(page);
+
+		if (pagelruvec != lruvec) {
+			if (lruvec)
+				spin_unlock_irqrestore(&lruvec->lru_lock,
+						       flags);
+			lruvec = pagelruvec;
+			spin_lock_irqsave(&lruvec->lru_lock, flags);
 		}
 
 		(*move_fn)(page, arg);
 	}
-	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
-	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	if (lruvec)
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
+	release_pages(pages, nr, cold);
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec,
+				void (*move_fn)(struct page *page, void *arg),
+				void *arg)
+{
+	lru_move_pages(pvec->pages, pagevec_count(pvec), pvec->cold,
+		       move_fn, arg);
 	pagevec_reinit(pvec);
 }
 
-static void pagevec_move_tail_fn(struct page *page, void *arg)
+static void lru_cache_move_fn(struct lru_cache *lc,
+			      void (*move_fn)(struct page *page, void *arg),
+			      void *arg)
+{
+	lru_move_pages(lc->pages, lc->nr, 0, move_fn, arg);
+	lc->nr = 0;
+}
+
+static void lru_move_tail_fn(struct page *page, void *arg)
 {
 	int *pgmoved = arg;
-	struct zone *zone = page_zone(page);
 
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		enum lru_list lru = page_lru_base_type(page);
-		list_move_tail(&page->lru, &zone->lru[lru].list);
+		list_move_tail(&page->lru, &page_lruvec(page)->lists[lru]);
 		mem_cgroup_rotate_reclaimable_page(page);
 		(*pgmoved)++;
 	}
 }
 
 /*
- * pagevec_move_tail() must be called with IRQ disabled.
+ * lru_cache_move_tail() must be called with IRQ disabled.
  * Otherwise this may cause nasty races.
  */
-static void pagevec_move_tail(struct pagevec *pvec)
+static void lru_cache_move_tail(struct lru_cache *lc)
 {
 	int pgmoved = 0;
 
-	pagevec_lru_move_fn(pvec, pagevec_move_tail_fn, &pgmoved);
+	lru_cache_move_fn(lc, lru_move_tail_fn, &pgmoved);
 	__count_vm_events(PGROTATED, pgmoved);
 }
 
@@ -263,14 +301,14 @@ void rotate_reclaimable_page(struct page *page)
 {
 	if (!PageLocked(page) && !PageDirty(page) && !PageActive(page) &&
 	    !PageUnevictable(page) && PageLRU(page)) {
-		struct pagevec *pvec;
+		struct lru_cache *lc;
 		unsigned long flags;
 
 		page_cache_get(page);
 		local_irq_save(flags);
-		pvec = &__get_cpu_var(lru_rotate_pvecs);
-		if (!pagevec_add(pvec, page))
-			pagevec_move_tail(pvec);
+		lc = &__get_cpu_var(lru_rotate_caches);
+		if (!lru_cache_add_page(lc, page))
+			lru_cache_move_tail(lc);
 		local_irq_restore(flags);
 	}
 }
@@ -278,9 +316,11 @@ void rotate_reclaimable_page(struct page *page)
 static void update_page_reclaim_stat(struct zone *zone, struct page *page,
 				     int file, int rotated)
 {
-	struct zone_reclaim_stat *reclaim_stat = &zone->reclaim_stat;
+	struct zone_reclaim_stat *reclaim_stat;
 	struct zone_reclaim_stat *memcg_reclaim_stat;
 
+	reclaim_stat = &page_lruvec(page)->reclaim_stat;
+
 	memcg_reclaim_stat = mem_cgroup_get_reclaim_stat_from_page(page);
 
 	reclaim_stat->recent_scanned[file]++;
@@ -314,25 +354,25 @@ static void __activate_page(struct page *page, void *arg)
 }
 
 #ifdef CONFIG_SMP
-static DEFINE_PER_CPU(struct pagevec, activate_page_pvecs);
+static DEFINE_PER_CPU(struct lru_cache, activate_page_caches);
 
 static void activate_page_drain(int cpu)
 {
-	struct pagevec *pvec = &per_cpu(activate_page_pvecs, cpu);
+	struct lru_cache *lc = &per_cpu(activate_page_caches, cpu);
 
-	if (pagevec_count(pvec))
-		pagevec_lru_move_fn(pvec, __activate_page, NULL);
+	if (lc->nr)
+		lru_cache_move_fn(lc, __activate_page, NULL);
 }
 
 void activate_page(struct page *page)
 {
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
-		struct pagevec *pvec = &get_cpu_var(activate_page_pvecs);
+		struct lru_cache *lc = &get_cpu_var(activate_page_caches);
 
 		page_cache_get(page);
-		if (!pagevec_add(pvec, page))
-			pagevec_lru_move_fn(pvec, __activate_page, NULL);
-		put_cpu_var(activate_page_pvecs);
+		if (!lru_cache_add_page(lc, page))
+			lru_cache_move_fn(lc, __activate_page, NULL);
+		put_cpu_var(activate_page_caches);
 	}
 }
 
@@ -343,11 +383,11 @@ static inline void activate_page_drain(int cpu)
 
 void activate_page(struct page *page)
 {
-	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec = page_lruvec(page);
 
-	spin_lock_irq(&zone->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 	__activate_page(page, NULL);
-	spin_unlock_irq(&zone->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 }
 #endif
 
@@ -364,6 +404,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -371,14 +413,16 @@ void mark_page_accessed(struct page *page)
 
 EXPORT_SYMBOL(mark_page_accessed);
 
+static void ____pagevec_lru_add_fn(struct page *page, void *arg);
+
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_cache *lc = &get_cpu_var(lru_add_caches)[lru];
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		____pagevec_lru_add(pvec, lru);
-	put_cpu_var(lru_add_pvecs);
+	if (!lru_cache_add_page(lc, page))
+		lru_cache_move_fn(lc, ____pagevec_lru_add_fn, (void *)lru);
+	put_cpu_var(lru_add_caches);
 }
 EXPORT_SYMBOL(__lru_cache_add);
 
@@ -414,12 +458,13 @@ void lru_cache_add_lru(struct page *page, enum lru_list lru)
 void add_page_to_unevictable_list(struct page *page)
 {
 	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec = page_lruvec(page);
 
-	spin_lock_irq(&zone->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 	SetPageUnevictable(page);
 	SetPageLRU(page);
 	add_page_to_lru_list(zone, page, LRU_UNEVICTABLE);
-	spin_unlock_irq(&zone->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 }
 
 /*
@@ -480,7 +525,7 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		list_move_tail(&page->lru, &zone->lru[lru].list);
+		list_move_tail(&page->lru, &page_lruvec(page)->lists[lru]);
 		mem_cgroup_rotate_reclaimable_page(page);
 		__count_vm_event(PGROTATED);
 	}
@@ -491,35 +536,36 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 }
 
 /*
- * Drain pages out of the cpu's pagevecs.
+ * Drain pages out of the cpu's LRU caches.
  * Either "cpu" is the current CPU, and preemption has already been
  * disabled; or "cpu" is being hot-unplugged, and is already dead.
  */
 static void drain_cpu_pagevecs(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
-	struct pagevec *pvec;
-	int lru;
+	struct lru_cache *lcs = per_cpu(lru_add_caches, cpu);
+	struct lru_cache *lc;
+	enum lru_list lru;
 
 	for_each_lru(lru) {
-		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			____pagevec_lru_add(pvec, lru);
+		lc = &lcs[lru - LRU_BASE];
+		if (lc->nr)
+			lru_cache_move_fn(lc, ____pagevec_lru_add_fn,
+					  (void *)lru);
 	}
 
-	pvec = &per_cpu(lru_rotate_pvecs, cpu);
-	if (pagevec_count(pvec)) {
+	lc = &per_cpu(lru_rotate_caches, cpu);
+	if (lc->nr) {
 		unsigned long flags;
 
 		/* No harm done if a racing interrupt already did this */
 		local_irq_save(flags);
-		pagevec_move_tail(pvec);
+		lru_cache_move_tail(lc);
 		local_irq_restore(flags);
 	}
 
-	pvec = &per_cpu(lru_deactivate_pvecs, cpu);
-	if (pagevec_count(pvec))
-		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
+	lc = &per_cpu(lru_deactivate_caches, cpu);
+	if (lc->nr)
+		lru_cache_move_fn(lc, lru_deactivate_fn, NULL);
 
 	activate_page_drain(cpu);
 }
@@ -542,11 +588,11 @@ void deactivate_page(struct page *page)
 		return;
 
 	if (likely(get_page_unless_zero(page))) {
-		struct pagevec *pvec = &get_cpu_var(lru_deactivate_pvecs);
+		struct lru_cache *lc = &get_cpu_var(lru_deactivate_caches);
 
-		if (!pagevec_add(pvec, page))
-			pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
-		put_cpu_var(lru_deactivate_pvecs);
+		if (!lru_cache_add_page(lc, page))
+			lru_cache_move_fn(lc, lru_deactivate_fn, NULL);
+		put_cpu_var(lru_deactivate_caches);
 	}
 }
 
@@ -574,7 +620,7 @@ int lru_add_drain_all(void)
  * passed pages.  If it fell to zero then remove the page from the LRU and
  * free it.
  *
- * Avoid taking zone->lru_lock if possible, but if it is taken, retain it
+ * Avoid taking an lru_lock if possible, but if it is taken, retain it
  * for the remainder of the operation.
  *
  * The locking in this function is against shrink_inactive_list(): we recheck
@@ -586,7 +632,7 @@ void release_pages(struct page **pages, int nr, int cold)
 {
 	int i;
 	struct pagevec pages_to_free;
-	struct zone *zone = NULL;
+	struct lruvec *lruvec = NULL;
 	unsigned long uninitialized_var(flags);
 
 	pagevec_init(&pages_to_free, cold);
@@ -594,9 +640,10 @@ void release_pages(struct page **pages, int nr, int cold)
 		struct page *page = pages[i];
 
 		if (unlikely(PageCompound(page))) {
-			if (zone) {
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-				zone = NULL;
+			if (lruvec) {
+				spin_unlock_irqrestore(&lruvec->lru_lock,
+						       flags);
+				lruvec = NULL;
 			}
 			put_compound_page(page);
 			continue;
@@ -606,31 +653,32 @@ void release_pages(struct page **pages, int nr, int cold)
 			continue;
 
 		if (PageLRU(page)) {
-			struct zone *pagezone = page_zone(page);
-
-			if (pagezone != zone) {
-				if (zone)
-					spin_unlock_irqrestore(&zone->lru_lock,
-									flags);
-				zone = pagezone;
-				spin_lock_irqsave(&zone->lru_lock, flags);
+			struct lruvec *pagelruvec = page_lruvec(page);
+
+			if (pagelruvec != lruvec) {
+				if (lruvec)
+					spin_unlock_irqrestore(
+						&lruvec->lru_lock, flags);
+				lruvec = pagelruvec;
+				spin_lock_irqsave(&lruvec->lru_lock, flags);
 			}
 			VM_BUG_ON(!PageLRU(page));
 			__ClearPageLRU(page);
-			del_page_from_lru(zone, page);
+			del_page_from_lru(page_zone(page), page);
 		}
 
 		if (!pagevec_add(&pages_to_free, page)) {
-			if (zone) {
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-				zone = NULL;
+			if (lruvec) {
+				spin_unlock_irqrestore(&lruvec->lru_lock,
+						       flags);
+				lruvec = NULL;
 			}
 			__pagevec_free(&pages_to_free);
 			pagevec_reinit(&pages_to_free);
   		}
 	}
-	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+	if (lruvec)
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 
 	pagevec_free(&pages_to_free);
 }
@@ -667,7 +715,7 @@ void lru_add_page_tail(struct zone* zone,
 	VM_BUG_ON(!PageHead(page));
 	VM_BUG_ON(PageCompound(page_tail));
 	VM_BUG_ON(PageLRU(page_tail));
-	VM_BUG_ON(!spin_is_locked(&zone->lru_lock));
+	VM_BUG_ON(!spin_is_locked(&page_lruvec(page)->lru_lock));
 
 	SetPageLRU(page_tail);
 
@@ -684,7 +732,7 @@ void lru_add_page_tail(struct zone* zone,
 		if (likely(PageLRU(page)))
 			head = page->lru.prev;
 		else
-			head = &zone->lru[lru].list;
+			head = &page_lruvec(page_tail)->lists[lru];
 		__add_page_to_lru_list(zone, page_tail, lru, head);
 	} else {
 		SetPageUnevictable(page_tail);
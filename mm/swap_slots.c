@@ -0,0 +1,192 @@
+/*
+ * Per cpu swap slot caches
+ *
+ * Allocating or freeing a swap slot takes swap_lock, which becomes the
+ * most contended lock in the system when several cpus reclaim to fast swap
+ * such as zram. Instead, each cpu keeps a cache of allocated slots that
+ * get_swap_page() hands out, refilled SWAP_SLOTS_CACHE_SIZE slots at a
+ * time, and a cache of slots to free, returned in batches of the same size.
+ * swap_lock is then taken once per batch.
+ *
+ * Slots in either cache are marked SWAP_HAS_CACHE with a zero count in
+ * the swap map, like a slot on its way into the swap cache, so nobody else
+ * can allocate them. While the caches are active, read_swap_cache_async()
+ * doesn't wait for such slots to show up in the swap cache.
+ *
+ * swapoff disables the caches and drains them before bringing the swap
+ * area back in, and slots are freed directly while they are disabled. A
+ * cpu that goes offline has its caches drained.
+ */
+#include <linux/swap.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/cpu.h>
+#include <linux/init.h>
+
+#define SWAP_SLOTS_CACHE_SIZE	64
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;	/* protects slots, cur and nr */
+	swp_entry_t	slots[SWAP_SLOTS_CACHE_SIZE];
+	int		cur;
+	int		nr;
+	spinlock_t	free_lock;	/* protects slots_ret and n_ret */
+	swp_entry_t	slots_ret[SWAP_SLOTS_CACHE_SIZE];
+	int		n_ret;
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+
+/* Set once the caches are initialised, and while swapoff isn't running */
+bool swap_slot_cache_active;
+static bool swap_slot_cache_initialized;
+static int swap_slot_cache_disabled;
+static DEFINE_MUTEX(swap_slots_cache_mutex);
+
+static void drain_slots_cache_cpu(unsigned int cpu)
+{
+	struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+	mutex_lock(&cache->alloc_lock);
+	if (cache->nr) {
+		swapcache_free_entries(cache->slots + cache->cur, cache->nr);
+		cache->nr = 0;
+	}
+	mutex_unlock(&cache->alloc_lock);
+
+	spin_lock(&cache->free_lock);
+	if (cache->n_ret) {
+		swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+	}
+	spin_unlock(&cache->free_lock);
+}
+
+static void drain_slots_caches(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu)
+		drain_slots_cache_cpu(cpu);
+}
+
+/*
+ * Called by swapoff before it brings a swap area back in. Nests, as
+ * several swapoffs can run at the same time.
+ */
+void disable_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	if (!swap_slot_cache_disabled++ && swap_slot_cache_initialized) {
+		swap_slot_cache_active = false;
+		drain_slots_caches();
+	}
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+void reenable_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	if (!--swap_slot_cache_disabled && swap_slot_cache_initialized)
+		swap_slot_cache_active = true;
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+/*
+ * Don't take a batch when swap is nearly full, the slots would be missed
+ * by the other cpus.
+ */
+static bool swap_slots_refill_ok(void)
+{
+	return nr_swap_pages > 2 * SWAP_SLOTS_CACHE_SIZE * num_online_cpus();
+}
+
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry = { 0 };
+
+	/*
+	 * We may be moved to another cpu, which is fine: the cache is
+	 * protected by its mutex, not by running on its cpu.
+	 */
+	cache = __this_cpu_ptr(&swp_slots);
+	if (ACCESS_ONCE(swap_slot_cache_active)) {
+		mutex_lock(&cache->alloc_lock);
+		if (!cache->nr && swap_slot_cache_active &&
+		    swap_slots_refill_ok()) {
+			cache->cur = 0;
+			cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE,
+						   cache->slots);
+		}
+		if (cache->nr) {
+			entry = cache->slots[cache->cur++];
+			cache->nr--;
+		}
+		mutex_unlock(&cache->alloc_lock);
+		if (entry.val)
+			return entry;
+	}
+
+	if (!get_swap_pages(1, &entry) && ACCESS_ONCE(swap_slot_cache_active)) {
+		/* Out of swap, except for what the caches hold */
+		drain_slots_caches();
+		get_swap_pages(1, &entry);
+	}
+	return entry;
+}
+
+/*
+ * Free a swap slot whose last reference swap_entry_put() dropped.
+ */
+void free_swap_slot(swp_entry_t entry)
+{
+	struct swap_slots_cache *cache = __this_cpu_ptr(&swp_slots);
+
+	if (ACCESS_ONCE(swap_slot_cache_active)) {
+		spin_lock(&cache->free_lock);
+		/* Recheck, swapoff may have drained the cache meanwhile */
+		if (swap_slot_cache_active) {
+			if (cache->n_ret == SWAP_SLOTS_CACHE_SIZE) {
+				swapcache_free_entries(cache->slots_ret,
+						       cache->n_ret);
+				cache->n_ret = 0;
+			}
+			cache->slots_ret[cache->n_ret++] = entry;
+			spin_unlock(&cache->free_lock);
+			return;
+		}
+		spin_unlock(&cache->free_lock);
+	}
+
+	swapcache_free_entries(&entry, 1);
+}
+
+static int __cpuinit swap_slots_cpu_notify(struct notifier_block *self,
+					   unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		drain_slots_cache_cpu((long)hcpu);
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_init(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+		mutex_init(&cache->alloc_lock);
+		spin_lock_init(&cache->free_lock);
+	}
+	hotcpu_notifier(swap_slots_cpu_notify, 0);
+
+	mutex_lock(&swap_slots_cache_mutex);
+	swap_slot_cache_initialized = true;
+	swap_slot_cache_active = !swap_slot_cache_disabled;
+	mutex_unlock(&swap_slots_cache_mutex);
+	return 0;
+}
+subsys_initcall(swap_slots_init);
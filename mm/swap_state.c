@@ -317,6 +317,13 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		err = swapcache_prepare(entry);
 		if (err == -EEXIST) {	/* seems racy */
 			radix_tree_preload_end();
+			/*
+			 * A slot without references is parked in a per cpu
+			 * slot cache, or on its way there: it won't show up
+			 * in the swap cache, don't wait for it.
+			 */
+			if (swap_slot_cache_active && !__swp_swapcount(entry))
+				break;
 			continue;
 		}
 		if (err) {		/* swp entry is obsolete ? */
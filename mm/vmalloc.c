@@ -27,6 +27,7 @@
 #include <linux/pfn.h>
 #include <linux/kmemleak.h>
 #include <linux/atomic.h>
+#include <linux/workqueue.h>
 #include <asm/uaccess.h>
 #include <asm/tlbflush.h>
 #include <asm/shmparam.h>
@@ -254,9 +255,12 @@ struct vmap_area {
 	unsigned long va_end;
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
+	unsigned long gap;		/* free space just below va_start */
+	unsigned long subtree_max_gap;	/* largest gap in this subtree */
 	struct list_head list;		/* address sorted list */
-	struct list_head purge_list;	/* "lazy purge" list */
+	struct list_head purge_list;	/* "lazy purge" list, or cache */
 	void *private;
+	int cpu;			/* freed on, to cache it there */
 	struct rcu_head rcu_head;
 };
 
@@ -264,12 +268,6 @@ static DEFINE_SPINLOCK(vmap_area_lock);
 static LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
 static struct vmap_area *__find_vmap_area(unsigned long addr)
@@ -291,11 +289,38 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
+/*
+ * The rbtree is augmented with the free space between the areas: each
+ * area records the gap below it, and the largest gap in its subtree, so
+ * that alloc_vmap_area() finds the lowest hole that fits in O(log n)
+ * instead of walking the areas.
+ */
+static unsigned long subtree_max_gap(struct rb_node *n)
+{
+	return n ? rb_entry(n, struct vmap_area, rb_node)->subtree_max_gap : 0;
+}
+
+static void vmap_area_augment_cb(struct rb_node *n, void *unused)
+{
+	struct vmap_area *va = rb_entry(n, struct vmap_area, rb_node);
+
+	va->subtree_max_gap = max3(va->gap, subtree_max_gap(n->rb_left),
+				   subtree_max_gap(n->rb_right));
+}
+
+/* The gap of @n changed, update the subtrees it is in */
+static void vmap_area_propagate(struct rb_node *n)
+{
+	for (; n; n = rb_parent(n))
+		vmap_area_augment_cb(n, NULL);
+}
+
 static void __insert_vmap_area(struct vmap_area *va)
 {
 	struct rb_node **p = &vmap_area_root.rb_node;
 	struct rb_node *parent = NULL;
 	struct rb_node *tmp;
+	struct vmap_area *prev = NULL;
 
 	while (*p) {
 		struct vmap_area *tmp_va;
@@ -316,11 +341,196 @@ static void __insert_vmap_area(struct vmap_area *va)
 	/* address-sort this list so it is usable like the vmlist */
 	tmp = rb_prev(&va->rb_node);
 	if (tmp) {
-		struct vmap_area *prev;
 		prev = rb_entry(tmp, struct vmap_area, rb_node);
 		list_add_rcu(&va->list, &prev->list);
 	} else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	/* va splits the gap below the next area in two */
+	va->gap = va->va_start - (prev ? prev->va_end : 0);
+	rb_augment_insert(&va->rb_node, vmap_area_augment_cb, NULL);
+	tmp = rb_next(&va->rb_node);
+	if (tmp) {
+		struct vmap_area *next;
+
+		next = rb_entry(tmp, struct vmap_area, rb_node);
+		next->gap = next->va_start - va->va_end;
+		vmap_area_propagate(tmp);
+	}
+}
+
+/*
+ * Return the lowest @align aligned address of the hole below @va where
+ * @size bytes fit between @vstart and @vend, or 0.
+ */
+static unsigned long vmap_hole_fits(struct vmap_area *va, unsigned long size,
+				    unsigned long align, unsigned long vstart,
+				    unsigned long vend)
+{
+	unsigned long lo = va->va_start - va->gap;
+	unsigned long hi = min(va->va_start, vend);
+	unsigned long addr = ALIGN(max(lo, vstart), align);
+
+	if (addr < lo || addr >= hi || hi - addr < size)
+		return 0;
+	return addr;
+}
+
+/*
+ * Find the lowest address where @size bytes aligned to @align fit between
+ * @vstart and @vend. Subtrees whose largest gap is too small are skipped.
+ * Returns 0 if there is no room. Called with vmap_area_lock held.
+ */
+static unsigned long find_vmap_lowest_hole(unsigned long size,
+				unsigned long align, unsigned long vstart,
+				unsigned long vend)
+{
+	struct rb_node *n = vmap_area_root.rb_node;
+	struct vmap_area *va;
+	unsigned long addr;
+
+	while (n) {
+		va = rb_entry(n, struct vmap_area, rb_node);
+		/* lower holes first, the left ones end below va_start */
+		if (va->va_start > vstart &&
+		    subtree_max_gap(n->rb_left) >= size) {
+			n = n->rb_left;
+			continue;
+		}
+check:
+		addr = vmap_hole_fits(va, size, align, vstart, vend);
+		if (addr)
+			return addr;
+		/* the holes on the right and above the last area are higher */
+		if (va->va_end >= vend || vend - va->va_end < size)
+			return 0;
+		if (subtree_max_gap(n->rb_right) >= size) {
+			n = n->rb_right;
+			continue;
+		}
+		/* back up to the lowest ancestor not looked at yet */
+		for (;;) {
+			struct rb_node *parent = rb_parent(n);
+
+			if (!parent)
+				goto last;
+			if (parent->rb_left == n) {
+				n = parent;
+				va = rb_entry(n, struct vmap_area, rb_node);
+				goto check;
+			}
+			n = parent;
+		}
+	}
+
+last:
+	/* above the last area */
+	n = rb_last(&vmap_area_root);
+	addr = n ? rb_entry(n, struct vmap_area, rb_node)->va_end : 0;
+	addr = ALIGN(max(addr, vstart), align);
+	if (addr < vstart || addr >= vend || vend - addr < size)
+		return 0;
+	return addr;
+}
+
+/*
+ * Small areas are not freed by the lazy purge but kept, unmapped and
+ * flushed, in a cache of the cpu that freed them: up to VMAP_CACHE_DEPTH
+ * areas of each size up to VMAP_CACHE_PAGES pages, the guard page
+ * included. alloc_vmap_area() reuses them without taking vmap_area_lock
+ * or flushing again. They stay in the rbtree, so nobody allocates over
+ * them, and go back to the free space when an allocation runs out of it.
+ */
+#define VMAP_CACHE_PAGES	8
+#define VMAP_CACHE_DEPTH	8
+
+struct vmap_area_cache {
+	spinlock_t lock;
+	unsigned int nr[VMAP_CACHE_PAGES];
+	struct list_head areas[VMAP_CACHE_PAGES];
+};
+
+static DEFINE_PER_CPU(struct vmap_area_cache, vmap_area_cache);
+
+static struct vmap_area *vmap_area_cache_get(unsigned long size,
+				unsigned long align, unsigned long vstart,
+				unsigned long vend)
+{
+	unsigned long pages = size >> PAGE_SHIFT;
+	struct vmap_area_cache *vc;
+	struct vmap_area *va = NULL;
+
+	if (pages > VMAP_CACHE_PAGES)
+		return NULL;
+
+	vc = &get_cpu_var(vmap_area_cache);
+	spin_lock(&vc->lock);
+	if (vc->nr[pages - 1]) {
+		va = list_first_entry(&vc->areas[pages - 1], struct vmap_area,
+				      purge_list);
+		if (va->va_start >= vstart && va->va_end <= vend &&
+		    IS_ALIGNED(va->va_start, align)) {
+			list_del(&va->purge_list);
+			vc->nr[pages - 1]--;
+		} else
+			va = NULL;
+	}
+	spin_unlock(&vc->lock);
+	put_cpu_var(vmap_area_cache);
+
+	return va;
+}
+
+/* Called by the lazy purge once @va has been flushed */
+static bool vmap_area_cache_put(struct vmap_area *va)
+{
+	unsigned long pages = (va->va_end - va->va_start) >> PAGE_SHIFT;
+	struct vmap_area_cache *vc = &per_cpu(vmap_area_cache, va->cpu);
+	bool cached = false;
+
+	if (pages > VMAP_CACHE_PAGES ||
+	    va->va_start < VMALLOC_START || va->va_end > VMALLOC_END)
+		return false;
+
+	spin_lock(&vc->lock);
+	if (vc->nr[pages - 1] < VMAP_CACHE_DEPTH) {
+		va->flags = 0;
+		list_move(&va->purge_list, &vc->areas[pages - 1]);
+		vc->nr[pages - 1]++;
+		cached = true;
+	}
+	spin_unlock(&vc->lock);
+
+	return cached;
+}
+
+static void __free_vmap_area(struct vmap_area *va);
+
+/* Return the cached areas of all cpus to the free space */
+static void vmap_area_cache_drain(void)
+{
+	LIST_HEAD(valist);
+	struct vmap_area *va, *n_va;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct vmap_area_cache *vc = &per_cpu(vmap_area_cache, cpu);
+
+		spin_lock(&vc->lock);
+		for (i = 0; i < VMAP_CACHE_PAGES; i++) {
+			list_splice_init(&vc->areas[i], &valist);
+			vc->nr[i] = 0;
+		}
+		spin_unlock(&vc->lock);
+	}
+
+	if (list_empty(&valist))
+		return;
+
+	spin_lock(&vmap_area_lock);
+	list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		__free_vmap_area(va);
+	spin_unlock(&vmap_area_lock);
 }
 
 static void purge_vmap_area_lazy(void);
@@ -335,15 +545,17 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				int node, gfp_t gfp_mask)
 {
 	struct vmap_area *va;
-	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
 	BUG_ON(!is_power_of_2(align));
 
+	va = vmap_area_cache_get(size, align, vstart, vend);
+	if (va)
+		return va;
+
 	va = kmalloc_node(sizeof(struct vmap_area),
 			gfp_mask & GFP_RECLAIM_MASK, node);
 	if (unlikely(!va))
@@ -351,84 +563,14 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 
 retry:
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = rb_next(&first->rb_node);
-		if (n)
-			first = rb_entry(n, struct vmap_area, rb_node);
-		else
-			goto found;
-	}
-
-found:
-	if (addr + size > vend)
+	addr = find_vmap_lowest_hole(size, align, vstart, vend);
+	if (!addr)
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -454,27 +596,24 @@ overflow:
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct rb_node *next, *deepest;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
+	next = rb_next(&va->rb_node);
+	deepest = rb_augment_erase_begin(&va->rb_node);
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
+	rb_augment_erase_end(deepest, vmap_area_augment_cb, NULL);
 	list_del_rcu(&va->list);
 
+	/* the next area's gap now takes in va and the gap below it */
+	if (next) {
+		rb_entry(next, struct vmap_area, rb_node)->gap +=
+			va->gap + va->va_end - va->va_start;
+		vmap_area_propagate(next);
+	}
+
 	/*
 	 * Track the highest possible candidate for pcpu area
 	 * allocation.  Areas outside of vmalloc area can be returned
@@ -553,6 +692,10 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/* Lazily freed areas, waiting for the next purge */
+static DEFINE_SPINLOCK(vmap_purge_list_lock);
+static LIST_HEAD(vmap_purge_list);
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -598,20 +741,19 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
-			if (va->va_start < *start)
-				*start = va->va_start;
-			if (va->va_end > *end)
-				*end = va->va_end;
-			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
-			va->flags |= VM_LAZY_FREEING;
-			va->flags &= ~VM_LAZY_FREE;
-		}
+	spin_lock(&vmap_purge_list_lock);
+	list_splice_init(&vmap_purge_list, &valist);
+	spin_unlock(&vmap_purge_list_lock);
+
+	list_for_each_entry(va, &valist, purge_list) {
+		if (va->va_start < *start)
+			*start = va->va_start;
+		if (va->va_end > *end)
+			*end = va->va_end;
+		nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
+		va->flags |= VM_LAZY_FREEING;
+		va->flags &= ~VM_LAZY_FREE;
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
@@ -620,6 +762,10 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 		flush_tlb_kernel_range(*start, *end);
 
 	if (nr) {
+		/* Flushed now, keep the small ones for reuse */
+		list_for_each_entry_safe(va, n_va, &valist, purge_list)
+			vmap_area_cache_put(va);
+
 		spin_lock(&vmap_area_lock);
 		list_for_each_entry_safe(va, n_va, &valist, purge_list)
 			__free_vmap_area(va);
@@ -640,26 +786,50 @@ static void try_purge_vmap_area_lazy(void)
 }
 
 /*
- * Kick off a purge of the outstanding lazy areas.
+ * Kick off a purge of the outstanding lazy areas, and give back the areas
+ * kept for reuse: called when we run out of vmap space.
  */
 static void purge_vmap_area_lazy(void)
 {
 	unsigned long start = ULONG_MAX, end = 0;
 
 	__purge_vmap_area_lazy(&start, &end, 1, 0);
+	vmap_area_cache_drain();
 }
 
+static void purge_vmap_area_work(struct work_struct *work)
+{
+	try_purge_vmap_area_lazy();
+}
+
+static DECLARE_WORK(vmap_purge_work, purge_vmap_area_work);
+
 /*
  * Free a vmap area, caller ensuring that the area has been unmapped
  * and flush_cache_vunmap had been called for the correct range
  * previously.
+ *
+ * Once half of lazy_max_pages() is waiting, a purge is started in the
+ * background, so that the task freeing the area doesn't pay for the
+ * global TLB flush. It only purges itself past lazy_max_pages(), when the
+ * frees outrun the background purge or set_iounmap_nonlazy() was called.
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
+	int nr_lazy;
+
 	va->flags |= VM_LAZY_FREE;
-	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
-	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
+	va->cpu = raw_smp_processor_id();
+	spin_lock(&vmap_purge_list_lock);
+	list_add_tail(&va->purge_list, &vmap_purge_list);
+	spin_unlock(&vmap_purge_list_lock);
+
+	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
+				    &vmap_lazy_nr);
+	if (unlikely(nr_lazy > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
+	else if (unlikely(nr_lazy > lazy_max_pages() / 2) && keventd_up())
+		schedule_work(&vmap_purge_work);
 }
 
 /*
@@ -1151,10 +1321,17 @@ void __init vmalloc_init(void)
 
 	for_each_possible_cpu(i) {
 		struct vmap_block_queue *vbq;
+		struct vmap_area_cache *vc;
+		int j;
 
 		vbq = &per_cpu(vmap_block_queue, i);
 		spin_lock_init(&vbq->lock);
 		INIT_LIST_HEAD(&vbq->free);
+
+		vc = &per_cpu(vmap_area_cache, i);
+		spin_lock_init(&vc->lock);
+		for (j = 0; j < VMAP_CACHE_PAGES; j++)
+			INIT_LIST_HEAD(&vc->areas[j]);
 	}
 
 	/* Import existing vmlist entries. */
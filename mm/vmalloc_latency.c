@@ -0,0 +1,167 @@
+/*
+ * vmalloc/vfree latency test
+ *
+ * Starts threads= threads, by default one per online cpu, that each make
+ * nr_allocs vmalloc() calls of 1 to max_pages pages, keeping up to hold
+ * areas allocated at a time and freeing the oldest one before each
+ * allocation. Reports the 50th, 90th, 99th and 99.9th percentile and the
+ * maximum latency of vmalloc() and vfree() over all threads, and the
+ * throughput. This is the pattern of drivers that map and unmap buffers
+ * all the time, such as binder, zram and nvmap kernel mappings, where
+ * vmap_area_lock and the TLB flushes of the lazy purge show up.
+ *
+ *   modprobe vmalloc_latency threads=4 nr_allocs=100000 max_pages=4
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/latency_test.h>
+
+static unsigned int threads;
+module_param(threads, uint, 0444);
+MODULE_PARM_DESC(threads, "threads, 0 for one per online cpu");
+
+static unsigned int nr_allocs = 100000;
+module_param(nr_allocs, uint, 0444);
+MODULE_PARM_DESC(nr_allocs, "allocations per thread");
+
+static unsigned int max_pages = 4;
+module_param(max_pages, uint, 0444);
+MODULE_PARM_DESC(max_pages, "largest allocation in pages");
+
+static unsigned int hold = 32;
+module_param(hold, uint, 0444);
+MODULE_PARM_DESC(hold, "areas each thread keeps allocated at a time");
+
+struct latency_thread {
+	struct task_struct	*task;
+	struct completion	done;
+	u32			*alloc_ns;
+	u32			*free_ns;
+	unsigned int		nr_alloc;
+	unsigned int		nr_free;
+	unsigned int		failed;
+};
+
+static int latency_thread_fn(void *data)
+{
+	struct latency_thread *lt = data;
+	unsigned int i, slot = 0;
+	void **held;
+	ktime_t start;
+
+	held = kcalloc(hold, sizeof(*held), GFP_KERNEL);
+	if (!held)
+		goto out;
+
+	for (i = 0; i < nr_allocs; i++) {
+		unsigned long size;
+
+		if (held[slot]) {
+			start = ktime_get();
+			vfree(held[slot]);
+			lt->free_ns[lt->nr_free++] =
+				latency_test_ns(start, ktime_get());
+			held[slot] = NULL;
+		}
+
+		size = (random32() % max_pages + 1) << PAGE_SHIFT;
+		start = ktime_get();
+		held[slot] = vmalloc(size);
+		lt->alloc_ns[lt->nr_alloc++] =
+			latency_test_ns(start, ktime_get());
+		if (!held[slot])
+			lt->failed++;
+		slot = (slot + 1) % hold;
+
+		cond_resched();
+	}
+
+	for (i = 0; i < hold; i++)
+		vfree(held[i]);
+	kfree(held);
+out:
+	complete(&lt->done);
+	return 0;
+}
+
+static int __init vmalloc_latency_init(void)
+{
+	struct latency_thread *lts;
+	unsigned int i, nr_alloc = 0, nr_free = 0, failed = 0;
+	u32 *alloc_ns, *free_ns;
+	ktime_t start;
+	s64 usecs;
+	int ret = 0;
+
+	if (!threads)
+		threads = num_online_cpus();
+	if (!nr_allocs || !max_pages || !hold)
+		return -EINVAL;
+
+	lts = kcalloc(threads, sizeof(*lts), GFP_KERNEL);
+	/* Sampled outside the timed calls, the buffers are merged below */
+	alloc_ns = vmalloc((size_t)threads * nr_allocs * sizeof(u32));
+	free_ns = vmalloc((size_t)threads * nr_allocs * sizeof(u32));
+	if (!lts || !alloc_ns || !free_ns) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	start = ktime_get();
+	for (i = 0; i < threads; i++) {
+		struct latency_thread *lt = &lts[i];
+
+		init_completion(&lt->done);
+		lt->alloc_ns = alloc_ns + (size_t)i * nr_allocs;
+		lt->free_ns = free_ns + (size_t)i * nr_allocs;
+		lt->task = kthread_run(latency_thread_fn, lt,
+				       "vmalloc_lat/%u", i);
+		if (IS_ERR(lt->task))
+			complete(&lt->done);
+	}
+
+	for (i = 0; i < threads; i++) {
+		struct latency_thread *lt = &lts[i];
+
+		wait_for_completion(&lt->done);
+		/* Compact the samples of all threads at the front */
+		memmove(alloc_ns + nr_alloc, lt->alloc_ns,
+			lt->nr_alloc * sizeof(u32));
+		memmove(free_ns + nr_free, lt->free_ns,
+			lt->nr_free * sizeof(u32));
+		nr_alloc += lt->nr_alloc;
+		nr_free += lt->nr_free;
+		failed += lt->failed;
+	}
+	usecs = ktime_us_delta(ktime_get(), start);
+
+	pr_info("vmalloc_latency: %u threads, %u allocations of up to %u "
+		"pages, %u failed, %lld usecs, %llu allocations/s\n",
+		threads, nr_alloc, max_pages, failed, usecs,
+		usecs ? div64_u64((u64)nr_alloc * USEC_PER_SEC, usecs) : 0ULL);
+	latency_test_report("vmalloc_latency", "vmalloc", alloc_ns, nr_alloc);
+	latency_test_report("vmalloc_latency", "vfree", free_ns, nr_free);
+
+out:
+	vfree(free_ns);
+	vfree(alloc_ns);
+	kfree(lts);
+	return ret;
+}
+
+static void __exit vmalloc_latency_exit(void)
+{
+}
+
+module_init(vmalloc_latency_init);
+module_exit(vmalloc_latency_exit);
+
+MODULE_DESCRIPTION("vmalloc/vfree latency test");
+MODULE_LICENSE("GPL");
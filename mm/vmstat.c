@@ -708,6 +708,8 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"workingset_refault",
+	"workingset_activate",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -756,6 +758,16 @@ const char * const vmstat_text[] = {
 
 	"pgrotated",
 
+	"pcp_highorder_hit",
+	"pcp_highorder_miss",
+
+	"readahead_pages",
+	"readahead_hit",
+	"readahead_evicted",
+	"readahead_unused",
+	"readahead_window_grow",
+	"readahead_window_shrink",
+
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
 	"compact_pages_moved",
@@ -763,6 +775,11 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_stall_usecs",
+	"compact_daemon_wake",
+	"compact_daemon_proactive",
+	"compact_daemon_success",
+	"compact_daemon_fail",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -0,0 +1,183 @@
+/*
+ * Workingset detection
+ *
+ * The file LRU decides from scan ratios alone how large the active list
+ * may grow. A set of pages that is accessed over and over again but is
+ * larger than the inactive list never gets activated: each page is
+ * evicted before its second access, and the pages that were activated
+ * long ago keep the active list for themselves.
+ *
+ * To tell those pages apart from use-once pages, every zone counts the
+ * pages that leave its inactive list, evicted or activated, in
+ * zone->inactive_age. When reclaim evicts a page cache page, the count
+ * is stored in a shadow entry that takes the page's place in the page
+ * cache radix tree. When the page is faulted back in, the difference
+ * between the count now and the one in the shadow entry, the refault
+ * distance, is the number of pages the inactive list would have needed
+ * on top of its size for the page to still be in memory.
+ *
+ * The active list holds the most that the inactive list could have
+ * grown by. If the refault distance is within the number of active file
+ * pages, the page would have been accessed twice while in memory had
+ * the active list given up that much space, so it is activated right
+ * away and competes with the established working set on the active list.
+ * Otherwise it starts on the inactive list like any other new page.
+ *
+ * Shadow entries are removed when the page comes back, when the file is
+ * truncated and when its inode is evicted. A file that stays cached
+ * would otherwise collect them without bound, so the number a mapping
+ * may keep is capped at the number of active file pages: every eviction
+ * from a zone advances its inactive_age, so of the shadow entries from
+ * one zone all but the most recent NR_ACTIVE_FILE have a refault
+ * distance that cannot activate anything. Once a mapping is at the cap,
+ * reclaim drops such stale entries near the page it evicts, and stores
+ * no new shadow entry if it finds none to drop.
+ */
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/radix-tree.h>
+#include <linux/vmstat.h>
+#include <linux/fs.h>
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+/* Tree slots looked at per eviction once a mapping is at the cap */
+#define SHADOW_SCAN_BATCH	8
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zonep,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction, refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zonep = NODE_DATA(nid)->node_zones + zid;
+
+	/* The counter wraps within the bits the shadow entry keeps */
+	refault = atomic_long_read(&(*zonep)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+static bool shadow_stale(void *shadow)
+{
+	unsigned long distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &distance);
+	return distance > zone_page_state(zone, NR_ACTIVE_FILE);
+}
+
+/*
+ * Drop the stale shadow entries among the slots following @index,
+ * wrapping around to the start of the file. The caller holds the
+ * mapping's tree_lock.
+ */
+static void shrink_shadows(struct address_space *mapping, pgoff_t index)
+{
+	void **slots[SHADOW_SCAN_BATCH];
+	void *entries[SHADOW_SCAN_BATCH];
+	unsigned long indices[SHADOW_SCAN_BATCH];
+	unsigned int i, nr, wrapped;
+
+	nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots, indices,
+					 index, SHADOW_SCAN_BATCH);
+	if (nr < SHADOW_SCAN_BATCH && index) {
+		wrapped = radix_tree_gang_lookup_slot(&mapping->page_tree,
+				slots + nr, indices + nr, 0,
+				SHADOW_SCAN_BATCH - nr);
+		/* Stop short of the slots the first lookup returned */
+		while (wrapped && indices[nr + wrapped - 1] >= index)
+			wrapped--;
+		nr += wrapped;
+	}
+
+	/* Deletion can free nodes, read all the slots first */
+	for (i = 0; i < nr; i++)
+		entries[i] = radix_tree_deref_slot_protected(slots[i],
+						&mapping->tree_lock);
+	for (i = 0; i < nr; i++) {
+		if (!radix_tree_exceptional_entry(entries[i]))
+			continue;
+		if (!shadow_stale(entries[i]))
+			continue;
+		radix_tree_delete(&mapping->page_tree, indices[i]);
+		mapping->nrshadows--;
+	}
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected, or
+ * %NULL if @mapping already holds as many as it may keep. The caller
+ * holds the mapping's tree_lock.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	if (mapping->nrshadows >= global_page_state(NR_ACTIVE_FILE)) {
+		shrink_shadows(mapping, page->index);
+		if (mapping->nrshadows >= global_page_state(NR_ACTIVE_FILE))
+			return NULL;
+	}
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
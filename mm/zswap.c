@@ -0,0 +1,451 @@
+/*
+ * zswap - compressed cache for swap pages
+ *
+ * A frontswap backend that compresses pages being swapped out with LZO
+ * and keeps them in RAM instead of writing them to the swap device. A
+ * swap in of such a page then costs a decompression rather than a read.
+ *
+ * The pool is limited to max_pool_percent of RAM. When a store finds it
+ * full, the least recently stored pages are decompressed into the swap
+ * cache and written to their slots on the swap device, and the pool only
+ * rejects pages if that didn't make room. Pages that compress poorly are
+ * rejected and go straight to the swap device.
+ *
+ * zswap is off until enabled with zswap.enabled=1 on the command line or
+ * through /sys/module/zswap/parameters/enabled. Statistics are in
+ * /sys/kernel/debug/zswap. See Documentation/vm/zswap.txt.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/writeback.h>
+#include <linux/frontswap.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/lzo.h>
+#include <linux/debugfs.h>
+
+static bool zswap_enabled;
+module_param_named(enabled, zswap_enabled, bool, 0644);
+MODULE_PARM_DESC(enabled, "compress pages being swapped out");
+
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+MODULE_PARM_DESC(max_pool_percent, "pool size limit in percent of RAM");
+
+/*
+ * kmalloc rounds anything larger up to a full page, which would store
+ * the page without saving any memory.
+ */
+#define ZSWAP_MAX_ENTRY_SIZE	(PAGE_SIZE / 2)
+
+/* Most entries a full store writes back to make room */
+#define ZSWAP_WRITEBACK_BATCH	16
+
+/*
+ * A compressed page. The entry is referenced by the tree while it is
+ * stored, and temporarily by loads and by writeback.
+ */
+struct zswap_entry {
+	struct rb_node		rbnode;
+	struct list_head	lru;
+	pgoff_t			offset;
+	unsigned int		type;
+	int			refcount;
+	unsigned int		length;
+	u8			data[0];
+};
+
+/*
+ * zswap_lock protects the trees, the LRU list, the entry refcounts and
+ * the pool size. It nests inside swap_lock, which frontswap holds when it
+ * flushes a page whose swap slot is freed.
+ */
+static DEFINE_SPINLOCK(zswap_lock);
+static struct rb_root zswap_trees[MAX_SWAPFILES];
+/* Most recently stored entries first */
+static LIST_HEAD(zswap_lru);
+
+static DEFINE_PER_CPU(u8 *, zswap_dstmem);
+static DEFINE_PER_CPU(void *, zswap_workmem);
+
+/* Statistics, see /sys/kernel/debug/zswap */
+static u64 zswap_pool_total_size;
+static u64 zswap_stored_pages;
+static u64 zswap_pool_limit_hit;
+static u64 zswap_written_back_pages;
+static u64 zswap_writeback_busy;
+static u64 zswap_reject_compress_poor;
+static u64 zswap_reject_alloc_fail;
+static u64 zswap_duplicate_entry;
+
+static u64 zswap_max_pool_size(void)
+{
+	return ((u64)totalram_pages * zswap_max_pool_percent / 100)
+		<< PAGE_SHIFT;
+}
+
+static bool zswap_is_full(void)
+{
+	return zswap_pool_total_size > zswap_max_pool_size();
+}
+
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (offset < entry->offset)
+			node = node->rb_left;
+		else if (offset > entry->offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Returns the entry already stored at the same offset, in which case
+ * @entry was not inserted.
+ */
+static struct zswap_entry *zswap_rb_insert(struct rb_root *root,
+					   struct zswap_entry *entry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *cur;
+
+	while (*link) {
+		parent = *link;
+		cur = rb_entry(parent, struct zswap_entry, rbnode);
+		if (entry->offset < cur->offset)
+			link = &parent->rb_left;
+		else if (entry->offset > cur->offset)
+			link = &parent->rb_right;
+		else
+			return cur;
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return NULL;
+}
+
+static void zswap_entry_put(struct zswap_entry *entry)
+{
+	if (--entry->refcount)
+		return;
+
+	zswap_stored_pages--;
+	zswap_pool_total_size -= ksize(entry);
+	kfree(entry);
+}
+
+/* Drop the entry from its tree and the LRU, called with zswap_lock held */
+static void zswap_erase(struct zswap_entry *entry)
+{
+	rb_erase(&entry->rbnode, &zswap_trees[entry->type]);
+	RB_CLEAR_NODE(&entry->rbnode);
+	list_del_init(&entry->lru);
+	zswap_entry_put(entry);
+}
+
+/*
+ * Write the page held by @entry to its swap slot. The page is read into
+ * a new swap cache page, which the load from the pool fills, and written
+ * out from there: the swap cache page pins the slot until the write has
+ * completed, so it can't be freed and reused under the write, and swap
+ * ins find the page in the swap cache meanwhile.
+ */
+static int zswap_writeback_entry(struct zswap_entry *entry)
+{
+	swp_entry_t swpentry = swp_entry(entry->type, entry->offset);
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+	};
+	struct page *page;
+	int ret = -EBUSY;
+
+	/* Already swapped in, the pool copy may still be needed */
+	page = find_get_page(&swapper_space, swpentry.val);
+	if (page) {
+		page_cache_release(page);
+		return -EEXIST;
+	}
+
+	page = read_swap_cache_async(swpentry, GFP_KERNEL | __GFP_NOWARN,
+				     NULL, 0);
+	if (!page)
+		return -ENOMEM;
+
+	/*
+	 * The page was unlocked after the load from the pool. Don't wait
+	 * for it if someone else has it locked, we may hold the lock of the
+	 * page being stored.
+	 */
+	if (trylock_page(page)) {
+		if (PageSwapCache(page) && page_private(page) == swpentry.val &&
+		    PageUptodate(page) && !PageWriteback(page)) {
+			/* Move it to the tail of the LRU once written */
+			SetPageReclaim(page);
+			ret = __swap_writepage(page, &wbc);
+		} else
+			unlock_page(page);
+	}
+	page_cache_release(page);
+	return ret;
+}
+
+/*
+ * Write back the least recently stored entries until there is room below
+ * the limit for a batch of average entries, or a batch has been written
+ * back. Returns whether the pool has room again.
+ */
+static bool zswap_shrink(void)
+{
+	u64 target = zswap_max_pool_size();
+	struct zswap_entry *entry;
+	int i, ret;
+
+	target -= min_t(u64, target, ZSWAP_WRITEBACK_BATCH * PAGE_SIZE / 2);
+
+	for (i = 0; i < ZSWAP_WRITEBACK_BATCH; i++) {
+		spin_lock(&zswap_lock);
+		if (zswap_pool_total_size <= target || list_empty(&zswap_lru)) {
+			spin_unlock(&zswap_lock);
+			break;
+		}
+		entry = list_entry(zswap_lru.prev, struct zswap_entry, lru);
+		list_del_init(&entry->lru);
+		entry->refcount++;
+		spin_unlock(&zswap_lock);
+
+		ret = zswap_writeback_entry(entry);
+
+		spin_lock(&zswap_lock);
+		if (ret == 0) {
+			zswap_written_back_pages++;
+			/* Unless it was replaced or flushed meanwhile */
+			if (!RB_EMPTY_NODE(&entry->rbnode))
+				zswap_erase(entry);
+		} else {
+			zswap_writeback_busy++;
+			if (!RB_EMPTY_NODE(&entry->rbnode))
+				list_add(&entry->lru, &zswap_lru);
+		}
+		zswap_entry_put(entry);
+		spin_unlock(&zswap_lock);
+	}
+
+	return !zswap_is_full();
+}
+
+/*
+ * frontswap hooks
+ */
+
+static void zswap_frontswap_init(unsigned type)
+{
+	spin_lock(&zswap_lock);
+	zswap_trees[type] = RB_ROOT;
+	spin_unlock(&zswap_lock);
+}
+
+static int zswap_frontswap_store(unsigned type, pgoff_t offset,
+				 struct page *page)
+{
+	struct zswap_entry *entry, *dupentry;
+	size_t dlen;
+	u8 *src, *dst;
+	int ret;
+
+	if (!zswap_enabled)
+		return -EPERM;
+
+	if (zswap_is_full() && !zswap_shrink()) {
+		zswap_pool_limit_hit++;
+		return -ENOMEM;
+	}
+
+	dst = get_cpu_var(zswap_dstmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &dlen,
+			       __get_cpu_var(zswap_workmem));
+	kunmap_atomic(src, KM_USER0);
+
+	if (ret != LZO_E_OK || sizeof(*entry) + dlen > ZSWAP_MAX_ENTRY_SIZE) {
+		put_cpu_var(zswap_dstmem);
+		zswap_reject_compress_poor++;
+		return -E2BIG;
+	}
+
+	/* Neither sleep nor dip into reserves, the page can still be written */
+	entry = kmalloc(sizeof(*entry) + dlen,
+			GFP_NOWAIT | __GFP_NORETRY | __GFP_NOWARN);
+	if (!entry) {
+		put_cpu_var(zswap_dstmem);
+		zswap_reject_alloc_fail++;
+		return -ENOMEM;
+	}
+	memcpy(entry->data, dst, dlen);
+	put_cpu_var(zswap_dstmem);
+
+	entry->offset = offset;
+	entry->type = type;
+	entry->refcount = 1;
+	entry->length = dlen;
+
+	spin_lock(&zswap_lock);
+	while ((dupentry = zswap_rb_insert(&zswap_trees[type], entry))) {
+		zswap_duplicate_entry++;
+		zswap_erase(dupentry);
+	}
+	list_add(&entry->lru, &zswap_lru);
+	zswap_stored_pages++;
+	zswap_pool_total_size += ksize(entry);
+	spin_unlock(&zswap_lock);
+
+	return 0;
+}
+
+static int zswap_frontswap_load(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_entry *entry;
+	size_t dlen = PAGE_SIZE;
+	u8 *dst;
+	int ret;
+
+	spin_lock(&zswap_lock);
+	entry = zswap_rb_search(&zswap_trees[type], offset);
+	if (!entry) {
+		/* Written back */
+		spin_unlock(&zswap_lock);
+		return -ENOENT;
+	}
+	entry->refcount++;
+	spin_unlock(&zswap_lock);
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->length, dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+	/* The swap slot was never written, there's no other copy */
+	BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+
+	spin_lock(&zswap_lock);
+	zswap_entry_put(entry);
+	spin_unlock(&zswap_lock);
+
+	return 0;
+}
+
+static void zswap_frontswap_flush_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_entry *entry;
+
+	spin_lock(&zswap_lock);
+	entry = zswap_rb_search(&zswap_trees[type], offset);
+	if (entry)
+		zswap_erase(entry);
+	spin_unlock(&zswap_lock);
+}
+
+static void zswap_frontswap_flush_area(unsigned type)
+{
+	struct rb_root *root = &zswap_trees[type];
+	struct rb_node *node;
+
+	spin_lock(&zswap_lock);
+	while ((node = rb_first(root))) {
+		zswap_erase(rb_entry(node, struct zswap_entry, rbnode));
+		cond_resched_lock(&zswap_lock);
+	}
+	spin_unlock(&zswap_lock);
+}
+
+static struct frontswap_ops zswap_frontswap_ops = {
+	.init		= zswap_frontswap_init,
+	.store		= zswap_frontswap_store,
+	.load		= zswap_frontswap_load,
+	.flush_page	= zswap_frontswap_flush_page,
+	.flush_area	= zswap_frontswap_flush_area,
+};
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zswap_debugfs_root;
+
+static void __init zswap_debugfs_init(void)
+{
+	if (!debugfs_initialized())
+		return;
+
+	zswap_debugfs_root = debugfs_create_dir("zswap", NULL);
+	if (!zswap_debugfs_root)
+		return;
+
+	debugfs_create_u64("pool_total_size", S_IRUGO, zswap_debugfs_root,
+			   &zswap_pool_total_size);
+	debugfs_create_u64("stored_pages", S_IRUGO, zswap_debugfs_root,
+			   &zswap_stored_pages);
+	debugfs_create_u64("pool_limit_hit", S_IRUGO, zswap_debugfs_root,
+			   &zswap_pool_limit_hit);
+	debugfs_create_u64("written_back_pages", S_IRUGO, zswap_debugfs_root,
+			   &zswap_written_back_pages);
+	debugfs_create_u64("writeback_busy", S_IRUGO, zswap_debugfs_root,
+			   &zswap_writeback_busy);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO, zswap_debugfs_root,
+			   &zswap_reject_alloc_fail);
+	debugfs_create_u64("duplicate_entry", S_IRUGO, zswap_debugfs_root,
+			   &zswap_duplicate_entry);
+}
+#else
+static inline void zswap_debugfs_init(void)
+{
+}
+#endif
+
+static int __init zswap_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(zswap_dstmem, cpu) = kmalloc_node(
+			lzo1x_worst_compress(PAGE_SIZE), GFP_KERNEL,
+			cpu_to_node(cpu));
+		per_cpu(zswap_workmem, cpu) = kmalloc_node(
+			LZO1X_1_MEM_COMPRESS, GFP_KERNEL, cpu_to_node(cpu));
+		if (!per_cpu(zswap_dstmem, cpu) ||
+		    !per_cpu(zswap_workmem, cpu))
+			goto nomem;
+	}
+
+	/*
+	 * Register even while disabled: swap areas only get a frontswap map
+	 * if a backend is registered when they are swapped on.
+	 */
+	frontswap_register_ops(&zswap_frontswap_ops);
+	zswap_debugfs_init();
+	return 0;
+
+nomem:
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zswap_dstmem, cpu));
+		kfree(per_cpu(zswap_workmem, cpu));
+	}
+	pr_err("zswap: can't allocate compression buffers\n");
+	return -ENOMEM;
+}
+module_init(zswap_init);
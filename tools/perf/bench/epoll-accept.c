@@ -0,0 +1,208 @@
+/*
+ *
+ * epoll-accept.c
+ *
+ * accept: Wakeups per accepted connection of epoll workers
+ *
+ * A number of worker threads, each with its own epoll instance, wait for
+ * a shared listening socket to become readable and then accept from it
+ * until it runs dry, like the workers of a prefork server. A client
+ * thread connects to it over loopback a number of times. Without
+ * --exclusive every connection wakes all the workers, which then race
+ * for it; with it the socket is added with EPOLLEXCLUSIVE and wakes one.
+ * Prints the wakeups, the wakeups that found nothing to accept and the
+ * wakeups per accepted connection. A worker woken up for a connection
+ * that another one took already may go back to sleep inside
+ * epoll_wait(), so the context switches of the workers per connection
+ * are printed too.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1 << 28)
+#endif
+
+static unsigned int nthreads;
+static unsigned int nconns = 10000;
+static unsigned int delay_us = 100;
+static bool exclusive;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of workers, default online cpus"),
+	OPT_UINTEGER('c', "connections", &nconns,
+		     "Specify number of connections"),
+	OPT_UINTEGER('d', "delay", &delay_us,
+		     "Specify microseconds between connections"),
+	OPT_BOOLEAN('x', "exclusive", &exclusive,
+		    "Add the listening socket with EPOLLEXCLUSIVE"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_accept_usage[] = {
+	"perf bench epoll accept <options>",
+	NULL
+};
+
+static int listen_fd;
+static struct sockaddr_in addr;
+static volatile int done;
+static unsigned long wakeups, empty_wakeups, accepts, switches;
+
+static void *worker_fn(void *arg __used)
+{
+	struct rusage ru;
+	long nvcsw;
+	struct epoll_event ev;
+	int epfd, fd, got;
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		die("epoll_create1");
+	ev.events = EPOLLIN | (exclusive ? EPOLLEXCLUSIVE : 0);
+	ev.data.fd = listen_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev))
+		die("epoll_ctl");
+
+	getrusage(RUSAGE_THREAD, &ru);
+	nvcsw = ru.ru_nvcsw;
+	while (!done) {
+		if (epoll_wait(epfd, &ev, 1, 100) <= 0)
+			continue;
+		__sync_fetch_and_add(&wakeups, 1);
+
+		for (got = 0; (fd = accept(listen_fd, NULL, NULL)) >= 0; got++)
+			close(fd);
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			die("accept");
+		if (got)
+			__sync_fetch_and_add(&accepts, got);
+		else
+			__sync_fetch_and_add(&empty_wakeups, 1);
+	}
+
+	getrusage(RUSAGE_THREAD, &ru);
+	__sync_fetch_and_add(&switches, ru.ru_nvcsw - nvcsw);
+	close(epfd);
+	return NULL;
+}
+
+static void *client_fn(void *arg __used)
+{
+	unsigned int i;
+	int fd;
+
+	for (i = 0; i < nconns; i++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			die("socket");
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+			die("connect");
+		close(fd);
+		if (delay_us)
+			usleep(delay_us);
+	}
+	return NULL;
+}
+
+int bench_epoll_accept(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	socklen_t len = sizeof(addr);
+	pthread_t *threads, client;
+	unsigned int i;
+	double usecs;
+	int one = 1;
+
+	argc = parse_options(argc, argv, options,
+			     bench_epoll_accept_usage, 0);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+		die("socket");
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(listen_fd, (struct sockaddr *)&addr, &len) ||
+	    listen(listen_fd, 1024))
+		die("listen");
+	fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, worker_fn, NULL))
+			die("pthread_create");
+	/* Let the workers block in epoll_wait() */
+	usleep(100000);
+
+	gettimeofday(&start, NULL);
+	if (pthread_create(&client, NULL, client_fn, NULL))
+		die("pthread_create");
+	pthread_join(client, NULL);
+	while (accepts < nconns)
+		usleep(1000);
+	gettimeofday(&stop, NULL);
+
+	done = 1;
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	close(listen_fd);
+
+	timersub(&stop, &start, &diff);
+	usecs = diff.tv_sec * 1000000.0 + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u workers accepting %u connections, %s wakeups\n\n",
+		       nthreads, nconns, exclusive ? "exclusive" : "shared");
+		printf(" %14lu wakeups\n", wakeups);
+		printf(" %14lu wakeups without a connection\n", empty_wakeups);
+		printf(" %14.3f wakeups per connection\n",
+		       (double)wakeups / accepts);
+		printf(" %14.3f context switches per connection\n",
+		       (double)switches / accepts);
+		printf(" %14.3f usecs total\n", usecs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3f\n", (double)wakeups / accepts);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Throughput of the futex hash table
+ *
+ * Every thread owns a set of futexes and keeps calling FUTEX_WAIT on
+ * them with a value they don't have, so that each call returns right
+ * after looking the futex up and taking its hash bucket lock. With
+ * --wake the threads call FUTEX_WAKE instead, on futexes nobody waits
+ * on. Collisions and bouncing bucket locks show as lower throughput
+ * with more threads.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nfutexes = 1024;
+static unsigned int nsecs = 10;
+static bool fshared;
+static bool wake;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads, default online cpus"),
+	OPT_UINTEGER('f', "futexes", &nfutexes,
+		     "Specify number of futexes per thread"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime in seconds"),
+	OPT_BOOLEAN('s', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_BOOLEAN('w', "wake", &wake,
+		    "Call FUTEX_WAKE without waiters instead of FUTEX_WAIT"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t thread;
+	u_int32_t *futex;
+	unsigned long ops;
+	unsigned long errors;
+};
+
+static volatile int done;
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	int opflags = fshared ? 0 : FUTEX_PRIVATE_FLAG;
+	unsigned int i;
+	int ret;
+
+	while (!done) {
+		for (i = 0; i < nfutexes; i++) {
+			if (wake)
+				ret = futex_wake(&w->futex[i], 1, opflags);
+			else
+				ret = futex_wait(&w->futex[i], 1234, opflags);
+			if (ret < 0 && errno != EWOULDBLOCK)
+				w->errors++;
+		}
+		w->ops += nfutexes;
+	}
+	return NULL;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long total = 0, errors = 0;
+	struct worker *workers;
+	double secs;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nfutexes)
+		nfutexes = 1;
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		workers[i].futex = calloc(nfutexes, sizeof(u_int32_t));
+		if (!workers[i].futex)
+			die("calloc");
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			die("pthread_create");
+	}
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].ops;
+		errors += workers[i].errors;
+		free(workers[i].futex);
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1e6;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads, %u %s futexes each, FUTEX_%s\n\n",
+		       nthreads, nfutexes, fshared ? "shared" : "private",
+		       wake ? "WAKE" : "WAIT");
+		for (i = 0; i < nthreads; i++)
+			printf(" thread %3u: %14.0f ops/sec\n", i,
+			       workers[i].ops / secs);
+		printf("\n %14s: %lu.%03lu [sec]\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f ops/sec\n", total / secs);
+		if (errors)
+			printf(" %14lu errors\n", errors);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+	return 0;
+}
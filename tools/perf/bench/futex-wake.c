@@ -0,0 +1,144 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Latency of waking up the waiters of a futex
+ *
+ * A number of threads block in FUTEX_WAIT on a single futex, and the
+ * main thread wakes them up, one FUTEX_WAKE call at a time, timing how
+ * long it takes until all of them are awake. Repeats that a number of
+ * times and prints the average.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nwakes = 1;
+static unsigned int nrepeat = 10;
+static bool fshared;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of waiters, default online cpus"),
+	OPT_UINTEGER('w', "nwakes", &nwakes,
+		     "Specify number of waiters to wake per call"),
+	OPT_UINTEGER('r', "repeat", &nrepeat,
+		     "Specify number of rounds"),
+	OPT_BOOLEAN('s', "shared", &fshared,
+		    "Use a shared futex instead of a private one"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static u_int32_t futex1;
+static unsigned int blocked;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+static void *waiter_fn(void *arg __used)
+{
+	int opflags = fshared ? 0 : FUTEX_PRIVATE_FLAG;
+
+	pthread_mutex_lock(&lock);
+	blocked++;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+
+	/* Only a FUTEX_WAKE may let us go, the main thread counts them */
+	while (futex_wait(&futex1, 0, opflags) && errno == EINTR)
+		;
+	return NULL;
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	int opflags;
+	struct timeval start, stop, diff;
+	unsigned long long total_usec = 0;
+	unsigned int i, r, woken;
+	pthread_t *threads;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_wake_usage, 0);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nwakes)
+		nwakes = 1;
+	opflags = fshared ? 0 : FUTEX_PRIVATE_FLAG;
+
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+
+	for (r = 0; r < nrepeat; r++) {
+		futex1 = 0;
+		blocked = 0;
+		for (i = 0; i < nthreads; i++)
+			if (pthread_create(&threads[i], NULL, waiter_fn, NULL))
+				die("pthread_create");
+
+		/* Wait until every thread is about to block, then some more */
+		pthread_mutex_lock(&lock);
+		while (blocked < nthreads)
+			pthread_cond_wait(&cond, &lock);
+		pthread_mutex_unlock(&lock);
+		usleep(100000);
+
+		gettimeofday(&start, NULL);
+		woken = 0;
+		while (woken < nthreads) {
+			int ret = futex_wake(&futex1, nwakes, opflags);
+
+			if (ret > 0)
+				woken += ret;
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		total_usec += diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+		for (i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u rounds of waking %u threads, %u per "
+		       "FUTEX_WAKE, %s futex\n\n", nrepeat, nthreads, nwakes,
+		       fshared ? "shared" : "private");
+		printf(" %14.3f usecs per round\n",
+		       (double)total_usec / nrepeat);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3f\n", (double)total_usec / nrepeat);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(threads);
+	return 0;
+}
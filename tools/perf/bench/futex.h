@@ -0,0 +1,32 @@
+/*
+ *
+ * futex.h
+ *
+ * Wrappers for the futex(2) operations used by the futex benchmarks
+ *
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+
+#define futex(uaddr, op, val, timeout, uaddr2, val3)		\
+	syscall(SYS_futex, uaddr, op, val, timeout, uaddr2, val3)
+
+static inline int
+futex_wait(u_int32_t *uaddr, u_int32_t val, int opflags)
+{
+	return futex(uaddr, FUTEX_WAIT | opflags, val, NULL, NULL, 0);
+}
+
+static inline int
+futex_wake(u_int32_t *uaddr, int nr_wake, int opflags)
+{
+	return futex(uaddr, FUTEX_WAKE | opflags, nr_wake, NULL, NULL, 0);
+}
+
+#endif /* _FUTEX_H */
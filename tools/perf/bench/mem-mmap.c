@@ -0,0 +1,180 @@
+/*
+ *
+ * mem-mmap.c
+ *
+ * mmap: Page faults racing with mmap/munmap of the same process
+ *
+ * A number of fault threads each touch every page of their own anonymous
+ * region and then drop it with MADV_DONTNEED, so that the next round
+ * faults it in again, which takes mmap_sem for read. Meanwhile mapper
+ * threads mmap and munmap a small region over and over, which takes
+ * mmap_sem for write and makes the faulting threads wait for it.
+ * Prints the page faults and the mmap/munmap pairs per second, and the
+ * context switches of the fault threads per fault, which shows how often
+ * they went to sleep on mmap_sem rather than spinning for it.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static unsigned int nthreads;
+static unsigned int nmappers = 1;
+static unsigned int npages = 256;
+static unsigned int nsecs = 10;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of fault threads, default online cpus"),
+	OPT_UINTEGER('m', "mappers", &nmappers,
+		     "Specify number of mmap/munmap threads"),
+	OPT_UINTEGER('p', "pages", &npages,
+		     "Specify number of pages faulted per round"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_mem_mmap_usage[] = {
+	"perf bench mem mmap <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t thread;
+	unsigned long ops;
+	long switches;
+};
+
+static volatile int done;
+static long page_size;
+
+static void *fault_fn(void *arg)
+{
+	struct worker *w = arg;
+	size_t len = (size_t)npages * page_size;
+	struct rusage ru;
+	unsigned int i;
+	char *buf;
+
+	buf = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		die("mmap");
+
+	getrusage(RUSAGE_THREAD, &ru);
+	w->switches = -ru.ru_nvcsw;
+	while (!done) {
+		for (i = 0; i < npages; i++)
+			buf[(size_t)i * page_size] = 1;
+		if (madvise(buf, len, MADV_DONTNEED))
+			die("madvise");
+		w->ops += npages;
+	}
+	getrusage(RUSAGE_THREAD, &ru);
+	w->switches += ru.ru_nvcsw;
+
+	munmap(buf, len);
+	return NULL;
+}
+
+static void *mapper_fn(void *arg)
+{
+	struct worker *w = arg;
+	void *p;
+
+	while (!done) {
+		p = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			die("mmap");
+		munmap(p, page_size);
+		w->ops++;
+	}
+	return NULL;
+}
+
+int bench_mem_mmap(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long faults = 0, maps = 0;
+	long switches = 0;
+	struct worker *workers;
+	unsigned int i;
+	double secs;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_mmap_usage, 0);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!npages)
+		npages = 1;
+	page_size = sysconf(_SC_PAGESIZE);
+
+	workers = calloc(nthreads + nmappers, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads + nmappers; i++)
+		if (pthread_create(&workers[i].thread, NULL,
+				   i < nthreads ? fault_fn : mapper_fn,
+				   &workers[i]))
+			die("pthread_create");
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < nthreads + nmappers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (i < nthreads) {
+			faults += workers[i].ops;
+			switches += workers[i].switches;
+		} else {
+			maps += workers[i].ops;
+		}
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1e6;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u fault threads of %u pages, %u mappers\n\n",
+		       nthreads, npages, nmappers);
+		printf(" %14s: %lu.%03lu [sec]\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0f faults/sec\n", faults / secs);
+		printf(" %14.0f mmap/munmap/sec\n", maps / secs);
+		printf(" %14.3f context switches per fault\n",
+		       faults ? (double)switches / faults : 0.0);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f\n", faults / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+	return 0;
+}
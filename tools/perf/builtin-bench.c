@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex hashing and wakeups
+ *  epoll ... epoll wakeups
  *
  */
 
@@ -52,6 +54,32 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "mmap",
+	  "Page faults racing with mmap/munmap",
+	  bench_mem_mmap },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Throughput of futex hash table lookups",
+	  bench_futex_hash },
+	{ "wake",
+	  "Latency of waking up the waiters of a futex",
+	  bench_futex_wake },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite epoll_suites[] = {
+	{ "accept",
+	  "Wakeups per accepted connection of epoll workers",
+	  bench_epoll_accept },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +99,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex hashing and wakeups",
+	  futex_suites },
+	{ "epoll",
+	  "epoll wakeups",
+	  epoll_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
@@ -0,0 +1,180 @@
+/*
+ * Periodic bursty tasks
+ *
+ * Starts a number of threads that each wake up at a fixed period, spin
+ * for a burst and go back to sleep, like the UI, audio and sensor
+ * threads of an app. How well they are placed shows in how late they
+ * wake up after their timer, how often a burst does not finish within
+ * its period, and how often a thread wakes up on another cpu than the
+ * one it ran on last.
+ *
+ * Load balancing and wakeup placement by instantaneous runqueue weight
+ * sees these threads as full weight tasks whenever they happen to be
+ * queued, and as nothing while they sleep. With the per-entity load
+ * averages they count for the fraction of the time they actually run.
+ *
+ *   gcc -O2 -Wall -pthread -o bursty bursty.c
+ *   ./bursty -t 8 -p 16 -b 4 -s 10
+ *
+ * -t	threads
+ * -p	period in ms
+ * -b	burst in ms
+ * -s	seconds to run
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+static unsigned int period_ms = 16, burst_ms = 4, seconds = 10;
+
+struct bursty {
+	pthread_t thread;
+	unsigned int nr;
+	unsigned int missed;
+	unsigned int migrated;
+	long *lateness;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ts_add_ns(struct timespec *ts, long ns)
+{
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= 1000000000) {
+		ts->tv_nsec -= 1000000000;
+		ts->tv_sec++;
+	}
+}
+
+static long ts_sub_us(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000000 +
+	       (a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+static void *bursty_fn(void *data)
+{
+	struct bursty *b = data;
+	unsigned int periods = seconds * 1000 / period_ms;
+	struct timespec next, woke, end;
+	int cpu = sched_getcpu();
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (b->nr < periods) {
+		struct timespec deadline;
+
+		ts_add_ns(&next, period_ms * 1000000L);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &woke);
+		b->lateness[b->nr++] = ts_sub_us(&woke, &next);
+
+		if (sched_getcpu() != cpu) {
+			cpu = sched_getcpu();
+			b->migrated++;
+		}
+
+		/* Spin for the burst, counting time spent preempted too */
+		end = woke;
+		ts_add_ns(&end, burst_ms * 1000000L);
+		do
+			clock_gettime(CLOCK_MONOTONIC, &woke);
+		while (ts_sub_us(&woke, &end) < 0);
+
+		deadline = next;
+		ts_add_ns(&deadline, period_ms * 1000000L);
+		if (ts_sub_us(&woke, &deadline) > 0)
+			b->missed++;
+	}
+	return NULL;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int threads = 8, i, nr = 0, missed = 0, migrated = 0;
+	struct bursty *bs;
+	long *all;
+	double start;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:p:b:s:")) != -1) {
+		switch (c) {
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			period_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			burst_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-p period ms] "
+				"[-b burst ms] [-s seconds]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!threads || !period_ms || burst_ms >= period_ms) {
+		fprintf(stderr, "need threads and a burst shorter than "
+			"the period\n");
+		return 2;
+	}
+
+	bs = calloc(threads, sizeof(*bs));
+	all = calloc((size_t)threads * (seconds * 1000 / period_ms + 1),
+		     sizeof(*all));
+	if (!bs || !all) {
+		perror("calloc");
+		return 1;
+	}
+
+	start = now();
+	for (i = 0; i < threads; i++) {
+		bs[i].lateness = all + (size_t)i * (seconds * 1000 / period_ms);
+		if (pthread_create(&bs[i].thread, NULL, bursty_fn, &bs[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(bs[i].thread, NULL);
+		/* Compact the samples of all threads at the front */
+		memmove(all + nr, bs[i].lateness, bs[i].nr * sizeof(*all));
+		nr += bs[i].nr;
+		missed += bs[i].missed;
+		migrated += bs[i].migrated;
+	}
+
+	qsort(all, nr, sizeof(*all), cmp_long);
+	printf("%u threads, %u/%u ms, %.2f s, %u periods\n", threads,
+	       burst_ms, period_ms, now() - start, nr);
+	if (!nr)
+		return 0;
+	printf("wakeup latency us: p50 %ld p90 %ld p99 %ld max %ld\n",
+	       all[nr / 2], all[(size_t)nr * 9 / 10],
+	       all[(size_t)nr * 99 / 100], all[nr - 1]);
+	printf("missed %u (%.2f%%), migrated %u (%.2f%%)\n", missed,
+	       100.0 * missed / nr, migrated, 100.0 * migrated / nr);
+	return 0;
+}
@@ -0,0 +1,76 @@
+#
+# Shared helpers for the benchmark scripts in this directory.
+#
+# Each script starts with a comment block describing what it measures,
+# with a "# usage: <script> <arguments>" line, and sources this file:
+#
+#	. "$(dirname "$0")/common.sh"
+#
+# All of them need root, which is checked here.
+
+BENCH_DIR=$(dirname "$0")
+
+die()
+{
+	echo "$(basename "$0"): $*" >&2
+	exit 1
+}
+
+# Print the usage line from the header of the script and exit.
+usage()
+{
+	sed -n "s/^# usage: [^ ]*/usage: $(basename "$0")/p" "$0" >&2
+	exit 1
+}
+
+[ "$(id -u)" -eq 0 ] || die "needs root"
+
+drop_caches()
+{
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+}
+
+# build <binary> <source in this directory> [cc options]
+build()
+{
+	bin=$1
+	src=$2
+	shift 2
+	${CC:-cc} -O2 -Wall "$@" -o "$bin" "$BENCH_DIR/$src" ||
+		die "cannot build $src"
+}
+
+# Snapshot the /proc/vmstat counters matching a pattern into a file, and
+# print the change in each of them since the snapshot.
+vmstat_save()
+{
+	awk -v pat="$1" '$1 ~ pat { print $1, $2 }' /proc/vmstat | sort > "$2"
+}
+
+vmstat_delta()
+{
+	awk -v pat="$1" '$1 ~ pat { print $1, $2 }' /proc/vmstat | sort |
+		join "$2" - | awk '{ printf "%-28s %12d\n", $1, $3 - $2 }'
+	rm -f "$2"
+}
+
+# Contentions on the locks matching a pattern since /proc/lock_stat was
+# last cleared, nothing without CONFIG_LOCK_STAT.
+lock_contentions()
+{
+	[ -r /proc/lock_stat ] || return
+	awk -v pat="$1" '$1 ~ pat { n += $3 } END { print n + 0 }' \
+		/proc/lock_stat
+}
+
+lock_stat_clear()
+{
+	[ -w /proc/lock_stat ] && echo 0 > /proc/lock_stat
+}
+
+# Next step of a 1, 2, 4, ... max series.
+next_step()
+{
+	echo $(($1 * 2 > $2 && $1 < $2 ? $2 : $1 * 2))
+}
@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# High-order allocation latency under fragmentation.
+#
+# Fills a tmpfs with 4k files until only a small part of memory is free,
+# then deletes every other file. Memory is left fragmented by movable
+# pages that compaction can migrate. The highorder_latency module then
+# allocates order-3 and order-4 blocks, once with kcompactd's periodic
+# checks turned off and once with them on. Prints the latency histograms
+# from the kernel log and the change in the compaction counters from
+# /proc/vmstat for each run.
+#
+# usage: highorder-latency.sh [free MiB to leave] [allocations per order]
+#
+# Needs root and a kernel with CONFIG_COMPACTION and
+# CONFIG_HIGHORDER_LATENCY_TEST=m.
+
+. "$(dirname "$0")/common.sh"
+
+LEAVE=${1:-64}
+NR=${2:-1000}
+
+MNT=$(mktemp -d /tmp/frag.XXXXXX) || exit 1
+ORDERS=$(cat /proc/sys/vm/kcompactd_orders)
+
+cleanup()
+{
+	echo "$ORDERS" > /proc/sys/vm/kcompactd_orders
+	rmmod highorder_latency 2>/dev/null
+	umount "$MNT" 2>/dev/null
+	rmdir "$MNT"
+}
+trap cleanup EXIT
+
+fragment()
+{
+	free=$(awk '/^MemFree:/ { print int($2 / 1024) }' /proc/meminfo)
+	nr=$(( (free - LEAVE) * 256 ))
+	[ $nr -gt 0 ] || return
+
+	mount -t tmpfs -o size=$((free - LEAVE))m none "$MNT" || exit 1
+	i=0
+	while [ $i -lt $nr ]; do
+		head -c 4096 /dev/zero > "$MNT/$i" 2>/dev/null || break
+		i=$((i + 1))
+	done
+	i=0
+	while [ $i -lt $nr ]; do
+		rm -f "$MNT/$i"
+		i=$((i + 2))
+	done
+}
+
+run()
+{
+	echo "=== $1"
+	echo "$2" > /proc/sys/vm/kcompactd_orders
+
+	drop_caches
+	umount "$MNT" 2>/dev/null
+	fragment
+	vmstat_save "^compact_" "$MNT.before"
+
+	dmesg -c > /dev/null
+	modprobe highorder_latency nr_allocs="$NR" || exit 1
+	rmmod highorder_latency
+	dmesg | sed -n 's/.*highorder_latency: //p'
+
+	vmstat_delta "^compact_" "$MNT.before"
+}
+
+run "direct compaction only" 0
+run "kcompactd for orders 3 and 4" 24
@@ -0,0 +1,177 @@
+/*
+ * KSM convergence time
+ *
+ * Starts a number of processes that each map the same anonymous image,
+ * like instances of one VM or container, page i holding the same data in
+ * every process, plus a share of pages unique to each process. Marks the
+ * memory MADV_MERGEABLE and prints how long ksmd takes to reach 50%, 90%
+ * and all of the sharing possible, polling /sys/kernel/mm/ksm.
+ *
+ *   gcc -O2 -Wall -o ksm-converge ksm-converge.c
+ *   ./ksm-converge -n 16 -s 64 -u 10 -t 300
+ *
+ * -n	processes
+ * -s	MiB mapped by each
+ * -u	percent of each mapping unique to the process
+ * -t	seconds to wait at most
+ *
+ * KSM must be running, see ksm-converge.sh.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define KSM_DIR "/sys/kernel/mm/ksm/"
+
+static size_t page_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long ksm_read(const char *name)
+{
+	char path[128];
+	unsigned long val = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), KSM_DIR "%s", name);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	if (fscanf(f, "%lu", &val) != 1)
+		val = 0;
+	fclose(f);
+	return val;
+}
+
+static void fill(char *mem, size_t nr_pages, size_t nr_unique, int id)
+{
+	size_t i, j;
+
+	for (i = 0; i < nr_pages; i++) {
+		uint64_t *p = (uint64_t *)(mem + i * page_size);
+		/* The unique pages come last, tagged with the process */
+		uint64_t seed = i < nr_pages - nr_unique ?
+				i : ((uint64_t)(id + 1) << 40) | i;
+
+		for (j = 0; j < page_size / sizeof(*p); j++)
+			p[j] = seed * 0x9e3779b97f4a7c15ULL + j;
+	}
+}
+
+static void child(size_t nr_pages, size_t nr_unique, int id, int ready)
+{
+	char *mem;
+
+	mem = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	fill(mem, nr_pages, nr_unique, id);
+	if (madvise(mem, nr_pages * page_size, MADV_MERGEABLE)) {
+		perror("madvise");
+		exit(1);
+	}
+	if (write(ready, "", 1) != 1)
+		exit(1);
+	for (;;)
+		pause();
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nr_procs = 8, unique_pct = 10, timeout = 300;
+	size_t size_mb = 64, nr_pages, nr_unique;
+	unsigned long target, sharing = 0, scans;
+	double start, t50 = 0, t90 = 0;
+	int fds[2], c, i;
+	pid_t *pids;
+	char byte;
+
+	while ((c = getopt(argc, argv, "n:s:u:t:")) != -1) {
+		switch (c) {
+		case 'n':
+			nr_procs = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			unique_pct = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			timeout = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n processes] [-s MiB] "
+				"[-u unique percent] [-t seconds]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (nr_procs < 2 || unique_pct > 100)
+		return 2;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	nr_pages = (size_mb << 20) / page_size;
+	nr_unique = nr_pages * unique_pct / 100;
+	/* Each shared page is kept once, the other processes share it */
+	target = (nr_pages - nr_unique) * (nr_procs - 1);
+
+	pids = calloc(nr_procs, sizeof(*pids));
+	if (!pids || pipe(fds))
+		return 1;
+	for (i = 0; i < nr_procs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			nr_procs = i;
+			goto out;
+		}
+		if (!pids[i])
+			child(nr_pages, nr_unique, i, fds[1]);
+	}
+	for (i = 0; i < nr_procs; i++)
+		if (read(fds[0], &byte, 1) != 1)
+			goto out;
+
+	scans = ksm_read("full_scans");
+	start = now();
+	while (now() - start < timeout) {
+		sharing = ksm_read("pages_sharing");
+		if (!t50 && sharing * 2 >= target)
+			t50 = now() - start;
+		if (!t90 && sharing * 10 >= target * 9)
+			t90 = now() - start;
+		if (sharing >= target)
+			break;
+		usleep(100000);
+	}
+
+	printf("%u processes x %zu MiB, %u%% unique: %lu of %lu pages "
+	       "sharing\n", nr_procs, size_mb, unique_pct, sharing, target);
+	printf("50%%: %8.1f s  90%%: %8.1f s  100%%: %8.1f s  "
+	       "full scans: %lu  pages_to_scan: %lu\n",
+	       t50, t90, sharing >= target ? now() - start : 0.0,
+	       ksm_read("full_scans") - scans, ksm_read("pages_to_scan"));
+out:
+	for (i = 0; i < nr_procs; i++)
+		kill(pids[i], SIGKILL);
+	while (wait(NULL) > 0)
+		;
+	return sharing >= target ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# KSM convergence time with one and with several scan threads, with and
+# without auto_tune.
+#
+# For each configuration, unmerges everything, sets scan_threads and
+# auto_tune, starts ksmd and runs ksm-converge.c, which prints how long
+# it takes for the pages of a set of identical processes to be merged.
+# Restores the KSM settings on exit.
+#
+# usage: ksm-converge.sh [processes] [MiB per process] [unique percent]
+#
+# Needs root and a kernel with CONFIG_KSM.
+
+. "$(dirname "$0")/common.sh"
+
+PROCS=${1:-8}
+SIZE=${2:-64}
+UNIQUE=${3:-10}
+
+KSM=/sys/kernel/mm/ksm
+BIN=$(mktemp /tmp/ksm-converge.XXXXXX) || exit 1
+CPUS=$(getconf _NPROCESSORS_ONLN)
+
+[ -d $KSM ] || die "kernel without KSM"
+build "$BIN" ksm-converge.c
+
+RUN=$(cat $KSM/run)
+PAGES=$(cat $KSM/pages_to_scan)
+THREADS=$(cat $KSM/scan_threads 2>/dev/null)
+AUTO=$(cat $KSM/auto_tune 2>/dev/null)
+
+cleanup()
+{
+	echo 2 > $KSM/run
+	echo $PAGES > $KSM/pages_to_scan
+	[ -n "$THREADS" ] && echo $THREADS > $KSM/scan_threads
+	[ -n "$AUTO" ] && echo $AUTO > $KSM/auto_tune
+	echo $RUN > $KSM/run
+	rm -f "$BIN"
+}
+trap cleanup EXIT
+
+converge()
+{
+	echo 2 > $KSM/run
+	echo $PAGES > $KSM/pages_to_scan
+	if [ -n "$THREADS" ]; then
+		echo $1 > $KSM/scan_threads
+		echo $2 > $KSM/auto_tune
+	elif [ $1 -ne 1 -o $2 -ne 0 ]; then
+		return
+	fi
+	echo 1 > $KSM/run
+	echo "scan_threads=$1 auto_tune=$2"
+	"$BIN" -n $PROCS -s $SIZE -u $UNIQUE
+}
+
+converge 1 0
+[ $CPUS -gt 1 ] && converge $CPUS 0
+converge 1 1
+[ $CPUS -gt 1 ] && converge $CPUS 1
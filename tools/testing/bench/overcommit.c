@@ -0,0 +1,137 @@
+/*
+ * Anonymous memory overcommit workload
+ *
+ * Maps more anonymous memory than fits in RAM, fills every page with data
+ * that compresses about as well as typical application heaps, then makes
+ * a number of passes over it, alternately in order and in random order.
+ * Every page carries its own index, which is checked on each pass, so a
+ * page that comes back from swap wrong is reported. Prints the time each
+ * pass took.
+ *
+ *   gcc -O2 -Wall -o overcommit overcommit.c
+ *   ./overcommit -s 1536 -p 4 -r 30
+ *
+ * -s	MiB to map
+ * -p	passes after the initial fill
+ * -r	percent of each page filled with random bytes, the rest repeats
+ *	a short pattern (0 compresses to almost nothing, 100 not at all)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+static size_t page_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* xorshift, rand() is too slow to fill gigabytes */
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static void fill_page(uint64_t *p, size_t idx, unsigned int rand_pct)
+{
+	size_t words = page_size / sizeof(*p);
+	size_t nr_rand = words * rand_pct / 100;
+	size_t i;
+
+	p[0] = idx;
+	for (i = 1; i < words; i++)
+		p[i] = i < nr_rand ? rnd() : (i & 15) * 0x0101010101010101ULL;
+}
+
+/* Returns the number of pages that didn't carry their index */
+static size_t pass(char *mem, size_t nr_pages, int random_order)
+{
+	size_t i, idx, bad = 0;
+
+	for (i = 0; i < nr_pages; i++) {
+		uint64_t *p;
+
+		idx = random_order ? rnd() % nr_pages : i;
+		p = (uint64_t *)(mem + idx * page_size);
+		if (p[0] != idx)
+			bad++;
+		/* Dirty the page so it has to be swapped out again */
+		p[1]++;
+	}
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	size_t size_mb = 1024, nr_pages, i, bad;
+	unsigned int passes = 4, rand_pct = 30, n;
+	double start;
+	char *mem;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:p:r:")) != -1) {
+		switch (c) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rand_pct = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s MiB] [-p passes] "
+				"[-r random percent]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (rand_pct > 100)
+		rand_pct = 100;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	nr_pages = (size_mb << 20) / page_size;
+	mem = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	start = now();
+	for (i = 0; i < nr_pages; i++)
+		fill_page((uint64_t *)(mem + i * page_size), i, rand_pct);
+	printf("fill:          %8.2f s\n", now() - start);
+
+	bad = 0;
+	for (n = 0; n < passes; n++) {
+		int random_order = n & 1;
+		size_t b;
+
+		start = now();
+		b = pass(mem, nr_pages, random_order);
+		printf("pass %u %-7s %8.2f s%s\n", n,
+		       random_order ? "random" : "linear", now() - start,
+		       b ? "  CORRUPTED PAGES" : "");
+		bad += b;
+	}
+
+	if (bad) {
+		printf("%zu pages came back with the wrong contents\n", bad);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# Page allocation throughput and zone->lock contention with one to N
+# threads allocating small blocks in parallel.
+#
+# For each load and thread count, runs the page_alloc_parallel module and
+# prints its allocation rate, the share of order 1 to 3 allocations served
+# from the per cpu lists, and when the kernel has CONFIG_LOCK_STAT the
+# contention on zone->lock.
+#
+# usage: parallel-alloc.sh [rounds per thread] [max threads]
+#
+# Needs root and a kernel with CONFIG_PAGE_ALLOC_PARALLEL_TEST=m.
+
+. "$(dirname "$0")/common.sh"
+
+NR=${1:-100000}
+MAX=${2:-$(getconf _NPROCESSORS_ONLN)}
+
+trap 'rmmod page_alloc_parallel 2>/dev/null' EXIT
+
+vmstat()
+{
+	awk -v name=$1 '$1 == name { print $2 }' /proc/vmstat
+}
+
+printf "%5s %8s %12s %8s %12s\n" load threads "pages/s" "pcp hit" contentions
+for load in fork net; do
+	n=1
+	while [ $n -le $MAX ]; do
+		lock_stat_clear
+		hit=$(vmstat pcp_highorder_hit)
+		miss=$(vmstat pcp_highorder_miss)
+
+		dmesg -c > /dev/null
+		modprobe page_alloc_parallel load=$load threads=$n \
+			nr_loops=$NR || exit 1
+		rmmod page_alloc_parallel
+		rate=$(dmesg | sed -n 's/.* \([0-9]*\) pages\/s$/\1/p')
+
+		hit=$(($(vmstat pcp_highorder_hit) - hit))
+		miss=$(($(vmstat pcp_highorder_miss) - miss))
+		awk -v l=$load -v n=$n -v r="$rate" -v h=$hit -v m=$miss \
+		    -v c="$(lock_contentions "zone->lock")" 'BEGIN {
+			printf "%5s %8d %12s %7.1f%% %12s\n", l, n, r,
+			       h + m ? 100 * h / (h + m) : 0, c }'
+		n=$(next_step $n $MAX)
+	done
+done
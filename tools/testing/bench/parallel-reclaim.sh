@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# Page cache reclaim throughput with one to N cpus reclaiming in parallel.
+#
+# Creates files in DIR totalling twice the RAM, then for each step drops
+# the page cache and has that many readers stream through all of them,
+# each its own share, so that every step pushes the same amount of page
+# cache through the LRU and the readers reclaim it from each other in
+# direct reclaim. Prints the wall time of each step, the pages scanned and
+# stolen per second, and when the kernel has CONFIG_LOCK_STAT the
+# contention on the lru_locks.
+#
+# usage: parallel-reclaim.sh [dir] [max readers]
+#
+# Needs root and free space for twice the RAM in DIR. Runs in the root
+# memory cgroup: the memory controller keeps a single LRU lock per zone.
+
+. "$(dirname "$0")/common.sh"
+
+DIR=${1:-/data/local/tmp}
+MAX=${2:-$(getconf _NPROCESSORS_ONLN)}
+
+MEM=$(awk '/^MemTotal/ { print int($2 / 1024) }' /proc/meminfo)
+NR_FILES=$((MAX * 4))
+SIZE=$((MEM * 2 / NR_FILES))
+
+cleanup()
+{
+	rm -f "$DIR"/reclaim.*
+}
+trap cleanup EXIT
+
+i=0
+while [ $i -lt $NR_FILES ]; do
+	dd if=/dev/zero of="$DIR/reclaim.$i" bs=1M count=$SIZE 2> /dev/null ||
+		exit 1
+	i=$((i + 1))
+done
+sync
+
+vmstat_sum()
+{
+	awk -v pat="$1" '$1 ~ pat { n += $2 } END { print n + 0 }' /proc/vmstat
+}
+
+printf "%7s %10s %12s %12s %12s\n" readers seconds "pgscan/s" "pgsteal/s" \
+	contentions
+n=1
+while [ $n -le $MAX ]; do
+	drop_caches
+	lock_stat_clear
+	scan=$(vmstat_sum "^pgscan_")
+	steal=$(vmstat_sum "^pgsteal_")
+	start=$(date +%s.%N)
+
+	r=0
+	while [ $r -lt $n ]; do
+		(
+			f=$r
+			while [ $f -lt $NR_FILES ]; do
+				cat "$DIR/reclaim.$f" > /dev/null
+				f=$((f + n))
+			done
+		) &
+		r=$((r + 1))
+	done
+	wait
+
+	end=$(date +%s.%N)
+	scan=$(($(vmstat_sum "^pgscan_") - scan))
+	steal=$(($(vmstat_sum "^pgsteal_") - steal))
+	awk -v n=$n -v s="$start" -v e="$end" -v scan=$scan -v steal=$steal \
+		-v c="$(lock_contentions "lruvec->lru_lock")" \
+		'BEGIN { printf "%7d %10.2f %12d %12d %12s\n", n, e - s,
+			 scan / (e - s), steal / (e - s), c }'
+	n=$(next_step $n $MAX)
+done
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# Swap out throughput with one to N cpus reclaiming in parallel to zram.
+#
+# Sets up zram0 as the highest priority swap device, then for each step
+# runs that many copies of overcommit.c, each in its own memory
+# cgroup limited to half of what it maps, so that every copy reclaims and
+# swaps on its own. Prints the wall time of each step, the pages it
+# swapped out per second, and when the kernel has CONFIG_LOCK_STAT the
+# contention on swap_lock.
+#
+# usage: parallel-swapout.sh [MiB per copy] [passes] [max copies]
+#
+# Needs root, zram and the memory cgroup controller. zram0 must not be in
+# use.
+
+. "$(dirname "$0")/common.sh"
+
+SIZE=${1:-256}
+PASSES=${2:-2}
+MAX=${3:-$(getconf _NPROCESSORS_ONLN)}
+
+ZRAM=/sys/block/zram0
+CG=/dev/cgroup/memory
+BIN=$(mktemp /tmp/overcommit.XXXXXX) || exit 1
+
+[ -d $ZRAM ] || modprobe zram num_devices=1 2>/dev/null
+[ -d $ZRAM ] || die "kernel without zram"
+build "$BIN" overcommit.c
+
+cleanup()
+{
+	swapoff /dev/zram0 2>/dev/null
+	echo 1 > $ZRAM/reset
+	for d in $CG/swapout.*; do
+		[ -d "$d" ] && rmdir "$d"
+	done
+	[ -n "$MOUNTED" ] && umount $CG
+	rm -f "$BIN"
+}
+trap cleanup EXIT
+
+echo $((SIZE * MAX * 1024 * 1024)) > $ZRAM/disksize || exit 1
+mkswap /dev/zram0 > /dev/null || exit 1
+swapon -p 32767 /dev/zram0 || exit 1
+
+if [ ! -f $CG/tasks ]; then
+	mkdir -p $CG
+	mount -t cgroup -o memory none $CG || exit 1
+	MOUNTED=1
+fi
+
+pswpout()
+{
+	awk '/^pswpout/ { print $2 }' /proc/vmstat
+}
+
+printf "%6s %10s %14s %12s\n" copies seconds "pswpout/s" contentions
+n=1
+while [ $n -le $MAX ]; do
+	lock_stat_clear
+	out=$(pswpout)
+	start=$(date +%s.%N)
+
+	i=0
+	while [ $i -lt $n ]; do
+		d=$CG/swapout.$i
+		mkdir -p $d
+		echo $((SIZE / 2))M > $d/memory.limit_in_bytes
+		sh -c "echo \$\$ > $d/tasks; exec $BIN -s $SIZE -p $PASSES" \
+			> /dev/null &
+		i=$((i + 1))
+	done
+	wait
+
+	end=$(date +%s.%N)
+	out=$(($(pswpout) - out))
+	awk -v n=$n -v s="$start" -v e="$end" -v out=$out \
+		-v c="$(lock_contentions "^swap_lock:")" \
+		'BEGIN { printf "%6d %10.2f %14d %12s\n", n, e - s,
+			 out / (e - s), c }'
+	n=$(next_step $n $MAX)
+done
@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Placement of periodic bursty tasks next to a hackbench load, with and
+# without the per-entity load averages.
+#
+# For PELT_LOAD and NO_PELT_LOAD in turn, runs bursty.c on its own and
+# then alongside hackbench (or perf bench sched messaging when there is
+# no hackbench), and prints what bursty.c reports on wakeup latency,
+# missed periods and migrations, and the time hackbench took. Restores
+# the scheduler features on exit.
+#
+# usage: pelt-placement.sh [threads] [period ms] [burst ms] [seconds]
+#
+# Needs root, debugfs and a kernel with CONFIG_SCHED_DEBUG.
+
+. "$(dirname "$0")/common.sh"
+
+THREADS=${1:-8}
+PERIOD=${2:-16}
+BURST=${3:-4}
+TIME=${4:-10}
+
+FEATURES=/sys/kernel/debug/sched_features
+BIN=$(mktemp /tmp/bursty.XXXXXX) || exit 1
+
+[ -f $FEATURES ] || mount -t debugfs none /sys/kernel/debug 2>/dev/null
+[ -f $FEATURES ] || die "kernel without CONFIG_SCHED_DEBUG"
+grep -q PELT_LOAD $FEATURES || die "kernel without PELT_LOAD"
+build "$BIN" bursty.c -pthread
+
+if command -v hackbench > /dev/null; then
+	HACKBENCH="hackbench 10 process 2000"
+elif command -v perf > /dev/null; then
+	HACKBENCH="perf bench sched messaging -g 10 -l 2000"
+else
+	die "neither hackbench nor perf found"
+fi
+
+PELT=$(grep -o "[A-Z_]*PELT_LOAD" $FEATURES)
+
+cleanup()
+{
+	echo $PELT > $FEATURES
+	rm -f "$BIN"
+}
+trap cleanup EXIT
+
+for feature in PELT_LOAD NO_PELT_LOAD; do
+	echo $feature > $FEATURES
+	echo "== $feature"
+
+	echo "-- bursty"
+	"$BIN" -t $THREADS -p $PERIOD -b $BURST -s $TIME
+
+	echo "-- bursty + $HACKBENCH"
+	(while :; do $HACKBENCH > /dev/null; done) &
+	LOAD=$!
+	"$BIN" -t $THREADS -p $PERIOD -b $BURST -s $TIME
+	kill $LOAD
+	wait $LOAD 2>/dev/null
+
+	echo "-- $HACKBENCH"
+	start=$(date +%s.%N)
+	$HACKBENCH > /dev/null
+	end=$(date +%s.%N)
+	awk -v s="$start" -v e="$end" 'BEGIN { printf "%.2f s\n", e - s }'
+done
@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# Readahead benchmark for mixed sequential and random buffered reads.
+#
+# Runs fio with sequential readers only, random readers only and both at
+# once on the same set of files, dropping caches before each run. Prints
+# the read bandwidth of each group of jobs and the change in the readahead
+# counters from /proc/vmstat.
+#
+# usage: ra-mixed.sh <dir> [file MiB] [jobs] [seconds]
+#
+# Needs root and fio. To see the effect of memory pressure, run it in a
+# memory cgroup or with a small mem= on the kernel command line.
+
+. "$(dirname "$0")/common.sh"
+
+DIR=$1
+SIZE=${2:-256}
+JOBS=${3:-4}
+RUNTIME=${4:-30}
+
+[ -n "$DIR" ] && [ -d "$DIR" ] || usage
+
+# All jobs share the same files, one per reader.
+FILES=$(seq -f ra-mixed.%g -s : 0 $((JOBS - 1)))
+
+JOB=$(mktemp /tmp/ra-mixed.XXXXXX) || exit 1
+
+cleanup()
+{
+	rm -f "$JOB" "$DIR"/ra-mixed.*
+}
+trap cleanup EXIT
+
+run()
+{
+	name=$1
+	shift
+	{
+		echo "[global]"
+		echo "directory=$DIR"
+		echo "filename=$FILES"
+		echo "filesize=${SIZE}m"
+		echo "ioengine=psync"
+		echo "runtime=$RUNTIME"
+		echo "time_based"
+		for job in "$@"; do
+			echo "[$job]"
+			echo "numjobs=$JOBS"
+			echo "new_group"
+			case $job in
+			seq)	echo "rw=read"; echo "bs=64k" ;;
+			rand)	echo "rw=randread"; echo "bs=4k" ;;
+			esac
+		done
+	} > "$JOB"
+
+	drop_caches
+	vmstat_save "^readahead_" "$JOB.before"
+
+	echo "=== $name"
+	fio --group_reporting "$JOB" | grep -E '^[a-z]+: \(groupid|READ:'
+
+	vmstat_delta "^readahead_" "$JOB.before"
+}
+
+# Lay out the files once so no run measures allocation.
+run "layout" seq > /dev/null
+
+run "sequential" seq
+run "random" rand
+run "mixed" seq rand
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Parallel read benchmark for squashfs.
+#
+# Builds a squashfs image from a source directory, loop-mounts it and reads
+# every file back with 1, 2, ... N parallel readers, dropping caches
+# between runs.  Prints the wall time of each run and the squashfs cache
+# statistics from debugfs, if mounted.
+#
+# usage: squashfs-parallel-read.sh <source dir> [max readers] [mksquashfs args]
+#
+# Needs root, mksquashfs and a kernel with loop and squashfs support.
+
+. "$(dirname "$0")/common.sh"
+
+SRC=$1
+MAX=${2:-$(grep -c ^processor /proc/cpuinfo)}
+[ $# -gt 2 ] && shift 2 || set --
+
+[ -n "$SRC" ] && [ -d "$SRC" ] || usage
+
+WORK=$(mktemp -d /tmp/sqfs-bench.XXXXXX) || exit 1
+IMG=$WORK/image.sqfs
+MNT=$WORK/mnt
+DEBUGFS=$(awk '$3 == "debugfs" { print $2; exit }' /proc/mounts)
+
+cleanup()
+{
+	umount "$MNT" 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+mkdir "$MNT"
+mksquashfs "$SRC" "$IMG" -no-progress -noappend "$@" >/dev/null || exit 1
+mount -t squashfs -o loop,ro "$IMG" "$MNT" || exit 1
+DEV=$(awk -v mnt="$MNT" '$2 == mnt { sub("/dev/", "", $1); print $1 }' \
+	/proc/mounts)
+
+find "$MNT" -type f > "$WORK/files"
+echo "$(wc -l < "$WORK/files") files, image $(du -k "$IMG" | cut -f1) KiB"
+
+n=1
+while [ $n -le "$MAX" ]; do
+	drop_caches
+
+	start=$(date +%s.%N)
+	# one reader per chunk of the (shuffled) file list
+	sort -R "$WORK/files" | split -n r/$n - "$WORK/part."
+	for part in "$WORK"/part.*; do
+		xargs -d '\n' cat < "$part" > /dev/null &
+	done
+	wait
+	end=$(date +%s.%N)
+	rm -f "$WORK"/part.*
+
+	printf "%3d readers: %8.3f s\n" $n $(echo "$end - $start" | bc)
+	n=$((n + 1))
+done
+
+if [ -n "$DEBUGFS" ] && [ -r "$DEBUGFS/squashfs/$DEV" ]; then
+	echo "cache statistics ($DEV):"
+	cat "$DEBUGFS/squashfs/$DEV"
+fi
@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Mixed read/write benchmark for block layer writeback throttling.
+#
+# Runs a buffered sequential writer, which keeps background writeback
+# busy, next to a reader doing small random direct reads, once with
+# writeback throttling off and once with the given read latency target.
+# Prints the read completion latency and the write bandwidth of each run,
+# and the throttling state from sysfs after it.
+#
+# usage: wbt-mixed.sh <dir on the device> [target usec] [seconds]
+#
+# Needs root and fio. The directory must be on a file system on a request
+# based block device; it needs room for a file of twice the RAM size.
+
+. "$(dirname "$0")/common.sh"
+
+DIR=$1
+TARGET=${2:-2000}
+RUNTIME=${3:-60}
+
+[ -n "$DIR" ] && [ -d "$DIR" ] || usage
+
+DEV=$(df -P "$DIR" | awk 'NR == 2 { print $1 }')
+DEV=$(basename "$(readlink -f "$DEV")")
+# partitions have their queue on the parent device
+[ -e /sys/class/block/$DEV/partition ] &&
+	DEV=$(basename "$(readlink -f /sys/class/block/$DEV/..)")
+QUEUE=/sys/block/$DEV/queue
+
+[ -w "$QUEUE/wbt_lat_usec" ] || die "$DEV: no writeback throttling support"
+
+MEM_MB=$(awk '/^MemTotal/ { print int($2 / 1024) }' /proc/meminfo)
+OLD=$(cat "$QUEUE/wbt_lat_usec")
+JOB=$(mktemp /tmp/wbt-mixed.XXXXXX) || exit 1
+
+cleanup()
+{
+	echo "$OLD" > "$QUEUE/wbt_lat_usec"
+	rm -f "$JOB" "$DIR"/wbt-mixed.*
+}
+trap cleanup EXIT
+
+cat > "$JOB" <<JOBEOF
+[global]
+directory=$DIR
+filename_format=wbt-mixed.\$jobname
+runtime=$RUNTIME
+time_based
+
+[writer]
+rw=write
+bs=128k
+size=$((MEM_MB * 2))m
+ioengine=sync
+
+[reader]
+rw=randread
+bs=4k
+size=256m
+direct=1
+ioengine=sync
+JOBEOF
+
+# Lay the files out first so the reader doesn't measure allocation.
+fio --create_only=1 "$JOB" > /dev/null || exit 1
+
+for lat in 0 "$TARGET"; do
+	echo "$lat" > "$QUEUE/wbt_lat_usec"
+	drop_caches
+
+	echo "=== $DEV wbt_lat_usec=$lat"
+	fio "$JOB" | awk '
+		/^(reader|writer):/	{ job = $1 }
+		job == "writer:" && /WRITE:|write:/	{ print "writer " $0 }
+		job == "reader:" && /^ +clat [(]/	{ print "reader " $0 }
+		job == "reader:" && /percentiles/	{ pct = 1; print "reader " $0; next }
+		pct && /^ +\|/				{ print "reader " $0; next }
+		{ pct = 0 }'
+	cat "$QUEUE/wbt_state"
+done
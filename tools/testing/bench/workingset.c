@@ -0,0 +1,168 @@
+/*
+ * Page cache working set workload
+ *
+ * Creates two files in the given directory, each 60% of RAM by default,
+ * so that together they slightly exceed it. Maps the first one and
+ * touches every page of it twice, which puts it on the active list like
+ * the binaries of the apps used so far. Then makes a number of passes
+ * over the second one, the new working set. Readahead is turned off on
+ * the mappings, so that every page that isn't cached is a major fault,
+ * as with the scattered reads of an app launch.
+ *
+ * Without refault detection the second file never gets the active list
+ * away from the first one and every pass faults in most of it again.
+ * With it, the major faults should drop off after the first passes.
+ * Prints the time, the major faults and the workingset_refault and
+ * workingset_activate deltas of /proc/vmstat for each pass.
+ *
+ *   gcc -O2 -Wall -o workingset workingset.c
+ *   ./workingset -d /data/local/tmp -p 6
+ *
+ * -d	directory for the files
+ * -s	MiB per file, defaults to 60% of RAM
+ * -p	passes over the second file
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static size_t page_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long majflt(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_majflt;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	char key[64];
+	unsigned long val, ret = 0;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %lu", key, &val) == 2) {
+		if (!strcmp(key, name)) {
+			ret = val;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static char *create_file(const char *dir, const char *name, size_t size)
+{
+	char path[4096], *buf, *mem;
+	size_t done;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	unlink(path);
+
+	buf = malloc(1 << 20);
+	memset(buf, 0x5a, 1 << 20);
+	for (done = 0; done < size; done += 1 << 20) {
+		if (write(fd, buf, 1 << 20) != 1 << 20) {
+			perror("write");
+			exit(1);
+		}
+	}
+	free(buf);
+	fsync(fd);
+	/* Start from disk, not from the pages the writes left behind */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+	mem = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	madvise(mem, size, MADV_RANDOM);
+	close(fd);
+	return mem;
+}
+
+static void pass(const char *what, const char *mem, size_t size)
+{
+	unsigned long refault = vmstat("workingset_refault");
+	unsigned long activate = vmstat("workingset_activate");
+	long faults = majflt();
+	double start = now();
+	volatile char sum = 0;
+	size_t off;
+
+	for (off = 0; off < size; off += page_size)
+		sum += mem[off];
+
+	printf("%-8s %8.2f s %10ld %10lu %10lu\n", what, now() - start,
+	       majflt() - faults, vmstat("workingset_refault") - refault,
+	       vmstat("workingset_activate") - activate);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = ".";
+	size_t size_mb = 0, size;
+	unsigned int passes = 6, n;
+	char *old, *new, name[16];
+	int c;
+
+	while ((c = getopt(argc, argv, "d:s:p:")) != -1) {
+		switch (c) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d dir] [-s MiB] "
+				"[-p passes]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (!size_mb)
+		size_mb = (size_t)sysconf(_SC_PHYS_PAGES) / 100 * 60 *
+			  page_size >> 20;
+	size = size_mb << 20;
+
+	old = create_file(dir, "workingset.old", size);
+	new = create_file(dir, "workingset.new", size);
+
+	printf("%-8s %10s %10s %10s %10s\n", "pass", "time", "majflt",
+	       "refault", "activate");
+	pass("old 0", old, size);
+	pass("old 1", old, size);
+	for (n = 0; n < passes; n++) {
+		snprintf(name, sizeof(name), "new %u", n);
+		pass(name, new, size);
+	}
+	return 0;
+}
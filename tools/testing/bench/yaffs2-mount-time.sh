@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# Mount time benchmark for yaffs2.
+#
+# Creates a nandsim device, fills it with a yaffs2 file system and times
+# mounting it
+#   - by scanning the tags of every chunk (no checkpoint, no summaries),
+#   - from the block summaries (no checkpoint), as after a power loss,
+#   - from the checkpoint, as after a clean unmount.
+# The scan statistics from /proc/yaffs are printed with each run.
+#
+# usage: yaffs2-mount-time.sh [MiB to fill] [runs]
+#
+# Needs root and a kernel with nandsim, mtdblock and yaffs2. The default
+# nandsim geometry is 256MiB with 2KiB pages; override it with NANDSIM_ID,
+# e.g. NANDSIM_ID="first_id_byte=0xec second_id_byte=0xd3" for 1GiB.
+
+. "$(dirname "$0")/common.sh"
+
+FILL=${1:-128}
+RUNS=${2:-3}
+NANDSIM_ID=${NANDSIM_ID:-"first_id_byte=0x20 second_id_byte=0xaa"}
+
+WORK=$(mktemp -d /tmp/yaffs-bench.XXXXXX) || exit 1
+MNT=$WORK/mnt
+
+cleanup()
+{
+	umount "$MNT" 2>/dev/null
+	rmmod nandsim 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+mkdir "$MNT"
+modprobe nandsim $NANDSIM_ID || exit 1
+MTD=$(awk -F: '/NAND simulator/ { sub("mtd", "", $1); print $1 }' /proc/mtd)
+[ -n "$MTD" ] || die "nandsim did not register an mtd device"
+modprobe mtdblock 2>/dev/null
+DEV=/dev/mtdblock$MTD
+
+flash_erase /dev/mtd$MTD 0 0 >/dev/null 2>&1
+
+# Fill with a mix of small and large files, then rewrite some of them so
+# that the scan has obsolete chunks to deal with.
+mount -t yaffs2 "$DEV" "$MNT" || exit 1
+i=0
+while [ $(du -sm "$MNT" | cut -f1) -lt "$FILL" ]; do
+	mkdir -p "$MNT/d$((i / 100))"
+	dd if=/dev/urandom of="$MNT/d$((i / 100))/f$i" bs=4k \
+		count=$(( (i % 7) * (i % 13) + 1 )) 2>/dev/null || break
+	i=$((i + 1))
+done
+find "$MNT" -name 'f*[05]' | while read f; do
+	dd if=/dev/urandom of="$f" bs=4k count=1 conv=notrunc 2>/dev/null
+done
+umount "$MNT"
+echo "$i files, $FILL MiB on $DEV"
+
+run()
+{
+	name=$1
+	opts=$2
+	n=0
+	while [ $n -lt "$RUNS" ]; do
+		start=$(date +%s.%N)
+		mount -t yaffs2 -o "ro,$opts" "$DEV" "$MNT" || exit 1
+		end=$(date +%s.%N)
+		stats=$(awk '/^n_sum_scans|^n_tag_scans/ {
+			sub(/\.+$/, "", $1); printf "%s %s ", $1, $2 }' /proc/yaffs)
+		umount "$MNT"
+		printf "%-10s %8.3f s  %s\n" "$name" $(echo "$end - $start" | bc) \
+			"$stats"
+		n=$((n + 1))
+	done
+}
+
+run "full scan" "no-checkpoint-read,summary-off"
+run "summary" "no-checkpoint-read"
+run "checkpoint" "summary-on"
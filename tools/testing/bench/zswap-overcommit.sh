@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Swap I/O and run time of an anonymous memory overcommit workload, with
+# zswap disabled and enabled.
+#
+# Builds overcommit.c next to this script and runs it twice, mapping
+# the given percentage of RAM. Prints the pass times, the change in the
+# swap counters from /proc/vmstat, and after the zswap run the pool
+# statistics from debugfs.
+#
+# usage: zswap-overcommit.sh [percent of RAM to map] [passes] [random percent]
+#
+# Needs root, an active swap device and a kernel with CONFIG_ZSWAP.
+
+. "$(dirname "$0")/common.sh"
+
+PCT=${1:-150}
+PASSES=${2:-4}
+RAND=${3:-30}
+
+PARAMS=/sys/module/zswap/parameters
+STATS=/sys/kernel/debug/zswap
+BIN=$(mktemp /tmp/overcommit.XXXXXX) || exit 1
+
+[ -d $PARAMS ] || die "kernel without zswap"
+[ $(wc -l < /proc/swaps) -gt 1 ] || die "no active swap"
+build "$BIN" overcommit.c
+
+ENABLED=$(cat $PARAMS/enabled)
+
+cleanup()
+{
+	echo "$ENABLED" > $PARAMS/enabled
+	rm -f "$BIN" "$BIN.before"
+}
+trap cleanup EXIT
+
+[ -d $STATS ] || mount -t debugfs none /sys/kernel/debug 2>/dev/null
+
+run()
+{
+	echo "=== $1"
+	echo "$2" > $PARAMS/enabled
+
+	drop_caches
+	vmstat_save "^pswp" "$BIN.before"
+
+	size=$(awk -v pct="$PCT" \
+		'/^MemTotal:/ { print int($2 / 1024 * pct / 100) }' /proc/meminfo)
+	"$BIN" -s "$size" -p "$PASSES" -r "$RAND"
+
+	vmstat_delta "^pswp" "$BIN.before"
+	if [ "$2" != N ] && [ -d $STATS ]; then
+		for f in $STATS/*; do
+			printf "%-28s %12d\n" "zswap_$(basename $f)" $(cat $f)
+		done
+	fi
+}
+
+run "swap device only" N
+run "zswap" Y